@@ -0,0 +1,18 @@
+/*
+ * The generated benchmark data, shared by bench/gen.c, which makes it, and
+ *  bench/main.c, which reads it. This can only have definitions, since gen.c
+ *  only links purpl_util.
+ */
+
+#pragma once
+
+/*
+ * The small files. There are enough of them that per-entry costs in archives
+ *  and batches show up, and the file names have four digits.
+ */
+#define SMALL_COUNT 10000
+#define SMALL_SIZE 4096
+
+/* The large files */
+#define LARGE_COUNT 4
+#define LARGE_SIZE (8 * 1024 * 1024)
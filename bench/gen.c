@@ -0,0 +1,283 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include <purpl/pack.h>
+#include <purpl/types.h>
+#include <purpl/util.h>
+
+#include "data.h"
+
+/* Format a string that lasts until the program exits */
+#define FMT(...) \
+	purpl_fmt_text_arena(purpl_get_scratch_arena(), NULL, __VA_ARGS__)
+
+void usage(const char *prog);
+int make_dir(const char *path);
+int write_file(const char *path, const char *data, size_t size);
+int write_tar(const char *path, char **names, char **files, size_t *sizes,
+	      size_t count);
+int write_pack(const char *path, char **names, char **files, size_t *sizes,
+	       size_t count, bool compress);
+int write_app_info(const char *dir);
+
+/* Words to build the file contents from, so they compress like real data */
+static const char *words[] = {
+	"purpl", "engine", "asset", "texture", "mesh", "shader", "sound",
+	"level", "entity", "frame", "render", "update", "window", "vertex",
+	"\n", "\t", "{", "}", "0", "1", "2", "3", "=", ";",
+};
+
+/* Fill a buffer with the same text every time */
+static void fill(char *buf, size_t size, u32 seed)
+{
+	const char *word;
+	size_t len;
+	size_t i;
+
+	i = 0;
+	while (i < size) {
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		word = words[seed % PURPL_ARRAY_SIZE(words)];
+		len = PURPL_MIN(strlen(word), size - i);
+		memcpy(buf + i, word, len);
+		i += len;
+		if (i < size)
+			buf[i++] = ' ';
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	char *names[SMALL_COUNT + LARGE_COUNT];
+	char *files[SMALL_COUNT + LARGE_COUNT];
+	size_t sizes[SMALL_COUNT + LARGE_COUNT];
+	const char *dir;
+	size_t count;
+	size_t i;
+	int err;
+
+	/* Check arguments */
+	if (argc < 2)
+		usage(argv[0]);
+	dir = argv[1];
+
+	/* Make the directories */
+	if (make_dir(dir) || make_dir(FMT("%s/small", dir)) ||
+	    make_dir(FMT("%s/large", dir))) {
+		fprintf(stderr,
+			"Error: failed to create directories in %s: %s\n", dir,
+			strerror(errno));
+		return errno;
+	}
+
+	/* Generate the files */
+	count = 0;
+	for (i = 0; i < SMALL_COUNT + LARGE_COUNT; i++) {
+		if (i < SMALL_COUNT) {
+			names[i] = FMT("small/%04zu.bin", i);
+			sizes[i] = SMALL_SIZE;
+		} else {
+			names[i] = FMT("large/%zu.bin", i - SMALL_COUNT);
+			sizes[i] = LARGE_SIZE;
+		}
+		files[i] = calloc(sizes[i], sizeof(char));
+		if (!names[i] || !files[i]) {
+			fprintf(stderr, "Error: out of memory\n");
+			return ENOMEM;
+		}
+		fill(files[i], sizes[i], (u32)i * 2654435761u + 1);
+		count++;
+
+		err = write_file(FMT("%s/%s", dir, names[i]), files[i],
+				 sizes[i]);
+		if (err)
+			return err;
+	}
+
+	/* Put them in archives */
+	err = write_tar(FMT("%s/assets.tar", dir), names, files, sizes, count);
+	if (!err)
+		err = write_pack(FMT("%s/assets.pak", dir), names, files, sizes,
+				 count, false);
+	if (!err)
+		err = write_pack(FMT("%s/assets_z.pak", dir), names, files,
+				 sizes, count, true);
+	if (!err)
+		err = write_app_info(dir);
+
+	for (i = 0; i < count; i++)
+		free(files[i]);
+	purpl_free_scratch_arena();
+
+	return err;
+}
+
+void usage(const char *prog)
+{
+	printf("Usage: %s <output directory>\n", PURPL_GET_BASENAME(prog));
+	exit(EINVAL);
+}
+
+int make_dir(const char *path)
+{
+	int err;
+
+	if (!path)
+		return ENOMEM;
+#ifdef _WIN32
+	err = _mkdir(path);
+#else
+	err = mkdir(path, 0755);
+#endif
+	if (err && errno != EEXIST)
+		return errno;
+
+	return 0;
+}
+
+int write_file(const char *path, const char *data, size_t size)
+{
+	FILE *fp;
+
+	fp = path ? fopen(path, "wb") : NULL;
+	if (!fp) {
+		fprintf(stderr, "Error: failed to truncate file %s: %s\n",
+			path, strerror(errno));
+		return errno;
+	}
+	if (fwrite(data, sizeof(char), size, fp) != size) {
+		fprintf(stderr, "Error: failed to write to %s: %s\n", path,
+			strerror(errno));
+		fclose(fp);
+		return errno;
+	}
+	fclose(fp);
+
+	return 0;
+}
+
+/* Write a ustar header for a regular file */
+static void write_tar_header(FILE *fp, const char *name, size_t size)
+{
+	char hdr[512];
+	u32 sum;
+	size_t i;
+
+	memset(hdr, 0, sizeof(hdr));
+	strncpy(hdr, name, 99);
+	snprintf(hdr + 100, 8, "%07o", 0644);
+	snprintf(hdr + 108, 8, "%07o", 0);
+	snprintf(hdr + 116, 8, "%07o", 0);
+	snprintf(hdr + 124, 12, "%011llo", (unsigned long long)size);
+	snprintf(hdr + 136, 12, "%011o", 0);
+	hdr[156] = '0';
+	memcpy(hdr + 257, "ustar", 6);
+	memcpy(hdr + 263, "00", 2);
+
+	/* The checksum is worked out with its own field as spaces */
+	memset(hdr + 148, ' ', 8);
+	sum = 0;
+	for (i = 0; i < sizeof(hdr); i++)
+		sum += (u8)hdr[i];
+	snprintf(hdr + 148, 7, "%06o", sum);
+
+	fwrite(hdr, sizeof(char), sizeof(hdr), fp);
+}
+
+int write_tar(const char *path, char **names, char **files, size_t *sizes,
+	      size_t count)
+{
+	static const char zeros[1024];
+	FILE *fp;
+	size_t i;
+
+	fp = path ? fopen(path, "wb") : NULL;
+	if (!fp) {
+		fprintf(stderr, "Error: failed to truncate file %s: %s\n",
+			path, strerror(errno));
+		return errno;
+	}
+
+	/* Each file is a header and its data, padded to 512 bytes */
+	for (i = 0; i < count; i++) {
+		write_tar_header(fp, names[i], sizes[i]);
+		fwrite(files[i], sizeof(char), sizes[i], fp);
+		fwrite(zeros, sizeof(char), (512 - sizes[i] % 512) % 512, fp);
+	}
+
+	/* Then two empty blocks */
+	fwrite(zeros, sizeof(char), sizeof(zeros), fp);
+	if (fclose(fp) != 0) {
+		fprintf(stderr, "Error: failed to write to %s: %s\n", path,
+			strerror(errno));
+		return errno;
+	}
+
+	return 0;
+}
+
+int write_pack(const char *path, char **names, char **files, size_t *sizes,
+	       size_t count, bool compress)
+{
+	struct purpl_pack_writer *writer;
+	FILE *fp;
+	size_t i;
+	int err;
+
+	writer = purpl_create_pack_writer();
+	if (!writer)
+		return errno;
+	for (i = 0; i < count; i++) {
+		err = purpl_pack_writer_add(writer, names[i], files[i],
+					    sizes[i], compress);
+		if (err) {
+			purpl_free_pack_writer(writer);
+			return err;
+		}
+	}
+
+	fp = path ? fopen(path, "wb") : NULL;
+	if (!fp) {
+		fprintf(stderr, "Error: failed to truncate file %s: %s\n",
+			path, strerror(errno));
+		purpl_free_pack_writer(writer);
+		return errno;
+	}
+	err = purpl_write_pack(writer, fp) ? 0 : errno;
+	fclose(fp);
+	purpl_free_pack_writer(writer);
+	if (err)
+		fprintf(stderr, "Error: failed to write pack %s: %s\n", path,
+			strerror(err));
+
+	return err;
+}
+
+int write_app_info(const char *dir)
+{
+	char *info;
+
+	info = FMT("{\n"
+		   "\t\"name\": \"Purpl Engine Benchmarks\",\n"
+		   "\t\"log_path\": \"%s/bench.log\",\n"
+		   "\t\"ver_maj\": 1,\n"
+		   "\t\"ver_min\": 0,\n"
+		   "\t\"search_paths\": [\n"
+		   "\t\t\"%s\"\n"
+		   "\t]\n"
+		   "}\n",
+		   dir, dir);
+	if (!info)
+		return ENOMEM;
+	return write_file(FMT("%s/app.json", dir), info, strlen(info));
+}
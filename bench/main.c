@@ -0,0 +1,1324 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <archive.h>
+
+#include <purpl/purpl.h>
+
+#include "data.h"
+
+/* Where the generated data is if -d isn't given */
+#ifndef PURPL_BENCH_DATA
+#define PURPL_BENCH_DATA "data"
+#endif
+
+/* The engine version the results are for */
+#ifndef PURPL_BENCH_VERSION
+#define PURPL_BENCH_VERSION "unknown"
+#endif
+
+/* The number of times each benchmark is measured */
+#define SAMPLES 5
+
+/* The default length of each sample in milliseconds */
+#define DEFAULT_SAMPLE_MS 100
+
+/* The number of assets kept alive by the allocation churn benchmarks */
+#define CHURN_LIVE 64
+
+/* The number of items the job benchmarks go through each time */
+#define JOB_ITEMS (4 * 1024 * 1024)
+
+/* The number of draw commands in each frame of the render benchmarks */
+#define RENDER_ITEMS (64 * 1024)
+
+/* What the render benchmarks do */
+enum render_bench { RENDER_SORT, RENDER_SUBMIT, RENDER_SUBMIT_JOBS };
+
+/* The number of sprites in each frame of the sprite benchmarks */
+#define SPRITE_COUNT 100000
+
+/* The number of pages and sprites in the sprite benchmarks' atlas */
+#define SPRITE_PAGES 4
+#define SPRITE_DEFS 64
+
+/* The number of transforms in the transform and culling benchmarks */
+#define TRANSFORM_COUNT (64 * 1024)
+
+/* How many of them are roots, the rest are their children */
+#define TRANSFORM_ROOTS (TRANSFORM_COUNT / 4)
+
+/* How the transform and culling benchmarks do it */
+enum transform_bench {
+	TRANSFORM_CGLM,
+	TRANSFORM_SCALAR,
+	TRANSFORM_SSE,
+	TRANSFORM_AVX2
+};
+
+/* The number of entities in the ECS benchmarks */
+#define ECS_COUNT (1024 * 1024)
+
+/* The number of them the deferred change benchmark tags and untags */
+#define ECS_DEFER_COUNT 10000
+
+/* What the ECS benchmarks do */
+enum ecs_bench { ECS_ITERATE_2, ECS_ITERATE_3, ECS_ITERATE_3_JOBS, ECS_DEFER };
+
+/* The ECS benchmarks' component types */
+enum { ECS_POSITION, ECS_VELOCITY, ECS_LIFETIME, ECS_TAGGED };
+
+/* A transform the way an entity would store it without the kernels */
+struct naive_transform {
+	mat4 world;
+	versor rotation;
+	vec3 position;
+	vec3 scale;
+	vec3 box[2];
+	u32 parent;
+};
+
+/*
+ * A benchmark does its operation `iters` times and returns the number of
+ *  bytes it went through (or 0 if that doesn't mean anything for it)
+ */
+typedef u64 (*bench_func)(u64 iters, uint arg);
+
+/* A benchmark and what it needs set up first */
+struct benchmark {
+	const char *name;
+	bench_func func;
+	bool (*setup)(uint arg);
+	void (*teardown)(uint arg);
+	uint arg;
+};
+
+/* The results of a benchmark */
+struct result {
+	const char *name;
+	u64 iters; /* Per sample */
+	double median; /* Nanoseconds per operation */
+	double min;
+	double max;
+	double bytes; /* Per operation */
+};
+
+void usage(const char *prog);
+void run_benchmark(struct benchmark *bench, u64 sample_ns,
+		   struct result *result);
+void write_results(FILE *fp, struct result *results, size_t count);
+
+/* Everything the benchmarks use */
+static const char *data_dir;
+static struct purpl_inst *inst;
+static char *archives[3];
+static size_t archive_sizes[3];
+static struct purpl_embed *embeds[3];
+static struct purpl_logger *loggers[4];
+static u8 log_indices[4];
+static u32 *job_items;
+static struct purpl_batch_file batch_files[SMALL_COUNT];
+static struct purpl_renderer *renderer;
+static u64 *render_keys;
+static struct purpl_render_item *render_items;
+static struct purpl_render_item *render_tmp;
+static struct purpl_atlas_header sprite_hdr;
+static struct purpl_atlas_sprite sprite_defs[SPRITE_DEFS];
+static u32 sprite_textures[SPRITE_PAGES];
+static struct purpl_atlas sprite_atlas;
+static struct purpl_sprite_instance *sprite_instances;
+static struct purpl_sprite_draw *sprite_draws;
+static struct purpl_transforms *transforms;
+static struct naive_transform *naive_transforms;
+static vec4 transform_planes[6];
+static u32 *transform_visible;
+static struct purpl_ecs *ecs;
+static u32 ecs_components[4];
+static purpl_entity *ecs_entities;
+
+/* Where results go so the compiler can't skip the work */
+static volatile u64 sink;
+
+/* The archives and loggers, in the order above */
+enum { TAR, PACK, PACK_Z };
+enum { LOG_TEXT, LOG_ASYNC, LOG_BINARY, LOG_FILTERED };
+
+/* Read one byte from each page, like something using the data would */
+static u64 touch(const char *data, size_t size)
+{
+	u64 sum = 0;
+	size_t i;
+
+	for (i = 0; i < size; i += 4096)
+		sum += (u8)data[i];
+
+	return sum;
+}
+
+static u64 bench_file(u64 iters, uint arg)
+{
+	struct purpl_asset *asset;
+	bool large = arg & 2;
+	bool map = arg & 1;
+	u64 bytes = 0;
+	u64 i;
+
+	for (i = 0; i < iters; i++) {
+		if (large)
+			asset = purpl_load_asset_from_file(
+				data_dir, map, "large/%u.bin",
+				(uint)(i % LARGE_COUNT));
+		else
+			asset = purpl_load_asset_from_file(
+				data_dir, map, "small/%04u.bin",
+				(uint)(i % SMALL_COUNT));
+		if (!asset)
+			continue;
+		sink += touch(asset->data, asset->size);
+		bytes += asset->size;
+		purpl_free_asset(asset);
+	}
+
+	return bytes;
+}
+
+static bool setup_batch(uint arg)
+{
+	size_t i;
+
+	/* The paths only need to be made once */
+	if (!batch_files[0].path) {
+		for (i = 0; i < SMALL_COUNT; i++) {
+			batch_files[i].path = purpl_fmt_text(
+				NULL, "%s/small/%04u.bin", data_dir, (uint)i);
+			if (!batch_files[i].path)
+				return false;
+		}
+	}
+
+	/* The fallback should get all the threads it can */
+	if (arg & PURPL_BATCH_NO_URING)
+		return purpl_inst_start_jobs(inst, 0) == 0;
+	return true;
+}
+
+static void teardown_batch(uint arg)
+{
+	if (arg & PURPL_BATCH_NO_URING)
+		purpl_inst_stop_jobs(inst);
+}
+
+static u64 bench_batch(u64 iters, uint arg)
+{
+	u64 bytes = 0;
+	size_t i;
+	u64 j;
+
+	/*
+	 * Each operation reads every small file in one batch, so the queue is
+	 *  as deep as a big load would make it
+	 */
+	for (j = 0; j < iters; j++) {
+		purpl_inst_read_files(inst, batch_files, SMALL_COUNT, arg);
+		for (i = 0; i < SMALL_COUNT; i++) {
+			if (batch_files[i].err)
+				continue;
+			sink += touch(batch_files[i].data,
+				      batch_files[i].size);
+			bytes += batch_files[i].size;
+			free(batch_files[i].data);
+			batch_files[i].data = NULL;
+		}
+	}
+
+	return bytes;
+}
+
+static u64 bench_tar(u64 iters, uint arg)
+{
+	struct purpl_asset *asset;
+	struct archive *ar;
+	u64 bytes = 0;
+	u64 i;
+	int err;
+
+	NOPE(arg);
+
+	/* Without an index, every load has to go through the headers */
+	for (i = 0; i < iters; i++) {
+		ar = archive_read_new();
+		archive_read_support_format_tar(ar);
+		err = archive_read_open_memory(ar, archives[TAR],
+					       archive_sizes[TAR]);
+		if (err != ARCHIVE_OK) {
+			archive_read_free(ar);
+			continue;
+		}
+		asset = purpl_load_asset_from_archive(ar, "small/%04u.bin",
+						      (uint)(i % SMALL_COUNT));
+		archive_read_free(ar);
+		if (!asset)
+			continue;
+		sink += touch(asset->data, asset->size);
+		bytes += asset->size;
+		purpl_free_asset(asset);
+	}
+
+	return bytes;
+}
+
+static u64 bench_embed_index(u64 iters, uint arg)
+{
+	struct purpl_embed *embed;
+	u64 bytes = 0;
+	u64 i;
+
+	for (i = 0; i < iters; i++) {
+		embed = purpl_load_embed(archives[arg],
+					 archives[arg] + archive_sizes[arg]);
+		if (!embed)
+			continue;
+		bytes += archive_sizes[arg];
+		purpl_free_embed(embed);
+	}
+
+	return bytes;
+}
+
+static u64 bench_embed(u64 iters, uint arg)
+{
+	struct purpl_asset *asset;
+	u64 bytes = 0;
+	u64 i;
+
+	for (i = 0; i < iters; i++) {
+		asset = purpl_load_asset_from_embed(embeds[arg],
+						    "small/%04u.bin",
+						    (uint)(i % SMALL_COUNT));
+		if (!asset)
+			continue;
+		sink += touch(asset->data, asset->size);
+		bytes += asset->size;
+		purpl_free_asset(asset);
+	}
+
+	return bytes;
+}
+
+static u64 bench_log(u64 iters, uint arg)
+{
+	s8 level = (arg == LOG_FILTERED) ? PURPL_DEBUG : PURPL_INFO;
+	u64 bytes = 0;
+	u64 i;
+
+	for (i = 0; i < iters; i++)
+		bytes += purpl_write_log(loggers[arg], __FILENAME__, __LINE__,
+					 log_indices[arg], level,
+					 "Loaded %s (%zu bytes) in %.3f ms",
+					 "small/0001.bin", (size_t)SMALL_SIZE,
+					 i * 0.001);
+
+	return bytes;
+}
+
+static u64 bench_fmt(u64 iters, uint arg)
+{
+	struct purpl_arena *scratch;
+	struct purpl_arena_mark mark;
+	char *str;
+	s64 len;
+	u64 bytes = 0;
+	u64 i;
+
+	scratch = purpl_get_scratch_arena();
+	for (i = 0; i < iters; i++) {
+		if (arg) {
+			mark = purpl_mark_arena(scratch);
+			str = purpl_fmt_text_arena(
+				scratch, &len, "%s/small/%04u.bin (%d%%)",
+				data_dir, (uint)(i % SMALL_COUNT),
+				(int)(i % 100));
+			sink += str[0];
+			purpl_release_arena(scratch, mark);
+		} else {
+			str = purpl_fmt_text(&len, "%s/small/%04u.bin (%d%%)",
+					     data_dir, (uint)(i % SMALL_COUNT),
+					     (int)(i % 100));
+			sink += str[0];
+			(len > 0) ? free(str) : (void)0;
+		}
+		bytes += PURPL_MAX(len, 0);
+	}
+
+	return bytes;
+}
+
+static u64 bench_app_info(u64 iters, uint arg)
+{
+	struct purpl_app_info *info;
+	u64 i;
+
+	NOPE(arg);
+
+	for (i = 0; i < iters; i++) {
+		info = purpl_load_app_info(NULL, false, "%s/app.json",
+					   data_dir);
+		if (info)
+			purpl_free_app_info(info);
+	}
+
+	return 0;
+}
+
+static u64 bench_churn(u64 iters, uint arg)
+{
+	struct purpl_asset *live[CHURN_LIVE] = { 0 };
+	struct purpl_asset *asset;
+	char name[64];
+	u64 i;
+
+	/*
+	 * Replace the oldest of a set of assets each time, like loading and
+	 *  freeing them does
+	 */
+	for (i = 0; i < iters + CHURN_LIVE; i++) {
+		asset = live[i % CHURN_LIVE];
+		if (asset && arg) {
+			purpl_pool_free_str(asset->name);
+			PURPL_POOL_DELETE(asset);
+		} else if (asset) {
+			free(asset->name);
+			free(asset);
+		}
+		if (i >= iters) {
+			live[i % CHURN_LIVE] = NULL;
+			continue;
+		}
+
+		snprintf(name, sizeof(name), "%s/small/%04u.bin", data_dir,
+			 (uint)(i % SMALL_COUNT));
+		if (arg) {
+			asset = PURPL_POOL_NEW(struct purpl_asset);
+			if (asset)
+				asset->name = purpl_pool_strdup(name);
+		} else {
+			asset = calloc(1, sizeof(struct purpl_asset));
+			if (asset)
+				asset->name = strdup(name);
+		}
+		if (asset && !asset->name) {
+			arg ? PURPL_POOL_DELETE(asset) : free(asset);
+			asset = NULL;
+		}
+		live[i % CHURN_LIVE] = asset;
+	}
+
+	return 0;
+}
+
+static void job_range(void *data, size_t start, size_t end)
+{
+	u32 *items = data;
+	u32 x;
+	size_t i;
+
+	/* Some hashing, so the work is more than memory bandwidth */
+	for (i = start; i < end; i++) {
+		x = items[i] + (u32)i;
+		x ^= x >> 16;
+		x *= 0x7FEB352D;
+		x ^= x >> 15;
+		x *= 0x846CA68B;
+		x ^= x >> 16;
+		items[i] = x;
+	}
+}
+
+static bool setup_jobs(uint arg)
+{
+	/* One thread means no job system at all */
+	if (arg < 2)
+		return true;
+	return purpl_inst_start_jobs(inst, arg - 1) == 0;
+}
+
+static void teardown_jobs(uint arg)
+{
+	NOPE(arg);
+
+	purpl_inst_stop_jobs(inst);
+}
+
+static u64 bench_jobs(u64 iters, uint arg)
+{
+	u64 i;
+
+	NOPE(arg);
+
+	for (i = 0; i < iters; i++)
+		purpl_inst_parallel_for(inst, JOB_ITEMS, 0, job_range,
+					job_items);
+	sink += job_items[0];
+
+	return iters * JOB_ITEMS * sizeof(u32);
+}
+
+static void loop_update(struct purpl_inst *inst, u64 dt, void *user)
+{
+	NOPE(inst);
+	NOPE(user);
+
+	sink += dt;
+}
+
+static u64 bench_loop(u64 iters, uint arg)
+{
+	struct purpl_loop_config config = { 0 };
+
+	NOPE(arg);
+
+	/* Each operation is one tick of a headless instance */
+	config.max_ticks = iters;
+	config.unthrottled = true;
+	purpl_inst_run_fixed(inst, NULL, &config, loop_update, NULL);
+
+	return 0;
+}
+
+static bool setup_render(uint arg)
+{
+	u64 x;
+	u32 depth;
+	size_t i;
+
+	renderer = purpl_create_renderer(&purpl_null_render_backend);
+	render_keys = PURPL_CALLOC(RENDER_ITEMS, u64);
+	render_items = PURPL_CALLOC(RENDER_ITEMS, struct purpl_render_item);
+	render_tmp = PURPL_CALLOC(RENDER_ITEMS, struct purpl_render_item);
+	if (!renderer || !render_keys || !render_items || !render_tmp)
+		return false;
+
+	/* A few passes, a few hundred materials, and any depth */
+	x = 0x9E3779B97F4A7C15ull;
+	for (i = 0; i < RENDER_ITEMS; i++) {
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		depth = purpl_render_depth((float)(x >> 40), false);
+		render_keys[i] = PURPL_RENDER_KEY(x % 4, (x >> 8) % 256, depth);
+	}
+
+	if (arg == RENDER_SUBMIT_JOBS)
+		return purpl_inst_start_jobs(inst, SDL_GetCPUCount() - 1) == 0;
+	return true;
+}
+
+static void teardown_render(uint arg)
+{
+	if (arg == RENDER_SUBMIT_JOBS)
+		purpl_inst_stop_jobs(inst);
+	if (renderer)
+		purpl_free_renderer(renderer);
+	renderer = NULL;
+	free(render_keys);
+	render_keys = NULL;
+	free(render_items);
+	render_items = NULL;
+	free(render_tmp);
+	render_tmp = NULL;
+}
+
+static void render_range(void *data, size_t start, size_t end)
+{
+	size_t i;
+
+	NOPE(data);
+
+	for (i = start; i < end; i++)
+		purpl_render_rect(renderer, render_keys[i], (float)(i % 1024),
+				  (float)(i / 1024), 16.0f, 16.0f,
+				  (u32)render_keys[i]);
+}
+
+static u64 bench_render(u64 iters, uint arg)
+{
+	size_t i;
+	u64 j;
+
+	/* Each operation is a frame's worth of commands */
+	for (j = 0; j < iters; j++) {
+		switch (arg) {
+		case RENDER_SORT:
+			for (i = 0; i < RENDER_ITEMS; i++) {
+				render_items[i].key = render_keys[i];
+				render_items[i].cmd = NULL;
+			}
+			purpl_render_sort(render_items, render_tmp,
+					  RENDER_ITEMS);
+			sink += render_items[0].key;
+			break;
+		case RENDER_SUBMIT:
+			render_range(NULL, 0, RENDER_ITEMS);
+			sink += purpl_render_flush(renderer);
+			break;
+		case RENDER_SUBMIT_JOBS:
+			purpl_inst_parallel_for(inst, RENDER_ITEMS, 0,
+						render_range, NULL);
+			sink += purpl_render_flush(renderer);
+			break;
+		}
+	}
+
+	return iters * RENDER_ITEMS * sizeof(struct purpl_render_cmd);
+}
+
+/* A backend that batches sprites like a real one, but doesn't draw them */
+static void batch_submit(struct purpl_renderer *renderer,
+			 const struct purpl_render_item *items, size_t count)
+{
+	NOPE(renderer);
+
+	sink += purpl_batch_sprites(items, count, sprite_instances,
+				    &sprite_draws);
+}
+
+static const struct purpl_render_backend batch_backend = {
+	.name = "batch",
+	.submit = batch_submit,
+};
+
+static bool setup_sprites(uint arg)
+{
+	size_t i;
+
+	renderer = purpl_create_renderer(&batch_backend);
+	sprite_instances =
+		PURPL_CALLOC(SPRITE_COUNT, struct purpl_sprite_instance);
+	if (!renderer || !sprite_instances)
+		return false;
+
+	/* An atlas with its sprites spread over a few pages */
+	sprite_hdr.page_count = SPRITE_PAGES;
+	sprite_hdr.page_width = 1024;
+	sprite_hdr.page_height = 1024;
+	sprite_hdr.sprite_count = SPRITE_DEFS;
+	for (i = 0; i < SPRITE_PAGES; i++)
+		sprite_textures[i] = (u32)i + 1;
+	for (i = 0; i < SPRITE_DEFS; i++) {
+		sprite_defs[i].page = (u32)(i * 7 % SPRITE_PAGES);
+		sprite_defs[i].w = 16 + (u32)i % 16;
+		sprite_defs[i].h = 16 + (u32)i % 8;
+		sprite_defs[i].u1 = 1.0f;
+		sprite_defs[i].v1 = 1.0f;
+	}
+	sprite_atlas.hdr = &sprite_hdr;
+	sprite_atlas.sprites = sprite_defs;
+	sprite_atlas.textures = sprite_textures;
+	sprite_atlas.renderer = renderer;
+
+	if (arg == RENDER_SUBMIT_JOBS)
+		return purpl_inst_start_jobs(inst, SDL_GetCPUCount() - 1) == 0;
+	return true;
+}
+
+static void teardown_sprites(uint arg)
+{
+	if (arg == RENDER_SUBMIT_JOBS)
+		purpl_inst_stop_jobs(inst);
+	if (renderer)
+		purpl_free_renderer(renderer);
+	renderer = NULL;
+	free(sprite_instances);
+	sprite_instances = NULL;
+	stbds_arrfree(sprite_draws);
+}
+
+static void sprite_range(void *data, size_t start, size_t end)
+{
+	size_t i;
+
+	NOPE(data);
+
+	for (i = start; i < end; i++)
+		purpl_render_sprite(renderer, 0, (u32)i, &sprite_atlas,
+				    &sprite_defs[i % SPRITE_DEFS],
+				    (float)(i % 1920), (float)(i % 1080), 1.0f,
+				    0xFFFFFFFF);
+}
+
+static u64 bench_sprites(u64 iters, uint arg)
+{
+	u64 i;
+
+	/* Each operation is a frame of recording, sorting, and batching */
+	for (i = 0; i < iters; i++) {
+		if (arg == RENDER_SUBMIT_JOBS)
+			purpl_inst_parallel_for(inst, SPRITE_COUNT, 0,
+						sprite_range, NULL);
+		else
+			sprite_range(NULL, 0, SPRITE_COUNT);
+		purpl_render_flush(renderer);
+	}
+
+	return iters * SPRITE_COUNT * sizeof(struct purpl_sprite_instance);
+}
+
+/* Compose the world matrices with a cglm call for each step of each one */
+static void update_naive(void)
+{
+	struct naive_transform *transform;
+	mat4 local;
+	size_t i;
+
+	for (i = 0; i < TRANSFORM_COUNT; i++) {
+		transform = &naive_transforms[i];
+		glm_translate_make(local, transform->position);
+		glm_quat_rotate(local, transform->rotation, local);
+		glm_scale(local, transform->scale);
+		if (transform->parent == PURPL_NO_PARENT)
+			glm_mat4_copy(local, transform->world);
+		else
+			glm_mat4_mul(naive_transforms[transform->parent].world,
+				     local, transform->world);
+	}
+}
+
+static bool setup_transforms(uint arg)
+{
+	struct naive_transform *naive;
+	mat4 proj;
+	versor rotation;
+	vec3 position;
+	vec3 scale = { 1.0f, 1.0f, 1.0f };
+	vec3 axis;
+	vec3 box[2] = { { -1.0f, -1.0f, -1.0f }, { 1.0f, 1.0f, 1.0f } };
+	u64 x;
+	u32 parent;
+	size_t i;
+
+	/* Skip kernels the CPU can't run */
+	transforms = purpl_create_transforms(TRANSFORM_COUNT);
+	if (!transforms)
+		return false;
+	if (arg != TRANSFORM_CGLM) {
+		if (arg - TRANSFORM_SCALAR > transforms->simd) {
+			purpl_free_transforms(transforms);
+			transforms = NULL;
+			errno = ENOTSUP;
+			return false;
+		}
+		transforms->simd = arg - TRANSFORM_SCALAR;
+	}
+
+	naive_transforms =
+		PURPL_CALLOC(TRANSFORM_COUNT, struct naive_transform);
+	transform_visible = PURPL_CALLOC(TRANSFORM_COUNT, u32);
+	if (!naive_transforms || !transform_visible)
+		return false;
+
+	/*
+	 * Roots scattered all around the camera, then their children a level
+	 *  at a time, so no parent is in the same block as its children
+	 */
+	x = 0x9E3779B97F4A7C15ull;
+	for (i = 0; i < TRANSFORM_COUNT; i++) {
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		parent = i < TRANSFORM_ROOTS ? PURPL_NO_PARENT
+					     : (u32)(i % TRANSFORM_ROOTS);
+		position[0] = ((float)(x & 0xFF) - 128.0f) * 0.5f;
+		position[1] = ((float)((x >> 8) & 0xFF) - 128.0f) * 0.5f;
+		position[2] = ((float)((x >> 16) & 0xFF) - 128.0f) * 0.5f;
+		if (parent != PURPL_NO_PARENT) {
+			position[0] *= 0.05f;
+			position[1] *= 0.05f;
+			position[2] *= 0.05f;
+		}
+		axis[0] = 1.0f;
+		axis[1] = (float)((x >> 24) & 0xFF) / 255.0f;
+		axis[2] = 0.5f;
+		glm_quatv(rotation, (float)((x >> 32) & 0xFFFF) / 10000.0f,
+			  axis);
+
+		purpl_add_transform(transforms, parent);
+		purpl_set_transform(transforms, (u32)i, position, rotation,
+				    scale);
+		purpl_set_bounds(transforms, (u32)i, box);
+
+		naive = &naive_transforms[i];
+		memcpy(naive->rotation, rotation, sizeof(versor));
+		memcpy(naive->position, position, sizeof(vec3));
+		memcpy(naive->scale, scale, sizeof(vec3));
+		memcpy(naive->box, box, sizeof(box));
+		naive->parent = parent;
+	}
+
+	/* A camera at the origin, and world matrices for the culling */
+	glm_perspective(1.2f, 16.0f / 9.0f, 0.1f, 100.0f, proj);
+	glm_frustum_planes(proj, transform_planes);
+	purpl_update_transforms(transforms);
+	update_naive();
+
+	return true;
+}
+
+static void teardown_transforms(uint arg)
+{
+	NOPE(arg);
+
+	if (transforms)
+		purpl_free_transforms(transforms);
+	transforms = NULL;
+	free(naive_transforms);
+	naive_transforms = NULL;
+	free(transform_visible);
+	transform_visible = NULL;
+}
+
+static u64 bench_transforms(u64 iters, uint arg)
+{
+	u64 i;
+
+	/* Each operation is every world matrix */
+	for (i = 0; i < iters; i++) {
+		if (arg == TRANSFORM_CGLM)
+			update_naive();
+		else
+			purpl_update_transforms(transforms);
+	}
+
+	return iters * TRANSFORM_COUNT * sizeof(mat4);
+}
+
+static u64 bench_cull(u64 iters, uint arg)
+{
+	vec3 box[2];
+	size_t count;
+	size_t j;
+	u64 i;
+
+	/* Each operation is culling every transform */
+	for (i = 0; i < iters; i++) {
+		if (arg == TRANSFORM_CGLM) {
+			count = 0;
+			for (j = 0; j < TRANSFORM_COUNT; j++) {
+				glm_aabb_transform(naive_transforms[j].box,
+						   naive_transforms[j].world,
+						   box);
+				if (glm_aabb_frustum(box, transform_planes))
+					transform_visible[count++] = (u32)j;
+			}
+		} else {
+			count = purpl_cull_transforms(transforms,
+						      transform_planes, 0,
+						      TRANSFORM_COUNT,
+						      transform_visible);
+		}
+		sink += count;
+	}
+
+	return iters * TRANSFORM_COUNT * sizeof(mat4);
+}
+
+/* Move a chunk of entities */
+static void ecs_move(struct purpl_ecs_chunk *chunk, void *data)
+{
+	vec3 *position;
+	vec3 *velocity;
+	u32 i;
+
+	NOPE(data);
+
+	position = purpl_ecs_column(chunk, ecs_components[ECS_POSITION]);
+	velocity = purpl_ecs_column(chunk, ecs_components[ECS_VELOCITY]);
+	for (i = 0; i < chunk->count; i++) {
+		position[i][0] += velocity[i][0] * (1.0f / 60.0f);
+		position[i][1] += velocity[i][1] * (1.0f / 60.0f);
+		position[i][2] += velocity[i][2] * (1.0f / 60.0f);
+	}
+}
+
+/* Move a chunk of entities, slow them down, and age them */
+static void ecs_age(struct purpl_ecs_chunk *chunk, void *data)
+{
+	vec3 *position;
+	vec3 *velocity;
+	float *lifetime;
+	u32 i;
+
+	NOPE(data);
+
+	position = purpl_ecs_column(chunk, ecs_components[ECS_POSITION]);
+	velocity = purpl_ecs_column(chunk, ecs_components[ECS_VELOCITY]);
+	lifetime = purpl_ecs_column(chunk, ecs_components[ECS_LIFETIME]);
+	for (i = 0; i < chunk->count; i++) {
+		position[i][0] += velocity[i][0] * (1.0f / 60.0f);
+		position[i][1] += velocity[i][1] * (1.0f / 60.0f);
+		position[i][2] += velocity[i][2] * (1.0f / 60.0f);
+		velocity[i][0] *= 0.99f;
+		velocity[i][1] *= 0.99f;
+		velocity[i][2] *= 0.99f;
+		lifetime[i] -= 1.0f / 60.0f;
+	}
+}
+
+static bool setup_ecs(uint arg)
+{
+	vec3 *velocity;
+	float *lifetime;
+	u64 components;
+	size_t i;
+
+	ecs = purpl_create_ecs();
+	ecs_entities = PURPL_CALLOC(ECS_COUNT, purpl_entity);
+	if (!ecs || !ecs_entities)
+		return false;
+	ecs_components[ECS_POSITION] =
+		purpl_ecs_register_component(ecs, sizeof(vec3));
+	ecs_components[ECS_VELOCITY] =
+		purpl_ecs_register_component(ecs, sizeof(vec3));
+	ecs_components[ECS_LIFETIME] =
+		purpl_ecs_register_component(ecs, sizeof(float));
+	ecs_components[ECS_TAGGED] = purpl_ecs_register_component(ecs, 0);
+
+	/* Every entity has all three components */
+	components = PURPL_ECS_BIT(ecs_components[ECS_POSITION]) |
+		     PURPL_ECS_BIT(ecs_components[ECS_VELOCITY]) |
+		     PURPL_ECS_BIT(ecs_components[ECS_LIFETIME]);
+	for (i = 0; i < ECS_COUNT; i++) {
+		ecs_entities[i] = purpl_ecs_create(ecs, components);
+		if (!ecs_entities[i])
+			return false;
+		velocity = purpl_ecs_get(ecs, ecs_entities[i],
+					 ecs_components[ECS_VELOCITY]);
+		velocity[0][0] = (float)(i % 7);
+		velocity[0][1] = (float)(i % 5);
+		velocity[0][2] = (float)(i % 3);
+		lifetime = purpl_ecs_get(ecs, ecs_entities[i],
+					 ecs_components[ECS_LIFETIME]);
+		*lifetime = 10.0f;
+	}
+
+	if (arg == ECS_ITERATE_3_JOBS)
+		return purpl_inst_start_jobs(inst, SDL_GetCPUCount() - 1) == 0;
+	return true;
+}
+
+static void teardown_ecs(uint arg)
+{
+	if (arg == ECS_ITERATE_3_JOBS)
+		purpl_inst_stop_jobs(inst);
+	if (ecs)
+		purpl_free_ecs(ecs);
+	ecs = NULL;
+	free(ecs_entities);
+	ecs_entities = NULL;
+}
+
+static u64 bench_ecs(u64 iters, uint arg)
+{
+	u64 all;
+	size_t i;
+	u64 j;
+
+	all = PURPL_ECS_BIT(ecs_components[ECS_POSITION]) |
+	      PURPL_ECS_BIT(ecs_components[ECS_VELOCITY]);
+	for (j = 0; j < iters; j++) {
+		switch (arg) {
+		case ECS_ITERATE_2:
+			sink += purpl_ecs_each(ecs, all, 0, ecs_move, NULL);
+			break;
+		case ECS_ITERATE_3:
+			sink += purpl_ecs_each(
+				ecs,
+				all | PURPL_ECS_BIT(
+					      ecs_components[ECS_LIFETIME]),
+				0, ecs_age, NULL);
+			break;
+		case ECS_ITERATE_3_JOBS:
+			sink += purpl_inst_ecs_each(
+				inst, ecs,
+				all | PURPL_ECS_BIT(
+					      ecs_components[ECS_LIFETIME]),
+				0, ecs_age, NULL);
+			break;
+		case ECS_DEFER:
+			/* Each entity moves to another archetype and back */
+			for (i = 0; i < ECS_DEFER_COUNT; i++)
+				purpl_ecs_defer_add(ecs, ecs_entities[i],
+						    ecs_components[ECS_TAGGED],
+						    NULL);
+			sink += purpl_ecs_flush(ecs);
+			for (i = 0; i < ECS_DEFER_COUNT; i++)
+				purpl_ecs_defer_remove(
+					ecs, ecs_entities[i],
+					ecs_components[ECS_TAGGED]);
+			sink += purpl_ecs_flush(ecs);
+			break;
+		}
+	}
+
+	switch (arg) {
+	case ECS_ITERATE_2:
+		return iters * ECS_COUNT * sizeof(vec3) * 2;
+	case ECS_ITERATE_3:
+	case ECS_ITERATE_3_JOBS:
+		return iters * ECS_COUNT * (sizeof(vec3) * 2 + sizeof(float));
+	default:
+		return 0;
+	}
+}
+
+/* The benchmarks that don't depend on the machine */
+static struct benchmark benchmarks[] = {
+	{ "asset/file_read_small", bench_file, NULL, NULL, 0 },
+	{ "asset/file_map_small", bench_file, NULL, NULL, 1 },
+	{ "asset/file_read_large", bench_file, NULL, NULL, 2 },
+	{ "asset/file_map_large", bench_file, NULL, NULL, 3 },
+	{ "asset/batch_read_10k", bench_batch, setup_batch, teardown_batch,
+	  PURPL_BATCH_DEFAULT },
+	{ "asset/batch_read_10k_jobs", bench_batch, setup_batch,
+	  teardown_batch, PURPL_BATCH_NO_URING },
+	{ "archive/tar_scan", bench_tar, NULL, NULL, 0 },
+	{ "archive/index_tar", bench_embed_index, NULL, NULL, TAR },
+	{ "archive/index_pack", bench_embed_index, NULL, NULL, PACK },
+	{ "archive/embed_tar", bench_embed, NULL, NULL, TAR },
+	{ "archive/embed_pack", bench_embed, NULL, NULL, PACK },
+	{ "archive/embed_pack_z", bench_embed, NULL, NULL, PACK_Z },
+	{ "log/text", bench_log, NULL, NULL, LOG_TEXT },
+	{ "log/async", bench_log, NULL, NULL, LOG_ASYNC },
+	{ "log/binary", bench_log, NULL, NULL, LOG_BINARY },
+	{ "log/filtered", bench_log, NULL, NULL, LOG_FILTERED },
+	{ "fmt/text", bench_fmt, NULL, NULL, 0 },
+	{ "fmt/arena", bench_fmt, NULL, NULL, 1 },
+	{ "app_info/load", bench_app_info, NULL, NULL, 0 },
+	{ "alloc/malloc_churn", bench_churn, NULL, NULL, 0 },
+	{ "alloc/pool_churn", bench_churn, NULL, NULL, 1 },
+	{ "loop/headless_tick", bench_loop, NULL, NULL, 0 },
+	{ "render/sort", bench_render, setup_render, teardown_render,
+	  RENDER_SORT },
+	{ "render/submit_null", bench_render, setup_render, teardown_render,
+	  RENDER_SUBMIT },
+	{ "render/submit_null_jobs", bench_render, setup_render,
+	  teardown_render, RENDER_SUBMIT_JOBS },
+	{ "sprite/batch_100k", bench_sprites, setup_sprites, teardown_sprites,
+	  RENDER_SUBMIT },
+	{ "sprite/batch_100k_jobs", bench_sprites, setup_sprites,
+	  teardown_sprites, RENDER_SUBMIT_JOBS },
+	{ "transform/update_cglm", bench_transforms, setup_transforms,
+	  teardown_transforms, TRANSFORM_CGLM },
+	{ "transform/update_scalar", bench_transforms, setup_transforms,
+	  teardown_transforms, TRANSFORM_SCALAR },
+	{ "transform/update_sse", bench_transforms, setup_transforms,
+	  teardown_transforms, TRANSFORM_SSE },
+	{ "transform/update_avx2", bench_transforms, setup_transforms,
+	  teardown_transforms, TRANSFORM_AVX2 },
+	{ "cull/cglm", bench_cull, setup_transforms, teardown_transforms,
+	  TRANSFORM_CGLM },
+	{ "cull/scalar", bench_cull, setup_transforms, teardown_transforms,
+	  TRANSFORM_SCALAR },
+	{ "cull/sse", bench_cull, setup_transforms, teardown_transforms,
+	  TRANSFORM_SSE },
+	{ "cull/avx2", bench_cull, setup_transforms, teardown_transforms,
+	  TRANSFORM_AVX2 },
+	{ "ecs/iterate_1m_2", bench_ecs, setup_ecs, teardown_ecs,
+	  ECS_ITERATE_2 },
+	{ "ecs/iterate_1m_3", bench_ecs, setup_ecs, teardown_ecs,
+	  ECS_ITERATE_3 },
+	{ "ecs/iterate_1m_3_jobs", bench_ecs, setup_ecs, teardown_ecs,
+	  ECS_ITERATE_3_JOBS },
+	{ "ecs/defer_10k", bench_ecs, setup_ecs, teardown_ecs, ECS_DEFER },
+};
+
+/* Load everything the benchmarks need */
+static bool setup(void)
+{
+	static const char *archive_names[] = { "assets.tar", "assets.pak",
+					       "assets_z.pak" };
+	bool mapped;
+	int index;
+	size_t i;
+
+	/* Read the archives and index them */
+	for (i = 0; i < PURPL_ARRAY_SIZE(archive_names); i++) {
+		mapped = false;
+		archives[i] = purpl_read_file(&archive_sizes[i], NULL, &mapped,
+					      "%s/%s", data_dir,
+					      archive_names[i]);
+		if (!archives[i]) {
+			fprintf(stderr, "Error: failed to read %s/%s: %s\n",
+				data_dir, archive_names[i], strerror(errno));
+			return false;
+		}
+		embeds[i] = purpl_load_embed(archives[i],
+					     archives[i] + archive_sizes[i]);
+		if (!embeds[i]) {
+			fprintf(stderr, "Error: failed to index %s: %s\n",
+				archive_names[i], strerror(errno));
+			return false;
+		}
+	}
+
+	/* Make a headless instance for the jobs and the loop */
+	inst = purpl_create_inst(false, false, NULL, NULL, "%s/app.json",
+				 data_dir);
+	if (!inst) {
+		fprintf(stderr, "Error: failed to create instance: %s\n",
+			strerror(errno));
+		return false;
+	}
+
+	/* Make a logger for each way of logging */
+	loggers[LOG_TEXT] = purpl_init_logger(&log_indices[LOG_TEXT],
+					      PURPL_INFO, PURPL_DEBUG,
+					      "%s/text.log", data_dir);
+	loggers[LOG_ASYNC] = purpl_init_logger(&log_indices[LOG_ASYNC],
+					       PURPL_INFO, PURPL_DEBUG,
+					       "%s/async.log", data_dir);
+	loggers[LOG_BINARY] = purpl_init_logger(&log_indices[LOG_BINARY],
+						PURPL_INFO, PURPL_DEBUG,
+						"%s/unused.log", data_dir);
+	loggers[LOG_FILTERED] = purpl_init_logger(&log_indices[LOG_FILTERED],
+						  PURPL_INFO, PURPL_INFO,
+						  "%s/filtered.log", data_dir);
+	for (i = 0; i < PURPL_ARRAY_SIZE(loggers); i++) {
+		if (!loggers[i]) {
+			fprintf(stderr, "Error: failed to start logger: %s\n",
+				strerror(errno));
+			return false;
+		}
+	}
+	index = purpl_open_binary_log(loggers[LOG_BINARY], PURPL_DEBUG,
+				      "%s/binary.plog", data_dir);
+	log_indices[LOG_BINARY] = index;
+	if (index < 0 ||
+	    purpl_start_async_log(loggers[LOG_ASYNC], 0, PURPL_LOG_BLOCK)) {
+		fprintf(stderr, "Error: failed to set up logs: %s\n",
+			strerror(errno));
+		return false;
+	}
+
+	/* And the items for the jobs */
+	job_items = PURPL_CALLOC(JOB_ITEMS, u32);
+	if (!job_items) {
+		fprintf(stderr, "Error: out of memory\n");
+		return false;
+	}
+
+	return true;
+}
+
+/* Free everything setup loaded */
+static void cleanup(void)
+{
+	size_t i;
+
+	for (i = 0; i < PURPL_ARRAY_SIZE(archives); i++) {
+		purpl_free_embed(embeds[i]);
+		free(archives[i]);
+	}
+	for (i = 0; i < PURPL_ARRAY_SIZE(loggers); i++) {
+		if (loggers[i])
+			purpl_end_logger(loggers[i], false);
+	}
+	free(job_items);
+	for (i = 0; i < SMALL_COUNT; i++)
+		free((char *)batch_files[i].path);
+	if (inst)
+		purpl_end_inst(inst);
+}
+
+int main(int argc, char *argv[])
+{
+	struct benchmark *benches = NULL;
+	struct benchmark bench;
+	struct result *results = NULL;
+	struct result result;
+	struct purpl_arena *names;
+	const char *output = NULL;
+	const char *filter = NULL;
+	u64 sample_ns = DEFAULT_SAMPLE_MS * PURPL_NS_PER_MS;
+	uint max_threads = 0;
+	FILE *fp;
+	size_t i;
+	int ret = 0;
+
+	/* Check arguments */
+	data_dir = PURPL_BENCH_DATA;
+	for (i = 1; i < (size_t)argc; i++) {
+		if (argv[i][0] != '-' || !argv[i][1] || argv[i][2] ||
+		    i + 1 >= (size_t)argc)
+			usage(argv[0]);
+		switch (argv[i++][1]) {
+		case 'd':
+			data_dir = argv[i];
+			break;
+		case 'f':
+			filter = argv[i];
+			break;
+		case 'j':
+			max_threads = strtoul(argv[i], NULL, 10);
+			break;
+		case 'o':
+			output = argv[i];
+			break;
+		case 't':
+			sample_ns =
+				strtoull(argv[i], NULL, 10) * PURPL_NS_PER_MS;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!max_threads)
+		max_threads = SDL_GetCPUCount();
+
+	if (!setup()) {
+		cleanup();
+		return errno ? errno : EINVAL;
+	}
+
+	/* Add a job benchmark for each number of threads */
+	names = purpl_create_arena(0);
+	for (i = 0; i < PURPL_ARRAY_SIZE(benchmarks); i++)
+		stbds_arrput(benches, benchmarks[i]);
+	for (i = 1; i <= max_threads; i++) {
+		bench.name = purpl_fmt_text_arena(names, NULL,
+						  "jobs/parallel_for_%zu", i);
+		bench.func = bench_jobs;
+		bench.setup = setup_jobs;
+		bench.teardown = teardown_jobs;
+		bench.arg = i;
+		stbds_arrput(benches, bench);
+	}
+
+	/* Run them */
+	for (i = 0; i < stbds_arrlenu(benches); i++) {
+		if (filter && !strstr(benches[i].name, filter))
+			continue;
+		run_benchmark(&benches[i], sample_ns, &result);
+		if (!result.iters)
+			continue;
+		stbds_arrput(results, result);
+		fprintf(stderr, "%-28s %14.1f ns/op", result.name,
+			result.median);
+		if (result.bytes)
+			fprintf(stderr, " %10.1f MiB/s",
+				result.bytes / result.median * 1e9 /
+					(1024 * 1024));
+		fputc('\n', stderr);
+	}
+
+	/* Write the results */
+	fp = output ? fopen(output, "wb") : stdout;
+	if (fp) {
+		write_results(fp, results, stbds_arrlenu(results));
+		if (fp != stdout)
+			fclose(fp);
+	} else {
+		fprintf(stderr, "Error: failed to truncate file %s: %s\n",
+			output, strerror(errno));
+		ret = errno;
+	}
+
+	stbds_arrfree(results);
+	stbds_arrfree(benches);
+	purpl_free_arena(names);
+	cleanup();
+
+	return ret;
+}
+
+void usage(const char *prog)
+{
+	printf("Usage: %s [-d <data directory>] [-f <filter>] "
+	       "[-j <max threads>] [-o <output>] [-t <sample ms>]\n",
+	       PURPL_GET_BASENAME(prog));
+	exit(EINVAL);
+}
+
+/* Compare times for qsort */
+static int compare_times(const void *a, const void *b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+void run_benchmark(struct benchmark *bench, u64 sample_ns,
+		   struct result *result)
+{
+	double times[SAMPLES];
+	u64 iters;
+	u64 start;
+	u64 time;
+	u64 bytes;
+	uint i;
+
+	memset(result, 0, sizeof(struct result));
+	result->name = bench->name;
+	if (bench->setup && !bench->setup(bench->arg)) {
+		fprintf(stderr, "Error: failed to set up %s: %s\n",
+			bench->name, strerror(errno));
+		if (bench->teardown)
+			bench->teardown(bench->arg);
+		return;
+	}
+
+	/* Find out how many iterations it takes to fill a sample */
+	iters = 1;
+	while (1) {
+		start = purpl_get_time_ns();
+		bench->func(iters, bench->arg);
+		time = purpl_get_time_ns() - start;
+		if (time >= sample_ns / 10 || iters >= (1ull << 40))
+			break;
+		iters *= 2;
+	}
+	iters = PURPL_MAX(iters * sample_ns / PURPL_MAX(time, 1), 1);
+
+	/* Then measure it */
+	bytes = 0;
+	for (i = 0; i < SAMPLES; i++) {
+		start = purpl_get_time_ns();
+		bytes = bench->func(iters, bench->arg);
+		time = purpl_get_time_ns() - start;
+		times[i] = (double)time / iters;
+	}
+	qsort(times, SAMPLES, sizeof(double), compare_times);
+
+	if (bench->teardown)
+		bench->teardown(bench->arg);
+
+	result->iters = iters;
+	result->median = times[SAMPLES / 2];
+	result->min = times[0];
+	result->max = times[SAMPLES - 1];
+	result->bytes = (double)bytes / iters;
+}
+
+void write_results(FILE *fp, struct result *results, size_t count)
+{
+	size_t i;
+
+	fprintf(fp,
+		"{\n"
+		"\t\"engine\": \"%s\",\n"
+		"\t\"samples\": %d,\n"
+		"\t\"results\": [\n",
+		PURPL_BENCH_VERSION, SAMPLES);
+	for (i = 0; i < count; i++) {
+		fprintf(fp,
+			"\t\t{ \"name\": \"%s\", \"iterations\": %llu, "
+			"\"ns_per_op\": %.3f, \"min_ns\": %.3f, "
+			"\"max_ns\": %.3f, \"bytes_per_op\": %.1f }%s\n",
+			results[i].name, results[i].iters, results[i].median,
+			results[i].min, results[i].max, results[i].bytes,
+			(i < count - 1) ? "," : "");
+	}
+	fputs("\t]\n}\n", fp);
+}
@@ -11,18 +11,21 @@
 #define APP_INFO_POSTFIX "_win32"
 #endif
 
-/* Symbols from embedded file */
+/*
+ * Symbols from embedded file (embed_end is an array when mkembed makes
+ *  assembly but a pointer when it makes C, so use embed_size instead)
+ */
 extern char embed_start[];
-extern char embed_end[];
-extern size_t embed_size;
+extern const size_t embed_size;
 
 /* This is called every frame (think a Win32 window procedure of sorts) */
-void frame(struct purpl_inst *inst, SDL_Event e, uint delta, void *user);
+void frame(struct purpl_inst *inst, const struct purpl_input *input,
+	   uint delta, void *user);
 
 int main(int argc, char *argv[])
 {
 	int err;
-	char *test_name;
+	const char *test_name;
 	struct purpl_asset *test;
 	struct purpl_inst *inst;
 	bool have_ast = false;
@@ -43,7 +46,8 @@ int main(int argc, char *argv[])
 	NOPE(argv);
 
 	/* Create an instance */
-	inst = purpl_create_inst(true, true, embed_start, embed_end,
+	inst = purpl_create_inst(true, true, embed_start,
+				 embed_start + embed_size,
 				 "app" APP_INFO_POSTFIX ".json");
 	if (!inst) {
 		fprintf(stderr, "Error: failed to create instance: %s\n",
@@ -52,19 +56,16 @@ int main(int argc, char *argv[])
 	}
 
 	/* Log the details of the app info */
-	purpl_write_log(
-		inst->logger, __FILENAME__, __LINE__, -1,
-		-1, /* -1 means the default index/level */
-		"Contents of loaded app info:\nApp name: %s\nLog path: %s\n"
-		"Version: %d.%d\nSearch paths: %s",
-		inst->info->name, inst->info->log, inst->info->ver_maj,
-		inst->info->ver_min, inst->info->search_paths);
+	PURPL_LOG_INFO(inst->logger,
+		       "Contents of loaded app info:\nApp name: %s\nLog path: "
+		       "%s\nVersion: %d.%d\nSearch paths: %s",
+		       inst->info->name, inst->info->log, inst->info->ver_maj,
+		       inst->info->ver_min, inst->info->search_paths);
 
 	/* Load an asset */
 	test_name = purpl_inst_load_asset_from_file(inst, true, "test.txt");
 	if (!test_name) {
-		purpl_write_log(inst->logger, __FILENAME__, __LINE__, -1,
-				PURPL_ERROR, "Error: failed to load asset: %s",
+		PURPL_LOG_ERROR(inst->logger, "Error: failed to load asset: %s",
 				strerror(errno));
 		have_ast = false;
 	} else {
@@ -75,18 +76,15 @@ int main(int argc, char *argv[])
 		/* Put the asset's contents in the log */
 		test = stbds_shget(inst->assets, test_name);
 		if (!test) {
-			purpl_write_log(
-				inst->logger, __FILENAME__, __LINE__, -1,
-				PURPL_FATAL,
+			PURPL_LOG_FATAL(
+				inst->logger,
 				"Error: failed to get asset from list: %s",
 				strerror(errno));
-			free(test_name);
 			purpl_end_inst(inst);
 			return errno;
 		}
-		purpl_write_log(inst->logger, __FILENAME__, __LINE__, -1, -1,
-				"Contents of \"%s\":\n%s", test->name,
-				test->data);
+		PURPL_LOG_INFO(inst->logger, "Contents of \"%s\":\n%s",
+			       test->name, test->data);
 	}
 
 	/* Create a window (yay it took so long to get here) */
@@ -94,11 +92,9 @@ int main(int argc, char *argv[])
 				       inst->info->name, inst->info->ver_maj,
 				       inst->info->ver_min);
 	if (err) {
-		purpl_write_log(inst->logger, __FILENAME__, __LINE__, -1,
-				PURPL_FATAL,
+		PURPL_LOG_FATAL(inst->logger,
 				"Error: failed to create window: %s",
 				strerror(errno));
-		free(test_name);
 		purpl_end_inst(inst);
 		return errno;
 	}
@@ -106,11 +102,9 @@ int main(int argc, char *argv[])
 	/* Initialize graphics */
 	err = purpl_inst_init_graphics(inst);
 	if (err) {
-		purpl_write_log(inst->logger, __FILENAME__, __LINE__, -1,
-				PURPL_FATAL,
+		PURPL_LOG_FATAL(inst->logger,
 				"Error: failed to initialize graphics: %s",
 				strerror(errno));
-		free(test_name);
 		purpl_end_inst(inst);
 		return errno;
 	}
@@ -119,8 +113,8 @@ int main(int argc, char *argv[])
 #if PURPL_USE_OPENGL_GFX
 	SDL_GL_GetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, &ctx_ver_maj);
 	SDL_GL_GetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, &ctx_ver_min);
-	purpl_write_log(inst->logger, __FILENAME__, __LINE__, -1, -1,
-			"OpenGL context version is %d.%d", ctx_ver_maj, ctx_ver_min);
+	PURPL_LOG_INFO(inst->logger, "OpenGL context version is %d.%d",
+		       ctx_ver_maj, ctx_ver_min);
 #endif
 
 	/* Run the main game loop */
@@ -136,8 +130,8 @@ int main(int argc, char *argv[])
 	}
 
 	/* Log the amount of time we ran for */
-	purpl_write_log(inst->logger, __FILENAME__, __LINE__, -1, -1,
-			"Total runtime: %0.3lf %s", runtime, runtime_s);
+	PURPL_LOG_INFO(inst->logger, "Total runtime: %0.3lf %s", runtime,
+		       runtime_s);
 
 #ifndef NDEBUG
 	/* Save our log's filename */
@@ -180,22 +174,20 @@ int main(int argc, char *argv[])
 	return 0;
 }
 
-void frame(struct purpl_inst *inst, SDL_Event e, uint delta, void *user)
+void frame(struct purpl_inst *inst, const struct purpl_input *input,
+	   uint delta, void *user)
 {
 	SDL_Rect rect;
 	static bool yellow = true;
 	static uint total = 0;
 
-	NOPE(e);
 	NOPE(user);
 
 	/* Fill out a rectangle */
-	SDL_GetWindowSize(inst->wnd, &rect.w, &rect.h);
-	rect.w /= 2;
-	rect.h /= 2;
-	SDL_GetWindowSize(inst->wnd, &rect.x, &rect.y);
-	rect.x /= 2;
-	rect.y /= 2;
+	rect.w = input->window.w / 2;
+	rect.h = input->window.h / 2;
+	rect.x = input->window.w / 2;
+	rect.y = input->window.h / 2;
 	rect.x -= (rect.w / 2);
 	rect.y -= (rect.h / 2);
 
@@ -205,4 +197,10 @@ void frame(struct purpl_inst *inst, SDL_Event e, uint delta, void *user)
 		total = 0;
 		yellow = !yellow;
 	}
+
+	/* Draw it */
+	purpl_render_rect(inst->renderer, PURPL_RENDER_KEY(0, 0, 0), rect.x,
+			  rect.y, rect.w, rect.h,
+			  yellow ? PURPL_RGBA(255, 255, 0, 255) :
+				   PURPL_RGBA(128, 0, 255, 255));
 }
@@ -46,6 +46,10 @@ struct purpl_app_info {
 	char ver_maj; /**< The major version of the app */
 	char ver_min; /**< The minor version of the app */
 	char *search_paths; /**< Where to search for assets */
+	struct purpl_search_paths *paths; /**< `search_paths`, parsed */
+	size_t asset_budget; /**< The optional `asset_budget` key, the most
+				  bytes of assets to keep loaded (0 for no
+				  limit) */
 };
 
 /**
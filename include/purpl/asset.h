@@ -25,6 +25,9 @@
 #include <archive.h>
 #include <archive_entry.h>
 
+#include <stb_ds.h>
+
+#include "pack.h"
 #include "util.h"
 
 #ifdef __cplusplus
@@ -41,6 +44,39 @@ extern "C" {
  */
 #define PURPL_PATH_SEP_STR ";"
 
+/**
+ * @brief This is an internal structure for the names in a cached directory
+ *  listing, don't mess with it
+ */
+struct purpl_dir_entry {
+	char *key;
+	bool value; /* Whether it's a directory */
+};
+
+/**
+ * @brief This is an internal structure for cached directory listings, don't
+ *  mess with it
+ */
+struct purpl_dir_listing {
+	char *key;
+	struct purpl_dir_entry *value;
+};
+
+/**
+ * @brief A parsed list of search paths, with a cache of the directories
+ *  looked at within them
+ *
+ * Directories are listed the first time a lookup goes through them, so after
+ *  that, finding out which search path has a file is just hash lookups. The
+ *  cache doesn't notice files being added or removed on its own, use
+ *  `purpl_refresh_search_paths` for that.
+ */
+struct purpl_search_paths {
+	char **paths; /**< The canonical paths, in order, see `stb_ds.h` */
+	struct purpl_dir_listing
+		*dirs; /**< The directories listed so far, see `stb_ds.h` */
+};
+
 /**
  * @brief A structure to hold information about an asset
  */
@@ -50,19 +86,51 @@ struct purpl_asset {
 	size_t size; /**< The size of `data` */
 	struct purpl_mapping *mapping; /**< The mapping information */
 	bool mapped; /**< Whether the file was mapped */
+	bool embedded; /**< Whether `data` points into an embed (don't free it) */
+	uint refs; /**< The references held through an instance's asset cache */
+	struct purpl_asset *lru_prev; /**< Used by the asset cache, don't touch */
+	struct purpl_asset *lru_next; /**< Used by the asset cache, don't touch */
+};
+
+/**
+ * @brief Information about an entry in an embed, gathered when the embed is
+ *  loaded
+ */
+struct purpl_embed_entry {
+	size_t ordinal; /**< The position of the entry in the archive */
+	size_t size; /**< The size of the entry's data */
+	ptrdiff_t offset; /**< The offset of the entry's data from the start of
+			       the embed, or -1 if it isn't stored contiguously
+			       (i.e. the archive is compressed) */
+	bool dir; /**< Whether the entry is a directory */
+};
+
+/**
+ * @brief This is an internal structure for looking up embed entries by path,
+ *  don't mess with it
+ */
+struct purpl_embed_index {
+	char *key;
+	struct purpl_embed_entry value;
 };
 
 /**
  * @brief A structure to hold information about an embedded archive.
  * 
- * To use this to load assets, use the `ar` member and pass it to
- *  `purpl_load_asset_from_archive`.
+ * To load assets from this, use `purpl_load_asset_from_embed`. If the embed
+ *  is a pack (see `pack.h`), `pack` is used and `ar` and `index` are `NULL`.
+ *  Otherwise, the `ar` member is left at the start of the archive for use with
+ *  `purpl_load_asset_from_archive`, but that has to scan the archive.
  */
 struct purpl_embed {
 	char *start; /**< The start of the embed */
 	char *end; /**< The end of the embed */
 	size_t size; /**< The size of the embed */
+	int format; /**< The libarchive format code of the archive */
 	struct archive *ar; /**< The libarchive handle to the archive */
+	struct purpl_embed_index
+		*index; /**< The entries of the archive, see `stb_ds.h` */
+	struct purpl_pack *pack; /**< The pack, if the embed is one */
 };
 
 /**
@@ -75,23 +143,119 @@ struct purpl_embed {
  * @return Returns `NULL` or a `purpl_embed` structure.
  * 
  * Embedding an archive in your executable requires you to use the
- *  `tools/mkembed` utility that gets built when you build the engine.
+ *  `tools/mkembed` utility that gets built when you build the engine. The
+ *  archive's headers are read once here to build an index, so that assets
+ *  can be looked up in any order afterwards.
  */
 extern struct purpl_embed *purpl_load_embed(const char *sym_start,
 					    const char *sym_end);
 
+/**
+ * @brief Loads an asset from an embed using its index
+ * 
+ * @param embed is the embed to load from
+ * @param path is the path within the archive to the asset
+ * 
+ * @return Returns `NULL` or a `purpl_asset` structure. Sets `errno` to `ENOENT`
+ *  if the file is nonexistent or empty and `EISDIR` if it's a directory.
+ * 
+ * If the embed is a pack, this doesn't touch libarchive at all. For packs
+ *  and uncompressed tars (or anything else libarchive doesn't have to
+ *  decode), uncompressed entries' `data` points straight into the embed and
+ *  `embedded` is set. Otherwise, the data is decompressed into a buffer.
+ */
+extern struct purpl_asset *purpl_load_asset_from_embed(struct purpl_embed *embed,
+						       const char *path, ...);
+
 /**
  * @brief Loads an asset from an archive
  * 
- * @param ar is the libarchive object to load from (for embedded, use `embed->ar`)
+ * @param ar is the libarchive object to load from (for embeds, use
+ *  `purpl_load_asset_from_embed` instead)
  * @param path is the path within the archive to the asset
  * 
  * @return Returns `NULL` or a `purpl_asset` structure. Sets `errno` to `ENOENT` if
  *  the file is nonexistent or empty and `EISDIR` if it's a directory.
+ * 
+ * This reads headers from wherever `ar` currently is, so entries before the
+ *  current position can't be found.
  */
 extern struct purpl_asset *purpl_load_asset_from_archive(struct archive *ar,
 							 const char *path, ...);
 
+/**
+ * @brief Find the first search path containing a file
+ *
+ * @param search_paths is the list of paths to search (see
+ *  `purpl_load_asset_from_file`)
+ * @param name is the path to the file relative to the search paths
+ *
+ * @return Returns the full, canonical path to the file, which has to be
+ *  `free`d, or `NULL` with `errno` set to `ENOENT` if it isn't in any of the
+ *  paths.
+ *
+ * This is safe to call from any thread.
+ */
+extern char *purpl_find_asset(const char *search_paths, const char *name,
+			      ...);
+
+/**
+ * @brief Parse a list of search paths
+ *
+ * @param search_paths is the list of paths, separated by
+ *  `PURPL_PATH_SEP_STR`
+ *
+ * @return Returns `NULL` or a `purpl_search_paths` structure.
+ */
+extern struct purpl_search_paths *
+purpl_parse_search_paths(const char *search_paths);
+
+/**
+ * @brief Find the first search path containing a file, using cached
+ *  directory listings
+ *
+ * @param paths is the search paths
+ * @param name is the path to the file relative to the search paths
+ *
+ * @return Returns the full path to the file, which has to be `free`d, or
+ *  `NULL` with `errno` set to `ENOENT` if it isn't in any of the paths.
+ *
+ * The path is canonical as long as nothing in `name` is a symbolic link.
+ *  Only directories that can't be listed are checked with the file system
+ *  directly. This isn't safe to call from more than one thread at a time.
+ */
+extern char *purpl_resolve_asset(struct purpl_search_paths *paths,
+				 const char *name, ...);
+
+/**
+ * @brief Forget cached directory listings, so they're listed again the next
+ *  time they're needed
+ *
+ * @param paths is the search paths
+ * @param dir is the full path of the directory to forget, or `NULL` to forget
+ *  all of them
+ */
+extern void purpl_refresh_search_paths(struct purpl_search_paths *paths,
+				       const char *dir);
+
+/**
+ * @brief Free a list of search paths
+ *
+ * @param paths is the search paths to free
+ */
+extern void purpl_free_search_paths(struct purpl_search_paths *paths);
+
+/**
+ * @brief Load an asset from an exact path
+ *
+ * @param map is whether or not to map the file instead of reading it into a
+ *  buffer
+ * @param path is the path to the file
+ *
+ * @return Returns either `NULL` or a usable `purpl_asset` structure.
+ */
+extern struct purpl_asset *purpl_load_asset(bool map, const char *path, ...);
+
 /**
  * @brief Load an asset from a file, searching `search_paths`
  *
@@ -103,11 +267,25 @@ extern struct purpl_asset *purpl_load_asset_from_archive(struct archive *ar,
  *  path where that name is found
  * 
  * @return Returns either `NULL` or a usable `purpl_asset` structure.
+ *
+ * The search paths are parsed once per thread and looked up with
+ *  `purpl_resolve_asset`. If a file isn't where the cached listings say, they
+ *  are listed again before giving up.
  */
 extern struct purpl_asset *purpl_load_asset_from_file(const char *search_paths,
 						      bool map,
 						      const char *name, ...);
 
+/**
+ * @brief Free the search paths `purpl_load_asset_from_file` cached on this
+ *  thread
+ *
+ * Each thread keeps the last search paths it loaded from parsed, along with
+ *  their directory listings (see `purpl_resolve_asset`). Threads that load
+ *  from files should call this before exiting.
+ */
+extern void purpl_forget_search_paths(void);
+
 /**
  * @brief Free the information associated with an asset
  * 
@@ -0,0 +1,100 @@
+/**
+ * @file atlas.h
+ * @author MobSlicer152 (brambleclaw1414@gmail.com)
+ * @brief The texture atlas format
+ *
+ * @copyright Copyright (c) MobSlicer152 2021
+ * This software is provided 'as-is', without any express or implied warranty. In no event will the authors be held liable for any damages arising from the use of this software.
+ * Permission is granted to anyone to use this software for any purpose, including commercial applications, and to alter it and redistribute it freely, subject to the following restrictions:
+ * 1. The origin of this software must not be misrepresented; you must not claim that you wrote the original software. If you use this software in a product, an acknowledgment in the product documentation would be appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#pragma once
+
+#ifndef PURPL_ATLAS_H
+#define PURPL_ATLAS_H 1
+
+#include "types.h"
+#include "util.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief The first four bytes of an atlas
+ */
+#define PURPL_ATLAS_MAGIC "PATL"
+
+/**
+ * @brief The version of the atlas format this code reads and writes
+ */
+#define PURPL_ATLAS_VERSION 1
+
+/**
+ * @brief The alignment of each page's pixels within an atlas
+ */
+#define PURPL_ATLAS_ALIGN 64
+
+/**
+ * @brief The largest width or height a page can have, which every OpenGL 4
+ *  implementation can handle as a texture
+ */
+#define PURPL_ATLAS_MAX_PAGE_SIZE 16384
+
+/**
+ * @brief The distance between the starts of two pages of an atlas
+ */
+#define PURPL_ATLAS_PAGE_STRIDE(width, height)               \
+	(((u64)(width) * (height)*4 + PURPL_ATLAS_ALIGN - 1) & \
+	 ~((u64)PURPL_ATLAS_ALIGN - 1))
+
+/**
+ * @brief The header at the start of an atlas, which `mkatlas` makes
+ *
+ * Everything in an atlas is little-endian. The header is followed by the
+ *  sprites (`sprite_count` of them, sorted by name), then their names, each
+ *  followed by a 0 byte, then the pages. Each page is `page_width` by
+ *  `page_height` RGBA pixels, top row first, starting on a
+ *  `PURPL_ATLAS_ALIGN` byte boundary, so they can be uploaded straight out
+ *  of an uncompressed pack.
+ */
+struct purpl_atlas_header {
+	char magic[4]; /**< `PURPL_ATLAS_MAGIC` */
+	u32 version; /**< `PURPL_ATLAS_VERSION` */
+	u32 page_count; /**< The number of pages */
+	u32 page_width; /**< The width of each page */
+	u32 page_height; /**< The height of each page */
+	u32 sprite_count; /**< The number of sprites */
+	u64 sprites_offset; /**< The offset of the sprites */
+	u64 names_offset; /**< The offset of the names */
+	u64 names_size; /**< The size of the names */
+	u64 pages_offset; /**< The offset of the first page */
+	u64 size; /**< The size of the whole atlas */
+};
+
+/**
+ * @brief A sprite in an atlas
+ */
+struct purpl_atlas_sprite {
+	u32 name_offset; /**< The offset of the name within the names */
+	u32 name_len; /**< The length of the name, excluding its terminator
+			   (this is the image's path without its extension) */
+	u32 page; /**< The page the sprite is on */
+	u32 x; /**< The left of the sprite on the page in pixels */
+	u32 y; /**< The top of the sprite on the page in pixels */
+	u32 w; /**< The width of the sprite in pixels */
+	u32 h; /**< The height of the sprite in pixels */
+	float u0; /**< `x` from 0 to 1 */
+	float v0; /**< `y` from 0 to 1 */
+	float u1; /**< The right of the sprite from 0 to 1 */
+	float v1; /**< The bottom of the sprite from 0 to 1 */
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !PURPL_ATLAS_H */
@@ -0,0 +1,115 @@
+/**
+ * @file batch.h
+ * @author MobSlicer152 (brambleclaw1414@gmail.com)
+ * @brief Reading lots of files at once
+ *
+ * @copyright Copyright (c) MobSlicer152 2021
+ * This software is provided 'as-is', without any express or implied warranty. In no event will the authors be held liable for any damages arising from the use of this software.
+ * Permission is granted to anyone to use this software for any purpose, including commercial applications, and to alter it and redistribute it freely, subject to the following restrictions:
+ * 1. The origin of this software must not be misrepresented; you must not claim that you wrote the original software. If you use this software in a product, an acknowledgment in the product documentation would be appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#pragma once
+
+#ifndef PURPL_BATCH_H
+#define PURPL_BATCH_H 1
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "asset.h"
+#include "inst.h"
+#include "types.h"
+#include "util.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief The most operations a batch keeps in flight through io_uring
+ */
+#define PURPL_BATCH_RING_SIZE 256
+
+/**
+ * @brief The most a single read asks for, because io_uring reads take a
+ *  32-bit length
+ */
+#define PURPL_BATCH_MAX_READ (1024 * 1024 * 1024)
+
+/**
+ * @brief Flags for `purpl_inst_read_files` and `purpl_inst_load_assets`
+ */
+enum purpl_batch_flags {
+	PURPL_BATCH_DEFAULT = 0, /**< Use io_uring if it works */
+	PURPL_BATCH_NO_URING = 1 << 0, /**< Always use the job system */
+};
+
+/**
+ * @brief A file to read in a batch
+ */
+struct purpl_batch_file {
+	const char *path; /**< The path to read, which has to stay valid */
+	char *data; /**< The contents, or a buffer to read them into */
+	size_t capacity; /**< The size of `data` if it's a buffer */
+	size_t size; /**< The size of the file */
+	int err; /**< 0, or the `errno` value reading it failed with */
+};
+
+/**
+ * @brief Read a list of files
+ *
+ * @param inst is the instance whose jobs do the reading if io_uring can't,
+ *  or `NULL` to read them on this thread
+ * @param files is the files to read
+ * @param count is the number of files
+ * @param flags is a combination of `purpl_batch_flags` values
+ *
+ * @return Returns the number of files read. Check each file's `err` for why
+ *  the rest failed.
+ *
+ * On Linux, every open, stat, read, and close goes through io_uring, so a
+ *  batch of small files takes a handful of system calls instead of four per
+ *  file. Elsewhere, or if the kernel doesn't have io_uring, each file is
+ *  opened and read with `pread` in a `purpl_inst_parallel_for` job, which
+ *  only runs in parallel once the instance's jobs are started.
+ *
+ * If a file's `data` is `NULL`, a buffer is allocated (`free` it), otherwise
+ *  the file is read into it. Either way, the contents are NUL terminated, so
+ *  a buffer needs to be at least one byte bigger than the file, and a file
+ *  that doesn't fit fails with `ENOBUFS` and its `size` set.
+ */
+extern size_t purpl_inst_read_files(struct purpl_inst *inst,
+				    struct purpl_batch_file *files,
+				    size_t count, u32 flags);
+
+/**
+ * @brief Load a list of assets into an instance's asset cache
+ *
+ * @param inst is the instance
+ * @param names is the names of the assets (resolved like
+ *  `purpl_inst_load_asset_from_file` does)
+ * @param count is the number of names
+ * @param keys is filled in with the name of each asset in `inst->assets`
+ *  (release them with `purpl_inst_free_asset`), or `NULL` where loading
+ *  failed
+ * @param flags is a combination of `purpl_batch_flags` values
+ *
+ * @return Returns the number of assets loaded
+ *
+ * Assets that are already loaded just get another reference, and the rest
+ *  are read with `purpl_inst_read_files`. This is meant for loading a level,
+ *  where thousands of small files would otherwise each take their own trip
+ *  through `purpl_load_asset`. The assets are never mapped.
+ */
+extern size_t purpl_inst_load_assets(struct purpl_inst *inst,
+				     const char **names, size_t count,
+				     const char **keys, u32 flags);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !PURPL_BATCH_H */
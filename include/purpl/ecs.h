@@ -0,0 +1,432 @@
+/**
+ * @file ecs.h
+ * @author MobSlicer152 (brambleclaw1414@gmail.com)
+ * @brief Entities and components, stored by archetype
+ *
+ * @copyright Copyright (c) MobSlicer152 2021
+ * This software is provided 'as-is', without any express or implied warranty. In no event will the authors be held liable for any damages arising from the use of this software.
+ * Permission is granted to anyone to use this software for any purpose, including commercial applications, and to alter it and redistribute it freely, subject to the following restrictions:
+ * 1. The origin of this software must not be misrepresented; you must not claim that you wrote the original software. If you use this software in a product, an acknowledgment in the product documentation would be appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#pragma once
+
+#ifndef PURPL_ECS_H
+#define PURPL_ECS_H 1
+
+#include <stdbool.h>
+
+#include <SDL.h>
+
+#include <stb_ds.h>
+
+#include "inst.h"
+#include "types.h"
+#include "util.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief The size of each chunk of entities, including its header
+ */
+#define PURPL_ECS_CHUNK_SIZE (16 * 1024)
+
+/**
+ * @brief The alignment of each column in a chunk
+ */
+#define PURPL_ECS_COLUMN_ALIGN 16
+
+/**
+ * @brief The number of component types an ECS can have
+ */
+#define PURPL_ECS_MAX_COMPONENTS 64
+
+/**
+ * @brief Get the bit for a component type, for making sets of them
+ */
+#define PURPL_ECS_BIT(component) (1ull << (component))
+
+/**
+ * @brief An invalid component type
+ */
+#define PURPL_ECS_NO_COMPONENT UINT32_MAX
+
+/**
+ * @brief An entity, which is its index and the generation of that index, so
+ *  old handles to a destroyed entity don't refer to the next one to use its
+ *  index
+ */
+typedef u64 purpl_entity;
+
+/**
+ * @brief An entity that never exists
+ */
+#define PURPL_NULL_ENTITY 0
+
+/**
+ * @brief Get the index of an entity
+ */
+#define PURPL_ENTITY_INDEX(entity) ((u32)(entity))
+
+/**
+ * @brief Get the generation of an entity
+ */
+#define PURPL_ENTITY_GENERATION(entity) ((u32)((entity) >> 32))
+
+struct purpl_ecs_archetype;
+
+/**
+ * @brief A chunk of entities with the same components
+ *
+ * Each chunk is `PURPL_ECS_CHUNK_SIZE` bytes, and after this header it has
+ *  a column of entities, then a column for each component (in order of their
+ *  types). Use `purpl_ecs_entities` and `purpl_ecs_column` to get them.
+ */
+struct purpl_ecs_chunk {
+	struct purpl_ecs_archetype *archetype; /**< The chunk's archetype */
+	u32 count; /**< The number of entities in the chunk */
+};
+
+/**
+ * @brief This is an internal structure for the entities with a set of
+ *  components, don't mess with it
+ *
+ * Every chunk but the last one in use is full. Removing an entity moves the
+ *  last one into its place, and chunks that empty out are kept for later.
+ */
+struct purpl_ecs_archetype {
+	u64 components;
+	u32 capacity;
+	u32 entities;
+	u32 offsets[PURPL_ECS_MAX_COMPONENTS];
+	struct purpl_ecs_chunk **chunks;
+	size_t count;
+};
+
+/**
+ * @brief This is an internal structure for where an entity is, don't mess
+ *  with it
+ */
+struct purpl_ecs_record {
+	struct purpl_ecs_archetype *archetype;
+	u32 chunk;
+	u32 row;
+	u32 generation;
+};
+
+/**
+ * @brief Types of deferred changes
+ */
+enum purpl_ecs_cmd_type {
+	PURPL_ECS_CMD_CREATE, /**< Create an entity */
+	PURPL_ECS_CMD_DESTROY, /**< Destroy an entity */
+	PURPL_ECS_CMD_ADD, /**< Add or set a component */
+	PURPL_ECS_CMD_REMOVE, /**< Remove a component */
+};
+
+/**
+ * @brief This is an internal structure for a deferred change, don't mess
+ *  with it
+ */
+struct purpl_ecs_cmd {
+	u32 type;
+	u32 component;
+	purpl_entity entity;
+	u64 components;
+	size_t data;
+};
+
+/**
+ * @brief This is an internal structure for a thread's deferred changes,
+ *  don't mess with it
+ */
+struct purpl_ecs_commands {
+	SDL_threadID owner;
+	struct purpl_ecs_cmd *cmds;
+	u8 *data;
+};
+
+/**
+ * @brief An entity component system
+ *
+ * Entities are stored by archetype (the set of components they have), in
+ *  chunks where each component is a column, so going over every entity with
+ *  some components only touches memory for those components. Adding or
+ *  removing components moves an entity to another archetype.
+ *
+ * Nothing here is safe to call from more than one thread at once, except
+ *  reading and writing components and the `purpl_ecs_defer_*` functions.
+ *  Deferred changes are recorded into a buffer for each thread and applied by
+ *  `purpl_ecs_flush`, so they're how jobs change what entities exist.
+ */
+struct purpl_ecs {
+	u32 sizes[PURPL_ECS_MAX_COMPONENTS]; /**< The size of each component
+						  type */
+	u32 component_count; /**< The number of component types */
+	size_t count; /**< The number of entities */
+
+	struct purpl_ecs_record *records; /**< Every entity index, see
+					       `stb_ds.h` */
+	u32 *free; /**< Indices of destroyed entities, see `stb_ds.h` */
+	struct {
+		u64 key;
+		struct purpl_ecs_archetype *value;
+	} *archetypes; /**< The archetypes by their components, see
+			    `stb_ds.h` */
+	struct purpl_ecs_chunk **matched; /**< The chunks a parallel query is
+					       going over */
+
+	u32 id; /**< Unique, for finding the calling thread's buffer */
+	SDL_SpinLock lock; /**< Protects `commands` */
+	struct purpl_ecs_commands **commands; /**< Each thread's deferred
+						   changes */
+};
+
+/**
+ * @brief Goes over a chunk of the entities matched by a query
+ *
+ * @param chunk is the chunk
+ * @param data is the data passed to the query
+ */
+typedef void (*purpl_ecs_func)(struct purpl_ecs_chunk *chunk, void *data);
+
+/**
+ * @brief Create an ECS
+ *
+ * @return Returns an ECS or `NULL` with `errno` set.
+ */
+extern struct purpl_ecs *purpl_create_ecs(void);
+
+/**
+ * @brief Create `inst->ecs`
+ *
+ * @param inst is the instance
+ *
+ * @return Returns 0 or sets and returns `errno`. If the instance already has
+ *  an ECS, returns `EEXIST`.
+ *
+ * `purpl_inst_run` and `purpl_inst_run_fixed` flush it after every frame or
+ *  update, and `purpl_end_inst` frees it.
+ */
+extern int purpl_inst_create_ecs(struct purpl_inst *inst);
+
+/**
+ * @brief Add a component type
+ *
+ * @param ecs is the ECS
+ * @param size is the size of the component (0 makes a tag, which entities
+ *  can have but which has no data)
+ *
+ * @return Returns the component type or `PURPL_ECS_NO_COMPONENT` with `errno`
+ *  set. If there are already `PURPL_ECS_MAX_COMPONENTS` types, `errno` is
+ *  `ENOSPC`.
+ */
+extern u32 purpl_ecs_register_component(struct purpl_ecs *ecs, size_t size);
+
+/**
+ * @brief Create an entity
+ *
+ * @param ecs is the ECS
+ * @param components is the set of components it has (see `PURPL_ECS_BIT`),
+ *  which start out zeroed
+ *
+ * @return Returns the entity or `PURPL_NULL_ENTITY` with `errno` set.
+ */
+extern purpl_entity purpl_ecs_create(struct purpl_ecs *ecs, u64 components);
+
+/**
+ * @brief Destroy an entity
+ *
+ * @param ecs is the ECS
+ * @param entity is the entity
+ *
+ * @return Returns 0 or sets and returns `errno`.
+ */
+extern int purpl_ecs_destroy(struct purpl_ecs *ecs, purpl_entity entity);
+
+/**
+ * @brief Check whether an entity exists
+ *
+ * @param ecs is the ECS
+ * @param entity is the entity
+ *
+ * @return Returns whether `entity` exists.
+ */
+extern bool purpl_ecs_alive(const struct purpl_ecs *ecs, purpl_entity entity);
+
+/**
+ * @brief Get a component of an entity
+ *
+ * @param ecs is the ECS
+ * @param entity is the entity
+ * @param component is the component type
+ *
+ * @return Returns the component, or `NULL` if the entity doesn't have it (or
+ *  it's a tag). The pointer stops being valid when any entity is created,
+ *  destroyed, or changes its components.
+ */
+extern void *purpl_ecs_get(const struct purpl_ecs *ecs, purpl_entity entity,
+			   u32 component);
+
+/**
+ * @brief Add a component to an entity, or set it if it already has it
+ *
+ * @param ecs is the ECS
+ * @param entity is the entity
+ * @param component is the component type
+ * @param value is what to set the component to (`NULL` means zero)
+ *
+ * @return Returns 0 or sets and returns `errno`.
+ */
+extern int purpl_ecs_add(struct purpl_ecs *ecs, purpl_entity entity,
+			 u32 component, const void *value);
+
+/**
+ * @brief Remove a component from an entity
+ *
+ * @param ecs is the ECS
+ * @param entity is the entity
+ * @param component is the component type
+ *
+ * @return Returns 0 or sets and returns `errno`.
+ */
+extern int purpl_ecs_remove(struct purpl_ecs *ecs, purpl_entity entity,
+			    u32 component);
+
+/**
+ * @brief Get the entities in a chunk
+ *
+ * @param chunk is the chunk
+ *
+ * @return Returns `chunk->count` entities.
+ */
+extern const purpl_entity *
+purpl_ecs_entities(const struct purpl_ecs_chunk *chunk);
+
+/**
+ * @brief Get a component's column in a chunk
+ *
+ * @param chunk is the chunk
+ * @param component is the component type
+ *
+ * @return Returns `chunk->count` components, aligned to
+ *  `PURPL_ECS_COLUMN_ALIGN`, or `NULL` if the chunk's entities don't have
+ *  the component (or it's a tag).
+ */
+extern void *purpl_ecs_column(const struct purpl_ecs_chunk *chunk,
+			      u32 component);
+
+/**
+ * @brief Go over every chunk of entities with some components
+ *
+ * @param ecs is the ECS
+ * @param all is the set of components the entities have to have
+ * @param none is the set of components they can't have
+ * @param func is called for each chunk
+ * @param data is passed to `func`
+ *
+ * @return Returns the number of entities gone over.
+ *
+ * `func` can change components, but only make other changes with the
+ *  `purpl_ecs_defer_*` functions.
+ */
+extern size_t purpl_ecs_each(struct purpl_ecs *ecs, u64 all, u64 none,
+			     purpl_ecs_func func, void *data);
+
+/**
+ * @brief Go over every chunk of entities with some components using the job
+ *  system, see `purpl_ecs_each`
+ *
+ * @param inst is the instance with the job system
+ * @param ecs is the ECS
+ * @param all is the set of components the entities have to have
+ * @param none is the set of components they can't have
+ * @param func is called for each chunk, from any thread
+ * @param data is passed to `func`
+ *
+ * @return Returns the number of entities gone over.
+ *
+ * The chunks are split between jobs, and this waits for all of them. If the
+ *  job system isn't running, it's the same as `purpl_ecs_each`.
+ */
+extern size_t purpl_inst_ecs_each(struct purpl_inst *inst,
+				  struct purpl_ecs *ecs, u64 all, u64 none,
+				  purpl_ecs_func func, void *data);
+
+/**
+ * @brief Create an entity when the ECS is next flushed
+ *
+ * @param ecs is the ECS
+ * @param components is the set of components it has
+ * @param values has a value for each component in `components` (lowest bit
+ *  first), where `NULL` means zero, and can be `NULL` to zero all of them
+ *
+ * @return Returns 0 or sets and returns `errno`.
+ */
+extern int purpl_ecs_defer_create(struct purpl_ecs *ecs, u64 components,
+				  const void *const *values);
+
+/**
+ * @brief Destroy an entity when the ECS is next flushed
+ *
+ * @param ecs is the ECS
+ * @param entity is the entity
+ *
+ * @return Returns 0 or sets and returns `errno`.
+ */
+extern int purpl_ecs_defer_destroy(struct purpl_ecs *ecs, purpl_entity entity);
+
+/**
+ * @brief Add or set a component when the ECS is next flushed
+ *
+ * @param ecs is the ECS
+ * @param entity is the entity
+ * @param component is the component type
+ * @param value is what to set the component to (`NULL` means zero), which is
+ *  copied now
+ *
+ * @return Returns 0 or sets and returns `errno`.
+ */
+extern int purpl_ecs_defer_add(struct purpl_ecs *ecs, purpl_entity entity,
+			       u32 component, const void *value);
+
+/**
+ * @brief Remove a component when the ECS is next flushed
+ *
+ * @param ecs is the ECS
+ * @param entity is the entity
+ * @param component is the component type
+ *
+ * @return Returns 0 or sets and returns `errno`.
+ */
+extern int purpl_ecs_defer_remove(struct purpl_ecs *ecs, purpl_entity entity,
+				  u32 component);
+
+/**
+ * @brief Apply every thread's deferred changes
+ *
+ * @param ecs is the ECS
+ *
+ * @return Returns the number of changes applied.
+ *
+ * Each thread's changes are applied in the order they were made. Changes to
+ *  an entity that was destroyed by then are skipped.
+ */
+extern size_t purpl_ecs_flush(struct purpl_ecs *ecs);
+
+/**
+ * @brief Free an ECS and every entity in it
+ *
+ * @param ecs is the ECS
+ */
+extern void purpl_free_ecs(struct purpl_ecs *ecs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !PURPL_ECS_H */
@@ -0,0 +1,221 @@
+/**
+ * @file input.h
+ * @author MobSlicer152 (brambleclaw1414@gmail.com)
+ * @brief Keyboard, mouse, gamepad, and window state
+ *
+ * @copyright Copyright (c) MobSlicer152 2021
+ * This software is provided 'as-is', without any express or implied warranty. In no event will the authors be held liable for any damages arising from the use of this software.
+ * Permission is granted to anyone to use this software for any purpose, including commercial applications, and to alter it and redistribute it freely, subject to the following restrictions:
+ * 1. The origin of this software must not be misrepresented; you must not claim that you wrote the original software. If you use this software in a product, an acknowledgment in the product documentation would be appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#pragma once
+
+#ifndef PURPL_INPUT_H
+#define PURPL_INPUT_H 1
+
+#include <stdbool.h>
+
+#include <SDL.h>
+
+#include <stb_ds.h>
+
+#include "types.h"
+#include "util.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief The number of events taken from SDL at once
+ */
+#define PURPL_INPUT_BATCH 64
+
+/**
+ * @brief The most gamepads that are kept track of
+ */
+#define PURPL_MAX_GAMEPADS 4
+
+/**
+ * @brief The number of `u64`s it takes to have a bit for every key
+ */
+#define PURPL_KEY_WORDS ((SDL_NUM_SCANCODES + 63) / 64)
+
+/**
+ * @brief The state of a set of buttons: which ones are held, and which ones
+ *  went down or up since the last frame
+ */
+struct purpl_button_state {
+	u32 down; /**< The buttons held, one bit each */
+	u32 pressed; /**< The buttons that went down */
+	u32 released; /**< The buttons that went up */
+};
+
+/**
+ * @brief The state of the mouse
+ */
+struct purpl_mouse_state {
+	int x; /**< The position in the window */
+	int y; /**< The position in the window */
+	int dx; /**< How far it moved since the last frame */
+	int dy; /**< How far it moved since the last frame */
+	int wheel_x; /**< How far the wheel scrolled since the last frame */
+	int wheel_y; /**< How far the wheel scrolled since the last frame */
+	struct purpl_button_state buttons; /**< Bit `SDL_BUTTON_LEFT - 1` and
+						so on, like `SDL_BUTTON` */
+};
+
+/**
+ * @brief The state of a gamepad
+ */
+struct purpl_gamepad_state {
+	SDL_GameController *controller; /**< The controller, or `NULL` if
+					     there isn't one in this slot */
+	SDL_JoystickID id; /**< The controller's instance ID */
+	struct purpl_button_state buttons; /**< Bit `SDL_CONTROLLER_BUTTON_A`
+						and so on */
+	s16 axes[SDL_CONTROLLER_AXIS_MAX]; /**< The raw axis values */
+};
+
+/**
+ * @brief The window's geometry and flags, kept up to date from window events
+ *  so nothing has to ask SDL for them every frame
+ */
+struct purpl_window_state {
+	int x; /**< The position of the window */
+	int y; /**< The position of the window */
+	int w; /**< The size of the window */
+	int h; /**< The size of the window */
+	u32 flags; /**< The window's `SDL_WindowFlags` */
+	bool moved; /**< Whether the window moved or resized this frame */
+};
+
+/**
+ * @brief Everything that happened since the last frame, and the state of
+ *  the input devices that resulted
+ */
+struct purpl_input {
+	SDL_Event *events; /**< Every event this frame, in order, see
+			        `stb_ds.h` */
+	u64 keys[PURPL_KEY_WORDS]; /**< The keys held, by scancode */
+	u64 keys_pressed[PURPL_KEY_WORDS]; /**< The keys that went down */
+	u64 keys_released[PURPL_KEY_WORDS]; /**< The keys that went up */
+	struct purpl_mouse_state mouse; /**< The mouse */
+	struct purpl_gamepad_state
+		gamepads[PURPL_MAX_GAMEPADS]; /**< The gamepads, in the order
+						   they were connected */
+	struct purpl_window_state window; /**< The window */
+	u32 window_id; /**< The ID of the window, or 0 if there isn't one */
+	bool keep; /**< See `purpl_input_keep` */
+};
+
+/**
+ * @brief Start tracking a window's state
+ *
+ * @param input is the input state
+ * @param wnd is the window, or `NULL` to stop tracking one
+ *
+ * This asks SDL for the window's geometry once, and after that it's updated
+ *  by `purpl_poll_input`. `purpl_inst_create_window` does this.
+ */
+extern void purpl_input_set_window(struct purpl_input *input,
+				   SDL_Window *wnd);
+
+/**
+ * @brief Take every waiting event from SDL and update the input state
+ *
+ * @param input is the input state
+ *
+ * @return Returns the number of new events, which are at the end of
+ *  `input->events`
+ *
+ * Events are taken `PURPL_INPUT_BATCH` at a time with `SDL_PeepEvents`. The
+ *  events, edges, and mouse motion from the last call are cleared first,
+ *  unless `purpl_input_keep` was called since. The instance loops call this
+ *  at the start of each frame.
+ */
+extern size_t purpl_poll_input(struct purpl_input *input);
+
+/**
+ * @brief Keep this frame's events and edges for the next call to
+ *  `purpl_poll_input` to add to
+ *
+ * @param input is the input state
+ *
+ * `purpl_inst_run_fixed` uses this for frames where no update ran, so
+ *  presses aren't lost between updates.
+ */
+extern void purpl_input_keep(struct purpl_input *input);
+
+/**
+ * @brief Forget the edges (but not the events) of this frame
+ *
+ * @param input is the input state
+ *
+ * `purpl_inst_run_fixed` uses this after the first update of a frame, so
+ *  that only one update sees each press.
+ */
+extern void purpl_clear_input_edges(struct purpl_input *input);
+
+/**
+ * @brief Close any gamepads and free the events
+ *
+ * @param input is the input state
+ */
+extern void purpl_free_input(struct purpl_input *input);
+
+/**
+ * @brief Check if a key is held
+ *
+ * @param input is the input state
+ * @param key is the key's scancode
+ *
+ * @return Returns whether the key is held
+ */
+extern bool purpl_key_down(const struct purpl_input *input, SDL_Scancode key);
+
+/**
+ * @brief Check if a key went down this frame
+ *
+ * @param input is the input state
+ * @param key is the key's scancode
+ *
+ * @return Returns whether the key went down
+ */
+extern bool purpl_key_pressed(const struct purpl_input *input,
+			      SDL_Scancode key);
+
+/**
+ * @brief Check if a key went up this frame
+ *
+ * @param input is the input state
+ * @param key is the key's scancode
+ *
+ * @return Returns whether the key went up
+ */
+extern bool purpl_key_released(const struct purpl_input *input,
+			       SDL_Scancode key);
+
+/**
+ * @brief Get a gamepad's axis as a value from -1 to 1
+ *
+ * @param input is the input state
+ * @param pad is the gamepad's slot
+ * @param axis is the axis
+ * @param deadzone is how far from 0 (from 0 to 1) the axis has to be to
+ *  count, to ignore drift
+ *
+ * @return Returns the axis, or 0 if there's no gamepad in the slot or the
+ *  axis is in the dead zone
+ */
+extern float purpl_gamepad_axis(const struct purpl_input *input, uint pad,
+				SDL_GameControllerAxis axis, float deadzone);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !PURPL_INPUT_H */
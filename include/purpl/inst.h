@@ -22,6 +22,7 @@
 #include <stb_ds.h>
 
 #include "app_info.h"
+#include "input.h"
 #include "log.h"
 #include "types.h"
 #include "util.h"
@@ -37,6 +38,78 @@ extern "C" {
 #define PURPL_GRAPHICS_FLAGS SDL_WINDOW_OPENGL
 #endif
 
+/**
+ * @brief Nanoseconds in a second and a millisecond
+ */
+#define PURPL_NS_PER_SEC 1000000000ull
+#define PURPL_NS_PER_MS 1000000ull
+
+/**
+ * @brief The default number of updates per second for
+ *  `purpl_inst_run_fixed`
+ */
+#define PURPL_DEFAULT_TICK_RATE 60
+
+/**
+ * @brief The default most updates `purpl_inst_run_fixed` will run in one
+ *  frame to catch up
+ */
+#define PURPL_DEFAULT_MAX_STEPS 8
+
+/**
+ * @brief The number of recent frames `purpl_inst_get_perf_stats` looks at
+ */
+#define PURPL_FRAME_HISTORY 256
+
+/**
+ * @brief A frame is a hitch if it takes this many times as long as the
+ *  average of the recent frames
+ */
+#define PURPL_HITCH_FACTOR 2
+
+struct purpl_ecs;
+struct purpl_jobs;
+struct purpl_stream;
+struct purpl_watch;
+struct purpl_inst;
+
+/**
+ * @brief Timing for `purpl_inst_run_fixed`. Anything that's 0 gets the
+ *  default.
+ */
+struct purpl_loop_config {
+	uint tick_rate; /**< Updates per second */
+	uint frame_rate; /**< The most frames to render per second when vsync
+			      is off (0 means no limit) */
+	uint max_steps; /**< The most updates to run in one frame before
+			     giving up on catching up */
+	u64 max_ticks; /**< Stop after this many updates (0 means keep going
+			    until quit) */
+	bool unthrottled; /**< Without a window, run updates back to back
+			       instead of in real time */
+};
+
+/**
+ * @brief Called by `purpl_inst_run_fixed` to advance the simulation
+ *
+ * @param inst is the instance
+ * @param dt is the length of the step in nanoseconds (always the same)
+ * @param user is the user data
+ */
+typedef void (*purpl_update_callback)(struct purpl_inst *inst, u64 dt,
+				      void *user);
+
+/**
+ * @brief Called by `purpl_inst_run_fixed` to draw a frame
+ *
+ * @param inst is the instance
+ * @param alpha is how far (from 0 to 1) the time being drawn is between the
+ *  last update and the next one, for interpolating
+ * @param user is the user data
+ */
+typedef void (*purpl_render_callback)(struct purpl_inst *inst, double alpha,
+				      void *user);
+
 /**
  * @brief This is an internal structure for keeping track of assets, don't mess
  *  with it
@@ -46,6 +119,76 @@ struct purpl_asset_list {
 	struct purpl_asset *value;
 };
 
+/**
+ * @brief This is an internal structure for the bookkeeping of an instance's
+ *  assets, don't mess with it
+ */
+struct purpl_asset_cache {
+	struct purpl_asset *lru_head; /**< The least recently used unreferenced
+					   asset */
+	struct purpl_asset *lru_tail; /**< The most recently used unreferenced
+					   asset */
+	size_t resident;
+	size_t budget;
+	u64 hits;
+	u64 misses;
+	u64 evictions;
+	u64 loaded;
+};
+
+/**
+ * @brief Statistics about an instance's asset cache
+ */
+struct purpl_asset_stats {
+	u64 hits; /**< Loads that found the asset already loaded */
+	u64 misses; /**< Loads that had to read the asset */
+	u64 evictions; /**< Unreferenced assets freed to stay under budget */
+	size_t resident; /**< The bytes of asset data loaded */
+	size_t budget; /**< The budget (0 if there's no limit) */
+	size_t count; /**< The number of assets loaded */
+	u64 loaded; /**< The bytes of asset data read since the instance
+		         started */
+};
+
+/**
+ * @brief This is an internal structure for an instance's recent frame times,
+ *  don't mess with it
+ */
+struct purpl_frame_history {
+	u64 times[PURPL_FRAME_HISTORY];
+	u64 total;
+	u32 next;
+	u32 count;
+	u64 last_end;
+	u64 frames;
+	u64 hitches;
+	s8 log_index;
+	u64 log_interval;
+	u64 last_log;
+};
+
+/**
+ * @brief Frame times and engine counters, see `purpl_inst_get_perf_stats`
+ */
+struct purpl_perf_stats {
+	u64 frames; /**< The frames run since the instance was created */
+	u32 window; /**< The number of recent frames the times are from */
+	u64 min; /**< The shortest recent frame in nanoseconds */
+	u64 avg; /**< The average recent frame in nanoseconds */
+	u64 p95; /**< The 95th percentile of recent frames in nanoseconds */
+	u64 p99; /**< The 99th percentile of recent frames in nanoseconds */
+	u64 max; /**< The longest recent frame in nanoseconds */
+	u64 hitches; /**< The frames since the instance was created that took
+			  `PURPL_HITCH_FACTOR` times the average */
+	u64 frame_allocs; /**< The heap allocations the last frame made */
+	u64 dropped_steps; /**< See `purpl_inst_run_fixed` */
+	u64 bytes_loaded; /**< The bytes of asset data read */
+	size_t resident; /**< The bytes of asset data loaded now */
+	size_t assets; /**< The number of assets loaded now */
+	u64 mapped_bytes; /**< The bytes of files mapped now */
+	u64 log_bytes; /**< The bytes written to the instance's logs */
+};
+
 /**
  * @brief A structure that holds critical information about an instance of the
  *  engine. This is a collection of other structures that provide access to the
@@ -59,6 +202,25 @@ struct purpl_inst {
 	struct purpl_embed *embed; /**< The embedded archive if one was given */
 	struct purpl_asset_list
 		*assets; /**< The list of assets opened, see `stb_ds.h` */
+	struct purpl_asset_cache cache; /**< Bookkeeping for `assets` */
+	struct purpl_stream *stream; /**< The asset streaming workers, if any */
+	struct purpl_watch *watch; /**< The asset file watcher, if any */
+	struct purpl_jobs *jobs; /**< The job system, if it's been started */
+	struct purpl_renderer *renderer; /**< The renderer, if there is one */
+	struct purpl_ecs *ecs; /**< The entities, if `purpl_inst_create_ecs` was
+				    called */
+	struct purpl_arena *frame_arena; /**< Memory that lasts for one frame,
+					      reset by `purpl_inst_run` */
+	u64 frame_allocs; /**< The number of heap allocations the main thread
+			       made during the last frame */
+	u64 dropped_steps; /**< The updates `purpl_inst_run_fixed` skipped
+				because it fell too far behind */
+	u64 ticks; /**< The updates `purpl_inst_run_fixed` has run */
+	struct purpl_frame_history
+		frame_history; /**< Recent frame times, see
+				    `purpl_inst_get_perf_stats` */
+	struct purpl_input input; /**< This frame's events and the state of the
+				       input devices and window */
 	struct SDL_Window *wnd; /**< The SDL window */
 	int default_x; /**< The non-fullscreen x position of the window */
 	int default_y; /**< The non-fullscreen y position of the window */
@@ -118,6 +280,7 @@ extern int purpl_inst_create_window(struct purpl_inst *inst, bool fullscreen,
  *  error.
  * 
  * Call this _after_ you've created a window with `purpl_inst_create_window`.
+ *  This creates `inst->renderer` with the backend for the graphics API.
  */
 extern int purpl_inst_init_graphics(struct purpl_inst *inst);
 
@@ -127,16 +290,68 @@ extern int purpl_inst_init_graphics(struct purpl_inst *inst);
  * @param inst is the instance to run
  * @param user is optional user data to be passed to the `frame` callback
  * @param frame is a callback that is called each frame after window events are
- *  processed and before the renderer is updated
+ *  processed and assets loaded or reloaded in the background are swapped in,
+ *  and before the renderer is updated. It gets `inst->input`, which has every
+ *  event of the frame and the state of the keyboard, mouse, and gamepads.
+ *  Anything it records with `inst->renderer` is drawn at the end of the
+ *  frame, and changes it defers to `inst->ecs` are applied after it returns.
  * 
  * @return Returns the amount of time passed since the start of the function.
  * 
- * It is recommended to run this on a separate thread.
+ * It is recommended to run this on a separate thread. At the end of each
+ *  frame, `inst->frame_arena` and the calling thread's scratch arena are
+ *  reset, so anything the frame allocates from them is gone, and
+ *  `inst->frame_allocs` is set to the number of heap allocations the frame
+ *  made.
  */
 extern uint purpl_inst_run(struct purpl_inst *inst, void *user,
-			     void(frame)(struct purpl_inst *inst, SDL_Event e,
-					 uint delta,
-				       void *user));
+			   void(frame)(struct purpl_inst *inst,
+				       const struct purpl_input *input,
+				       uint delta, void *user));
+
+/**
+ * @brief Run `inst` with a fixed timestep
+ *
+ * @param inst is the instance to run
+ * @param user is optional user data to be passed to the callbacks
+ * @param config is the timing to use (`NULL` means the defaults)
+ * @param update is called zero or more times each frame, once for each step
+ *  of simulated time that has passed. Changes it defers to `inst->ecs` are
+ *  applied after each one returns.
+ * @param render is called once each frame after the updates, unless the
+ *  window is minimized (it can be `NULL` if there's no window)
+ *
+ * @return Returns the amount of time passed since the start of the function
+ *  in milliseconds.
+ *
+ * Unlike `purpl_inst_run`, this keeps going while the window doesn't have
+ *  focus, and times everything in nanoseconds with the performance counter.
+ *  If updates take longer than the time they simulate, at most
+ *  `config->max_steps` run per frame and the rest are dropped (and counted in
+ *  `inst->dropped_steps`). When vsync is off and `config->frame_rate` is set,
+ *  this sleeps between frames instead of spinning. Events, background assets
+ *  and temporary memory are handled the same as `purpl_inst_run`. Input is in
+ *  `inst->input`, and only the first update of a frame sees its presses and
+ *  releases. If a frame has no updates, its events and edges are kept for the
+ *  next one, so none are lost.
+ *
+ * If `purpl_inst_create_window` was never called, this runs headless: nothing
+ *  is drawn and video is never initialized, so it works without a display.
+ *  Updates run in real time (sleeping in between), or back to back if
+ *  `config->unthrottled` is set. The number of updates run is kept in
+ *  `inst->ticks`, and the updates per second are logged at the end.
+ */
+extern uint purpl_inst_run_fixed(struct purpl_inst *inst, void *user,
+				 const struct purpl_loop_config *config,
+				 purpl_update_callback update,
+				 purpl_render_callback render);
+
+/**
+ * @brief Get a time in nanoseconds, for measuring how long things take
+ *
+ * @return Returns the performance counter in nanoseconds.
+ */
+extern u64 purpl_get_time_ns(void);
 
 /**
  * @brief Load an asset from a file into the instance's assset list
@@ -145,23 +360,95 @@ extern uint purpl_inst_run(struct purpl_inst *inst, void *user,
  * @param map is whether to attempt to map the file
  * @param name is the name of the file
  * 
- * @return Returns the full path to the asset, to access it within the list.
+ * @return Returns the full, canonical path to the asset, to access it within
+ *  the list.
+ *
+ * If the file is already loaded, this adds a reference to it instead of
+ *  loading it again. Each successful call has to be matched by a call to
+ *  `purpl_inst_free_asset`.
  */
 extern const char *purpl_inst_load_asset_from_file(struct purpl_inst *inst,
 						   bool map, const char *name,
 						   ...);
 
 /**
- * @brief Free an asset loaded with one of the instance-based functions
+ * @brief Add an asset that's already been loaded to the instance's asset list
+ *
+ * @param inst is the instance to add the asset to
+ * @param asset is the asset, which the instance takes ownership of
+ *
+ * @return Returns the name of the asset within the list, like
+ *  `purpl_inst_load_asset_from_file`, or `NULL`.
+ *
+ * If an asset with the same name is already loaded, `asset` is freed and a
+ *  reference to the existing one is returned.
+ */
+extern const char *purpl_inst_add_asset(struct purpl_inst *inst,
+					struct purpl_asset *asset);
+
+/**
+ * @brief Release a reference to an asset loaded with one of the
+ *  instance-based functions
  * 
- * @param inst is the instance to remove the asset from
- * @param name is the name of the asset to remove (make sure it's the return
- *  value of the function that allocated and returned the string, not a copy.
- *  If you ignore the previous sentence, you'll get a memory leak or a double
- *  -free type of thing) 
+ * @param inst is the instance the asset belongs to
+ * @param name is the name of the asset, as returned when it was loaded
+ *
+ * Once nothing references an asset it stays loaded in case it's needed again,
+ *  until the instance's assets go over the `asset_budget` in the app info.
+ *  Then the least recently used unreferenced assets are freed, which also
+ *  frees their names.
  */
 extern void purpl_inst_free_asset(struct purpl_inst *inst, const char *name);
 
+/**
+ * @brief Free unreferenced assets until the instance's assets fit in a
+ *  budget
+ *
+ * @param inst is the instance to trim
+ * @param budget is the most bytes of assets to keep loaded (0 frees every
+ *  unreferenced asset)
+ *
+ * @return Returns the number of bytes freed.
+ */
+extern size_t purpl_inst_trim_assets(struct purpl_inst *inst, size_t budget);
+
+/**
+ * @brief Get statistics about the instance's assets
+ *
+ * @param inst is the instance
+ * @param stats receives the statistics
+ */
+extern void purpl_inst_get_asset_stats(struct purpl_inst *inst,
+				       struct purpl_asset_stats *stats);
+
+/**
+ * @brief Get frame time statistics and engine counters for an instance
+ *
+ * @param inst is the instance
+ * @param stats receives the statistics
+ *
+ * Frame times are measured from the end of one frame to the end of the next
+ *  by `purpl_inst_run` and `purpl_inst_run_fixed`, over the last
+ *  `PURPL_FRAME_HISTORY` frames. This is cheap enough to call every frame,
+ *  and works in release builds.
+ */
+extern void purpl_inst_get_perf_stats(struct purpl_inst *inst,
+				      struct purpl_perf_stats *stats);
+
+/**
+ * @brief Periodically write an instance's statistics to a log
+ *
+ * @param inst is the instance
+ * @param index is the log to write to (-1 means the default)
+ * @param interval is the time between writes in milliseconds (0 stops
+ *  writing them)
+ *
+ * The statistics are written at the info level from the end of a frame, so
+ *  nothing extra runs on other threads.
+ */
+extern void purpl_inst_log_perf_stats(struct purpl_inst *inst, s8 index,
+				      uint interval);
+
 /**
  * @brief Close an instance's window if one is open
  * 
@@ -0,0 +1,218 @@
+/**
+ * @file job.h
+ * @author MobSlicer152 (brambleclaw1414@gmail.com)
+ * @brief Running work across threads
+ *
+ * @copyright Copyright (c) MobSlicer152 2021
+ * This software is provided 'as-is', without any express or implied warranty. In no event will the authors be held liable for any damages arising from the use of this software.
+ * Permission is granted to anyone to use this software for any purpose, including commercial applications, and to alter it and redistribute it freely, subject to the following restrictions:
+ * 1. The origin of this software must not be misrepresented; you must not claim that you wrote the original software. If you use this software in a product, an acknowledgment in the product documentation would be appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#pragma once
+
+#ifndef PURPL_JOB_H
+#define PURPL_JOB_H 1
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include <SDL.h>
+
+#include <stb_ds.h>
+
+#include "inst.h"
+#include "types.h"
+#include "util.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief The number of jobs each worker's queue can hold (a power of two).
+ *  Jobs submitted when it's full go on a shared queue instead.
+ */
+#define PURPL_JOB_QUEUE_SIZE 4096
+
+/**
+ * @brief A job
+ *
+ * @param data is the data passed when it was submitted
+ */
+typedef void (*purpl_job_func)(void *data);
+
+/**
+ * @brief A job that handles part of a range, see `purpl_inst_parallel_for`
+ *
+ * @param data is the data passed to `purpl_inst_parallel_for`
+ * @param start is the first index to handle
+ * @param end is one past the last index to handle
+ */
+typedef void (*purpl_range_func)(void *data, size_t start, size_t end);
+
+/**
+ * @brief Counts jobs that haven't finished, so they can be waited for
+ *
+ * Zero it before using it. Each job submitted with it adds one, and each
+ *  one that finishes takes one away.
+ */
+struct purpl_job_counter {
+	SDL_atomic_t count; /**< The number of jobs left */
+};
+
+/**
+ * @brief This is an internal structure for a submitted job, don't mess
+ *  with it
+ */
+struct purpl_job {
+	purpl_job_func func;
+	purpl_range_func range;
+	void *data;
+	size_t start;
+	size_t end;
+	struct purpl_job_counter *counter;
+};
+
+/**
+ * @brief This is an internal structure for a worker's queue, don't mess
+ *  with it
+ *
+ * This is a Chase-Lev deque: the worker that owns it pushes and pops jobs at
+ *  the bottom, and other workers steal them from the top. Only taking the
+ *  last job needs a compare and swap.
+ */
+struct purpl_job_deque {
+	struct purpl_job **jobs;
+	u32 mask;
+	char pad0[64];
+	SDL_atomic_t top; /* Stolen from */
+	char pad1[64];
+	SDL_atomic_t bottom; /* Only changed by the owner */
+	char pad2[64];
+};
+
+/**
+ * @brief This is an internal structure for a worker, don't mess with it
+ */
+struct purpl_job_worker {
+	struct purpl_jobs *jobs;
+	struct purpl_job_deque deque;
+	SDL_Thread *thread;
+	u32 rng;
+	u64 executed;
+	u64 stolen;
+};
+
+/**
+ * @brief The state of an instance's job system
+ */
+struct purpl_jobs {
+	struct purpl_job_worker *workers; /**< The workers, where the first
+					       is the thread that started the
+					       job system */
+	uint count; /**< The number of workers, including the first */
+	SDL_mutex *lock; /**< Protects `injected` */
+	struct purpl_job **injected; /**< Jobs from threads without a queue,
+					  see `stb_ds.h` */
+	SDL_atomic_t ninjected; /**< The length of `injected` */
+	SDL_sem *wake; /**< Posted when there's work for sleeping workers */
+	SDL_atomic_t sleeping; /**< The number of sleeping workers */
+	SDL_atomic_t quit; /**< Tells the workers to stop */
+};
+
+/**
+ * @brief Statistics for one of the job system's workers
+ */
+struct purpl_job_stats {
+	u64 executed; /**< The jobs it's run */
+	u64 stolen; /**< How many of those it stole from other workers */
+};
+
+/**
+ * @brief Start the job system for an instance
+ *
+ * @param inst is the instance
+ * @param workers is the number of threads to start (0 means one less than
+ *  the number of CPUs). The thread calling this also runs jobs while it's
+ *  waiting for them.
+ *
+ * @return Returns 0 or sets and returns `errno`. If the job system was
+ *  already started, returns `EEXIST`.
+ *
+ * Call this from the thread that runs `purpl_inst_run`. Each worker has its
+ *  own queue, and idle workers steal from the others, so jobs submitted from
+ *  a job spread out on their own.
+ */
+extern int purpl_inst_start_jobs(struct purpl_inst *inst, uint workers);
+
+/**
+ * @brief Submit a job
+ *
+ * @param inst is the instance
+ * @param func is the job
+ * @param data is passed to `func`
+ * @param counter is an optional counter to wait on with
+ *  `purpl_inst_wait_for_jobs`
+ *
+ * @return Returns 0 or sets and returns `errno`.
+ *
+ * This can be called from any thread, including from jobs. If the job system
+ *  isn't running, the job runs before this returns.
+ */
+extern int purpl_inst_submit_job(struct purpl_inst *inst, purpl_job_func func,
+				 void *data, struct purpl_job_counter *counter);
+
+/**
+ * @brief Wait for the jobs submitted with a counter to finish
+ *
+ * @param inst is the instance
+ * @param counter is the counter
+ *
+ * This runs other jobs while it waits, so it's safe to call from a job, and
+ *  that's how to make one job depend on others.
+ */
+extern void purpl_inst_wait_for_jobs(struct purpl_inst *inst,
+				     struct purpl_job_counter *counter);
+
+/**
+ * @brief Split a range into jobs and wait for them to finish
+ *
+ * @param inst is the instance
+ * @param count is the number of items
+ * @param batch is the most items in each job (0 means enough for about four
+ *  jobs per worker)
+ * @param func handles each batch
+ * @param data is passed to `func`
+ *
+ * @return Returns 0 or sets and returns `errno`.
+ */
+extern int purpl_inst_parallel_for(struct purpl_inst *inst, size_t count,
+				   size_t batch, purpl_range_func func,
+				   void *data);
+
+/**
+ * @brief Get statistics for the job system's workers
+ *
+ * @param inst is the instance
+ * @param stats receives one entry for each worker (`inst->jobs->count`)
+ */
+extern void purpl_inst_get_job_stats(struct purpl_inst *inst,
+				     struct purpl_job_stats *stats);
+
+/**
+ * @brief Run any jobs left and stop the job system
+ *
+ * @param inst is the instance
+ *
+ * `purpl_end_inst` calls this.
+ */
+extern void purpl_inst_stop_jobs(struct purpl_inst *inst);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !PURPL_JOB_H */
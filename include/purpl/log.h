@@ -19,9 +19,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 #include <time.h>
 
+#include <SDL.h>
+
+#include <stb_ds.h>
 #include <stb_sprintf.h>
 
 #include "types.h"
@@ -52,18 +56,201 @@ enum purpl_log_level {
 	PURPL_DEBUG
 };
 
+/**
+ * @brief The highest message level compiled in
+ *
+ * Messages logged through the `PURPL_LOG` macros at a higher level than this
+ *  are compiled out, arguments and all. It's `PURPL_DEBUG` in debug builds and
+ *  `PURPL_INFO` in release builds, and can be overridden by defining it.
+ */
+#ifndef PURPL_LOG_MAX_LEVEL
+#ifdef NDEBUG
+#define PURPL_LOG_MAX_LEVEL PURPL_INFO
+#else
+#define PURPL_LOG_MAX_LEVEL PURPL_DEBUG
+#endif
+#endif
+
+/**
+ * @brief The most bytes of a message (after formatting) that fit in an
+ *  asynchronous log record. Longer messages are truncated.
+ */
+#define PURPL_LOG_MSG_SIZE 232
+
+/**
+ * @brief The default number of records in an asynchronous logger's ring
+ */
+#define PURPL_LOG_DEFAULT_RING 4096
+
+/**
+ * @brief What an asynchronous logger does when its ring is full
+ */
+enum purpl_log_policy {
+	PURPL_LOG_DROP, /**< Drop the message and count it (fatal and WTF
+			     messages still wait) */
+	PURPL_LOG_BLOCK /**< Wait for the writer thread to make room */
+};
+
+/**
+ * @brief The first four bytes of a binary log
+ */
+#define PURPL_LOG_BINARY_MAGIC "PLOG"
+
+/**
+ * @brief The version of the binary log format
+ */
+#define PURPL_LOG_BINARY_VERSION 1
+
+/**
+ * @brief The kinds of entry in a binary log
+ *
+ * A binary log starts with `PURPL_LOG_BINARY_MAGIC` and a u32 version, then
+ *  has entries that each start with one of these as a u8. Everything is in
+ *  host byte order.
+ *
+ * - `PURPL_LOG_BINARY_STRING` defines a string the first time it's used: a
+ *   u32 ID (IDs count up from 0), a u16 length, then the string.
+ * - `PURPL_LOG_BINARY_MESSAGE` is a message: a u8 level, u32 format string
+ *   ID, u32 file name ID, u32 line, u64 time, u16 argument size, then the
+ *   arguments. Each `*` and integer, float, and pointer argument is 8 bytes,
+ *   and each string is a u16 length followed by its characters. If the
+ *   arguments didn't fit, they stop early.
+ *
+ * Use `tools/logdec` to turn a binary log into text.
+ */
+enum purpl_log_binary_entry {
+	PURPL_LOG_BINARY_STRING,
+	PURPL_LOG_BINARY_MESSAGE
+};
+
+/**
+ * @brief This is an internal structure for the IDs of strings (by address)
+ *  in a binary log, don't mess with it
+ */
+struct purpl_log_string {
+	const char *key;
+	u32 value;
+};
+
+/**
+ * @brief This is an internal structure for the state of a binary log, don't
+ *  mess with it
+ */
+struct purpl_log_binary {
+	struct purpl_log_string *strings;
+	u32 next_id;
+	SDL_mutex *lock; /* Protects the strings and the file */
+};
+
+/**
+ * @brief This is an internal structure for a message waiting to be written
+ *  by an asynchronous logger, don't mess with it
+ */
+struct purpl_log_record {
+	SDL_atomic_t seq;
+	u16 len;
+	u8 index;
+	u8 level;
+	int line;
+	const char *file;
+	const char *fmt;
+	time_t time;
+	char msg[PURPL_LOG_MSG_SIZE];
+};
+
+/**
+ * @brief This is an internal structure for an asynchronous logger's ring
+ *  and writer thread, don't mess with it
+ *
+ * This is a bounded multi-producer queue (Dmitry Vyukov's design), where each
+ *  record's sequence number says whether it's free for the next producer or
+ *  ready for the writer. The producers and the writer touch different cache
+ *  lines.
+ */
+struct purpl_log_ring {
+	struct purpl_log_record *records;
+	u32 mask;
+	enum purpl_log_policy policy;
+	SDL_Thread *thread;
+	SDL_sem *wake;
+	char pad0[64];
+	SDL_atomic_t head; /* Claimed by producers */
+	SDL_atomic_t dropped;
+	char pad1[64];
+	u32 tail; /* Only touched by the writer */
+	SDL_atomic_t sleeping;
+	SDL_atomic_t quit;
+};
+
 /**
  * @brief Holds information about log files to be used with the
  *  logging functions
  */
 struct purpl_logger {
 	FILE **logs; /**< The log files this logger can use */
+	struct purpl_log_binary
+		*binary[PURPL_MAX_LOGS]; /**< The state of each binary log */
+	struct purpl_log_ring *ring; /**< The ring if the logger is
+					  asynchronous */
 	u8 nlogs : 6; /**< The number of logs open */
 	u8 default_index : 6; /**< The default log */
 	u8 default_level : 3; /**< The default log level */
 	u8 max_level[PURPL_MAX_LOGS]; /**< The max level to write for each log */
+	SDL_SpinLock written_lock; /**< Protects `written` */
+	u64 written; /**< The bytes written to all the logs */
 };
 
+/**
+ * @brief Whether a message would be written
+ *
+ * @param logger is the logger
+ * @param index is the index of the log (-1 means the default)
+ * @param level is the message level (-1 means the default)
+ *
+ * This is true if `level` is compiled in and isn't above the log's max level.
+ *  It's cheap enough to check before doing any work to build a message.
+ */
+#define PURPL_LOG_ENABLED(logger, index, level)                        \
+	((level) <= PURPL_LOG_MAX_LEVEL && (logger) &&                 \
+	 (((level) < 0) ? (logger)->default_level : (level)) <=        \
+		 (logger)->max_level[(((index) < 0) ?                  \
+					      (logger)->default_index : \
+					      (index)) &                \
+				     0x3F])
+
+/**
+ * @brief Writes a message to a log if its level is enabled
+ *
+ * @param logger is the logger
+ * @param index is the index of the log (-1 means the default)
+ * @param level is the message level (-1 means the default)
+ *
+ * The rest of the arguments are the format string and its arguments, which
+ *  aren't evaluated unless the message will actually be written. Use this (or
+ *  the level-specific versions) instead of calling `purpl_write_log` directly.
+ */
+#define PURPL_LOG(logger, index, level, ...)                                \
+	do {                                                                \
+		if (PURPL_LOG_ENABLED(logger, index, level))                \
+			purpl_write_log(logger, __FILENAME__, __LINE__,     \
+					index, level, __VA_ARGS__);         \
+	} while (0)
+
+/**
+ * @brief Write a message at a specific level to the default log
+ */
+#define PURPL_LOG_WTF(logger, ...) PURPL_LOG(logger, -1, PURPL_WTF, __VA_ARGS__)
+#define PURPL_LOG_FATAL(logger, ...) \
+	PURPL_LOG(logger, -1, PURPL_FATAL, __VA_ARGS__)
+#define PURPL_LOG_ERROR(logger, ...) \
+	PURPL_LOG(logger, -1, PURPL_ERROR, __VA_ARGS__)
+#define PURPL_LOG_WARNING(logger, ...) \
+	PURPL_LOG(logger, -1, PURPL_WARNING, __VA_ARGS__)
+#define PURPL_LOG_INFO(logger, ...) \
+	PURPL_LOG(logger, -1, PURPL_INFO, __VA_ARGS__)
+#define PURPL_LOG_DEBUG(logger, ...) \
+	PURPL_LOG(logger, -1, PURPL_DEBUG, __VA_ARGS__)
+
 /**
  * @brief Initializes a `purpl_logger` structure
  * 
@@ -99,6 +286,26 @@ extern struct purpl_logger *purpl_init_logger(u8 *first_index_ret,
 extern int purpl_open_log(struct purpl_logger *logger, s8 max_level,
 			  const char *path, ...);
 
+/**
+ * @brief Opens a binary log file for a `purpl_logger` structure
+ *
+ * @param logger is the logger structure to add the log to
+ * @param max_level is the max message level for the log. -1 means use the
+ *  default
+ * @param path is the path to the log file
+ *
+ * @return Returns the index of the log opened.
+ *
+ * Messages written to a binary log aren't formatted. Instead, the addresses
+ *  of the format string and file name and the raw arguments are written,
+ *  which is much faster and smaller. Each format string and file name is
+ *  written once, the first time it's used, so they have to be string
+ *  literals (or at least stay the same while the log is open). See
+ *  `enum purpl_log_binary_entry` for the format.
+ */
+extern int purpl_open_binary_log(struct purpl_logger *logger, s8 max_level,
+				 const char *path, ...);
+
 /**
  * @brief Writes a message to a log
  * 
@@ -109,23 +316,71 @@ extern int purpl_open_log(struct purpl_logger *logger, s8 max_level,
  * @param level is the message level
  * @param fmt the format string to be logged
  * 
- * @return Returns the number of bytes written.
+ * @return Returns the number of bytes written (or queued, if the logger is
+ *  asynchronous), or 0 if the level is above the log's max.
  * 
  * Writes a message to a log opened by a `purpl_logger` structure indicated
  *  by `index`. Don't be an idiot, use the right format specifiers so that 
- *  your code is less vulnerable.
+ *  your code is less vulnerable. The level is checked before the message is
+ *  formatted, but the arguments still get evaluated, so prefer the
+ *  `PURPL_LOG` macros.
  */
 extern size_t purpl_write_log(struct purpl_logger *logger, const char *file,
 			      const int line, s8 index, s8 level,
 			      const char *fmt, ...);
 
+/**
+ * @brief Make a logger asynchronous
+ *
+ * @param logger is the logger
+ * @param capacity is the number of messages that can be waiting at once,
+ *  rounded up to a power of two (0 means `PURPL_LOG_DEFAULT_RING`)
+ * @param policy is what to do when that many messages are waiting
+ *
+ * @return Returns 0 or sets and returns `errno`.
+ *
+ * After this, `purpl_write_log` only formats the message into a fixed-size
+ *  record and pushes it onto a lock-free ring. A writer thread adds the time
+ *  and level, writes records in batches, and flushes once per batch. Open
+ *  any logs you need before calling this.
+ */
+extern int purpl_start_async_log(struct purpl_logger *logger, u32 capacity,
+				 enum purpl_log_policy policy);
+
+/**
+ * @brief Write any waiting messages and make a logger synchronous again
+ *
+ * @param logger is the logger
+ *
+ * `purpl_end_logger` calls this.
+ */
+extern void purpl_stop_async_log(struct purpl_logger *logger);
+
+/**
+ * @brief Get the number of messages an asynchronous logger has dropped
+ *
+ * @param logger is the logger
+ *
+ * @return Returns the number of messages dropped because the ring was full.
+ */
+extern u32 purpl_log_dropped(struct purpl_logger *logger);
+
+/**
+ * @brief Get the number of bytes a logger has written
+ *
+ * @param logger is the logger
+ *
+ * @return Returns the bytes written to all of the logger's logs so far.
+ */
+extern u64 purpl_log_written(struct purpl_logger *logger);
+
 /**
  * @brief Sets the max level for the specified log
  * 
  * @param logger is the logger to operate on
  * @param index is the index of the log to change
  * @param level is the new max level for the specified index
- * @return Returns `level`
+ * @return Returns `level`, or -1 if there's no log at `index`
  */
 extern s8 purpl_set_max_level(struct purpl_logger *logger, u8 index, u8 level);
 
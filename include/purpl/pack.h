@@ -0,0 +1,254 @@
+/**
+ * @file pack.h
+ * @author MobSlicer152 (brambleclaw1414@gmail.com)
+ * @brief The engine's own asset pack format
+ *
+ * @copyright Copyright (c) MobSlicer152 2021
+ * This software is provided 'as-is', without any express or implied warranty. In no event will the authors be held liable for any damages arising from the use of this software.
+ * Permission is granted to anyone to use this software for any purpose, including commercial applications, and to alter it and redistribute it freely, subject to the following restrictions:
+ * 1. The origin of this software must not be misrepresented; you must not claim that you wrote the original software. If you use this software in a product, an acknowledgment in the product documentation would be appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#pragma once
+
+#ifndef PURPL_PACK_H
+#define PURPL_PACK_H 1
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+
+#include "types.h"
+#include "util.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief The first four bytes of a pack
+ */
+#define PURPL_PACK_MAGIC "PPAK"
+
+/**
+ * @brief The version of the pack format this code reads and writes
+ */
+#define PURPL_PACK_VERSION 1
+
+/**
+ * @brief The alignment of each entry's data within a pack
+ */
+#define PURPL_PACK_ALIGN 64
+
+/**
+ * @brief Set in an entry's flags if its data is zlib-compressed
+ */
+#define PURPL_PACK_DEFLATE (1 << 0)
+
+/**
+ * @brief The header at the start of a pack
+ *
+ * Everything in a pack is little-endian. The header is followed by the table
+ *  of contents (`count` entries, sorted by `hash`, then by name), then the
+ *  names, then the data of each entry. Each entry's data starts on a
+ *  `PURPL_PACK_ALIGN` byte boundary and is always followed by at least one
+ *  0 byte, so uncompressed text can be used in place.
+ */
+struct purpl_pack_header {
+	char magic[4]; /**< `PURPL_PACK_MAGIC` */
+	u32 version; /**< `PURPL_PACK_VERSION` */
+	u32 count; /**< The number of entries */
+	u32 flags; /**< Reserved */
+	u64 toc_offset; /**< The offset of the table of contents */
+	u64 names_offset; /**< The offset of the names */
+	u64 names_size; /**< The size of the names */
+	u64 size; /**< The size of the whole pack */
+};
+
+/**
+ * @brief An entry in a pack's table of contents
+ */
+struct purpl_pack_entry {
+	u64 hash; /**< The hash of the entry's path (see `purpl_hash_path`) */
+	u64 offset; /**< The offset of the entry's data from the start */
+	u64 size; /**< The size of the data as stored */
+	u64 raw_size; /**< The size of the data once decompressed */
+	u32 name_offset; /**< The offset of the path within the names */
+	u32 name_len; /**< The length of the path, excluding its terminator */
+	u32 checksum; /**< The CRC-32 of the decompressed data */
+	u32 flags; /**< `PURPL_PACK_DEFLATE` or 0 */
+};
+
+/**
+ * @brief A pack that's been loaded from memory
+ */
+struct purpl_pack {
+	const char *data; /**< The start of the pack */
+	size_t size; /**< The size of the pack */
+	const struct purpl_pack_header *hdr; /**< The header */
+	const struct purpl_pack_entry *toc; /**< The table of contents */
+	const char *names; /**< The names of the entries */
+};
+
+/**
+ * @brief This is an internal structure for files waiting to be written to a
+ *  pack, don't mess with it
+ */
+struct purpl_pack_file {
+	struct purpl_pack_entry entry;
+	char *name;
+	char *data;
+	bool owned;
+};
+
+/**
+ * @brief Collects files and writes them to a pack
+ */
+struct purpl_pack_writer {
+	struct purpl_pack_file *files; /**< The files to write, see `stb_ds.h` */
+	u64 names_size; /**< The total size of the names */
+};
+
+/**
+ * @brief Hash a path the way packs do (64-bit FNV-1a)
+ *
+ * @param path is the path to hash
+ *
+ * @return Returns the hash of `path`.
+ */
+extern u64 purpl_hash_path(const char *path);
+
+/**
+ * @brief Calculate or continue a CRC-32
+ *
+ * @param crc is 0, or the result of a previous call to continue from
+ * @param data is the data to checksum
+ * @param len is the length of `data`
+ *
+ * @return Returns the CRC-32 of everything passed so far.
+ */
+extern u32 purpl_crc32(u32 crc, const void *data, size_t len);
+
+/**
+ * @brief Load a pack from memory
+ *
+ * @param data is the start of the pack (it has to stay valid until
+ *  `purpl_free_pack` is called)
+ * @param size is the size of the pack
+ *
+ * @return Returns `NULL` or a `purpl_pack` structure. Sets `errno` to
+ *  `EILSEQ` if the pack is malformed.
+ */
+extern struct purpl_pack *purpl_load_pack(const void *data, size_t size);
+
+/**
+ * @brief Check whether a block of memory starts with a pack header
+ *
+ * @param data is the memory to check
+ * @param size is the size of `data`
+ *
+ * @return Returns true if `data` looks like a pack.
+ */
+extern bool purpl_is_pack(const void *data, size_t size);
+
+/**
+ * @brief Find an entry in a pack
+ *
+ * @param pack is the pack to search
+ * @param path is the path of the entry
+ *
+ * @return Returns the entry or `NULL` (with `errno` set to `ENOENT`).
+ *
+ * This is a binary search over the hashes in the table of contents, so it
+ *  doesn't touch any names unless the hashes match.
+ */
+extern const struct purpl_pack_entry *
+purpl_find_pack_entry(const struct purpl_pack *pack, const char *path);
+
+/**
+ * @brief Get the path of an entry in a pack
+ *
+ * @param pack is the pack containing `entry`
+ * @param entry is the entry
+ *
+ * @return Returns the entry's path.
+ */
+extern const char *purpl_pack_entry_name(const struct purpl_pack *pack,
+					 const struct purpl_pack_entry *entry);
+
+/**
+ * @brief Get the data of an entry in a pack
+ *
+ * @param pack is the pack containing `entry`
+ * @param entry is the entry to read
+ * @param copied_ret receives whether the data was decompressed into a new
+ *  buffer (which has to be `free`d) or points into the pack
+ *
+ * @return Returns the data (always followed by a 0 byte), or `NULL`. Sets
+ *  `errno` to `EILSEQ` if the data doesn't match its checksum.
+ *
+ * Uncompressed entries are only checksummed in debug builds, so that they
+ *  aren't touched until they're used.
+ */
+extern char *purpl_read_pack_entry(const struct purpl_pack *pack,
+				   const struct purpl_pack_entry *entry,
+				   bool *copied_ret);
+
+/**
+ * @brief Free a pack loaded with `purpl_load_pack` (not the memory it's in)
+ *
+ * @param pack is the pack to free
+ */
+extern void purpl_free_pack(struct purpl_pack *pack);
+
+/**
+ * @brief Create a pack writer
+ *
+ * @return Returns `NULL` or a new `purpl_pack_writer` structure.
+ */
+extern struct purpl_pack_writer *purpl_create_pack_writer(void);
+
+/**
+ * @brief Add a file to a pack writer
+ *
+ * @param writer is the writer to add the file to
+ * @param name is the path to store the file under (use forward slashes)
+ * @param data is the file's data (it's copied if it gets compressed,
+ *  otherwise it has to stay valid until the pack is written)
+ * @param size is the size of `data`
+ * @param compress is whether to try compressing the file. It's stored as-is
+ *  if compression doesn't save at least an eighth of its size.
+ *
+ * @return Returns 0 or sets and returns `errno`.
+ */
+extern int purpl_pack_writer_add(struct purpl_pack_writer *writer,
+				 const char *name, const void *data,
+				 size_t size, bool compress);
+
+/**
+ * @brief Write the files added to a writer to a pack
+ *
+ * @param writer is the writer
+ * @param fp is the file to write the pack to
+ *
+ * @return Returns the size of the pack, or 0 (with `errno` set) on failure.
+ */
+extern size_t purpl_write_pack(struct purpl_pack_writer *writer, FILE *fp);
+
+/**
+ * @brief Free a pack writer
+ *
+ * @param writer is the writer to free
+ */
+extern void purpl_free_pack_writer(struct purpl_pack_writer *writer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !PURPL_PACK_H */
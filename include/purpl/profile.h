@@ -0,0 +1,254 @@
+/**
+ * @file profile.h
+ * @author MobSlicer152 (brambleclaw1414@gmail.com)
+ * @brief Finding out where the time goes
+ *
+ * @copyright Copyright (c) MobSlicer152 2021
+ * This software is provided 'as-is', without any express or implied warranty. In no event will the authors be held liable for any damages arising from the use of this software.
+ * Permission is granted to anyone to use this software for any purpose, including commercial applications, and to alter it and redistribute it freely, subject to the following restrictions:
+ * 1. The origin of this software must not be misrepresented; you must not claim that you wrote the original software. If you use this software in a product, an acknowledgment in the product documentation would be appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#pragma once
+
+#ifndef PURPL_PROFILE_H
+#define PURPL_PROFILE_H 1
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include <SDL.h>
+
+#include <stb_ds.h>
+
+#include "types.h"
+#include "util.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Whether the profiling macros do anything. Define this as 0 to
+ *  compile them out.
+ */
+#ifndef PURPL_PROFILE
+#define PURPL_PROFILE 1
+#endif
+
+/**
+ * @brief The most events each thread can record during a capture. Events
+ *  after that are dropped.
+ */
+#ifndef PURPL_PROFILE_BUFFER_SIZE
+#define PURPL_PROFILE_BUFFER_SIZE 65536
+#endif
+
+/**
+ * @brief The most zones that can be open at once on a thread
+ */
+#define PURPL_PROFILE_MAX_DEPTH 32
+
+/**
+ * @brief The most different zones a frame summary can hold
+ */
+#define PURPL_PROFILE_MAX_ZONES 64
+
+/**
+ * @brief The version of the binary capture format
+ */
+#define PURPL_PROFILE_VERSION 1
+
+#if PURPL_PROFILE
+/**
+ * @brief Start a zone, which has to be ended with `PURPL_PROFILE_END` on
+ *  the same thread
+ *
+ * @param name is the name of the zone. Only the pointer is kept, so it has to
+ *  be a string literal or last as long.
+ */
+#define PURPL_PROFILE_BEGIN(name) purpl_profile_begin(name)
+
+/**
+ * @brief End the last zone started on this thread
+ */
+#define PURPL_PROFILE_END() purpl_profile_end()
+
+/**
+ * @brief Mark the end of a frame on this thread, see `purpl_profile_frame`
+ */
+#define PURPL_PROFILE_FRAME() purpl_profile_frame()
+#else
+#define PURPL_PROFILE_BEGIN(name) ((void)0)
+#define PURPL_PROFILE_END() ((void)0)
+#define PURPL_PROFILE_FRAME() ((void)0)
+#endif
+
+/**
+ * @brief Formats a capture can be exported in
+ */
+enum purpl_profile_format {
+	PURPL_PROFILE_CHROME, /**< Chrome's `trace_event` JSON, which
+			           chrome://tracing and Perfetto can open */
+	PURPL_PROFILE_BINARY, /**< A compact binary format: "PPRF", the
+				   version, a string table, then each thread's
+				   events */
+};
+
+/**
+ * @brief The type of an event
+ */
+enum purpl_profile_event_type {
+	PURPL_PROFILE_ZONE_BEGIN,
+	PURPL_PROFILE_ZONE_END,
+};
+
+/**
+ * @brief This is an internal structure for a recorded event, don't mess
+ *  with it
+ */
+struct purpl_profile_event {
+	const char *name;
+	u64 time;
+	u8 type;
+};
+
+/**
+ * @brief The time spent in one zone during a frame
+ */
+struct purpl_profile_zone {
+	const char *name; /**< The name of the zone */
+	u32 depth; /**< How many zones it was inside of (the least, if it was
+		        entered more than once) */
+	u32 count; /**< How many times it was entered */
+	u64 total; /**< The time spent in it, in nanoseconds */
+};
+
+/**
+ * @brief A summary of a frame, for showing in an overlay
+ */
+struct purpl_profile_frame {
+	u64 start; /**< When the frame started, from `purpl_get_time_ns` */
+	u64 duration; /**< How long the frame took in nanoseconds */
+	struct purpl_profile_zone
+		zones[PURPL_PROFILE_MAX_ZONES]; /**< The zones that ended during
+						     the frame, in the order
+						     they first ended */
+	u32 zone_count; /**< The number of zones */
+};
+
+/**
+ * @brief This is an internal structure for a thread's profiling state,
+ *  don't mess with it
+ */
+struct purpl_profile_thread {
+	struct purpl_profile_thread *next;
+	u32 id;
+	const char *name;
+	struct purpl_profile_event *events;
+	SDL_atomic_t count;
+	SDL_atomic_t dropped;
+	SDL_atomic_t generation;
+	const char *stack[PURPL_PROFILE_MAX_DEPTH];
+	u64 starts[PURPL_PROFILE_MAX_DEPTH];
+	bool recorded[PURPL_PROFILE_MAX_DEPTH];
+	u32 depth;
+	u32 overflow;
+	bool framed;
+	struct purpl_profile_frame current;
+	struct purpl_profile_frame last;
+};
+
+/**
+ * @brief Start a zone, use `PURPL_PROFILE_BEGIN` instead
+ *
+ * @param name is the name of the zone
+ */
+extern void purpl_profile_begin(const char *name);
+
+/**
+ * @brief End a zone, use `PURPL_PROFILE_END` instead
+ */
+extern void purpl_profile_end(void);
+
+/**
+ * @brief Mark the end of a frame on this thread
+ *
+ * After this has been called once on a thread, the zones that thread ends
+ *  are added up for each frame, and `purpl_profile_get_frame` returns the
+ *  totals for the last one. `purpl_inst_run` and `purpl_inst_run_fixed` call
+ *  this at the end of every frame.
+ */
+extern void purpl_profile_frame(void);
+
+/**
+ * @brief Get a summary of the last frame on this thread
+ *
+ * @param frame receives the summary
+ *
+ * @return Returns false if this thread hasn't finished a frame yet.
+ */
+extern bool purpl_profile_get_frame(struct purpl_profile_frame *frame);
+
+/**
+ * @brief Name the calling thread in captures
+ *
+ * @param name is the name, which has to last as long as the profiler
+ */
+extern void purpl_profile_name_thread(const char *name);
+
+/**
+ * @brief Start recording events, throwing away the last capture
+ *
+ * Until this is called, zones only count towards the frame summaries.
+ */
+extern void purpl_profile_start_capture(void);
+
+/**
+ * @brief Stop recording events
+ *
+ * @return Returns the number of events that didn't fit in their thread's
+ *  buffer.
+ */
+extern u64 purpl_profile_stop_capture(void);
+
+/**
+ * @brief Write the last capture to a file
+ *
+ * @param format is the format to write
+ * @param path is the path to the file
+ *
+ * @return Returns 0 or sets and returns `errno`.
+ *
+ * This can be called during a capture, in which case it writes what's been
+ *  recorded so far.
+ */
+extern int purpl_profile_export(enum purpl_profile_format format,
+				const char *path, ...);
+
+/**
+ * @brief Free the calling thread's profiler state
+ *
+ * Threads that used the profiler call this before they exit, after which
+ *  their events are no longer in exports. Using the profiler again on the
+ *  same thread starts over with new state.
+ */
+extern void purpl_profile_release_thread(void);
+
+/**
+ * @brief Stop capturing and free the calling thread's profiler state
+ *
+ * Other threads keep their state until they call
+ *  `purpl_profile_release_thread`, so this is safe to call while they're still
+ *  running. `purpl_end_inst` calls this.
+ */
+extern void purpl_profile_shutdown(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !PURPL_PROFILE_H */
@@ -18,9 +18,21 @@
 
 #include "app_info.h"
 #include "asset.h"
+#include "atlas.h"
+#include "batch.h"
+#include "ecs.h"
+#include "input.h"
 #include "inst.h"
+#include "job.h"
 #include "log.h"
+#include "pack.h"
+#include "profile.h"
+#include "render.h"
+#include "sprite.h"
+#include "stream.h"
+#include "transform.h"
 #include "types.h"
 #include "util.h"
+#include "watch.h"
 
 #endif /* !PURPL_H */
@@ -0,0 +1,382 @@
+/**
+ * @file render.h
+ * @author MobSlicer152 (brambleclaw1414@gmail.com)
+ * @brief Sorted, renderer-agnostic draw submission
+ *
+ * @copyright Copyright (c) MobSlicer152 2021
+ * This software is provided 'as-is', without any express or implied warranty. In no event will the authors be held liable for any damages arising from the use of this software.
+ * Permission is granted to anyone to use this software for any purpose, including commercial applications, and to alter it and redistribute it freely, subject to the following restrictions:
+ * 1. The origin of this software must not be misrepresented; you must not claim that you wrote the original software. If you use this software in a product, an acknowledgment in the product documentation would be appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#pragma once
+
+#ifndef PURPL_RENDER_H
+#define PURPL_RENDER_H 1
+
+#include <stdbool.h>
+
+#include <SDL.h>
+
+#include <stb_ds.h>
+
+#include "inst.h"
+#include "types.h"
+#include "util.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Make a sort key. Items are drawn in order of their keys, so the pass
+ *  matters most, then the material (so items that share state are drawn
+ *  together), then the depth.
+ *
+ * @param pass is the pass (8 bits)
+ * @param material is the material (24 bits)
+ * @param depth is the depth, see `purpl_render_depth` (32 bits)
+ *
+ * Items with the same key are drawn in the order each thread recorded them.
+ */
+#define PURPL_RENDER_KEY(pass, material, depth)         \
+	(((u64)((pass)&0xFF) << 56) |                   \
+	 ((u64)((material)&0xFFFFFF) << 32) | (u64)(u32)(depth))
+
+/**
+ * @brief Get the parts of a sort key
+ */
+#define PURPL_RENDER_KEY_PASS(key) ((u8)((key) >> 56))
+#define PURPL_RENDER_KEY_MATERIAL(key) ((u32)((key) >> 32) & 0xFFFFFF)
+#define PURPL_RENDER_KEY_DEPTH(key) ((u32)(key))
+
+/**
+ * @brief Pack a color, each part from 0 to 255
+ */
+#define PURPL_RGBA(r, g, b, a)                                       \
+	(((u32)((r)&0xFF) << 24) | ((u32)((g)&0xFF) << 16) |         \
+	 ((u32)((b)&0xFF) << 8) | (u32)((a)&0xFF))
+
+/**
+ * @brief The types of draw commands
+ */
+enum purpl_render_cmd_type {
+	PURPL_RENDER_CLEAR, /**< Clear the screen to `color` */
+	PURPL_RENDER_RECT, /**< Fill a rectangle with `color` */
+	PURPL_RENDER_SPRITE, /**< Draw part of `texture` in a rectangle,
+				  tinted by `color` (see `sprite.h`) */
+	PURPL_RENDER_CMD_TYPES, /**< The number of types */
+};
+
+/**
+ * @brief A draw command
+ */
+struct purpl_render_cmd {
+	u64 key; /**< The sort key, see `PURPL_RENDER_KEY` */
+	u32 type; /**< The type of the command, see `purpl_render_cmd_type` */
+	u32 color; /**< The color, see `PURPL_RGBA` */
+	float x; /**< The left of the rectangle in pixels */
+	float y; /**< The top of the rectangle in pixels */
+	float w; /**< The width of the rectangle in pixels */
+	float h; /**< The height of the rectangle in pixels */
+	u32 texture; /**< The texture of a sprite */
+	float u0; /**< The left of the part of the texture, from 0 to 1 */
+	float v0; /**< The top of the part of the texture, from 0 to 1 */
+	float u1; /**< The right of the part of the texture, from 0 to 1 */
+	float v1; /**< The bottom of the part of the texture, from 0 to 1 */
+};
+
+/**
+ * @brief A command and its key, which is what gets sorted
+ */
+struct purpl_render_item {
+	u64 key; /**< The command's sort key */
+	const struct purpl_render_cmd *cmd; /**< The command */
+};
+
+struct purpl_renderer;
+
+/**
+ * @brief The functions that turn sorted commands into drawing
+ */
+struct purpl_render_backend {
+	const char *name; /**< The name of the backend */
+
+	/**
+	 * @brief Set up the backend, which can put its state in
+	 *  `renderer->data`. Returns 0 or sets and returns `errno`. This
+	 *  can be `NULL`.
+	 */
+	int (*init)(struct purpl_renderer *renderer);
+
+	/**
+	 * @brief Start a frame that's `width` by `height` pixels. This can
+	 *  be `NULL`.
+	 */
+	void (*begin)(struct purpl_renderer *renderer, int width, int height);
+
+	/**
+	 * @brief Draw the frame's commands, sorted by key
+	 */
+	void (*submit)(struct purpl_renderer *renderer,
+		       const struct purpl_render_item *items, size_t count);
+
+	/**
+	 * @brief Free the backend's state. This can be `NULL`.
+	 */
+	void (*shutdown)(struct purpl_renderer *renderer);
+
+	/**
+	 * @brief Create a texture from RGBA pixels, returning a handle that
+	 *  isn't 0 and fits in a sort key's material, or 0 with `errno` set
+	 */
+	u32 (*create_texture)(struct purpl_renderer *renderer, const u8 *pixels,
+			      u32 width, u32 height);
+
+	/**
+	 * @brief Destroy a texture
+	 */
+	void (*destroy_texture)(struct purpl_renderer *renderer, u32 texture);
+};
+
+/**
+ * @brief This is an internal structure for the commands one thread recorded,
+ *  don't mess with it
+ */
+struct purpl_cmd_buffer {
+	SDL_threadID owner;
+	struct purpl_render_cmd *cmds;
+};
+
+/**
+ * @brief Counters for a renderer, see `purpl_render_get_stats`
+ */
+struct purpl_render_stats {
+	u64 frames; /**< The frames flushed */
+	u64 commands; /**< The commands flushed in total */
+	size_t last_commands; /**< The commands in the last frame */
+	size_t buffers; /**< The threads that have recorded commands */
+	u64 sort_time; /**< How long the last frame took to sort, in
+			    nanoseconds */
+	u64 submit_time; /**< How long the backend took with the last frame,
+			      in nanoseconds */
+};
+
+/**
+ * @brief A renderer. Commands are recorded from any thread into that thread's
+ *  buffer, then `purpl_render_flush` sorts them and hands them to the
+ *  backend.
+ */
+struct purpl_renderer {
+	const struct purpl_render_backend *backend; /**< The backend */
+	void *data; /**< The backend's state */
+	int width; /**< The width of the current frame */
+	int height; /**< The height of the current frame */
+	struct purpl_render_stats stats; /**< Counters */
+
+	/* Internal stuff, don't mess with it */
+	u32 id;
+	SDL_SpinLock lock;
+	struct purpl_cmd_buffer **buffers;
+	struct purpl_render_item *items;
+	struct purpl_render_item *sorted;
+};
+
+/**
+ * @brief What the null backend keeps track of, in `renderer->data`
+ */
+struct purpl_null_render_state {
+	u64 frames; /**< The frames submitted */
+	u64 items; /**< The items submitted in total */
+	u64 checksum; /**< A hash of every key in the order they came */
+	u64 unsorted; /**< The times a key came after a bigger one (this should
+			   always be 0) */
+	size_t counts[PURPL_RENDER_CMD_TYPES]; /**< The commands of each type
+						    in total */
+	u32 textures; /**< The textures created, which is also the last
+			   handle */
+};
+
+/**
+ * @brief A backend that doesn't draw anything, it just checks and counts what
+ *  it's given. This is for measuring the rest of the renderer without a GPU.
+ */
+extern const struct purpl_render_backend purpl_null_render_backend;
+
+#if PURPL_USE_OPENGL_GFX
+/**
+ * @brief A backend that draws with OpenGL 3.3 core. The context has to be
+ *  current when the renderer is created and flushed. Everything is drawn as
+ *  instanced quads from a streaming buffer, which stays mapped if
+ *  `GL_ARB_buffer_storage` is there.
+ */
+extern const struct purpl_render_backend purpl_gl_render_backend;
+#endif
+
+/**
+ * @brief Create a renderer
+ *
+ * @param backend is the backend to draw with
+ *
+ * @return Returns a renderer or `NULL` with `errno` set.
+ */
+extern struct purpl_renderer *
+purpl_create_renderer(const struct purpl_render_backend *backend);
+
+/**
+ * @brief Create a renderer for an instance, which `purpl_inst_run` flushes at
+ *  the end of each frame
+ *
+ * @param inst is the instance
+ * @param backend is the backend to draw with
+ *
+ * @return Returns 0 or sets and returns `errno`. If the instance already has
+ *  a renderer, returns `EEXIST`.
+ *
+ * `purpl_inst_init_graphics` does this with the backend for the graphics API,
+ *  so this is mostly for using the null backend without a window.
+ */
+extern int
+purpl_inst_create_renderer(struct purpl_inst *inst,
+			   const struct purpl_render_backend *backend);
+
+/**
+ * @brief Turn a depth into the depth part of a sort key
+ *
+ * @param depth is the depth
+ * @param back_to_front is whether further things should be drawn first (for
+ *  blending) instead of closer things (to save drawing hidden pixels)
+ *
+ * @return Returns a value that sorts the same way as `depth`, or the opposite
+ *  way if `back_to_front` is true.
+ */
+extern u32 purpl_render_depth(float depth, bool back_to_front);
+
+/**
+ * @brief Create a texture
+ *
+ * @param renderer is the renderer
+ * @param pixels is `width` by `height` RGBA pixels, top row first
+ * @param width is the width of the texture
+ * @param height is the height of the texture
+ *
+ * @return Returns a handle to use in commands, or 0 with `errno` set.
+ *
+ * Call this from the thread that flushes the renderer.
+ */
+extern u32 purpl_render_create_texture(struct purpl_renderer *renderer,
+				       const u8 *pixels, u32 width,
+				       u32 height);
+
+/**
+ * @brief Destroy a texture
+ *
+ * @param renderer is the renderer
+ * @param texture is the texture, which can't be used by any commands that
+ *  haven't been flushed
+ */
+extern void purpl_render_destroy_texture(struct purpl_renderer *renderer,
+					 u32 texture);
+
+/**
+ * @brief Start a frame
+ *
+ * @param renderer is the renderer
+ * @param width is the width of the frame in pixels
+ * @param height is the height of the frame in pixels
+ */
+extern void purpl_render_begin(struct purpl_renderer *renderer, int width,
+			       int height);
+
+/**
+ * @brief Add a command to the calling thread's buffer
+ *
+ * @param renderer is the renderer
+ * @param key is the command's sort key
+ *
+ * @return Returns a zeroed command with `key` filled in, for the caller to
+ *  fill in the rest of, or `NULL` with `errno` set. It's only valid until the
+ *  next command is added from the same thread.
+ *
+ * Any thread can record commands, but not while `purpl_render_flush` runs.
+ */
+extern struct purpl_render_cmd *
+purpl_render_push(struct purpl_renderer *renderer, u64 key);
+
+/**
+ * @brief Clear the screen
+ *
+ * @param renderer is the renderer
+ * @param pass is the pass to clear at the start of
+ * @param color is the color to clear to
+ *
+ * @return Returns 0 or sets and returns `errno`.
+ *
+ * The clear's key has material and depth 0, so it comes before anything else
+ *  in the pass that doesn't also have both at 0.
+ */
+extern int purpl_render_clear(struct purpl_renderer *renderer, u8 pass,
+			      u32 color);
+
+/**
+ * @brief Fill a rectangle
+ *
+ * @param renderer is the renderer
+ * @param key is the sort key
+ * @param x is the left of the rectangle in pixels
+ * @param y is the top of the rectangle in pixels
+ * @param w is the width of the rectangle in pixels
+ * @param h is the height of the rectangle in pixels
+ * @param color is the color
+ *
+ * @return Returns 0 or sets and returns `errno`.
+ */
+extern int purpl_render_rect(struct purpl_renderer *renderer, u64 key,
+			     float x, float y, float w, float h, u32 color);
+
+/**
+ * @brief Sort items by key
+ *
+ * @param items is the items
+ * @param tmp is space for as many items
+ * @param count is the number of items
+ *
+ * This is a stable radix sort, a byte at a time, that skips bytes that are
+ *  the same in every key. The result ends up in `items`.
+ */
+extern void purpl_render_sort(struct purpl_render_item *items,
+			      struct purpl_render_item *tmp, size_t count);
+
+/**
+ * @brief Sort every thread's commands, hand them to the backend, and empty
+ *  the buffers
+ *
+ * @param renderer is the renderer
+ *
+ * @return Returns the number of commands.
+ */
+extern size_t purpl_render_flush(struct purpl_renderer *renderer);
+
+/**
+ * @brief Get a renderer's counters
+ *
+ * @param renderer is the renderer
+ * @param stats receives the counters
+ */
+extern void purpl_render_get_stats(struct purpl_renderer *renderer,
+				   struct purpl_render_stats *stats);
+
+/**
+ * @brief Free a renderer and every thread's buffer
+ *
+ * @param renderer is the renderer to free
+ */
+extern void purpl_free_renderer(struct purpl_renderer *renderer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !PURPL_RENDER_H */
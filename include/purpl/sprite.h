@@ -0,0 +1,150 @@
+/**
+ * @file sprite.h
+ * @author MobSlicer152 (brambleclaw1414@gmail.com)
+ * @brief Texture atlases and sprite batching
+ *
+ * @copyright Copyright (c) MobSlicer152 2021
+ * This software is provided 'as-is', without any express or implied warranty. In no event will the authors be held liable for any damages arising from the use of this software.
+ * Permission is granted to anyone to use this software for any purpose, including commercial applications, and to alter it and redistribute it freely, subject to the following restrictions:
+ * 1. The origin of this software must not be misrepresented; you must not claim that you wrote the original software. If you use this software in a product, an acknowledgment in the product documentation would be appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#pragma once
+
+#ifndef PURPL_SPRITE_H
+#define PURPL_SPRITE_H 1
+
+#include <stdbool.h>
+
+#include <stb_ds.h>
+
+#include "atlas.h"
+#include "render.h"
+#include "types.h"
+#include "util.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief An atlas whose pages have been made into textures
+ */
+struct purpl_atlas {
+	const struct purpl_atlas_header *hdr; /**< The header */
+	const struct purpl_atlas_sprite *sprites; /**< The sprites */
+	const char *names; /**< The names of the sprites */
+	u32 *textures; /**< The texture of each page */
+	struct purpl_renderer *renderer; /**< The renderer the textures are
+					      for */
+};
+
+/**
+ * @brief One sprite, as the backend draws it. Rectangles are sprites without
+ *  a texture.
+ */
+struct purpl_sprite_instance {
+	float x; /**< The left of the sprite in pixels */
+	float y; /**< The top of the sprite in pixels */
+	float w; /**< The width of the sprite in pixels */
+	float h; /**< The height of the sprite in pixels */
+	float u0; /**< The left of the texture coordinates */
+	float v0; /**< The top of the texture coordinates */
+	float u1; /**< The right of the texture coordinates */
+	float v1; /**< The bottom of the texture coordinates */
+	u32 color; /**< The tint, see `PURPL_RGBA` */
+};
+
+/**
+ * @brief A draw of a run of instances that share a texture, or a clear
+ */
+struct purpl_sprite_draw {
+	u32 type; /**< `PURPL_RENDER_SPRITE` or `PURPL_RENDER_CLEAR` */
+	u32 texture; /**< The texture, 0 for none */
+	u32 color; /**< The color to clear to */
+	u32 first; /**< The first instance */
+	u32 count; /**< The number of instances */
+};
+
+/**
+ * @brief Load an atlas made by `mkatlas` and create textures for its pages
+ *
+ * @param renderer is the renderer to create the textures with
+ * @param data is the atlas, which has to stay around until it's freed
+ * @param size is the size of the atlas
+ *
+ * @return Returns the atlas or `NULL` with `errno` set (`EILSEQ` if it isn't
+ *  a valid atlas).
+ */
+extern struct purpl_atlas *purpl_load_atlas(struct purpl_renderer *renderer,
+					    const char *data, size_t size);
+
+/**
+ * @brief Find a sprite in an atlas
+ *
+ * @param atlas is the atlas
+ * @param name is the sprite's name
+ *
+ * @return Returns the sprite or `NULL` if there isn't one with that name.
+ */
+extern const struct purpl_atlas_sprite *
+purpl_find_sprite(const struct purpl_atlas *atlas, const char *name);
+
+/**
+ * @brief Draw a sprite
+ *
+ * @param renderer is the renderer
+ * @param pass is the pass to draw it in
+ * @param depth is the depth part of its key, see `purpl_render_depth`
+ * @param atlas is the atlas it's from
+ * @param sprite is the sprite
+ * @param x is the left of the sprite in pixels
+ * @param y is the top of the sprite in pixels
+ * @param scale is how much bigger to make it than its size in the atlas
+ * @param color is the tint, see `PURPL_RGBA`
+ *
+ * @return Returns 0 or sets and returns `errno`.
+ *
+ * The page's texture is used as the material, so sprites on the same page in
+ *  the same pass are drawn together.
+ */
+extern int purpl_render_sprite(struct purpl_renderer *renderer, u8 pass,
+			       u32 depth, const struct purpl_atlas *atlas,
+			       const struct purpl_atlas_sprite *sprite,
+			       float x, float y, float scale, u32 color);
+
+/**
+ * @brief Turn sorted commands into instances and draws, which is what
+ *  backends that draw quads do with them
+ *
+ * @param items is the commands, sorted by key
+ * @param count is the number of commands
+ * @param instances receives the instances, and has to have room for `count`
+ *  of them (this can be mapped GPU memory, it's only written in order)
+ * @param draws is an array (see `stb_ds.h`) that's emptied and filled with
+ *  the draws
+ *
+ * @return Returns the number of instances.
+ *
+ * A new draw starts whenever the texture changes or there's a clear, so
+ *  commands should have their texture in the material part of their keys.
+ */
+extern size_t purpl_batch_sprites(const struct purpl_render_item *items,
+				  size_t count,
+				  struct purpl_sprite_instance *instances,
+				  struct purpl_sprite_draw **draws);
+
+/**
+ * @brief Destroy an atlas's textures and free it
+ *
+ * @param atlas is the atlas to free
+ */
+extern void purpl_free_atlas(struct purpl_atlas *atlas);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !PURPL_SPRITE_H */
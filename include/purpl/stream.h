@@ -0,0 +1,204 @@
+/**
+ * @file stream.h
+ * @author MobSlicer152 (brambleclaw1414@gmail.com)
+ * @brief Loading assets in the background
+ *
+ * @copyright Copyright (c) MobSlicer152 2021
+ * This software is provided 'as-is', without any express or implied warranty. In no event will the authors be held liable for any damages arising from the use of this software.
+ * Permission is granted to anyone to use this software for any purpose, including commercial applications, and to alter it and redistribute it freely, subject to the following restrictions:
+ * 1. The origin of this software must not be misrepresented; you must not claim that you wrote the original software. If you use this software in a product, an acknowledgment in the product documentation would be appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#pragma once
+
+#ifndef PURPL_STREAM_H
+#define PURPL_STREAM_H 1
+
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdbool.h>
+
+#include <SDL.h>
+
+#include <stb_ds.h>
+
+#include "asset.h"
+#include "inst.h"
+#include "types.h"
+#include "util.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief The default limit on bytes being loaded at once (64 MiB)
+ */
+#define PURPL_STREAM_DEFAULT_INFLIGHT (64 * 1024 * 1024)
+
+/**
+ * @brief The states an asynchronous load can be in
+ */
+enum purpl_stream_status {
+	PURPL_STREAM_INVALID, /**< The handle isn't (or is no longer) valid */
+	PURPL_STREAM_QUEUED, /**< Waiting for a worker */
+	PURPL_STREAM_LOADING, /**< A worker is loading it */
+	PURPL_STREAM_DONE, /**< Loaded and added to the asset list */
+	PURPL_STREAM_FAILED /**< Couldn't be loaded */
+};
+
+/**
+ * @brief A function called on the `purpl_inst_run` thread when an
+ *  asynchronous load finishes
+ *
+ * @param inst is the instance the asset was loaded into
+ * @param handle is the handle returned by `purpl_inst_load_asset_async`
+ * @param name is the asset's name in `inst->assets` (like the return value
+ *  of `purpl_inst_load_asset_from_file`, so release it with
+ *  `purpl_inst_free_asset`), or `NULL` if it failed
+ * @param err is 0 or the `errno` value the load failed with
+ * @param user is the user data passed when the load was requested
+ */
+typedef void (*purpl_stream_callback)(struct purpl_inst *inst, u32 handle,
+				      const char *name, int err, void *user);
+
+/**
+ * @brief This is an internal structure for a single asynchronous load, don't
+ *  mess with it
+ */
+struct purpl_stream_request {
+	u32 handle;
+	s32 priority;
+	u64 seq;
+	char *path;
+	bool map;
+	purpl_stream_callback callback;
+	void *user;
+	enum purpl_stream_status status;
+	bool cancelled;
+	size_t size;
+	struct purpl_asset *asset;
+	const char *key;
+	int err;
+};
+
+/**
+ * @brief This is an internal structure for looking up requests, don't mess
+ *  with it
+ */
+struct purpl_stream_map {
+	u32 key;
+	struct purpl_stream_request *value;
+};
+
+/**
+ * @brief The state of an instance's asset streaming workers
+ */
+struct purpl_stream {
+	SDL_Thread **workers; /**< The worker threads, see `stb_ds.h` */
+	SDL_mutex *lock; /**< Protects everything below */
+	SDL_cond *wake; /**< Signalled when there's work */
+	SDL_cond *space; /**< Signalled when in-flight bytes are freed */
+	struct purpl_stream_request **queue; /**< A heap of queued requests */
+	struct purpl_stream_map *requests; /**< Every live request */
+	struct purpl_stream_request **done; /**< Requests waiting for dispatch */
+	size_t max_inflight; /**< The limit on bytes being loaded at once */
+	size_t inflight; /**< Bytes loaded but not yet dispatched */
+	u32 next_handle; /**< The next handle to give out */
+	u64 seq; /**< Keeps requests of equal priority in order */
+	bool quit; /**< Tells the workers to stop */
+};
+
+/**
+ * @brief Start worker threads to load assets for an instance
+ *
+ * @param inst is the instance
+ * @param workers is the number of threads (0 means one less than the number
+ *  of CPUs, and at least one)
+ * @param max_inflight is the most bytes that can be loaded but not yet
+ *  dispatched at once (0 means `PURPL_STREAM_DEFAULT_INFLIGHT`). A file
+ *  bigger than this is still loaded, just on its own.
+ *
+ * @return Returns 0 or sets and returns `errno`. If streaming was already
+ *  started, returns `EEXIST`.
+ */
+extern int purpl_inst_start_streaming(struct purpl_inst *inst, uint workers,
+				      size_t max_inflight);
+
+/**
+ * @brief Queue an asset to be loaded in the background
+ *
+ * @param inst is the instance to load the asset into (streaming has to have
+ *  been started)
+ * @param map is whether to attempt to map the file
+ * @param priority is the priority of the load, higher goes first
+ * @param callback is an optional function to call when the load finishes
+ * @param user is passed to `callback`
+ * @param name is the name of the file
+ *
+ * @return Returns a handle to the load, or 0 on failure (with `errno` set to
+ *  `ENOENT` if the file isn't in any of the search paths).
+ *
+ * If `callback` is given, the handle stops being valid after it's called.
+ *  Otherwise, use `purpl_inst_poll_asset` to find out when it's done.
+ */
+extern u32 purpl_inst_load_asset_async(struct purpl_inst *inst, bool map,
+				       s32 priority,
+				       purpl_stream_callback callback,
+				       void *user, const char *name, ...);
+
+/**
+ * @brief Check on an asynchronous load
+ *
+ * @param inst is the instance
+ * @param handle is the handle to check
+ * @param name_ret receives the name of the asset in `inst->assets` if the
+ *  status is `PURPL_STREAM_DONE` (optional)
+ *
+ * @return Returns the status of the load. Once it's `PURPL_STREAM_DONE` or
+ *  `PURPL_STREAM_FAILED`, the handle stops being valid.
+ */
+extern enum purpl_stream_status
+purpl_inst_poll_asset(struct purpl_inst *inst, u32 handle,
+		      const char **name_ret);
+
+/**
+ * @brief Cancel an asynchronous load
+ *
+ * @param inst is the instance
+ * @param handle is the load to cancel
+ *
+ * @return Returns true if the load was cancelled, which invalidates the
+ *  handle, or false if it had already finished (or never existed).
+ *
+ * If a worker has already started loading the file, the result is thrown
+ *  away when it's done.
+ */
+extern bool purpl_inst_cancel_asset(struct purpl_inst *inst, u32 handle);
+
+/**
+ * @brief Add finished loads to the asset list and call their callbacks
+ *
+ * @param inst is the instance
+ *
+ * `purpl_inst_run` calls this every frame, before the frame callback.
+ */
+extern void purpl_inst_dispatch_assets(struct purpl_inst *inst);
+
+/**
+ * @brief Stop an instance's streaming workers
+ *
+ * @param inst is the instance
+ *
+ * Queued loads are dropped, and anything being loaded is waited for and
+ *  freed. `purpl_end_inst` calls this.
+ */
+extern void purpl_inst_stop_streaming(struct purpl_inst *inst);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !PURPL_STREAM_H */
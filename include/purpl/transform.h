@@ -0,0 +1,186 @@
+/**
+ * @file transform.h
+ * @author MobSlicer152 (brambleclaw1414@gmail.com)
+ * @brief Structure-of-arrays transforms and culling
+ *
+ * @copyright Copyright (c) MobSlicer152 2021
+ * This software is provided 'as-is', without any express or implied warranty. In no event will the authors be held liable for any damages arising from the use of this software.
+ * Permission is granted to anyone to use this software for any purpose, including commercial applications, and to alter it and redistribute it freely, subject to the following restrictions:
+ * 1. The origin of this software must not be misrepresented; you must not claim that you wrote the original software. If you use this software in a product, an acknowledgment in the product documentation would be appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#pragma once
+
+#ifndef PURPL_TRANSFORM_H
+#define PURPL_TRANSFORM_H 1
+
+#include <stdbool.h>
+
+#include <cglm/cglm.h>
+
+#include "types.h"
+#include "util.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief The parent of a transform that doesn't have one
+ */
+#define PURPL_NO_PARENT UINT32_MAX
+
+/**
+ * @brief The number of transforms the widest kernels handle at once. Arrays
+ *  are allocated in multiples of this and aligned to its size in floats.
+ */
+#define PURPL_TRANSFORM_LANES 8
+
+/**
+ * @brief The number of arrays in a set of transforms
+ */
+#define PURPL_TRANSFORM_ARRAYS 29
+
+/**
+ * @brief Instruction sets the kernels can use
+ */
+enum purpl_simd_level {
+	PURPL_SIMD_NONE, /**< Plain C */
+	PURPL_SIMD_SSE, /**< 4 transforms at a time with SSE2 */
+	PURPL_SIMD_AVX2, /**< 8 transforms at a time with AVX2 */
+};
+
+/**
+ * @brief A set of transforms, stored as one array per component so the
+ *  kernels can work on several transforms at a time
+ *
+ * Parents always come before their children, which is what lets the world
+ *  matrices be composed in one pass. Adding them a level of the hierarchy at
+ *  a time is fastest, because a block of transforms with one of their
+ *  parents in it gets done in plain C. World matrices are affine, so only
+ *  their top three rows are stored, one array per element (`world[row * 4 +
+ *  column]`). Use `purpl_get_world_matrix` to get one as a cglm `mat4`.
+ */
+struct purpl_transforms {
+	size_t count; /**< The number of transforms */
+	size_t capacity; /**< The number of transforms there's room for */
+	enum purpl_simd_level
+		simd; /**< The widest instructions the kernels will use, this
+			   can be lowered but not raised */
+
+	union {
+		struct {
+			float *px, *py, *pz; /**< Local positions */
+			float *qx, *qy, *qz,
+				*qw; /**< Local rotations (unit quaternions) */
+			float *sx, *sy, *sz; /**< Local scales */
+			u32 *parent; /**< Parents, or `PURPL_NO_PARENT` */
+			float *world[12]; /**< World matrices */
+			float *cx, *cy, *cz; /**< Local bounds centers */
+			float *ex, *ey, *ez; /**< Local bounds half extents */
+		};
+		void *arrays[PURPL_TRANSFORM_ARRAYS]; /**< All of the above */
+	};
+
+	void *data; /**< The allocation the arrays are in */
+};
+
+/**
+ * @brief Create a set of transforms
+ *
+ * @param capacity is the number of transforms to make room for up front
+ *
+ * @return Returns a set of transforms using the widest kernels the CPU
+ *  supports, or `NULL` with `errno` set.
+ */
+extern struct purpl_transforms *purpl_create_transforms(size_t capacity);
+
+/**
+ * @brief Add a transform
+ *
+ * @param transforms is the set of transforms
+ * @param parent is the parent, which has to already exist, or
+ *  `PURPL_NO_PARENT`
+ *
+ * @return Returns the index of the new transform, which starts with no
+ *  translation, rotation, or scaling and empty bounds at its origin, or
+ *  `PURPL_NO_PARENT` with `errno` set.
+ */
+extern u32 purpl_add_transform(struct purpl_transforms *transforms,
+			       u32 parent);
+
+/**
+ * @brief Set the local position, rotation, and scale of a transform
+ *
+ * @param transforms is the set of transforms
+ * @param index is the transform
+ * @param position is the position relative to the parent
+ * @param rotation is the rotation relative to the parent, as a unit
+ *  quaternion
+ * @param scale is the scale relative to the parent
+ *
+ * The world matrix isn't updated until `purpl_update_transforms` is called.
+ */
+extern void purpl_set_transform(struct purpl_transforms *transforms, u32 index,
+				vec3 position, versor rotation, vec3 scale);
+
+/**
+ * @brief Set the bounds of a transform
+ *
+ * @param transforms is the set of transforms
+ * @param index is the transform
+ * @param box is the bounding box in local space, as cglm's minimum and
+ *  maximum corners
+ */
+extern void purpl_set_bounds(struct purpl_transforms *transforms, u32 index,
+			     vec3 box[2]);
+
+/**
+ * @brief Compose the world matrices of every transform
+ *
+ * @param transforms is the set of transforms
+ */
+extern void purpl_update_transforms(struct purpl_transforms *transforms);
+
+/**
+ * @brief Get the world matrix of a transform
+ *
+ * @param transforms is the set of transforms
+ * @param index is the transform
+ * @param dest is where to put the matrix
+ */
+extern void purpl_get_world_matrix(const struct purpl_transforms *transforms,
+				   u32 index, mat4 dest);
+
+/**
+ * @brief Find the transforms whose bounds are inside a frustum
+ *
+ * @param transforms is the set of transforms, with up to date world matrices
+ * @param planes is the frustum, from `glm_frustum_planes`
+ * @param start is the first transform to check
+ * @param count is the number of transforms to check
+ * @param visible is where to put the indices of the visible transforms, in
+ *  order, and needs room for `count` of them
+ *
+ * @return Returns the number of visible transforms.
+ *
+ * Ranges that don't overlap can be culled on different threads at once.
+ */
+extern size_t purpl_cull_transforms(const struct purpl_transforms *transforms,
+				    vec4 planes[6], size_t start, size_t count,
+				    u32 *visible);
+
+/**
+ * @brief Free a set of transforms
+ *
+ * @param transforms is the set of transforms to free
+ */
+extern void purpl_free_transforms(struct purpl_transforms *transforms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !PURPL_TRANSFORM_H */
@@ -25,7 +25,7 @@ typedef unsigned int uint;
 typedef char s8;
 typedef short s16;
 typedef int s32;
-typedef long s64;
+typedef long long s64;
 #ifdef __GNUC__
 #define PURPL_U128_SUPPORTED
 typedef __int128 s128;
@@ -34,7 +34,7 @@ typedef __int128 s128;
 typedef unsigned char u8;
 typedef unsigned short u16;
 typedef unsigned int u32;
-typedef unsigned long u64;
+typedef unsigned long long u64;
 #ifdef __GNUC__
 #define PURPL_U128_SUPPORTED
 typedef unsigned __int128 u128;
@@ -20,10 +20,13 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <string.h>
 #include <errno.h>
 #include <time.h>
 
+#include <sys/stat.h>
+
 /* These are necessary for mapping files */
 #if __linux__ || __APPLE__
 #include <sys/mman.h>
@@ -54,6 +57,16 @@ extern "C" {
  */
 #define PURPL_ARRAY_SIZE(arr) (sizeof(arr) / sizeof(arr[0]))
 
+/**
+ * @brief Gets the smaller of two values
+ */
+#define PURPL_MIN(a, b) (((a) < (b)) ? (a) : (b))
+
+/**
+ * @brief Gets the larger of two values
+ */
+#define PURPL_MAX(a, b) (((a) > (b)) ? (a) : (b))
+
 /**
  * @brief Concatenates two values together (and generates a warning 
  *  sometimes so ignore it if you get the right value)
@@ -73,9 +86,20 @@ extern "C" {
 	((target)((val) & ((1 << (sizeof(val) << 3)) - 1)))
 
 /**
- * @brief 10% more convenient `calloc` for arrays.
+ * @brief Declares a variable with a separate copy for each thread
  */
-#define PURPL_CALLOC(count, type) ((type *)calloc((count), sizeof(type)))
+#ifdef _MSC_VER
+#define PURPL_THREAD_LOCAL __declspec(thread)
+#else
+#define PURPL_THREAD_LOCAL _Thread_local
+#endif
+
+/**
+ * @brief 10% more convenient `calloc` for arrays. This counts the
+ *  allocation, see `purpl_get_alloc_count`.
+ */
+#define PURPL_CALLOC(count, type) \
+	((type *)purpl_calloc((count), sizeof(type)))
 
 /**
  * @brief Saves `errno` in `err`, use with `PURPL_RESTORE_ERRNO`
@@ -132,6 +156,17 @@ extern "C" {
 		__result;                                  \
 	}))
 #endif
+
+/**
+ * @brief MSVC doesn't have the POSIX file type macros
+ */
+#ifndef S_ISDIR
+#define S_ISDIR(mode) (((mode) & _S_IFMT) == _S_IFDIR)
+#endif
+#ifndef S_ISREG
+#define S_ISREG(mode) (((mode) & _S_IFMT) == _S_IFREG)
+#endif
+
 #define PURPL_READ "rb" /**< Read only */
 #define PURPL_WRITE "rb+" /**< Read _and_ write */
 #define PURPL_OVERWRITE "wb+" /**< Overwrite (read and write, but truncated) */
@@ -143,14 +178,302 @@ extern "C" {
  * DO NOT USE `data` OR `len` DIRECTLY IF THEY MIGHT GET MODIFIED!
  */
 struct purpl_mapping {
-	void *data; /**< The actual mapped file */
-	size_t len; /**< The length of the file */
+	void *data; /**< The mapped file (or the requested range of it) */
+	size_t len; /**< The length of the file (or the range) */
+	u64 offset; /**< Where in the file `data` starts */
 	u8 prot; /**< The protection of the pages. See `purpl_map_file` for more */
+	u32 hints; /**< The hints last given for the mapping */
+	void *base; /**< The start of the pages, which can be before `data` */
+	size_t base_len; /**< The length of the pages */
+	struct purpl_prefault *prefault; /**< Background prefault */
 #ifdef _WIN32
 	HANDLE handle; /**< Ewwy Win32 handle to the "mapping object" */
 #endif
 };
 
+/**
+ * @brief Hints about how a mapping will be accessed. These can be combined,
+ *  except for `PURPL_MAP_SEQUENTIAL` and `PURPL_MAP_RANDOM`.
+ */
+enum purpl_map_hint {
+	PURPL_MAP_NORMAL = 0, /**< Nothing special, let the OS decide */
+	PURPL_MAP_SEQUENTIAL = 1 << 0, /**< Read front to back */
+	PURPL_MAP_RANDOM = 1 << 1, /**< Read all over the place */
+	PURPL_MAP_WILLNEED = 1 << 2, /**< Start reading pages in now */
+	PURPL_MAP_HUGEPAGE = 1 << 3, /**< Use huge pages, if the OS can */
+	PURPL_MAP_PREFAULT = 1 << 4, /**< Fault pages in on a thread */
+};
+
+/**
+ * @brief The alignment of everything allocated from an arena
+ */
+#define PURPL_ARENA_ALIGN 16
+
+/**
+ * @brief The default size of each block of an arena
+ */
+#define PURPL_ARENA_DEFAULT_BLOCK (64 * 1024)
+
+/**
+ * @brief This is an internal structure for a block of memory in an arena,
+ *  don't mess with it
+ */
+struct purpl_arena_block {
+	struct purpl_arena_block *next;
+	size_t size;
+	size_t used;
+	char data[];
+};
+
+/**
+ * @brief A linear allocator
+ *
+ * Allocating from an arena just bumps a pointer, and everything allocated
+ *  from it is freed at once by `purpl_reset_arena`. Blocks are kept when the
+ *  arena is reset, so once an arena has grown to fit everything it needs
+ *  between resets, it never calls `malloc` again.
+ */
+struct purpl_arena {
+	struct purpl_arena_block *first; /**< The first block */
+	struct purpl_arena_block
+		*current; /**< The block being allocated from */
+	size_t block_size; /**< The smallest size for new blocks */
+	size_t used; /**< The bytes allocated since the last reset */
+	size_t peak; /**< The most bytes ever allocated between resets */
+};
+
+/**
+ * @brief A point in an arena to go back to with `purpl_release_arena`
+ */
+struct purpl_arena_mark {
+	struct purpl_arena_block *block;
+	size_t block_used;
+	size_t used;
+};
+
+/**
+ * @brief `calloc`, but counted
+ *
+ * @param count is the number of elements
+ * @param size is the size of each element
+ *
+ * @return Returns the same as `calloc`.
+ *
+ * Use `PURPL_CALLOC` instead of this.
+ */
+extern void *purpl_calloc(size_t count, size_t size);
+
+/**
+ * @brief Get the number of allocations made by this thread
+ *
+ * @return Returns the number of times this thread has called `purpl_calloc`
+ *  (which includes `PURPL_CALLOC` and arenas getting new blocks).
+ *
+ * This is for checking that code that should never hit the heap doesn't, by
+ *  comparing it before and after.
+ */
+extern u64 purpl_get_alloc_count(void);
+
+/**
+ * @brief Get the number of bytes mapped with `purpl_map_file`
+ *
+ * @return Returns the total length of the mappings that haven't been unmapped
+ *  yet, across all threads.
+ */
+extern u64 purpl_get_mapped_bytes(void);
+
+/**
+ * @brief Create an arena
+ *
+ * @param block_size is the smallest size for each block (0 means
+ *  `PURPL_ARENA_DEFAULT_BLOCK`)
+ *
+ * @return Returns a new arena or `NULL` with `errno` set.
+ */
+extern struct purpl_arena *purpl_create_arena(size_t block_size);
+
+/**
+ * @brief Allocate memory from an arena
+ *
+ * @param arena is the arena
+ * @param size is the number of bytes to allocate
+ *
+ * @return Returns `PURPL_ARENA_ALIGN` aligned memory (which isn't zeroed),
+ *  or `NULL` with `errno` set. Don't free it.
+ */
+extern void *purpl_arena_alloc(struct purpl_arena *arena, size_t size);
+
+/**
+ * @brief Get a mark in an arena
+ *
+ * @param arena is the arena
+ *
+ * @return Returns a mark that `purpl_release_arena` can go back to.
+ */
+extern struct purpl_arena_mark purpl_mark_arena(struct purpl_arena *arena);
+
+/**
+ * @brief Free everything allocated from an arena since a mark
+ *
+ * @param arena is the arena
+ * @param mark is a mark from `purpl_mark_arena`, which must be from after
+ *  the last reset
+ */
+extern void purpl_release_arena(struct purpl_arena *arena,
+				struct purpl_arena_mark mark);
+
+/**
+ * @brief Free everything allocated from an arena, but keep its memory
+ *
+ * @param arena is the arena
+ */
+extern void purpl_reset_arena(struct purpl_arena *arena);
+
+/**
+ * @brief Free an arena and its memory
+ *
+ * @param arena is the arena
+ */
+extern void purpl_free_arena(struct purpl_arena *arena);
+
+/**
+ * @brief Get this thread's scratch arena
+ *
+ * @return Returns this thread's scratch arena, which is created the first
+ *  time this is called, or `NULL` if it couldn't be.
+ *
+ * The scratch arena is for temporary memory. Either get a mark with
+ *  `purpl_mark_arena` and release it when you're done, or, on the main
+ *  thread, let `purpl_inst_run` reset it at the end of the frame. Call
+ *  `purpl_free_scratch_arena` before a thread that used it exits.
+ */
+extern struct purpl_arena *purpl_get_scratch_arena(void);
+
+/**
+ * @brief Free this thread's scratch arena
+ */
+extern void purpl_free_scratch_arena(void);
+
+/**
+ * @brief The size of a cache line
+ */
+#define PURPL_CACHE_LINE 64
+
+/**
+ * @brief The number of size classes in the pool allocator, which go from 16
+ *  to `PURPL_POOL_MAX_SIZE` bytes in powers of two
+ */
+#define PURPL_POOL_CLASSES 6
+
+/**
+ * @brief The largest allocation the pool allocator handles itself, bigger
+ *  ones just use `calloc`
+ */
+#define PURPL_POOL_MAX_SIZE (16 << (PURPL_POOL_CLASSES - 1))
+
+/**
+ * @brief The size of each slab the pool allocator gets from the system
+ */
+#define PURPL_POOL_SLAB_SIZE (64 * 1024)
+
+/**
+ * @brief Whether each thread keeps its own free blocks, so most allocations
+ *  don't need the lock
+ */
+#ifndef PURPL_POOL_THREAD_CACHE
+#define PURPL_POOL_THREAD_CACHE 1
+#endif
+
+/**
+ * @brief Allocate a zeroed `type` from the pool allocator
+ */
+#define PURPL_POOL_NEW(type) ((type *)purpl_pool_alloc(sizeof(type)))
+
+/**
+ * @brief Give something from `PURPL_POOL_NEW` back to the pool allocator
+ */
+#define PURPL_POOL_DELETE(ptr) purpl_pool_free((ptr), sizeof(*(ptr)))
+
+/**
+ * @brief Statistics for one of the pool allocator's size classes
+ */
+struct purpl_pool_stats {
+	size_t size; /**< The size of each block */
+	size_t slabs; /**< The number of slabs */
+	s64 live; /**< The number of blocks allocated and not freed (only
+		       counted in debug builds) */
+};
+
+/**
+ * @brief Allocate memory from the pool allocator
+ *
+ * @param size is the number of bytes to allocate
+ *
+ * @return Returns zeroed memory, or `NULL` with `errno` set.
+ *
+ * Allocations are rounded up to a power of two, at least 16, and ones of 64
+ *  bytes or more start on a cache line. Memory has to be freed with
+ *  `purpl_pool_free` and the same size. In debug builds, freed blocks are
+ *  poisoned, and writes to them are reported when they're reused.
+ */
+extern void *purpl_pool_alloc(size_t size);
+
+/**
+ * @brief Give memory back to the pool allocator
+ *
+ * @param ptr is the memory (it can be `NULL`)
+ * @param size is the size it was allocated with
+ */
+extern void purpl_pool_free(void *ptr, size_t size);
+
+/**
+ * @brief Copy a string into memory from the pool allocator
+ *
+ * @param str is the string
+ *
+ * @return Returns the copy, which has to be freed with
+ *  `purpl_pool_free_str`, or `NULL` with `errno` set.
+ */
+extern char *purpl_pool_strdup(const char *str);
+
+/**
+ * @brief Copy part of a string into memory from the pool allocator
+ *
+ * @param str is the string
+ * @param len is the number of characters to copy
+ *
+ * @return Returns the same as `purpl_pool_strdup`.
+ */
+extern char *purpl_pool_strndup(const char *str, size_t len);
+
+/**
+ * @brief Free a string from `purpl_pool_strdup`
+ *
+ * The string's size is kept with it, so it can be shortened in place before
+ *  being freed.
+ *
+ * @param str is the string (it can be `NULL`)
+ */
+extern void purpl_pool_free_str(char *str);
+
+/**
+ * @brief Give this thread's cached blocks back to the pool allocator
+ *
+ * Threads that use the pool allocator should call this before exiting, or
+ *  the blocks they have cached can't be used by anyone else.
+ */
+extern void purpl_flush_pool_cache(void);
+
+/**
+ * @brief Get statistics for the pool allocator
+ *
+ * @param stats receives `PURPL_POOL_CLASSES` entries
+ *
+ * @return Returns the number of blocks that haven't been freed (always 0 in
+ *  release builds).
+ */
+extern s64 purpl_get_pool_stats(struct purpl_pool_stats *stats);
+
 /**
  * @brief Formats text as `vsprintf` would
  * 
@@ -189,6 +512,91 @@ extern char *purpl_fmt_text_va(s64 *len_ret, const char *fmt, va_list args);
  */
 extern char *purpl_fmt_text(s64 *len_ret, const char *fmt, ...);
 
+/**
+ * @brief Formats text as `vsprintf` would, into an arena
+ *
+ * @param arena is the arena to allocate the buffer from
+ * @param len_ret will receive the length of the string (it can be `NULL`,
+ *  and if it's -1, returns `fmt`)
+ * @param fmt is the `printf`-style format string to be formatted
+ * @param args is the variable argument structure that would be given to
+ *  `vsprintf`
+ *
+ * @return Returns a buffer from `arena` containing the formatted string, or
+ *  `fmt` if that doesn't work. Either way, don't free it.
+ *
+ * This formats straight into the arena when the string fits in its current
+ *  block, so it usually only formats once and never calls `malloc`.
+ */
+extern char *purpl_fmt_text_va_arena(struct purpl_arena *arena, s64 *len_ret,
+				     const char *fmt, va_list args);
+
+/**
+ * @brief Formats text as `sprintf` would, into an arena
+ *
+ * @param arena is the arena to allocate the buffer from
+ * @param len_ret will receive the length of the string (it can be `NULL`,
+ *  and if it's -1, returns `fmt`)
+ * @param fmt is the `printf`-style format string to be formatted
+ *
+ * @return Returns the same as `purpl_fmt_text_va_arena`.
+ */
+extern char *purpl_fmt_text_arena(struct purpl_arena *arena, s64 *len_ret,
+				  const char *fmt, ...);
+
+/**
+ * @brief Copy a string into an arena
+ *
+ * @param arena is the arena
+ * @param str is the string
+ *
+ * @return Returns the copy, or `NULL` with `errno` set.
+ */
+extern char *purpl_arena_strdup(struct purpl_arena *arena, const char *str);
+
+/**
+ * @brief The kinds of argument a `printf` conversion takes
+ */
+enum purpl_fmt_arg {
+	PURPL_FMT_NONE, /**< No argument (`%%`, or a conversion that isn't
+			     supported) */
+	PURPL_FMT_INT, /**< A signed integer */
+	PURPL_FMT_UINT, /**< An unsigned integer (or `%c`) */
+	PURPL_FMT_DOUBLE, /**< A floating point number */
+	PURPL_FMT_STRING, /**< A string */
+	PURPL_FMT_POINTER /**< A pointer */
+};
+
+/**
+ * @brief A `printf` conversion specification
+ */
+struct purpl_fmt_spec {
+	const char *start; /**< The `%` */
+	size_t len; /**< The length of the whole specification */
+	size_t body_len; /**< The length of the flags, width, and precision */
+	char size; /**< The length modifier: 0, `H` (hh), `h`, `l`, `q`
+			(ll), `L`, `z`, `j`, or `t` */
+	char conv; /**< The conversion character */
+	u8 stars; /**< The number of `*`s, each of which takes an `int` before
+		       the argument */
+	enum purpl_fmt_arg arg; /**< The kind of argument it takes */
+};
+
+/**
+ * @brief Find the next conversion specification in a `printf` format string
+ *
+ * @param fmt is where to start looking
+ * @param spec receives the specification
+ *
+ * @return Returns a pointer to just after the specification, or `NULL` if
+ *  there aren't any more.
+ *
+ * This is what the binary logger and `tools/logdec` use to agree on what
+ *  arguments a message has.
+ */
+extern const char *purpl_next_fmt_spec(const char *fmt,
+				       struct purpl_fmt_spec *spec);
+
 /**
  * @brief Maps a file into the process's virtual memory using the
  *  appropriate system function
@@ -213,6 +621,45 @@ extern char *purpl_fmt_text(s64 *len_ret, const char *fmt, ...);
  */
 extern struct purpl_mapping *purpl_map_file(u8 protection, FILE *fp);
 
+/**
+ * @brief Maps part of a file into memory
+ *
+ * @param protection is the same as for `purpl_map_file`
+ * @param fp is the file to map
+ * @param offset is where in the file to start, which doesn't have to be
+ *  page aligned
+ * @param len is how much of the file to map, or 0 for the rest of it
+ * @param hints is a combination of `purpl_map_hint` values
+ *
+ * @return Returns information about the mapping (`data` points at `offset`
+ *  in the file) or `NULL` and sets `errno`.
+ *
+ * This is `purpl_map_file`, but for files too big to map at once (or that you
+ *  only need part of). Sizes are 64-bit everywhere, so this works for files
+ *  over 4 GiB as long as the range fits in the address space. The hints are
+ *  given to `madvise` and `posix_fadvise` where those exist, and
+ *  `PURPL_MAP_PREFAULT` starts a thread that touches every page so the first
+ *  real access doesn't take a page fault. Unmap it with `purpl_unmap_file`,
+ *  which stops the prefault thread if it's still going.
+ */
+extern struct purpl_mapping *purpl_map_file_range(u8 protection, FILE *fp,
+						  u64 offset, u64 len,
+						  u32 hints);
+
+/**
+ * @brief Changes the hints for a mapping
+ *
+ * @param mapping is the mapping to advise
+ * @param hints is a combination of `purpl_map_hint` values
+ *
+ * @return Returns 0 or an `errno` value
+ *
+ * Use this when the access pattern changes after the mapping was made, like
+ *  switching from a sequential load to random lookups. Hints the OS doesn't
+ *  support are ignored.
+ */
+extern int purpl_advise_mapping(struct purpl_mapping *mapping, u32 hints);
+
 /**
  * @brief Unmap a file mapped with `purpl_map_file`.
  * 
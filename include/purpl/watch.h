@@ -0,0 +1,161 @@
+/**
+ * @file watch.h
+ * @author MobSlicer152 (brambleclaw1414@gmail.com)
+ * @brief Reloading assets when their files change
+ *
+ * @copyright Copyright (c) MobSlicer152 2021
+ * This software is provided 'as-is', without any express or implied warranty. In no event will the authors be held liable for any damages arising from the use of this software.
+ * Permission is granted to anyone to use this software for any purpose, including commercial applications, and to alter it and redistribute it freely, subject to the following restrictions:
+ * 1. The origin of this software must not be misrepresented; you must not claim that you wrote the original software. If you use this software in a product, an acknowledgment in the product documentation would be appreciated but is not required.
+ * 2. Altered source versions must be plainly marked as such, and must not be misrepresented as being the original software.
+ * 3. This notice may not be removed or altered from any source distribution.
+ */
+
+#pragma once
+
+#ifndef PURPL_WATCH_H
+#define PURPL_WATCH_H 1
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include <SDL.h>
+
+#include <stb_ds.h>
+
+#include "asset.h"
+#include "inst.h"
+#include "types.h"
+#include "util.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief The default time in milliseconds a file has to go unchanged before
+ *  it's reloaded
+ */
+#define PURPL_WATCH_DEFAULT_DELAY 100
+
+/**
+ * @brief A function called on the `purpl_inst_run` thread after an asset
+ *  has been reloaded
+ *
+ * @param inst is the instance the asset belongs to
+ * @param name is the asset's name in `inst->assets`
+ * @param user is the user data passed to `purpl_inst_add_reload_callback`
+ */
+typedef void (*purpl_reload_callback)(struct purpl_inst *inst,
+				      const char *name, void *user);
+
+/**
+ * @brief This is an internal structure for reload callbacks, don't mess
+ *  with it
+ */
+struct purpl_reload_callback_info {
+	purpl_reload_callback callback;
+	void *user;
+};
+
+/**
+ * @brief This is an internal structure for mapping watch descriptors to
+ *  directories, don't mess with it
+ */
+struct purpl_watch_dir {
+	int key;
+	char *value;
+};
+
+/**
+ * @brief This is an internal structure for sets of paths, don't mess with
+ *  it
+ */
+struct purpl_watch_path {
+	char *key;
+	u32 value;
+};
+
+/**
+ * @brief The state of an instance's file watcher
+ */
+struct purpl_watch {
+	int fd; /**< The inotify file descriptor */
+	SDL_Thread *thread; /**< The thread that reads events and reloads */
+	SDL_mutex *lock; /**< Protects everything below */
+	struct purpl_watch_dir *dirs; /**< Watched directories by descriptor */
+	struct purpl_watch_path *watched; /**< Watched directories by path */
+	struct purpl_watch_path
+		*files; /**< The files of loaded assets, and whether to map
+			     them */
+	struct purpl_watch_path
+		*pending; /**< Changed files, and when they last changed */
+	struct purpl_asset **ready; /**< Reloaded assets waiting to be
+					 swapped in, see `stb_ds.h` */
+	char **changed_dirs; /**< Directories whose listings are stale */
+	struct purpl_reload_callback_info
+		*callbacks; /**< The reload callbacks, see `stb_ds.h` */
+	u64 synced; /**< `inst->cache.misses` when the watches were last
+			 updated */
+	u32 delay; /**< The coalescing delay in milliseconds */
+	SDL_atomic_t quit; /**< Tells the thread to stop */
+};
+
+/**
+ * @brief Start watching the files of an instance's assets for changes
+ *
+ * @param inst is the instance
+ * @param delay is how long in milliseconds a file has to go without changing
+ *  before it's reloaded, so that a burst of writes only reloads it once (0
+ *  means `PURPL_WATCH_DEFAULT_DELAY`)
+ *
+ * @return Returns 0 or sets and returns `errno`. Returns `EOPNOTSUPP` on
+ *  platforms without inotify, and `EEXIST` if the instance is already
+ *  watching.
+ *
+ * The directories containing the instance's assets are watched, which also
+ *  keeps the search path cache (see `purpl_resolve_asset`) up to date for
+ *  them. Changed files are reloaded on a background thread, then swapped in
+ *  by `purpl_inst_reload_assets`.
+ */
+extern int purpl_inst_start_watching(struct purpl_inst *inst, uint delay);
+
+/**
+ * @brief Register a function to be called when an asset is reloaded
+ *
+ * @param inst is the instance
+ * @param callback is the function
+ * @param user is passed to `callback`
+ *
+ * @return Returns 0 or sets and returns `errno`.
+ */
+extern int purpl_inst_add_reload_callback(struct purpl_inst *inst,
+					  purpl_reload_callback callback,
+					  void *user);
+
+/**
+ * @brief Swap reloaded assets into the instance's asset list
+ *
+ * @param inst is the instance
+ *
+ * The `purpl_asset` structures in `inst->assets` stay where they are, only
+ *  their contents are replaced, so pointers to them stay valid (pointers to
+ *  their data don't). `purpl_inst_run` calls this every frame, before the
+ *  frame callback.
+ */
+extern void purpl_inst_reload_assets(struct purpl_inst *inst);
+
+/**
+ * @brief Stop watching an instance's assets
+ *
+ * @param inst is the instance
+ *
+ * `purpl_end_inst` calls this.
+ */
+extern void purpl_inst_stop_watching(struct purpl_inst *inst);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !PURPL_WATCH_H */
@@ -17,6 +17,7 @@ struct purpl_app_info *purpl_load_app_info(struct purpl_embed *embed,
 	struct json_object *ver_maj;
 	struct json_object *ver_min;
 	struct json_object *search_paths;
+	struct json_object *budget;
 	struct json_object *obj;
 	char *cur;
 	bool alw_ext;
@@ -53,10 +54,8 @@ struct purpl_app_info *purpl_load_app_info(struct purpl_embed *embed,
 			alw_ext = false;
 	}
 
-	if (!alw_ext) {
-		info->json = purpl_load_asset_from_archive(embed->ar, "%s",
-							   path_fmt);
-	}
+	if (!info->json && embed)
+		info->json = purpl_load_asset_from_embed(embed, "%s", path_fmt);
 	if (!info->json)
 		return NULL;
 
@@ -133,6 +132,18 @@ struct purpl_app_info *purpl_load_app_info(struct purpl_embed *embed,
 		return NULL;
 	}
 
+	/* The asset budget is optional */
+	budget = json_object_object_get(info->root, "asset_budget");
+	if (budget) {
+		if (json_object_get_type(budget) != json_type_int ||
+		    json_object_get_int64(budget) < 0) {
+			purpl_free_asset(info->json);
+			errno = EINVAL;
+			return NULL;
+		}
+		info->asset_budget = json_object_get_int64(budget);
+	}
+
 	/* Figure out how much space to allocate */
 	n_paths = json_object_array_length(search_paths);
 	paths_len = 0;
@@ -158,7 +169,7 @@ struct purpl_app_info *purpl_load_app_info(struct purpl_embed *embed,
 	}
 
 	/* Allocate the buffer */
-	info->search_paths = PURPL_CALLOC(paths_len, char);
+	info->search_paths = PURPL_CALLOC(paths_len + 1, char);
 	if (!info->search_paths)
 		return NULL;
 
@@ -186,6 +197,14 @@ struct purpl_app_info *purpl_load_app_info(struct purpl_embed *embed,
 				     PURPL_PATH_SEP_STR);
 	}
 
+	/* Parse them once, so lookups don't have to */
+	info->paths = purpl_parse_search_paths(info->search_paths);
+	if (!info->paths) {
+		free(info->search_paths);
+		purpl_free_asset(info->json);
+		return NULL;
+	}
+
 	/* Free stuff */
 	(path_len) ? (void)0 : free(path_fmt);
 
@@ -212,6 +231,10 @@ void purpl_free_app_info(struct purpl_app_info *info)
 	/* Free the JSON file's asset details */
 	purpl_free_asset(info->json);
 
+	/* Free the search paths */
+	free(info->search_paths);
+	purpl_free_search_paths(info->paths);
+
 	/* Free the structure */
 	free(info);
 
@@ -1,12 +1,61 @@
 #include "purpl/asset.h"
+#include "purpl/profile.h"
+
+#ifndef _WIN32
+#include <dirent.h>
+#endif
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/*
+ * The search paths purpl_load_asset_from_file last parsed on this thread, so
+ *  loading a lot of files from the same paths only lists each directory once
+ */
+static PURPL_THREAD_LOCAL char *cached_search_paths;
+static PURPL_THREAD_LOCAL struct purpl_search_paths *cached_paths;
+
+/* Open a libarchive handle at the start of an embed */
+static struct archive *open_embed_archive(struct purpl_embed *embed)
+{
+	struct archive *ar;
+	int err;
+
+	/* Start up libarchive */
+	ar = archive_read_new();
+	if (!ar) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	/* Enable support for tar archives because they're good */
+	archive_read_support_format_all(ar);
+	archive_read_support_filter_all(ar);
+
+	/* Load in the archive */
+	err = archive_read_open_memory(ar, embed->start, embed->size);
+	if (err != ARCHIVE_OK) {
+		archive_read_free(ar);
+		errno = ENOMEM; /*
+				 * Some interpretation will be necessary in
+				 * libarchive-related code
+				 */
+		return NULL;
+	}
+
+	return ar;
+}
+
 struct purpl_embed *purpl_load_embed(const char *sym_start, const char *sym_end)
 {
 	struct purpl_embed *embed;
+	struct archive_entry *ent;
+	struct purpl_embed_entry entry;
+	const void *block;
+	size_t block_len;
+	la_int64_t block_off;
+	size_t i;
 	int err;
 	int ___errno;
 
@@ -19,7 +68,7 @@ struct purpl_embed *purpl_load_embed(const char *sym_start, const char *sym_end)
 	}
 
 	/* Allocate the structure */
-	embed = PURPL_CALLOC(1, struct purpl_embed);
+	embed = PURPL_POOL_NEW(struct purpl_embed);
 	if (!embed)
 		return NULL;
 
@@ -28,22 +77,71 @@ struct purpl_embed *purpl_load_embed(const char *sym_start, const char *sym_end)
 	embed->end = sym_end;
 	embed->size = embed->end - embed->start;
 
-	/* Start up libarchive */
-	embed->ar = archive_read_new();
-	if (!embed->ar)
+	/* Packs have their own index, so libarchive isn't needed */
+	if (purpl_is_pack(embed->start, embed->size)) {
+		embed->pack = purpl_load_pack(embed->start, embed->size);
+		if (!embed->pack) {
+			PURPL_POOL_DELETE(embed);
+			return NULL;
+		}
+
+		PURPL_RESTORE_ERRNO(___errno);
+
+		return embed;
+	}
+
+	/* Open the archive */
+	embed->ar = open_embed_archive(embed);
+	if (!embed->ar) {
+		PURPL_POOL_DELETE(embed);
 		return NULL;
+	}
 
-	/* Enable support for tar archives because they're good */
-	archive_read_support_format_all(embed->ar);
-	archive_read_support_filter_all(embed->ar);
+	/* Make the index keep its own copies of the paths */
+	stbds_sh_new_strdup(embed->index);
 
-	/* Load in the archive */
-	err = archive_read_open_memory(embed->ar, embed->start, embed->size);
-	if (err != ARCHIVE_OK) {
-		errno = ENOMEM; /*
-				 * Some interpretation will be necessary in
-				 * libarchive-related code
-				 */
+	/* Read every header once so lookups don't have to */
+	i = 0;
+	while (1) {
+		err = archive_read_next_header(embed->ar, &ent);
+		if (err == ARCHIVE_EOF || err == ARCHIVE_FATAL)
+			break;
+		if (err != ARCHIVE_OK && err != ARCHIVE_WARN) {
+			i++;
+			continue;
+		}
+
+		/* Fill in what we know from the header */
+		entry.ordinal = i++;
+		entry.size = archive_entry_size(ent);
+		entry.offset = -1;
+		entry.dir = archive_entry_filetype(ent) == AE_IFDIR;
+
+		/*
+		 * If libarchive hands back the whole file in one block that
+		 *  lies inside the embed, the data is stored as-is and can be
+		 *  used without copying it
+		 */
+		if (!entry.dir && entry.size) {
+			err = archive_read_data_block(embed->ar, &block,
+						      &block_len, &block_off);
+			if (err == ARCHIVE_OK && block_off == 0 &&
+			    block_len == entry.size &&
+			    (char *)block >= embed->start &&
+			    (char *)block + block_len <= embed->end)
+				entry.offset = (char *)block - embed->start;
+		}
+
+		stbds_shput(embed->index, archive_entry_pathname(ent), entry);
+	}
+	embed->format = archive_format(embed->ar);
+
+	/* Rewind the handle for anyone using purpl_load_asset_from_archive */
+	archive_read_free(embed->ar);
+	embed->ar = open_embed_archive(embed);
+	if (!embed->ar) {
+		stbds_shfree(embed->index);
+		PURPL_POOL_DELETE(embed);
 		return NULL;
 	}
 
@@ -53,6 +151,169 @@ struct purpl_embed *purpl_load_embed(const char *sym_start, const char *sym_end)
 	return embed;
 }
 
+/* Load an asset from a pack */
+static struct purpl_asset *load_asset_from_pack(struct purpl_pack *pack,
+						const char *path)
+{
+	struct purpl_asset *asset;
+	const struct purpl_pack_entry *ent;
+	bool copied;
+
+	/* Find the entry */
+	ent = purpl_find_pack_entry(pack, path);
+	if (!ent)
+		return NULL;
+	if (!ent->raw_size) {
+		errno = ENOENT; /* Same as for archives */
+		return NULL;
+	}
+
+	/* Allocate the asset */
+	asset = PURPL_POOL_NEW(struct purpl_asset);
+	if (!asset)
+		return NULL;
+	asset->size = ent->raw_size;
+
+	/* Fill in the name of the asset */
+	asset->name = purpl_pool_strndup(purpl_pack_entry_name(pack, ent),
+					 ent->name_len);
+	if (!asset->name) {
+		PURPL_POOL_DELETE(asset);
+		return NULL;
+	}
+
+	/* Get the data */
+	asset->data = purpl_read_pack_entry(pack, ent, &copied);
+	if (!asset->data) {
+		purpl_free_asset(asset);
+		return NULL;
+	}
+	asset->embedded = !copied;
+
+	return asset;
+}
+
+struct purpl_asset *purpl_load_asset_from_embed(struct purpl_embed *embed,
+						const char *path, ...)
+{
+	struct purpl_asset *asset;
+	struct purpl_embed_index *ent;
+	struct archive *ar;
+	struct archive_entry *hdr;
+	va_list args;
+	char *path_fmt;
+	s64 path_len;
+	size_t i;
+	int ___errno;
+
+	PURPL_SAVE_ERRNO(___errno);
+
+	/* Check args */
+	if (!embed || !path) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	/* Format the path to the file */
+	va_start(args, path);
+	path_fmt = purpl_fmt_text_va(&path_len, path, args);
+	va_end(args);
+
+	/* Packs are handled separately */
+	if (embed->pack) {
+		asset = load_asset_from_pack(embed->pack, path_fmt);
+		(path_len > 0) ? free(path_fmt) : (void)0;
+		if (!asset)
+			return NULL;
+
+		PURPL_RESTORE_ERRNO(___errno);
+
+		return asset;
+	}
+
+	/* Look up the entry */
+	ent = stbds_shgetp_null(embed->index, path_fmt);
+	(path_len > 0) ? free(path_fmt) : (void)0;
+	if (!ent) {
+		errno = ENOENT;
+		return NULL;
+	}
+	if (ent->value.dir) {
+		errno = EISDIR;
+		return NULL;
+	}
+	if (!ent->value.size) {
+		errno = ENOENT; /* This is close enough for our purposes */
+		return NULL;
+	}
+
+	/* Allocate the asset */
+	asset = PURPL_POOL_NEW(struct purpl_asset);
+	if (!asset)
+		return NULL;
+	asset->size = ent->value.size;
+
+	/* Fill in the name of the asset */
+	asset->name = purpl_pool_strdup(ent->key);
+	if (!asset->name) {
+		PURPL_POOL_DELETE(asset);
+		return NULL;
+	}
+
+	/*
+	 * If the data is stored as-is and followed by a 0 (tar pads entries
+	 *  with them), it can be used in place
+	 */
+	if (ent->value.offset >= 0 &&
+	    embed->start + ent->value.offset + asset->size < embed->end &&
+	    embed->start[ent->value.offset + asset->size] == '\0') {
+		asset->data = embed->start + ent->value.offset;
+		asset->embedded = true;
+
+		PURPL_RESTORE_ERRNO(___errno);
+
+		return asset;
+	}
+
+	/* Otherwise, allocate a buffer for the file */
+	asset->data = PURPL_CALLOC(asset->size + 1, char);
+	if (!asset->data) {
+		purpl_free_asset(asset);
+		return NULL;
+	}
+
+	if (ent->value.offset >= 0) {
+		/* Stored, but not terminated, so copy it */
+		memcpy(asset->data, embed->start + ent->value.offset,
+		       asset->size);
+	} else {
+		/* Decompress it with a fresh handle, skipping to the entry */
+		ar = open_embed_archive(embed);
+		if (!ar) {
+			purpl_free_asset(asset);
+			return NULL;
+		}
+		for (i = 0; i <= ent->value.ordinal; i++) {
+			if (archive_read_next_header(ar, &hdr) < ARCHIVE_WARN) {
+				archive_read_free(ar);
+				purpl_free_asset(asset);
+				errno = EIO;
+				return NULL;
+			}
+		}
+		archive_read_data(ar, asset->data, asset->size);
+		archive_read_free(ar);
+	}
+
+	/* Append a 0 at the end of the buffer */
+	asset->data[asset->size] = '\0';
+
+	PURPL_RESTORE_ERRNO(___errno);
+
+	/* Return the asset */
+	return asset;
+}
+
 struct purpl_asset *purpl_load_asset_from_archive(struct archive *ar,
 						  const char *path, ...)
 {
@@ -81,9 +342,11 @@ struct purpl_asset *purpl_load_asset_from_archive(struct archive *ar,
 	 * Allocate an archive (0 is false and calloc zeroes the 
 	 * memory, so no worries about asset->mapped)
 	 */
-	asset = PURPL_CALLOC(1, struct purpl_asset);
-	if (!asset)
+	asset = PURPL_POOL_NEW(struct purpl_asset);
+	if (!asset) {
+		(path_len > 0) ? free(path_fmt) : (void)0;
 		return NULL;
+	}
 
 	/* Iterate through archive entries until we find the right file */
 	while (1) {
@@ -91,7 +354,7 @@ struct purpl_asset *purpl_load_asset_from_archive(struct archive *ar,
 		err = archive_read_next_header(ar, &ent);
 		if (err == ARCHIVE_EOF) {
 			errno = ENOENT;
-			return NULL;
+			break;
 		}
 
 		/* First, check for some other error */
@@ -105,20 +368,20 @@ struct purpl_asset *purpl_load_asset_from_archive(struct archive *ar,
 		/* Now that we have a match, check if it's a directory */
 		if (archive_entry_filetype(ent) == AE_IFDIR) {
 			errno = EISDIR;
-			return NULL;
+			break;
 		}
 
 		/* At this point, we can read the file, so get its length */
 		asset->size = archive_entry_size(ent);
 		if (!asset->size) {
 			errno = ENOENT; /* This is close enough for our purposes */
-			return NULL;
+			break;
 		}
 
 		/* Allocate a buffer for the file */
 		asset->data = PURPL_CALLOC(asset->size + 1, char);
 		if (!asset->data)
-			return NULL;
+			break;
 
 		/* And at last read it */
 		archive_read_data(ar, asset->data, asset->size);
@@ -127,15 +390,18 @@ struct purpl_asset *purpl_load_asset_from_archive(struct archive *ar,
 		asset->data[asset->size] = '\0';
 
 		/* Fill in the name of the asset */
-		asset->name =
-			PURPL_CALLOC(strlen(archive_entry_pathname(ent)), char);
-		if (!asset->name)
-			return NULL;
-		strcpy(asset->name, archive_entry_pathname(ent));
+		asset->name = purpl_pool_strdup(archive_entry_pathname(ent));
 
 		/* If we're here, the loop can end */
 		break;
 	}
+	(path_len > 0) ? free(path_fmt) : (void)0;
+
+	/* Anything without a name didn't make it all the way */
+	if (!asset->name) {
+		purpl_free_asset(asset);
+		return NULL;
+	}
 
 	PURPL_RESTORE_ERRNO(___errno);
 
@@ -143,20 +409,18 @@ struct purpl_asset *purpl_load_asset_from_archive(struct archive *ar,
 	return asset;
 }
 
-struct purpl_asset *purpl_load_asset_from_file(const char *search_paths,
-					       bool map, const char *name, ...)
+char *purpl_find_asset(const char *search_paths, const char *name, ...)
 {
-	struct purpl_asset *asset;
-	FILE *fp;
 	va_list args;
 	char *name_fmt;
 	s64 name_len;
 	char *full_name;
 	s64 full_name_len;
-	char **paths;
-	char *tmp;
-	char *paths_full;
-	u8 path_count;
+	char *canon;
+	const char *cur;
+	const char *sep;
+	size_t len;
+	struct stat st;
 	u8 i;
 	int ___errno;
 
@@ -173,91 +437,559 @@ struct purpl_asset *purpl_load_asset_from_file(const char *search_paths,
 	name_fmt = purpl_fmt_text_va(&name_len, name, args);
 	va_end(args);
 
-	/* Make our own copy of search_paths */
-	paths_full = PURPL_CALLOC(strlen(search_paths) + 1, char);
-	if (!paths_full)
+	/*
+	 * Go through the paths in place (strtok would need a copy and isn't
+	 *  safe to use from the streaming threads)
+	 */
+	full_name = NULL;
+	cur = search_paths;
+	for (i = 0; i < PURPL_MAX_PATHS; i++) {
+		sep = strstr(cur, PURPL_PATH_SEP_STR);
+		len = sep ? (size_t)(sep - cur) : strlen(cur);
+
+		/* Concatenate the path and check if there's a file there */
+		if (len) {
+			full_name = purpl_fmt_text(&full_name_len, "%.*s/%s",
+						   (int)len, cur, name_fmt);
+			if (stat(full_name, &st) == 0 && !S_ISDIR(st.st_mode))
+				break;
+			(full_name_len > 0) ? free(full_name) : (void)0;
+			full_name = NULL;
+		}
+
+		/* Move on to the next path */
+		if (!sep)
+			break;
+		cur = sep + strlen(PURPL_PATH_SEP_STR);
+	}
+
+	/* Free the name */
+	(name_len > 0) ? free(name_fmt) : (void)0;
+
+	/* Check if we found it */
+	if (!full_name) {
+		errno = ENOENT;
 		return NULL;
-	strcpy(paths_full, search_paths);
+	}
+
+	/*
+	 * Canonicalize the path, so that the same file reached through
+	 *  different search paths (or "./" and "../") has one name
+	 */
+#ifdef _WIN32
+	canon = _fullpath(NULL, full_name, 0);
+#else
+	canon = realpath(full_name, NULL);
+#endif
+	if (canon) {
+		(full_name_len > 0) ? free(full_name) : (void)0;
+		full_name = canon;
+	}
+
+	PURPL_RESTORE_ERRNO(___errno);
+
+	return full_name;
+}
 
-	/* Figure out how many paths there are */
-	tmp = strtok(paths_full, PURPL_PATH_SEP_STR);
-	if (!tmp) { /* Blame the user, they probably messed up */
+struct purpl_search_paths *purpl_parse_search_paths(const char *search_paths)
+{
+	struct purpl_search_paths *paths;
+	const char *cur;
+	const char *sep;
+	size_t len;
+	char *path;
+	char *canon;
+	u8 i;
+	int ___errno;
+
+	PURPL_SAVE_ERRNO(___errno);
+
+	/* Check args */
+	if (!search_paths) {
 		errno = EINVAL;
 		return NULL;
 	}
-	for (path_count = 1;
-	     path_count < PURPL_MAX_PATHS && strtok(NULL, PURPL_PATH_SEP_STR);
-	     path_count++)
-		;
 
-	/* Now allocate the array of pointers we need */
-	paths = PURPL_CALLOC(path_count, char *);
+	/* Allocate the structure */
+	paths = PURPL_CALLOC(1, struct purpl_search_paths);
 	if (!paths)
 		return NULL;
+	stbds_sh_new_strdup(paths->dirs);
+
+	/* Split up the paths */
+	cur = search_paths;
+	for (i = 0; i < PURPL_MAX_PATHS; i++) {
+		sep = strstr(cur, PURPL_PATH_SEP_STR);
+		len = sep ? (size_t)(sep - cur) : strlen(cur);
+
+		if (len) {
+			/* Copy the path */
+			path = PURPL_CALLOC(len + 1, char);
+			if (!path) {
+				purpl_free_search_paths(paths);
+				return NULL;
+			}
+			memcpy(path, cur, len);
 
-	/* The first round of tokenization fucks up paths_full, rebuild it */
-	strcpy(paths_full, search_paths);
+			/* Canonicalize it if it exists */
+#ifdef _WIN32
+			canon = _fullpath(NULL, path, 0);
+#else
+			canon = realpath(path, NULL);
+#endif
+			if (canon) {
+				free(path);
+				path = canon;
+			}
+
+			/* Get rid of any trailing slash */
+			len = strlen(path);
+			if (len > 1 && (path[len - 1] == '/' ||
+					path[len - 1] == '\\'))
+				path[len - 1] = 0;
+
+			stbds_arrput(paths->paths, path);
+		}
+
+		/* Move on to the next path */
+		if (!sep)
+			break;
+		cur = sep + strlen(PURPL_PATH_SEP_STR);
+	}
+
+	PURPL_RESTORE_ERRNO(___errno);
+
+	return paths;
+}
+
+/*
+ * Clean up a relative path in place, so that it can be used as a key. Slashes
+ *  are made forward, empty and "." components are removed, and ".." removes
+ *  the component before it. Returns false if a ".." goes above the start.
+ */
+static bool normalize_path(char *path)
+{
+	char *src;
+	char *dst;
+	size_t len;
+
+	src = path;
+	dst = path;
+	while (*src) {
+		/* Skip separators */
+		while (*src == '/' || *src == '\\')
+			src++;
+		if (!*src)
+			break;
+		len = strcspn(src, "/\\");
+
+		/* Handle . and .. */
+		if (len == 1 && src[0] == '.') {
+			src += len;
+			continue;
+		} else if (len == 2 && src[0] == '.' && src[1] == '.') {
+			if (dst == path)
+				return false;
+
+			/* Back up over the last component and its slash */
+			dst--;
+			while (dst > path && dst[-1] != '/')
+				dst--;
+			if (dst > path)
+				dst--;
+			src += len;
+			continue;
+		}
+
+		/* Copy anything else */
+		if (dst != path)
+			*dst++ = '/';
+		memmove(dst, src, len);
+		dst += len;
+		src += len;
+	}
+	*dst = 0;
+
+	return true;
+}
 
-	/* Separate the paths into individual pointers */
-	tmp = strtok(paths_full, PURPL_PATH_SEP_STR);
-	paths[0] = PURPL_CALLOC(strlen(tmp), char);
-	if (!paths[0])
+/* List the files in a directory */
+static struct purpl_dir_entry *list_dir(const char *path, bool *ok)
+{
+	struct purpl_dir_entry *listing = NULL;
+	const char *ent_name;
+	bool is_dir;
+#ifdef _WIN32
+	WIN32_FIND_DATAA ent;
+	HANDLE find;
+	char *pattern;
+	s64 pattern_len;
+
+	/* Start listing the directory */
+	pattern = purpl_fmt_text(&pattern_len, "%s/*", path);
+	find = FindFirstFileA(pattern, &ent);
+	(pattern_len > 0) ? free(pattern) : (void)0;
+	if (find == INVALID_HANDLE_VALUE) {
+		/* A directory that doesn't exist is just empty */
+		*ok = GetLastError() == ERROR_PATH_NOT_FOUND ||
+		      GetLastError() == ERROR_FILE_NOT_FOUND;
 		return NULL;
-	strcpy(paths[0], tmp);
-	for (i = 1; i < path_count; i++) {
-		tmp = strtok(NULL, PURPL_PATH_SEP_STR);
-		paths[i] = PURPL_CALLOC(strlen(tmp), char);
-		if (!paths[i])
-			return NULL;
-		strcpy(paths[i], tmp);
 	}
 
-	/* Find the path to the asset */
-	for (i = 0; i < path_count; i++) {
-		/* Concatenate the path */
-		full_name = purpl_fmt_text(&full_name_len, "%s/%s", paths[i],
-					   name_fmt);
+	stbds_sh_new_strdup(listing);
+	do {
+		ent_name = ent.cFileName;
+		is_dir = ent.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY;
+#else
+	DIR *dir;
+	struct dirent *ent;
+	struct stat st;
+	char *ent_path;
+	s64 ent_path_len;
+
+	/* Start listing the directory */
+	dir = opendir(path);
+	if (!dir) {
+		/* A directory that doesn't exist is just empty */
+		*ok = errno == ENOENT || errno == ENOTDIR;
+		return NULL;
+	}
 
-		/* Now try opening it, if it succeeds, we're done here */
-		errno = 0;
-		fp = fopen(full_name, "rb");
-		if (!fp) {
-			/* Free the path and continue if we failed */
-			(full_name_len > 0) ? (void)0 : free(full_name);
+	stbds_sh_new_strdup(listing);
+	while ((ent = readdir(dir))) {
+		ent_name = ent->d_name;
+#ifdef _DIRENT_HAVE_D_TYPE
+		is_dir = ent->d_type == DT_DIR;
+		if (ent->d_type == DT_UNKNOWN || ent->d_type == DT_LNK) {
+#endif
+			/* Some file systems don't say what the entry is */
+			ent_path = purpl_fmt_text(&ent_path_len, "%s/%s", path,
+						  ent_name);
+			is_dir = stat(ent_path, &st) == 0 &&
+				 S_ISDIR(st.st_mode);
+			(ent_path_len > 0) ? free(ent_path) : (void)0;
+#ifdef _DIRENT_HAVE_D_TYPE
+		}
+#endif
+#endif
+		/* Skip . and .. */
+		if (strcmp(ent_name, ".") == 0 || strcmp(ent_name, "..") == 0)
 			continue;
+
+		stbds_shput(listing, ent_name, is_dir);
+#ifdef _WIN32
+	} while (FindNextFileA(find, &ent));
+	FindClose(find);
+#else
+	}
+	closedir(dir);
+#endif
+
+	*ok = true;
+	return listing;
+}
+
+/* Check whether a directory has a file in it, listing it if need be */
+static bool dir_has_file(struct purpl_search_paths *paths, const char *dir,
+			 const char *file)
+{
+	struct purpl_dir_entry *listing;
+	struct stat st;
+	char *path;
+	s64 path_len;
+	ptrdiff_t idx;
+	bool ok;
+	bool found;
+
+	/* List the directory if it hasn't been yet */
+	idx = stbds_shgeti(paths->dirs, dir);
+	if (idx < 0) {
+		listing = list_dir(dir, &ok);
+		if (ok) {
+			stbds_shput(paths->dirs, dir, listing);
+			idx = stbds_shgeti(paths->dirs, dir);
 		}
 	}
 
-	/* Check if the file still isn't open */
-	if (!fp)
+	/* Check the listing */
+	if (idx >= 0) {
+		listing = paths->dirs[idx].value;
+		idx = stbds_shgeti(listing, file);
+		return idx >= 0 && !listing[idx].value;
+	}
+
+	/* If it couldn't be listed, fall back to asking the file system */
+	path = purpl_fmt_text(&path_len, "%s/%s", dir, file);
+	found = stat(path, &st) == 0 && !S_ISDIR(st.st_mode);
+	(path_len > 0) ? free(path) : (void)0;
+
+	return found;
+}
+
+char *purpl_resolve_asset(struct purpl_search_paths *paths, const char *name,
+			  ...)
+{
+	va_list args;
+	char *name_fmt;
+	s64 name_len;
+	char *rel;
+	char *file;
+	size_t dir_len;
+	char *dir;
+	s64 dir_fmt_len;
+	char *full_name;
+	s64 full_name_len;
+	size_t i;
+	int ___errno;
+
+	PURPL_SAVE_ERRNO(___errno);
+
+	/* Check args */
+	if (!paths || !name) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	/* Format and copy the name */
+	va_start(args, name);
+	name_fmt = purpl_fmt_text_va(&name_len, name, args);
+	va_end(args);
+	rel = PURPL_CALLOC(strlen(name_fmt) + 1, char);
+	if (!rel) {
+		(name_len > 0) ? free(name_fmt) : (void)0;
 		return NULL;
+	}
+	strcpy(rel, name_fmt);
+	(name_len > 0) ? free(name_fmt) : (void)0;
+
+	/* Clean it up so it can be looked up */
+	if (!normalize_path(rel)) {
+		free(rel);
+		errno = ENOENT;
+		return NULL;
+	}
+
+	/* Split it into the directory and file name */
+	file = strrchr(rel, '/');
+	if (file) {
+		dir_len = file - rel;
+		file++;
+	} else {
+		dir_len = 0;
+		file = rel;
+	}
+
+	/* Check each search path */
+	full_name = NULL;
+	for (i = 0; i < stbds_arrlenu(paths->paths) && *file; i++) {
+		dir = purpl_fmt_text(&dir_fmt_len, "%s%s%.*s", paths->paths[i],
+				     dir_len ? "/" : "", (int)dir_len, rel);
+		if (dir_has_file(paths, dir, file))
+			full_name = purpl_fmt_text(&full_name_len, "%s/%s",
+						   dir, file);
+		(dir_fmt_len > 0) ? free(dir) : (void)0;
+		if (full_name)
+			break;
+	}
+	free(rel);
+
+	/* Check if we found it */
+	if (!full_name || full_name_len < 0) {
+		errno = ENOENT;
+		return NULL;
+	}
+
+	PURPL_RESTORE_ERRNO(___errno);
+
+	return full_name;
+}
+
+void purpl_refresh_search_paths(struct purpl_search_paths *paths,
+				const char *dir)
+{
+	ptrdiff_t idx;
+	size_t i;
+
+	if (!paths) {
+		errno = EINVAL;
+		return;
+	}
+
+	/* Forget one directory */
+	if (dir) {
+		idx = stbds_shgeti(paths->dirs, dir);
+		if (idx >= 0) {
+			stbds_shfree(paths->dirs[idx].value);
+			stbds_shdel(paths->dirs, dir);
+		}
+		return;
+	}
+
+	/* Or forget all of them */
+	for (i = 0; i < stbds_shlenu(paths->dirs); i++)
+		stbds_shfree(paths->dirs[i].value);
+	stbds_shfree(paths->dirs);
+	stbds_sh_new_strdup(paths->dirs);
+}
+
+void purpl_free_search_paths(struct purpl_search_paths *paths)
+{
+	size_t i;
+
+	if (!paths) {
+		errno = EINVAL;
+		return;
+	}
+
+	/* Free the listings */
+	for (i = 0; i < stbds_shlenu(paths->dirs); i++)
+		stbds_shfree(paths->dirs[i].value);
+	stbds_shfree(paths->dirs);
+
+	/* Free the paths */
+	for (i = 0; i < stbds_arrlenu(paths->paths); i++)
+		free(paths->paths[i]);
+	stbds_arrfree(paths->paths);
 
-	/* Free some shit */
-	(name_len > 0) ? (void)0 : free(name_fmt);
 	free(paths);
+}
+
+struct purpl_asset *purpl_load_asset(bool map, const char *path, ...)
+{
+	struct purpl_asset *asset;
+	FILE *fp;
+	va_list args;
+	struct purpl_arena *scratch;
+	struct purpl_arena_mark mark;
+	char *path_fmt;
+	int ___errno;
 
-	/* Now we can finally allocate our structure */
-	asset = PURPL_CALLOC(1, struct purpl_asset);
+	PURPL_SAVE_ERRNO(___errno);
+
+	/* Check args */
+	if (!path) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	/* Format the path */
+	scratch = purpl_get_scratch_arena();
+	mark = purpl_mark_arena(scratch);
+	va_start(args, path);
+	path_fmt = purpl_fmt_text_va_arena(scratch, NULL, path, args);
+	va_end(args);
+
+	/* Open the file */
+	PURPL_PROFILE_BEGIN("Asset load");
+	fp = fopen(path_fmt, PURPL_READ);
+	if (!fp) {
+		purpl_release_arena(scratch, mark);
+		PURPL_PROFILE_END();
+		return NULL;
+	}
+
+	/* Now we can allocate our structure */
+	asset = PURPL_POOL_NEW(struct purpl_asset);
 	if (!asset) {
-		(full_name_len > 0) ? (void)0 : free(full_name);
+		purpl_release_arena(scratch, mark);
+		fclose(fp);
+		PURPL_PROFILE_END();
 		return NULL;
 	}
 
 	/* Fill in the structure */
-	asset->name = PURPL_CALLOC(strlen(full_name), char);
+	asset->name = purpl_pool_strdup(path_fmt);
+	purpl_release_arena(scratch, mark);
 	if (!asset->name) {
-		(full_name_len > 0) ? (void)0 : free(full_name);
+		PURPL_POOL_DELETE(asset);
+		fclose(fp);
+		PURPL_PROFILE_END();
 		return NULL;
 	}
-	strcpy(asset->name, full_name);
 	asset->data =
 		purpl_read_file_fp(&asset->size, &asset->mapping, &map, fp);
-	if (!asset->data)
+	fclose(fp);
+	PURPL_PROFILE_END();
+	if (!asset->data) {
+		purpl_pool_free_str(asset->name);
+		PURPL_POOL_DELETE(asset);
 		return NULL;
+	}
 	asset->mapped = map;
 
-	/* Close the file */
-	fclose(fp);
+	PURPL_RESTORE_ERRNO(___errno);
+
+	/* Return the asset */
+	return asset;
+}
+
+/* Get the parsed version of a list of search paths, parsing it if it's new */
+static struct purpl_search_paths *get_search_paths(const char *search_paths)
+{
+	if (cached_paths && strcmp(cached_search_paths, search_paths) == 0)
+		return cached_paths;
+
+	/* Forget the old ones and parse these */
+	purpl_forget_search_paths();
+	cached_search_paths = PURPL_CALLOC(strlen(search_paths) + 1, char);
+	if (!cached_search_paths)
+		return NULL;
+	strcpy(cached_search_paths, search_paths);
+	cached_paths = purpl_parse_search_paths(search_paths);
+	if (!cached_paths) {
+		free(cached_search_paths);
+		cached_search_paths = NULL;
+	}
+
+	return cached_paths;
+}
+
+struct purpl_asset *purpl_load_asset_from_file(const char *search_paths,
+					       bool map, const char *name, ...)
+{
+	struct purpl_search_paths *paths;
+	struct purpl_asset *asset;
+	va_list args;
+	char *name_fmt;
+	s64 name_len;
+	char *full_name;
+	uint i;
+	int ___errno;
+
+	PURPL_SAVE_ERRNO(___errno);
+
+	/* Check args */
+	if (!search_paths || !name) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	/* Format our filename */
+	va_start(args, name);
+	name_fmt = purpl_fmt_text_va(&name_len, name, args);
+	va_end(args);
+
+	/* Use cached directory listings if the paths can be parsed */
+	paths = get_search_paths(search_paths);
+	for (i = 0; i < 2; i++) {
+		/* Find the path to the asset and load it */
+		if (paths)
+			full_name = purpl_resolve_asset(paths, "%s", name_fmt);
+		else
+			full_name = purpl_find_asset(search_paths, "%s",
+						     name_fmt);
+		asset = full_name ? purpl_load_asset(map, "%s", full_name) :
+				    NULL;
+		free(full_name);
+
+		/* The listings could be out of date, so check once more */
+		if (asset || !paths || errno != ENOENT)
+			break;
+		purpl_refresh_search_paths(paths, NULL);
+	}
+	(name_len > 0) ? free(name_fmt) : (void)0;
+	if (!asset)
+		return NULL;
 
 	PURPL_RESTORE_ERRNO(___errno);
 
@@ -265,6 +997,15 @@ struct purpl_asset *purpl_load_asset_from_file(const char *search_paths,
 	return asset;
 }
 
+void purpl_forget_search_paths(void)
+{
+	if (cached_paths)
+		purpl_free_search_paths(cached_paths);
+	cached_paths = NULL;
+	free(cached_search_paths);
+	cached_search_paths = NULL;
+}
+
 void purpl_free_asset(struct purpl_asset *asset)
 {
 	int ___errno;
@@ -272,7 +1013,7 @@ void purpl_free_asset(struct purpl_asset *asset)
 	PURPL_SAVE_ERRNO(___errno);
 
 	/* Avoid a segfault/double free */
-	if (!asset || !asset->mapping) {
+	if (!asset) {
 		errno = EINVAL;
 		return;
 	}
@@ -280,11 +1021,12 @@ void purpl_free_asset(struct purpl_asset *asset)
 	/* If the file is mapped, deal with that */
 	if (asset->mapped)
 		purpl_unmap_file(asset->mapping);
-	else /* Otherwise free the data */
+	else if (!asset->embedded) /* Otherwise free the data if it's ours */
 		free(asset->data);
 
 	/* Free the rest of the structure */
-	free(asset);
+	purpl_pool_free_str(asset->name);
+	PURPL_POOL_DELETE(asset);
 
 	PURPL_RESTORE_ERRNO(___errno);
 }
@@ -301,11 +1043,17 @@ void purpl_free_embed(struct purpl_embed *embed)
 	}
 
 	/* Close the libarchive handle */
-	archive_read_close(embed->ar);
-	archive_read_free(embed->ar);
+	if (embed->ar) {
+		archive_read_close(embed->ar);
+		archive_read_free(embed->ar);
+	}
+
+	/* Free the index */
+	stbds_shfree(embed->index);
+	purpl_free_pack(embed->pack);
 
 	/* Free the embed */
-	free(embed);
+	PURPL_POOL_DELETE(embed);
 
 	PURPL_RESTORE_ERRNO(___errno);
 }
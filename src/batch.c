@@ -0,0 +1,634 @@
+#include "purpl/batch.h"
+#include "purpl/job.h"
+#include "purpl/profile.h"
+
+#include <fcntl.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <linux/stat.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Get a file's buffer ready for its contents */
+static int prepare_buffer(struct purpl_batch_file *file, u64 size,
+			  bool *owned)
+{
+	*owned = false;
+	if (size >= SIZE_MAX)
+		return EFBIG;
+	file->size = size;
+
+	/* Use the one that was given if it's big enough */
+	if (file->data)
+		return file->capacity > size ? 0 : ENOBUFS;
+
+	file->data = PURPL_CALLOC(size + 1, char);
+	if (!file->data)
+		return ENOMEM;
+	*owned = true;
+
+	return 0;
+}
+
+/* Terminate a file's contents, or get rid of them if it failed */
+static bool finish_file(struct purpl_batch_file *file, bool owned, int err)
+{
+	file->err = err;
+	if (err) {
+		if (owned) {
+			free(file->data);
+			file->data = NULL;
+		}
+		return false;
+	}
+
+	file->data[file->size] = 0;
+	return true;
+}
+
+/* Read a file the ordinary way */
+static void read_file(struct purpl_batch_file *file)
+{
+#ifdef _WIN32
+	struct _stat64 st;
+#else
+	struct stat st;
+#endif
+	bool owned = false;
+	s64 len;
+	u64 done;
+	int fd;
+	int err;
+
+	/* Open it and get its size */
+#ifdef _WIN32
+	fd = _open(file->path, _O_RDONLY | _O_BINARY);
+#else
+	fd = open(file->path, O_RDONLY | O_CLOEXEC);
+#endif
+	if (fd < 0) {
+		finish_file(file, false, errno);
+		return;
+	}
+#ifdef _WIN32
+	err = _fstat64(fd, &st) < 0 ? errno : 0;
+#else
+	err = fstat(fd, &st) < 0 ? errno : 0;
+#endif
+	if (!err && (st.st_mode & S_IFMT) != S_IFREG)
+		err = EISDIR;
+	if (!err)
+		err = prepare_buffer(file, st.st_size, &owned);
+
+	/* Read until it's all there */
+	done = 0;
+	while (!err && done < file->size) {
+		len = PURPL_MIN(file->size - done, PURPL_BATCH_MAX_READ);
+#ifdef _WIN32
+		len = _read(fd, file->data + done, len);
+#else
+		len = pread(fd, file->data + done, len, done);
+#endif
+		if (len < 0 && errno != EINTR)
+			err = errno;
+		else if (len == 0) /* It got shorter */
+			file->size = done;
+		else if (len > 0)
+			done += len;
+	}
+
+	close(fd);
+	finish_file(file, owned, err);
+}
+
+/* Read part of a batch, for purpl_inst_parallel_for */
+static void read_files(void *data, size_t start, size_t end)
+{
+	struct purpl_batch_file *files = data;
+	size_t i;
+
+	for (i = start; i < end; i++)
+		read_file(&files[i]);
+}
+
+#ifdef __linux__
+/* What an operation is for, kept in the low bits of its user_data */
+enum uring_op {
+	URING_OPEN,
+	URING_STATX,
+	URING_READ,
+	URING_CLOSE,
+};
+#define URING_OP_BITS 2
+#define URING_OP_MASK ((1 << URING_OP_BITS) - 1)
+
+/* An io_uring, set up by hand since liburing isn't a dependency */
+struct uring {
+	int fd;
+	u8 *sq_ring;
+	size_t sq_ring_len;
+	u8 *cq_ring;
+	size_t cq_ring_len;
+	struct io_uring_sqe *sqes;
+	size_t sqes_len;
+	u32 *sq_head;
+	u32 *sq_tail;
+	u32 sq_mask;
+	u32 *sq_array;
+	u32 *cq_head;
+	u32 *cq_tail;
+	u32 cq_mask;
+	struct io_uring_cqe *cqes;
+	u32 entries;
+	u32 queued; /* Submitted to the ring but not the kernel */
+	u32 inflight; /* Not completed yet, never more than entries */
+};
+
+/* The progress of a file being read through io_uring */
+struct uring_file {
+	struct statx stx;
+	int fd;
+	u8 pending;
+	bool owned;
+	bool finished;
+	int err;
+	u64 done;
+};
+
+/* Check that the kernel can do everything a batch needs */
+static bool uring_supported(int fd)
+{
+	static const u8 ops[] = { IORING_OP_OPENAT, IORING_OP_STATX,
+				  IORING_OP_READ, IORING_OP_CLOSE };
+	struct io_uring_probe *probe;
+	size_t size;
+	bool supported;
+	size_t i;
+
+	size = sizeof(struct io_uring_probe) +
+	       256 * sizeof(struct io_uring_probe_op);
+	probe = (struct io_uring_probe *)PURPL_CALLOC(size, u8);
+	if (!probe)
+		return false;
+
+	/* Kernels from before the probe can't do all of these anyway */
+	supported = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE,
+			    probe, 256) >= 0;
+	for (i = 0; supported && i < PURPL_ARRAY_SIZE(ops); i++)
+		supported = ops[i] <= probe->last_op &&
+			    probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED;
+
+	free(probe);
+	return supported;
+}
+
+/* Get rid of an io_uring */
+static void uring_destroy(struct uring *ring)
+{
+	if (ring->sqes)
+		munmap(ring->sqes, ring->sqes_len);
+	if (ring->cq_ring && ring->cq_ring != ring->sq_ring)
+		munmap(ring->cq_ring, ring->cq_ring_len);
+	if (ring->sq_ring)
+		munmap(ring->sq_ring, ring->sq_ring_len);
+	close(ring->fd);
+}
+
+/* Map a part of an io_uring */
+static void *uring_map(struct uring *ring, size_t len, u64 offset)
+{
+	void *ptr;
+
+	ptr = mmap(NULL, len, PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_POPULATE, ring->fd, offset);
+	return ptr == MAP_FAILED ? NULL : ptr;
+}
+
+/* Create an io_uring */
+static int uring_create(struct uring *ring, u32 entries)
+{
+	struct io_uring_params params;
+
+	memset(ring, 0, sizeof(struct uring));
+	memset(&params, 0, sizeof(struct io_uring_params));
+
+	/* Create it, and make sure it's useful */
+	ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+	if (ring->fd < 0)
+		return errno;
+	if (!uring_supported(ring->fd)) {
+		close(ring->fd);
+		return EOPNOTSUPP;
+	}
+
+	/* Newer kernels put both rings in one mapping */
+	ring->sq_ring_len =
+		params.sq_off.array + params.sq_entries * sizeof(u32);
+	ring->cq_ring_len = params.cq_off.cqes +
+			    params.cq_entries * sizeof(struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		ring->sq_ring_len =
+			PURPL_MAX(ring->sq_ring_len, ring->cq_ring_len);
+		ring->cq_ring_len = ring->sq_ring_len;
+	}
+
+	/* Map the rings and the submission entries */
+	ring->sq_ring = uring_map(ring, ring->sq_ring_len, IORING_OFF_SQ_RING);
+	if (ring->sq_ring && params.features & IORING_FEAT_SINGLE_MMAP)
+		ring->cq_ring = ring->sq_ring;
+	else if (ring->sq_ring)
+		ring->cq_ring =
+			uring_map(ring, ring->cq_ring_len, IORING_OFF_CQ_RING);
+	ring->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = uring_map(ring, ring->sqes_len, IORING_OFF_SQES);
+	if (!ring->sq_ring || !ring->cq_ring || !ring->sqes) {
+		uring_destroy(ring);
+		return ENOMEM;
+	}
+
+	/* Find everything in them */
+	ring->sq_head = (u32 *)(ring->sq_ring + params.sq_off.head);
+	ring->sq_tail = (u32 *)(ring->sq_ring + params.sq_off.tail);
+	ring->sq_mask = *(u32 *)(ring->sq_ring + params.sq_off.ring_mask);
+	ring->sq_array = (u32 *)(ring->sq_ring + params.sq_off.array);
+	ring->cq_head = (u32 *)(ring->cq_ring + params.cq_off.head);
+	ring->cq_tail = (u32 *)(ring->cq_ring + params.cq_off.tail);
+	ring->cq_mask = *(u32 *)(ring->cq_ring + params.cq_off.ring_mask);
+	ring->cqes =
+		(struct io_uring_cqe *)(ring->cq_ring + params.cq_off.cqes);
+	ring->entries = params.sq_entries;
+
+	return 0;
+}
+
+/* Queue an operation on a file */
+static void uring_queue(struct uring *ring, u8 opcode, size_t idx,
+			enum uring_op op, int fd, const void *addr, u32 len,
+			u64 offset)
+{
+	struct io_uring_sqe *sqe;
+	u32 tail;
+
+	tail = *ring->sq_tail;
+	sqe = &ring->sqes[tail & ring->sq_mask];
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	sqe->opcode = opcode;
+	sqe->fd = fd;
+	sqe->addr = (u64)(uintptr_t)addr;
+	sqe->len = len;
+	sqe->off = offset;
+	sqe->user_data = (u64)idx << URING_OP_BITS | op;
+	if (opcode == IORING_OP_OPENAT)
+		sqe->open_flags = O_RDONLY | O_CLOEXEC;
+
+	/* Publish it */
+	ring->sq_array[tail & ring->sq_mask] = tail & ring->sq_mask;
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	ring->queued++;
+	ring->inflight++;
+}
+
+/* Hand queued operations to the kernel and wait for at least one */
+static int uring_submit(struct uring *ring)
+{
+	long submitted;
+
+	submitted = PURPL_RETRY_INTR(syscall(__NR_io_uring_enter, ring->fd,
+					     ring->queued, 1,
+					     IORING_ENTER_GETEVENTS, NULL, 0));
+	if (submitted < 0)
+		return errno;
+	ring->queued -= submitted;
+
+	return 0;
+}
+
+/* Move a file along once an operation on it completes */
+static bool uring_complete(struct uring *ring, struct purpl_batch_file *files,
+			   struct uring_file *states, u64 user_data, s32 res)
+{
+	struct purpl_batch_file *file;
+	struct uring_file *state;
+	size_t idx;
+
+	idx = user_data >> URING_OP_BITS;
+	file = &files[idx];
+	state = &states[idx];
+	switch (user_data & URING_OP_MASK) {
+	case URING_OPEN:
+		if (res < 0)
+			state->err = -res;
+		else
+			state->fd = res;
+		break;
+	case URING_STATX:
+		if (res < 0 && !state->err)
+			state->err = -res;
+		break;
+	case URING_READ:
+		if (res < 0 && res != -EINTR && res != -EAGAIN)
+			state->err = -res;
+		else if (res == 0) /* It got shorter */
+			file->size = state->done;
+		else if (res > 0)
+			state->done += res;
+		break;
+	case URING_CLOSE:
+		return false;
+	}
+
+	/* Once it's open and its size is known, get a buffer */
+	if ((user_data & URING_OP_MASK) != URING_READ) {
+		if (--state->pending)
+			return false;
+		if (!state->err && !S_ISREG(state->stx.stx_mode))
+			state->err = EISDIR;
+		if (!state->err)
+			state->err = prepare_buffer(file, state->stx.stx_size,
+						    &state->owned);
+	}
+
+	/* Read more, or close it */
+	if (!state->err && state->done < file->size) {
+		uring_queue(ring, IORING_OP_READ, idx, URING_READ, state->fd,
+			    file->data + state->done,
+			    PURPL_MIN(file->size - state->done,
+				      PURPL_BATCH_MAX_READ),
+			    state->done);
+		return false;
+	}
+	if (state->fd >= 0)
+		uring_queue(ring, IORING_OP_CLOSE, idx, URING_CLOSE, state->fd,
+			    NULL, 0, 0);
+	state->finished = true;
+
+	return finish_file(file, state->owned, state->err);
+}
+
+/* Wait for everything the kernel has, without starting anything new */
+static int uring_drain(struct uring *ring, struct uring_file *states)
+{
+	struct io_uring_cqe *cqe;
+	long ret;
+	u32 head;
+	u32 tail;
+
+	/* Anything still queued was never seen by the kernel */
+	while (ring->inflight > ring->queued) {
+		ret = PURPL_RETRY_INTR(syscall(__NR_io_uring_enter, ring->fd,
+					       0, 1, IORING_ENTER_GETEVENTS,
+					       NULL, 0));
+		if (ret < 0)
+			return errno;
+
+		/* Only keep what's needed to clean up */
+		head = *ring->cq_head;
+		tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+		for (; head != tail; head++) {
+			cqe = &ring->cqes[head & ring->cq_mask];
+			ring->inflight--;
+			if ((cqe->user_data & URING_OP_MASK) == URING_OPEN &&
+			    cqe->res >= 0)
+				states[cqe->user_data >> URING_OP_BITS].fd =
+					cqe->res;
+		}
+		__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+	}
+
+	return 0;
+}
+
+/* Read a batch through an io_uring */
+static size_t uring_read_files(struct uring *ring,
+			       struct purpl_batch_file *files, size_t count)
+{
+	struct purpl_arena *scratch;
+	struct purpl_arena_mark mark;
+	struct uring_file *states;
+	struct io_uring_cqe *cqe;
+	size_t loaded;
+	size_t next;
+	size_t i;
+	u32 head;
+	u32 tail;
+	int err;
+
+	scratch = purpl_get_scratch_arena();
+	mark = purpl_mark_arena(scratch);
+	states = purpl_arena_alloc(scratch, count * sizeof(struct uring_file));
+	if (!states) {
+		purpl_release_arena(scratch, mark);
+		return 0;
+	}
+
+	loaded = 0;
+	next = 0;
+	err = 0;
+	while (next < count || ring->inflight) {
+		/* Start on as many files as there's room for */
+		while (next < count && ring->inflight + 2 <= ring->entries) {
+			states[next].fd = -1;
+			states[next].pending = 2;
+			states[next].owned = false;
+			states[next].finished = false;
+			states[next].err = 0;
+			states[next].done = 0;
+			uring_queue(ring, IORING_OP_OPENAT, next, URING_OPEN,
+				    AT_FDCWD, files[next].path, 0, 0);
+			uring_queue(ring, IORING_OP_STATX, next, URING_STATX,
+				    AT_FDCWD, files[next].path,
+				    STATX_TYPE | STATX_SIZE,
+				    (u64)(uintptr_t)&states[next].stx);
+			next++;
+		}
+
+		err = uring_submit(ring);
+		if (err && err != EAGAIN && err != EBUSY)
+			break;
+
+		/* Handle everything that's done */
+		head = *ring->cq_head;
+		tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+		for (; head != tail; head++) {
+			cqe = &ring->cqes[head & ring->cq_mask];
+			ring->inflight--;
+			if (uring_complete(ring, files, states, cqe->user_data,
+					   cqe->res))
+				loaded++;
+		}
+		__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+	}
+
+	/*
+	 * If the kernel stopped taking work, give up on the rest. It might
+	 *  still be writing to the states and buffers of what it already has,
+	 *  so wait for that before freeing anything.
+	 */
+	if (ring->inflight) {
+		if (uring_drain(ring, states))
+			return loaded; /* Leaving the scratch memory to it */
+		for (i = 0; i < count; i++) {
+			if (i >= next) {
+				files[i].err = err;
+			} else if (!states[i].finished) {
+				if (states[i].fd >= 0)
+					close(states[i].fd);
+				finish_file(&files[i], states[i].owned, err);
+			}
+		}
+	}
+
+	purpl_release_arena(scratch, mark);
+	return loaded;
+}
+#endif
+
+size_t purpl_inst_read_files(struct purpl_inst *inst,
+			     struct purpl_batch_file *files, size_t count,
+			     u32 flags)
+{
+#ifdef __linux__
+	struct uring ring;
+#endif
+	size_t loaded;
+	size_t i;
+	int ___errno;
+
+	PURPL_SAVE_ERRNO(___errno);
+
+	/* Check arguments */
+	if (!files || !count) {
+		errno = EINVAL;
+		return 0;
+	}
+	for (i = 0; i < count; i++)
+		files[i].err = 0;
+
+	PURPL_PROFILE_BEGIN("Batch read");
+
+	/* Use io_uring if it's there */
+#ifdef __linux__
+	if (!(flags & PURPL_BATCH_NO_URING) &&
+	    uring_create(&ring, PURPL_MIN(count * 2, PURPL_BATCH_RING_SIZE)) ==
+		    0) {
+		loaded = uring_read_files(&ring, files, count);
+		uring_destroy(&ring);
+		PURPL_PROFILE_END();
+
+		PURPL_RESTORE_ERRNO(___errno);
+
+		return loaded;
+	}
+#else
+	NOPE(flags);
+#endif
+
+	/* Otherwise, spread the files over the jobs */
+	if (inst)
+		purpl_inst_parallel_for(inst, count, 0, read_files, files);
+	else
+		read_files(files, 0, count);
+	for (i = 0, loaded = 0; i < count; i++)
+		loaded += !files[i].err;
+	PURPL_PROFILE_END();
+
+	PURPL_RESTORE_ERRNO(___errno);
+
+	return loaded;
+}
+
+size_t purpl_inst_load_assets(struct purpl_inst *inst, const char **names,
+			      size_t count, const char **keys, u32 flags)
+{
+	struct purpl_batch_file *files = NULL;
+	size_t *indices = NULL;
+	struct purpl_asset *asset;
+	char *path;
+	char *sep;
+	size_t loaded;
+	size_t i;
+	int ___errno;
+
+	PURPL_SAVE_ERRNO(___errno);
+
+	/* Check arguments */
+	if (!inst || !inst->info || !names || !keys) {
+		errno = EINVAL;
+		return 0;
+	}
+
+	/* Find every asset, and reference the ones that are already loaded */
+	loaded = 0;
+	for (i = 0; i < count; i++) {
+		keys[i] = NULL;
+		path = purpl_resolve_asset(inst->info->paths, "%s", names[i]);
+		if (!path)
+			continue;
+		if (stbds_shgeti(inst->assets, path) >= 0) {
+			free(path);
+			keys[i] = purpl_inst_load_asset_from_file(inst, false,
+								  "%s",
+								  names[i]);
+			loaded += keys[i] != NULL;
+			continue;
+		}
+
+		stbds_arrput(files,
+			     ((struct purpl_batch_file){ .path = path }));
+		stbds_arrput(indices, i);
+	}
+
+	/* Read the rest all at once */
+	if (stbds_arrlenu(files))
+		purpl_inst_read_files(inst, files, stbds_arrlenu(files), flags);
+
+	/* Add them to the cache */
+	for (i = 0; i < stbds_arrlenu(files); i++) {
+		path = (char *)files[i].path;
+		if (files[i].err) {
+			/* The directory listing was stale, so forget it */
+			sep = strrchr(path, '/');
+			if (files[i].err == ENOENT && sep) {
+				*sep = 0;
+				purpl_refresh_search_paths(inst->info->paths,
+							   path);
+			}
+			free(path);
+			continue;
+		}
+
+		asset = PURPL_POOL_NEW(struct purpl_asset);
+		if (!asset) {
+			free(files[i].data);
+			free(path);
+			continue;
+		}
+		asset->name = purpl_pool_strdup(path);
+		free(path);
+		if (!asset->name) {
+			free(files[i].data);
+			PURPL_POOL_DELETE(asset);
+			continue;
+		}
+		asset->data = files[i].data;
+		asset->size = files[i].size;
+		keys[indices[i]] = purpl_inst_add_asset(inst, asset);
+		loaded += keys[indices[i]] != NULL;
+	}
+
+	stbds_arrfree(files);
+	stbds_arrfree(indices);
+
+	PURPL_RESTORE_ERRNO(___errno);
+
+	return loaded;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,844 @@
+#include "purpl/ecs.h"
+#include "purpl/job.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Round up to the alignment of a column */
+#define ALIGN_COLUMN(x)                                         \
+	(((x) + PURPL_ECS_COLUMN_ALIGN - 1) &                   \
+	 ~(size_t)(PURPL_ECS_COLUMN_ALIGN - 1))
+
+/* Where the first column of a chunk can start */
+#define CHUNK_HEADER ALIGN_COLUMN(sizeof(struct purpl_ecs_chunk))
+
+/* Get a component of the entity in a row of a chunk */
+#define CELL(chunk, offset, size, row) \
+	((u8 *)(chunk) + (offset) + (size_t)(size) * (row))
+
+/* Gives each ECS an ID that's never reused */
+static SDL_atomic_t next_ecs_id;
+
+/* The buffer the calling thread last deferred changes into, and whose it is */
+static PURPL_THREAD_LOCAL u32 current_ecs;
+static PURPL_THREAD_LOCAL struct purpl_ecs_commands *current_commands;
+
+/* The data passed to each job of a parallel query */
+struct each_job {
+	purpl_ecs_func func;
+	void *data;
+	struct purpl_ecs_chunk **chunks;
+};
+
+/* Get the set of components that have been registered */
+static u64 registered(const struct purpl_ecs *ecs)
+{
+	if (ecs->component_count >= PURPL_ECS_MAX_COMPONENTS)
+		return ~0ull;
+	return PURPL_ECS_BIT(ecs->component_count) - 1;
+}
+
+/* Lay out an archetype's columns and get the size of a chunk of it */
+static size_t layout(const struct purpl_ecs *ecs,
+		     struct purpl_ecs_archetype *archetype, u32 capacity)
+{
+	size_t offset;
+	u32 i;
+
+	offset = CHUNK_HEADER;
+	archetype->entities = (u32)offset;
+	offset += (size_t)capacity * sizeof(purpl_entity);
+	for (i = 0; i < ecs->component_count; i++) {
+		/* Tags don't need a column */
+		archetype->offsets[i] = 0;
+		if (!(archetype->components & PURPL_ECS_BIT(i)) ||
+		    !ecs->sizes[i])
+			continue;
+
+		offset = ALIGN_COLUMN(offset);
+		archetype->offsets[i] = (u32)offset;
+		offset += (size_t)capacity * ecs->sizes[i];
+	}
+
+	return offset;
+}
+
+/* Get the archetype for a set of components, creating it the first time */
+static struct purpl_ecs_archetype *get_archetype(struct purpl_ecs *ecs,
+						 u64 components)
+{
+	struct purpl_ecs_archetype *archetype;
+	size_t row;
+	u32 capacity;
+	u32 i;
+
+	archetype = stbds_hmget(ecs->archetypes, components);
+	if (archetype)
+		return archetype;
+
+	archetype = PURPL_CALLOC(1, struct purpl_ecs_archetype);
+	if (!archetype)
+		return NULL;
+	archetype->components = components;
+
+	/* Fit as many entities as possible, allowing for alignment */
+	row = sizeof(purpl_entity);
+	for (i = 0; i < ecs->component_count; i++) {
+		if (components & PURPL_ECS_BIT(i))
+			row += ecs->sizes[i];
+	}
+	capacity = (u32)((PURPL_ECS_CHUNK_SIZE - CHUNK_HEADER) / row);
+	while (capacity && layout(ecs, archetype, capacity) >
+				   PURPL_ECS_CHUNK_SIZE)
+		capacity--;
+	if (!capacity) {
+		free(archetype);
+		errno = E2BIG;
+		return NULL;
+	}
+	archetype->capacity = capacity;
+
+	stbds_hmput(ecs->archetypes, components, archetype);
+	return archetype;
+}
+
+/* Add a row to the end of an archetype */
+static bool add_row(struct purpl_ecs_archetype *archetype, u32 *chunk,
+		    u32 *row)
+{
+	struct purpl_ecs_chunk *new_chunk;
+	size_t index;
+
+	/* Use a chunk that emptied out before allocating another one */
+	index = archetype->count / archetype->capacity;
+	if (index == stbds_arrlenu(archetype->chunks)) {
+		new_chunk = purpl_calloc(1, PURPL_ECS_CHUNK_SIZE);
+		if (!new_chunk)
+			return false;
+		new_chunk->archetype = archetype;
+		stbds_arrput(archetype->chunks, new_chunk);
+	}
+
+	*chunk = (u32)index;
+	*row = archetype->chunks[index]->count++;
+	archetype->count++;
+
+	return true;
+}
+
+/* Remove a row from an archetype by moving its last row into it */
+static void remove_row(struct purpl_ecs *ecs,
+		       struct purpl_ecs_archetype *archetype, u32 chunk,
+		       u32 row)
+{
+	struct purpl_ecs_chunk *dst;
+	struct purpl_ecs_chunk *src;
+	purpl_entity moved;
+	size_t last;
+	u32 last_row;
+	u32 i;
+
+	dst = archetype->chunks[chunk];
+	last = archetype->count - 1;
+	src = archetype->chunks[last / archetype->capacity];
+	last_row = (u32)(last % archetype->capacity);
+	if (src != dst || last_row != row) {
+		moved = ((purpl_entity *)CELL(src, archetype->entities, 0,
+					      0))[last_row];
+		((purpl_entity *)CELL(dst, archetype->entities, 0, 0))[row] =
+			moved;
+		for (i = 0; i < ecs->component_count; i++) {
+			if (archetype->offsets[i])
+				memcpy(CELL(dst, archetype->offsets[i],
+					    ecs->sizes[i], row),
+				       CELL(src, archetype->offsets[i],
+					    ecs->sizes[i], last_row),
+				       ecs->sizes[i]);
+		}
+		ecs->records[PURPL_ENTITY_INDEX(moved)].chunk = chunk;
+		ecs->records[PURPL_ENTITY_INDEX(moved)].row = row;
+	}
+
+	src->count--;
+	archetype->count--;
+}
+
+/* Get the record of an entity, if it exists */
+static struct purpl_ecs_record *get_record(const struct purpl_ecs *ecs,
+					   purpl_entity entity)
+{
+	struct purpl_ecs_record *record;
+
+	if (PURPL_ENTITY_INDEX(entity) >= stbds_arrlenu(ecs->records))
+		return NULL;
+
+	record = &ecs->records[PURPL_ENTITY_INDEX(entity)];
+	if (!record->archetype ||
+	    record->generation != PURPL_ENTITY_GENERATION(entity))
+		return NULL;
+
+	return record;
+}
+
+/* Move an entity to the archetype for a different set of components */
+static int move_entity(struct purpl_ecs *ecs, struct purpl_ecs_record *record,
+		       u64 components)
+{
+	struct purpl_ecs_archetype *src;
+	struct purpl_ecs_archetype *dst;
+	struct purpl_ecs_chunk *src_chunk;
+	struct purpl_ecs_chunk *dst_chunk;
+	u32 chunk;
+	u32 row;
+	u32 i;
+
+	src = record->archetype;
+	dst = get_archetype(ecs, components);
+	if (!dst || !add_row(dst, &chunk, &row))
+		return errno;
+
+	/* Bring over what it already had, and zero the rest */
+	src_chunk = src->chunks[record->chunk];
+	dst_chunk = dst->chunks[chunk];
+	((purpl_entity *)CELL(dst_chunk, dst->entities, 0, 0))[row] =
+		((purpl_entity *)CELL(src_chunk, src->entities, 0,
+				      0))[record->row];
+	for (i = 0; i < ecs->component_count; i++) {
+		if (!dst->offsets[i])
+			continue;
+		if (src->offsets[i])
+			memcpy(CELL(dst_chunk, dst->offsets[i], ecs->sizes[i],
+				    row),
+			       CELL(src_chunk, src->offsets[i], ecs->sizes[i],
+				    record->row),
+			       ecs->sizes[i]);
+		else
+			memset(CELL(dst_chunk, dst->offsets[i], ecs->sizes[i],
+				    row),
+			       0, ecs->sizes[i]);
+	}
+
+	remove_row(ecs, src, record->chunk, record->row);
+	record->archetype = dst;
+	record->chunk = chunk;
+	record->row = row;
+
+	return 0;
+}
+
+/* Get the calling thread's buffer, creating it the first time */
+static struct purpl_ecs_commands *get_commands(struct purpl_ecs *ecs)
+{
+	struct purpl_ecs_commands *commands;
+	SDL_threadID self;
+	size_t i;
+
+	if (current_ecs == ecs->id && current_commands)
+		return current_commands;
+
+	/* This thread might have deferred changes to another ECS in between */
+	self = SDL_ThreadID();
+	commands = NULL;
+	SDL_AtomicLock(&ecs->lock);
+	for (i = 0; i < stbds_arrlenu(ecs->commands); i++) {
+		if (ecs->commands[i]->owner == self) {
+			commands = ecs->commands[i];
+			break;
+		}
+	}
+	if (!commands) {
+		commands = PURPL_CALLOC(1, struct purpl_ecs_commands);
+		if (commands) {
+			commands->owner = self;
+			stbds_arrput(ecs->commands, commands);
+		}
+	}
+	SDL_AtomicUnlock(&ecs->lock);
+	if (!commands)
+		return NULL;
+
+	current_ecs = ecs->id;
+	current_commands = commands;
+	return commands;
+}
+
+/* Record a deferred change */
+static struct purpl_ecs_cmd *defer(struct purpl_ecs *ecs,
+				   enum purpl_ecs_cmd_type type,
+				   purpl_entity entity, u32 component,
+				   size_t size, u8 **data)
+{
+	struct purpl_ecs_commands *commands;
+	struct purpl_ecs_cmd *cmd;
+
+	commands = get_commands(ecs);
+	if (!commands)
+		return NULL;
+
+	/* The data can move, so commands keep its offset */
+	cmd = stbds_arraddnptr(commands->cmds, 1);
+	cmd->type = type;
+	cmd->component = component;
+	cmd->entity = entity;
+	cmd->components = 0;
+	cmd->data = stbds_arrlenu(commands->data);
+	if (size)
+		*data = stbds_arraddnptr(commands->data, size);
+
+	return cmd;
+}
+
+/* Go over part of the chunks a parallel query matched */
+static void each_range(void *data, size_t start, size_t end)
+{
+	struct each_job *job;
+	size_t i;
+
+	job = data;
+	for (i = start; i < end; i++)
+		job->func(job->chunks[i], job->data);
+}
+
+struct purpl_ecs *purpl_create_ecs(void)
+{
+	struct purpl_ecs *ecs;
+	int ___errno;
+
+	PURPL_SAVE_ERRNO(___errno);
+
+	/* Allocate the structure */
+	ecs = PURPL_CALLOC(1, struct purpl_ecs);
+	if (!ecs)
+		return NULL;
+	ecs->id = (u32)SDL_AtomicAdd(&next_ecs_id, 1) + 1;
+
+	PURPL_RESTORE_ERRNO(___errno);
+
+	return ecs;
+}
+
+int purpl_inst_create_ecs(struct purpl_inst *inst)
+{
+	int ___errno;
+
+	PURPL_SAVE_ERRNO(___errno);
+
+	/* Check arguments */
+	if (!inst) {
+		errno = EINVAL;
+		return errno;
+	}
+	if (inst->ecs) {
+		errno = EEXIST;
+		return errno;
+	}
+
+	inst->ecs = purpl_create_ecs();
+	if (!inst->ecs)
+		return errno;
+
+	PURPL_RESTORE_ERRNO(___errno);
+
+	return 0;
+}
+
+u32 purpl_ecs_register_component(struct purpl_ecs *ecs, size_t size)
+{
+	/* Check arguments */
+	if (!ecs || size > PURPL_ECS_CHUNK_SIZE / 2) {
+		errno = EINVAL;
+		return PURPL_ECS_NO_COMPONENT;
+	}
+	if (ecs->component_count >= PURPL_ECS_MAX_COMPONENTS) {
+		errno = ENOSPC;
+		return PURPL_ECS_NO_COMPONENT;
+	}
+
+	ecs->sizes[ecs->component_count] = (u32)size;
+	return ecs->component_count++;
+}
+
+purpl_entity purpl_ecs_create(struct purpl_ecs *ecs, u64 components)
+{
+	struct purpl_ecs_archetype *archetype;
+	struct purpl_ecs_record *record;
+	struct purpl_ecs_chunk *chunk;
+	purpl_entity entity;
+	size_t index;
+	u32 i;
+	int ___errno;
+
+	PURPL_SAVE_ERRNO(___errno);
+
+	/* Check arguments */
+	if (!ecs || components & ~registered(ecs)) {
+		errno = EINVAL;
+		return PURPL_NULL_ENTITY;
+	}
+
+	archetype = get_archetype(ecs, components);
+	if (!archetype)
+		return PURPL_NULL_ENTITY;
+
+	/* Reuse an index if there is one */
+	if (stbds_arrlenu(ecs->free)) {
+		index = stbds_arrpop(ecs->free);
+	} else {
+		if (stbds_arrlenu(ecs->records) >= UINT32_MAX) {
+			errno = ERANGE;
+			return PURPL_NULL_ENTITY;
+		}
+		index = stbds_arrlenu(ecs->records);
+		record = stbds_arraddnptr(ecs->records, 1);
+		memset(record, 0, sizeof(struct purpl_ecs_record));
+		record->generation = 1;
+	}
+
+	record = &ecs->records[index];
+	if (!add_row(archetype, &record->chunk, &record->row)) {
+		stbds_arrput(ecs->free, (u32)index);
+		return PURPL_NULL_ENTITY;
+	}
+	record->archetype = archetype;
+	entity = (u64)record->generation << 32 | index;
+
+	/* The row could have belonged to another entity */
+	chunk = archetype->chunks[record->chunk];
+	((purpl_entity *)CELL(chunk, archetype->entities, 0, 0))[record->row] =
+		entity;
+	for (i = 0; i < ecs->component_count; i++) {
+		if (archetype->offsets[i])
+			memset(CELL(chunk, archetype->offsets[i],
+				    ecs->sizes[i], record->row),
+			       0, ecs->sizes[i]);
+	}
+	ecs->count++;
+
+	PURPL_RESTORE_ERRNO(___errno);
+
+	return entity;
+}
+
+int purpl_ecs_destroy(struct purpl_ecs *ecs, purpl_entity entity)
+{
+	struct purpl_ecs_record *record;
+	struct purpl_ecs_archetype *archetype;
+
+	/* Check arguments */
+	record = ecs ? get_record(ecs, entity) : NULL;
+	if (!record) {
+		errno = EINVAL;
+		return errno;
+	}
+
+	archetype = record->archetype;
+	remove_row(ecs, archetype, record->chunk, record->row);
+
+	/* Old handles stop matching, and 0 is never valid */
+	record->archetype = NULL;
+	if (!++record->generation)
+		record->generation = 1;
+	stbds_arrput(ecs->free, PURPL_ENTITY_INDEX(entity));
+	ecs->count--;
+
+	return 0;
+}
+
+bool purpl_ecs_alive(const struct purpl_ecs *ecs, purpl_entity entity)
+{
+	return ecs && get_record(ecs, entity);
+}
+
+void *purpl_ecs_get(const struct purpl_ecs *ecs, purpl_entity entity,
+		    u32 component)
+{
+	struct purpl_ecs_record *record;
+	u32 offset;
+
+	/* Check arguments */
+	record = ecs ? get_record(ecs, entity) : NULL;
+	if (!record || component >= ecs->component_count) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	offset = record->archetype->offsets[component];
+	if (!offset)
+		return NULL;
+
+	return CELL(record->archetype->chunks[record->chunk], offset,
+		    ecs->sizes[component], record->row);
+}
+
+int purpl_ecs_add(struct purpl_ecs *ecs, purpl_entity entity, u32 component,
+		  const void *value)
+{
+	struct purpl_ecs_record *record;
+	void *dst;
+	int ___errno;
+
+	PURPL_SAVE_ERRNO(___errno);
+
+	/* Check arguments */
+	record = ecs ? get_record(ecs, entity) : NULL;
+	if (!record || component >= ecs->component_count) {
+		errno = EINVAL;
+		return errno;
+	}
+
+	if (!(record->archetype->components & PURPL_ECS_BIT(component)) &&
+	    move_entity(ecs, record,
+			record->archetype->components |
+				PURPL_ECS_BIT(component)) != 0)
+		return errno;
+
+	/* Set it, unless it's a tag */
+	dst = purpl_ecs_get(ecs, entity, component);
+	if (dst) {
+		if (value)
+			memcpy(dst, value, ecs->sizes[component]);
+		else
+			memset(dst, 0, ecs->sizes[component]);
+	}
+
+	PURPL_RESTORE_ERRNO(___errno);
+
+	return 0;
+}
+
+int purpl_ecs_remove(struct purpl_ecs *ecs, purpl_entity entity,
+		     u32 component)
+{
+	struct purpl_ecs_record *record;
+	int ___errno;
+
+	PURPL_SAVE_ERRNO(___errno);
+
+	/* Check arguments */
+	record = ecs ? get_record(ecs, entity) : NULL;
+	if (!record || component >= ecs->component_count) {
+		errno = EINVAL;
+		return errno;
+	}
+
+	if (record->archetype->components & PURPL_ECS_BIT(component) &&
+	    move_entity(ecs, record,
+			record->archetype->components &
+				~PURPL_ECS_BIT(component)) != 0)
+		return errno;
+
+	PURPL_RESTORE_ERRNO(___errno);
+
+	return 0;
+}
+
+const purpl_entity *purpl_ecs_entities(const struct purpl_ecs_chunk *chunk)
+{
+	if (!chunk) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	return (const purpl_entity *)CELL(chunk, chunk->archetype->entities, 0,
+					  0);
+}
+
+void *purpl_ecs_column(const struct purpl_ecs_chunk *chunk, u32 component)
+{
+	if (!chunk || component >= PURPL_ECS_MAX_COMPONENTS) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	if (!chunk->archetype->offsets[component])
+		return NULL;
+
+	return CELL(chunk, chunk->archetype->offsets[component], 0, 0);
+}
+
+size_t purpl_ecs_each(struct purpl_ecs *ecs, u64 all, u64 none,
+		      purpl_ecs_func func, void *data)
+{
+	struct purpl_ecs_archetype *archetype;
+	size_t total;
+	size_t i;
+	size_t j;
+
+	/* Check arguments */
+	if (!ecs || !func) {
+		errno = EINVAL;
+		return 0;
+	}
+
+	total = 0;
+	for (i = 0; i < stbds_hmlenu(ecs->archetypes); i++) {
+		archetype = ecs->archetypes[i].value;
+		if ((archetype->components & all) != all ||
+		    archetype->components & none)
+			continue;
+
+		/* Chunks after the first empty one are spares */
+		for (j = 0; j < stbds_arrlenu(archetype->chunks) &&
+			    archetype->chunks[j]->count;
+		     j++) {
+			total += archetype->chunks[j]->count;
+			func(archetype->chunks[j], data);
+		}
+	}
+
+	return total;
+}
+
+size_t purpl_inst_ecs_each(struct purpl_inst *inst, struct purpl_ecs *ecs,
+			   u64 all, u64 none, purpl_ecs_func func, void *data)
+{
+	struct purpl_ecs_archetype *archetype;
+	struct each_job job;
+	size_t total;
+	size_t i;
+	size_t j;
+
+	/* Check arguments */
+	if (!inst || !ecs || !func) {
+		errno = EINVAL;
+		return 0;
+	}
+
+	/* Gather the chunks, so the jobs can split them evenly */
+	stbds_arrsetlen(ecs->matched, 0);
+	total = 0;
+	for (i = 0; i < stbds_hmlenu(ecs->archetypes); i++) {
+		archetype = ecs->archetypes[i].value;
+		if ((archetype->components & all) != all ||
+		    archetype->components & none)
+			continue;
+
+		for (j = 0; j < stbds_arrlenu(archetype->chunks) &&
+			    archetype->chunks[j]->count;
+		     j++) {
+			total += archetype->chunks[j]->count;
+			stbds_arrput(ecs->matched, archetype->chunks[j]);
+		}
+	}
+
+	job.func = func;
+	job.data = data;
+	job.chunks = ecs->matched;
+	if (purpl_inst_parallel_for(inst, stbds_arrlenu(ecs->matched), 0,
+				    each_range, &job) != 0)
+		return 0;
+
+	return total;
+}
+
+int purpl_ecs_defer_create(struct purpl_ecs *ecs, u64 components,
+			   const void *const *values)
+{
+	struct purpl_ecs_cmd *cmd;
+	size_t size;
+	size_t value;
+	u8 *data;
+	u32 i;
+
+	/* Check arguments */
+	if (!ecs || components & ~registered(ecs)) {
+		errno = EINVAL;
+		return errno;
+	}
+
+	size = 0;
+	for (i = 0; i < ecs->component_count; i++) {
+		if (components & PURPL_ECS_BIT(i))
+			size += ecs->sizes[i];
+	}
+
+	cmd = defer(ecs, PURPL_ECS_CMD_CREATE, PURPL_NULL_ENTITY,
+		    PURPL_ECS_NO_COMPONENT, size, &data);
+	if (!cmd)
+		return errno;
+	cmd->components = components;
+
+	/* Copy the values in the same order as the columns */
+	value = 0;
+	for (i = 0; i < ecs->component_count; i++) {
+		if (!(components & PURPL_ECS_BIT(i)))
+			continue;
+		if (ecs->sizes[i]) {
+			if (values && values[value])
+				memcpy(data, values[value], ecs->sizes[i]);
+			else
+				memset(data, 0, ecs->sizes[i]);
+			data += ecs->sizes[i];
+		}
+		value++;
+	}
+
+	return 0;
+}
+
+int purpl_ecs_defer_destroy(struct purpl_ecs *ecs, purpl_entity entity)
+{
+	/* Check arguments */
+	if (!ecs) {
+		errno = EINVAL;
+		return errno;
+	}
+
+	if (!defer(ecs, PURPL_ECS_CMD_DESTROY, entity, PURPL_ECS_NO_COMPONENT,
+		   0, NULL))
+		return errno;
+
+	return 0;
+}
+
+int purpl_ecs_defer_add(struct purpl_ecs *ecs, purpl_entity entity,
+			u32 component, const void *value)
+{
+	u8 *data;
+
+	/* Check arguments */
+	if (!ecs || component >= ecs->component_count) {
+		errno = EINVAL;
+		return errno;
+	}
+
+	if (!defer(ecs, PURPL_ECS_CMD_ADD, entity, component,
+		   ecs->sizes[component], &data))
+		return errno;
+	if (ecs->sizes[component]) {
+		if (value)
+			memcpy(data, value, ecs->sizes[component]);
+		else
+			memset(data, 0, ecs->sizes[component]);
+	}
+
+	return 0;
+}
+
+int purpl_ecs_defer_remove(struct purpl_ecs *ecs, purpl_entity entity,
+			   u32 component)
+{
+	/* Check arguments */
+	if (!ecs || component >= ecs->component_count) {
+		errno = EINVAL;
+		return errno;
+	}
+
+	if (!defer(ecs, PURPL_ECS_CMD_REMOVE, entity, component, 0, NULL))
+		return errno;
+
+	return 0;
+}
+
+size_t purpl_ecs_flush(struct purpl_ecs *ecs)
+{
+	struct purpl_ecs_commands *commands;
+	struct purpl_ecs_cmd *cmd;
+	purpl_entity entity;
+	size_t applied;
+	size_t count;
+	size_t i;
+	size_t j;
+	u8 *data;
+	u32 k;
+	int ___errno;
+
+	PURPL_SAVE_ERRNO(___errno);
+
+	if (!ecs) {
+		errno = EINVAL;
+		return 0;
+	}
+
+	/* Nothing else can be deferring changes while this runs */
+	SDL_AtomicLock(&ecs->lock);
+	count = stbds_arrlenu(ecs->commands);
+	SDL_AtomicUnlock(&ecs->lock);
+
+	applied = 0;
+	for (i = 0; i < count; i++) {
+		commands = ecs->commands[i];
+		for (j = 0; j < stbds_arrlenu(commands->cmds); j++) {
+			cmd = &commands->cmds[j];
+			data = commands->data + cmd->data;
+			switch (cmd->type) {
+			case PURPL_ECS_CMD_CREATE:
+				entity = purpl_ecs_create(ecs, cmd->components);
+				if (!entity)
+					continue;
+				for (k = 0; k < ecs->component_count; k++) {
+					if (!(cmd->components &
+					      PURPL_ECS_BIT(k)) ||
+					    !ecs->sizes[k])
+						continue;
+					memcpy(purpl_ecs_get(ecs, entity, k),
+					       data, ecs->sizes[k]);
+					data += ecs->sizes[k];
+				}
+				break;
+			case PURPL_ECS_CMD_DESTROY:
+				if (purpl_ecs_destroy(ecs, cmd->entity) != 0)
+					continue;
+				break;
+			case PURPL_ECS_CMD_ADD:
+				if (purpl_ecs_add(ecs, cmd->entity,
+						  cmd->component, data) != 0)
+					continue;
+				break;
+			case PURPL_ECS_CMD_REMOVE:
+				if (purpl_ecs_remove(ecs, cmd->entity,
+						     cmd->component) != 0)
+					continue;
+				break;
+			}
+			applied++;
+		}
+
+		/* Keep the memory for next time */
+		stbds_arrsetlen(commands->cmds, 0);
+		stbds_arrsetlen(commands->data, 0);
+	}
+
+	PURPL_RESTORE_ERRNO(___errno);
+
+	return applied;
+}
+
+void purpl_free_ecs(struct purpl_ecs *ecs)
+{
+	struct purpl_ecs_archetype *archetype;
+	size_t i;
+	size_t j;
+
+	if (!ecs) {
+		errno = EINVAL;
+		return;
+	}
+
+	for (i = 0; i < stbds_hmlenu(ecs->archetypes); i++) {
+		archetype = ecs->archetypes[i].value;
+		for (j = 0; j < stbds_arrlenu(archetype->chunks); j++)
+			free(archetype->chunks[j]);
+		stbds_arrfree(archetype->chunks);
+		free(archetype);
+	}
+	stbds_hmfree(ecs->archetypes);
+
+	/* Other threads' caches can't match, since IDs aren't reused */
+	for (i = 0; i < stbds_arrlenu(ecs->commands); i++) {
+		stbds_arrfree(ecs->commands[i]->cmds);
+		stbds_arrfree(ecs->commands[i]->data);
+		free(ecs->commands[i]);
+	}
+	stbds_arrfree(ecs->commands);
+
+	stbds_arrfree(ecs->records);
+	stbds_arrfree(ecs->free);
+	stbds_arrfree(ecs->matched);
+	free(ecs);
+}
+
+#ifdef __cplusplus
+}
+#endif
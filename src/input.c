@@ -0,0 +1,307 @@
+#include "purpl/input.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Find a key's bit */
+#define KEY_WORD(key) ((key) / 64)
+#define KEY_BIT(key) (1ull << ((key) % 64))
+
+/* Update a set of buttons */
+static void set_button(struct purpl_button_state *buttons, uint button,
+		       bool down)
+{
+	if (button >= 32)
+		return;
+
+	if (down && !(buttons->down & (1u << button))) {
+		buttons->down |= 1u << button;
+		buttons->pressed |= 1u << button;
+	} else if (!down && buttons->down & (1u << button)) {
+		buttons->down &= ~(1u << button);
+		buttons->released |= 1u << button;
+	}
+}
+
+/* Find the slot of a gamepad */
+static struct purpl_gamepad_state *find_gamepad(struct purpl_input *input,
+						SDL_JoystickID id)
+{
+	size_t i;
+
+	for (i = 0; i < PURPL_MAX_GAMEPADS; i++) {
+		if (input->gamepads[i].controller &&
+		    input->gamepads[i].id == id)
+			return &input->gamepads[i];
+	}
+
+	return NULL;
+}
+
+/* Open a gamepad that was plugged in, if there's room */
+static void add_gamepad(struct purpl_input *input, int device)
+{
+	struct purpl_gamepad_state *pad;
+	size_t i;
+
+	for (i = 0; i < PURPL_MAX_GAMEPADS; i++) {
+		pad = &input->gamepads[i];
+		if (pad->controller)
+			continue;
+
+		pad->controller = SDL_GameControllerOpen(device);
+		if (!pad->controller)
+			return;
+		pad->id = SDL_JoystickInstanceID(
+			SDL_GameControllerGetJoystick(pad->controller));
+		memset(&pad->buttons, 0, sizeof(struct purpl_button_state));
+		memset(pad->axes, 0, sizeof(pad->axes));
+		return;
+	}
+}
+
+/* Update the window state from an event about it */
+static void update_window(struct purpl_input *input, SDL_WindowEvent *e)
+{
+	SDL_Window *wnd;
+
+	switch (e->event) {
+	case SDL_WINDOWEVENT_MOVED:
+		input->window.x = e->data1;
+		input->window.y = e->data2;
+		input->window.moved = true;
+		break;
+	case SDL_WINDOWEVENT_SIZE_CHANGED:
+		input->window.w = e->data1;
+		input->window.h = e->data2;
+		input->window.moved = true;
+		break;
+	case SDL_WINDOWEVENT_SHOWN:
+	case SDL_WINDOWEVENT_HIDDEN:
+	case SDL_WINDOWEVENT_MINIMIZED:
+	case SDL_WINDOWEVENT_MAXIMIZED:
+	case SDL_WINDOWEVENT_RESTORED:
+	case SDL_WINDOWEVENT_FOCUS_GAINED:
+	case SDL_WINDOWEVENT_FOCUS_LOST:
+		/* These are the only times the flags change */
+		wnd = SDL_GetWindowFromID(input->window_id);
+		if (wnd)
+			input->window.flags = SDL_GetWindowFlags(wnd);
+		break;
+	}
+}
+
+/* Update the input state from an event */
+static void handle_event(struct purpl_input *input, SDL_Event *e)
+{
+	struct purpl_gamepad_state *pad;
+	uint key;
+
+	switch (e->type) {
+	case SDL_KEYDOWN:
+	case SDL_KEYUP:
+		/* Repeats aren't presses */
+		key = e->key.keysym.scancode;
+		if (key >= SDL_NUM_SCANCODES || e->key.repeat)
+			break;
+		if (e->type == SDL_KEYDOWN) {
+			input->keys[KEY_WORD(key)] |= KEY_BIT(key);
+			input->keys_pressed[KEY_WORD(key)] |= KEY_BIT(key);
+		} else {
+			input->keys[KEY_WORD(key)] &= ~KEY_BIT(key);
+			input->keys_released[KEY_WORD(key)] |= KEY_BIT(key);
+		}
+		break;
+	case SDL_MOUSEMOTION:
+		input->mouse.x = e->motion.x;
+		input->mouse.y = e->motion.y;
+		input->mouse.dx += e->motion.xrel;
+		input->mouse.dy += e->motion.yrel;
+		break;
+	case SDL_MOUSEBUTTONDOWN:
+	case SDL_MOUSEBUTTONUP:
+		set_button(&input->mouse.buttons, e->button.button - 1,
+			   e->type == SDL_MOUSEBUTTONDOWN);
+		break;
+	case SDL_MOUSEWHEEL:
+		input->mouse.wheel_x += e->wheel.x;
+		input->mouse.wheel_y += e->wheel.y;
+		break;
+	case SDL_CONTROLLERDEVICEADDED:
+		add_gamepad(input, e->cdevice.which);
+		break;
+	case SDL_CONTROLLERDEVICEREMOVED:
+		pad = find_gamepad(input, e->cdevice.which);
+		if (pad) {
+			SDL_GameControllerClose(pad->controller);
+			memset(pad, 0, sizeof(struct purpl_gamepad_state));
+		}
+		break;
+	case SDL_CONTROLLERBUTTONDOWN:
+	case SDL_CONTROLLERBUTTONUP:
+		pad = find_gamepad(input, e->cbutton.which);
+		if (pad)
+			set_button(&pad->buttons, e->cbutton.button,
+				   e->type == SDL_CONTROLLERBUTTONDOWN);
+		break;
+	case SDL_CONTROLLERAXISMOTION:
+		pad = find_gamepad(input, e->caxis.which);
+		if (pad && e->caxis.axis < SDL_CONTROLLER_AXIS_MAX)
+			pad->axes[e->caxis.axis] = e->caxis.value;
+		break;
+	case SDL_WINDOWEVENT:
+		if (input->window_id && e->window.windowID == input->window_id)
+			update_window(input, &e->window);
+		break;
+	}
+}
+
+void purpl_input_set_window(struct purpl_input *input, SDL_Window *wnd)
+{
+	if (!input) {
+		errno = EINVAL;
+		return;
+	}
+
+	memset(&input->window, 0, sizeof(struct purpl_window_state));
+	input->window_id = 0;
+	if (!wnd)
+		return;
+
+	/* This is the only time SDL gets asked */
+	input->window_id = SDL_GetWindowID(wnd);
+	SDL_GetWindowPosition(wnd, &input->window.x, &input->window.y);
+	SDL_GetWindowSize(wnd, &input->window.w, &input->window.h);
+	input->window.flags = SDL_GetWindowFlags(wnd);
+}
+
+size_t purpl_poll_input(struct purpl_input *input)
+{
+	SDL_Event *batch;
+	size_t total;
+	int count;
+	int i;
+
+	if (!input) {
+		errno = EINVAL;
+		return 0;
+	}
+
+	/* Forget the last frame, unless it was kept */
+	if (!input->keep) {
+		stbds_arrsetlen(input->events, 0);
+		purpl_clear_input_edges(input);
+	}
+	input->keep = false;
+
+	/* Take the events straight into the array, a batch at a time */
+	SDL_PumpEvents();
+	total = 0;
+	do {
+		batch = stbds_arraddnptr(input->events, PURPL_INPUT_BATCH);
+		count = SDL_PeepEvents(batch, PURPL_INPUT_BATCH, SDL_GETEVENT,
+				       SDL_FIRSTEVENT, SDL_LASTEVENT);
+		count = PURPL_MAX(count, 0);
+		stbds_arrsetlen(input->events,
+				stbds_arrlenu(input->events) -
+					(PURPL_INPUT_BATCH - count));
+		for (i = 0; i < count; i++)
+			handle_event(input, &batch[i]);
+		total += count;
+	} while (count == PURPL_INPUT_BATCH);
+
+	return total;
+}
+
+void purpl_input_keep(struct purpl_input *input)
+{
+	if (!input) {
+		errno = EINVAL;
+		return;
+	}
+
+	input->keep = true;
+}
+
+void purpl_clear_input_edges(struct purpl_input *input)
+{
+	size_t i;
+
+	if (!input) {
+		errno = EINVAL;
+		return;
+	}
+
+	memset(input->keys_pressed, 0, sizeof(input->keys_pressed));
+	memset(input->keys_released, 0, sizeof(input->keys_released));
+	input->mouse.dx = 0;
+	input->mouse.dy = 0;
+	input->mouse.wheel_x = 0;
+	input->mouse.wheel_y = 0;
+	input->mouse.buttons.pressed = 0;
+	input->mouse.buttons.released = 0;
+	for (i = 0; i < PURPL_MAX_GAMEPADS; i++) {
+		input->gamepads[i].buttons.pressed = 0;
+		input->gamepads[i].buttons.released = 0;
+	}
+	input->window.moved = false;
+}
+
+void purpl_free_input(struct purpl_input *input)
+{
+	size_t i;
+
+	if (!input) {
+		errno = EINVAL;
+		return;
+	}
+
+	for (i = 0; i < PURPL_MAX_GAMEPADS; i++) {
+		if (input->gamepads[i].controller)
+			SDL_GameControllerClose(input->gamepads[i].controller);
+	}
+	stbds_arrfree(input->events);
+	memset(input, 0, sizeof(struct purpl_input));
+}
+
+bool purpl_key_down(const struct purpl_input *input, SDL_Scancode key)
+{
+	return input && (uint)key < SDL_NUM_SCANCODES &&
+	       input->keys[KEY_WORD(key)] & KEY_BIT(key);
+}
+
+bool purpl_key_pressed(const struct purpl_input *input, SDL_Scancode key)
+{
+	return input && (uint)key < SDL_NUM_SCANCODES &&
+	       input->keys_pressed[KEY_WORD(key)] & KEY_BIT(key);
+}
+
+bool purpl_key_released(const struct purpl_input *input, SDL_Scancode key)
+{
+	return input && (uint)key < SDL_NUM_SCANCODES &&
+	       input->keys_released[KEY_WORD(key)] & KEY_BIT(key);
+}
+
+float purpl_gamepad_axis(const struct purpl_input *input, uint pad,
+			 SDL_GameControllerAxis axis, float deadzone)
+{
+	float value;
+
+	if (!input || pad >= PURPL_MAX_GAMEPADS ||
+	    !input->gamepads[pad].controller ||
+	    (uint)axis >= SDL_CONTROLLER_AXIS_MAX)
+		return 0;
+
+	/* The negative side goes one further */
+	value = input->gamepads[pad].axes[axis] /
+		(input->gamepads[pad].axes[axis] < 0 ? 32768.0f : 32767.0f);
+	if (value > -deadzone && value < deadzone)
+		return 0;
+
+	return value;
+}
+
+#ifdef __cplusplus
+}
+#endif
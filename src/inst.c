@@ -1,4 +1,10 @@
+#include "purpl/ecs.h"
 #include "purpl/inst.h"
+#include "purpl/job.h"
+#include "purpl/profile.h"
+#include "purpl/render.h"
+#include "purpl/stream.h"
+#include "purpl/watch.h"
 
 struct purpl_inst *purpl_create_inst(bool allow_external_app_info,
 				     bool start_log, char *embed_start,
@@ -8,8 +14,10 @@ struct purpl_inst *purpl_create_inst(bool allow_external_app_info,
 	bool external;
 	bool have_embed;
 	va_list args;
-	char *path;
-	size_t path_len;
+	struct purpl_arena *scratch;
+	struct purpl_arena_mark mark;
+	const char *path;
+	size_t i;
 	int ___errno;
 
 	PURPL_SAVE_ERRNO(___errno);
@@ -21,26 +29,27 @@ struct purpl_inst *purpl_create_inst(bool allow_external_app_info,
 		NOPE(embed_end);
 
 	/* Format the path to the app info */
+	scratch = purpl_get_scratch_arena();
+	mark = purpl_mark_arena(scratch);
 	if (!app_info_path) {
-		/* Allocate a buffer */
-		path_len = strlen("app.json");
-		path = calloc(path_len + 1, sizeof(char));
-		if (!path)
-			return NULL;
-
-		/* Copy in the default app info path */
-		strcpy(path, "app.json");
+		path = "app.json";
 	} else {
-		/* Format the path normally */
 		va_start(args, app_info_path);
-		path = purpl_fmt_text_va(&path_len, app_info_path, args);
+		path = purpl_fmt_text_va_arena(scratch, NULL, app_info_path,
+					       args);
 		va_end(args);
 	}
 
-	/* Allocate the structure */
+	/* Allocate the structure and its frame arena */
 	inst = PURPL_CALLOC(1, struct purpl_inst);
 	if (!inst) {
-		(path_len > 0) ? (void)0 : free(path);
+		purpl_release_arena(scratch, mark);
+		return NULL;
+	}
+	inst->frame_arena = purpl_create_arena(0);
+	if (!inst->frame_arena) {
+		purpl_release_arena(scratch, mark);
+		free(inst);
 		return NULL;
 	}
 
@@ -48,7 +57,8 @@ struct purpl_inst *purpl_create_inst(bool allow_external_app_info,
 	if (have_embed) {
 		inst->embed = purpl_load_embed(embed_start, embed_end);
 		if (!inst->embed) {
-			(path_len > 0) ? (void)0 : free(path);
+			purpl_release_arena(scratch, mark);
+			purpl_free_arena(inst->frame_arena);
 			free(inst);
 			return NULL;
 		}
@@ -56,36 +66,55 @@ struct purpl_inst *purpl_create_inst(bool allow_external_app_info,
 
 	/* Load the app info */
 	inst->info = purpl_load_app_info(inst->embed, external, "%s", path);
+	purpl_release_arena(scratch, mark);
 	if (!inst->info) {
-		(path_len > 0) ? (void)0 : free(path);
 		purpl_free_embed(inst->embed);
+		purpl_free_arena(inst->frame_arena);
 		free(inst);
 		return NULL;
 	}
 
-	/* Append the app info's asset to our list */
-	stbds_shput(inst->assets, inst->info->json->name, inst->info->json);
+	/*
+	 * Append the app info's asset to our list. The reference taken here is
+	 *  never released, since the app info frees it.
+	 */
+	inst->cache.budget = inst->info->asset_budget;
+	if (!purpl_inst_add_asset(inst, inst->info->json)) {
+		/* That already freed the asset, so the app info can't */
+		inst->info->json = NULL;
+		purpl_free_app_info(inst->info);
+		stbds_shfree(inst->assets);
+		purpl_free_embed(inst->embed);
+		purpl_free_arena(inst->frame_arena);
+		free(inst);
+		return NULL;
+	}
 
 	/* Start the logger if requested */
 	if (start_log) {
 		inst->logger = purpl_init_logger(&inst->logindex, PURPL_INFO,
-						 PURPL_WARNING, "%s",
+						 PURPL_LOG_MAX_LEVEL, "%s",
 						 inst->info->log);
 		if (!inst->logger) {
-			(path_len > 0) ? (void)0 : free(path);
+			for (i = 0; i < stbds_shlenu(inst->assets); i++)
+				free(inst->assets[i].key);
+			stbds_shfree(inst->assets);
 			purpl_free_app_info(inst->info);
 			purpl_free_embed(inst->embed);
+			purpl_free_arena(inst->frame_arena);
 			free(inst);
 			return NULL;
 		}
 
 		/* State that the logger has started */
-		purpl_write_log(inst->logger, __FILENAME__, __LINE__, -1, -1,
-				"Logger started");
+		PURPL_LOG_INFO(inst->logger, "Logger started");
 	}
 
-	/* Properly initialize SDL */
-	SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS | SDL_INIT_TIMER);
+	/*
+	 * Properly initialize SDL. Video waits for a window, so instances
+	 *  without one work without a display.
+	 */
+	SDL_Init(SDL_INIT_EVENTS | SDL_INIT_TIMER | SDL_INIT_GAMECONTROLLER);
 
 	PURPL_RESTORE_ERRNO(___errno);
 
@@ -99,8 +128,9 @@ int purpl_inst_create_window(struct purpl_inst *inst, bool fullscreen,
 	va_list args;
 	int w;
 	int h;
+	struct purpl_arena *scratch;
+	struct purpl_arena_mark mark;
 	char *title_fmt;
-	s64 title_len;
 	struct SDL_Rect disp;
 	uint idx;
 	int ___errno;
@@ -119,9 +149,18 @@ int purpl_inst_create_window(struct purpl_inst *inst, bool fullscreen,
 		return errno;
 	}
 
+	/* Start up video if this is the first window */
+	if (!SDL_WasInit(SDL_INIT_VIDEO) &&
+	    SDL_InitSubSystem(SDL_INIT_VIDEO) != 0) {
+		errno = ENODEV;
+		return errno;
+	}
+
 	/* Format the title */
+	scratch = purpl_get_scratch_arena();
+	mark = purpl_mark_arena(scratch);
 	va_start(args, title);
-	title_fmt = purpl_fmt_text_va(&title_len, title, args);
+	title_fmt = purpl_fmt_text_va_arena(scratch, NULL, title, args);
 	va_end(args);
 
 	/* If necessary, get default values for width/height */
@@ -149,6 +188,7 @@ int purpl_inst_create_window(struct purpl_inst *inst, bool fullscreen,
 				     SDL_WINDOW_INPUT_FOCUS | SDL_WINDOW_SHOWN |
 					     SDL_WINDOW_RESIZABLE |
 					     PURPL_GRAPHICS_FLAGS);
+	purpl_release_arena(scratch, mark);
 	if (!inst->wnd) {
 		errno = ENOMEM; /* This is typically the cause */
 		return errno;
@@ -169,14 +209,14 @@ int purpl_inst_create_window(struct purpl_inst *inst, bool fullscreen,
 		SDL_SetWindowBordered(inst->wnd, !fullscreen);
 	}
 
+	/* Keep track of it from here on */
+	purpl_input_set_window(&inst->input, inst->wnd);
+
 #if defined NDEBUG && defined _WIN32
 	/* Eviscerate the console */
 	FreeConsole();
 #endif
 
-	/* Free our title format pointer */
-	(title_len < 0) ? (void)0 : free(title_fmt);
-
 	PURPL_RESTORE_ERRNO(___errno);
 
 	return 0;
@@ -246,16 +286,9 @@ int purpl_inst_init_graphics(struct purpl_inst *inst)
 	/* Enable VSync (TODO: make this controlled by settings file) */
 	SDL_GL_SetSwapInterval(1);
 
-	/* Initialize projection matrix */
-	glMatrixMode(GL_PROJECTION);
-	glLoadIdentity();
-
-	/* Initialize model view matrix */
-	glMatrixMode(GL_MODELVIEW);
-	glLoadIdentity();
-
-	/* Set clear color to black */
-	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	/* Create the renderer, which draws in pixels without any matrices */
+	if (purpl_inst_create_renderer(inst, &purpl_gl_render_backend) != 0)
+		return errno;
 #endif
 
 	PURPL_RESTORE_ERRNO(___errno);
@@ -263,20 +296,185 @@ int purpl_inst_init_graphics(struct purpl_inst *inst)
 	return 0;
 }
 
+/* Take this frame's events and handle the ones for the window */
+static void process_events(struct purpl_inst *inst, bool *fullscreen)
+{
+	struct purpl_window_state *window = &inst->input.window;
+	struct SDL_Rect disp;
+	SDL_Event *e;
+	size_t count;
+	size_t i;
+	int idx;
+
+	PURPL_PROFILE_BEGIN("Event poll");
+
+	/* Only look at the new events, the rest were handled already */
+	count = purpl_poll_input(&inst->input);
+	for (i = stbds_arrlenu(inst->input.events) - count;
+	     i < stbds_arrlenu(inst->input.events); i++) {
+		e = &inst->input.events[i];
+		if (e->type == SDL_QUIT)
+			inst->running = false;
+		if (e->type != SDL_KEYUP || !inst->wnd ||
+		    e->key.keysym.scancode != SDL_SCANCODE_F11)
+			continue;
+
+		/* Handle fullscreen toggling */
+		if (!*fullscreen) {
+			idx = SDL_GetWindowDisplayIndex(inst->wnd);
+			SDL_GetDisplayBounds(idx, &disp);
+
+			/* Unmaximize the window */
+			if (window->flags & SDL_WINDOW_MAXIMIZED)
+				SDL_RestoreWindow(inst->wnd);
+
+			/* Set the window size and position */
+			SDL_SetWindowSize(inst->wnd, disp.w, disp.h);
+			SDL_SetWindowPosition(inst->wnd, disp.x, disp.y);
+			*fullscreen = true;
+		} else {
+			/* Set the size and position to the saved values */
+			SDL_SetWindowSize(inst->wnd, inst->default_w,
+					  inst->default_h);
+			SDL_SetWindowPosition(inst->wnd, inst->default_x,
+					      inst->default_y);
+			*fullscreen = false;
+		}
+		SDL_SetWindowBordered(inst->wnd, !*fullscreen);
+	}
+
+	/* Handle resizing and moving */
+	if (window->moved && !*fullscreen &&
+	    !(window->flags & SDL_WINDOW_MAXIMIZED)) {
+		inst->default_x = window->x;
+		inst->default_y = window->y;
+		inst->default_w = window->w;
+		inst->default_h = window->h;
+	}
+
+	PURPL_PROFILE_END();
+}
+
+/* Get ready to draw a frame and swap in anything loaded in the background */
+static void begin_frame(struct purpl_inst *inst)
+{
+	/* Start the renderer's frame, which clears the window */
+	if (inst->renderer)
+		purpl_render_begin(inst->renderer, inst->input.window.w,
+				   inst->input.window.h);
+
+	/* Hand over any assets that finished loading */
+	if (inst->stream)
+		purpl_inst_dispatch_assets(inst);
+	if (inst->watch)
+		purpl_inst_reload_assets(inst);
+}
+
+/* Add the frame that just ended to the history */
+static void record_frame(struct purpl_inst *inst)
+{
+	struct purpl_frame_history *history = &inst->frame_history;
+	struct purpl_perf_stats stats;
+	u64 now;
+	u64 time;
+
+	/* The first frame has nothing to measure from */
+	now = purpl_get_time_ns();
+	time = now - history->last_end;
+	if (!history->last_end) {
+		history->last_end = now;
+		history->last_log = now;
+		return;
+	}
+	history->last_end = now;
+
+	/* Check against the average before this frame is part of it */
+	if (history->count >= PURPL_FRAME_HISTORY / 8 &&
+	    time > history->total / history->count * PURPL_HITCH_FACTOR)
+		history->hitches++;
+
+	/* Replace the oldest frame */
+	if (history->count == PURPL_FRAME_HISTORY)
+		history->total -= history->times[history->next];
+	else
+		history->count++;
+	history->times[history->next] = time;
+	history->total += time;
+	history->next = (history->next + 1) % PURPL_FRAME_HISTORY;
+	history->frames++;
+
+	/* Write the statistics to the log if it's time */
+	if (history->log_interval &&
+	    now - history->last_log >= history->log_interval) {
+		history->last_log = now;
+		purpl_inst_get_perf_stats(inst, &stats);
+		PURPL_LOG(inst->logger, history->log_index, PURPL_INFO,
+			  "Frame times over %u frames: min %.2f ms, avg %.2f "
+			  "ms, p95 %.2f ms, p99 %.2f ms, max %.2f ms; %llu "
+			  "frames, %llu hitches, %llu allocations last frame, "
+			  "%llu dropped steps; %zu assets (%zu bytes) "
+			  "resident, %llu bytes loaded, %llu bytes mapped, "
+			  "%llu bytes logged",
+			  stats.window, (double)stats.min / PURPL_NS_PER_MS,
+			  (double)stats.avg / PURPL_NS_PER_MS,
+			  (double)stats.p95 / PURPL_NS_PER_MS,
+			  (double)stats.p99 / PURPL_NS_PER_MS,
+			  (double)stats.max / PURPL_NS_PER_MS, stats.frames,
+			  stats.hitches, stats.frame_allocs,
+			  stats.dropped_steps, stats.assets, stats.resident,
+			  stats.bytes_loaded, stats.mapped_bytes,
+			  stats.log_bytes);
+	}
+}
+
+/* Show a frame and free its temporary memory */
+static void end_frame(struct purpl_inst *inst, u64 allocs)
+{
+	/* Draw what the frame recorded */
+	if (inst->renderer)
+		purpl_render_flush(inst->renderer);
+
+	/* Display rendered frame */
+#if PURPL_USE_OPENGL_GFX
+	if (inst->wnd) {
+		PURPL_PROFILE_BEGIN("Buffer swap");
+		SDL_GL_SwapWindow(inst->wnd);
+		PURPL_PROFILE_END();
+	}
+#endif
+
+	/* Free this frame's temporary memory */
+	purpl_reset_arena(inst->frame_arena);
+	purpl_reset_arena(purpl_get_scratch_arena());
+	inst->frame_allocs = purpl_get_alloc_count() - allocs;
+
+	record_frame(inst);
+	PURPL_PROFILE_FRAME();
+}
+
+u64 purpl_get_time_ns(void)
+{
+	u64 count;
+	u64 freq;
+
+	/* Split it up so it doesn't overflow */
+	count = SDL_GetPerformanceCounter();
+	freq = SDL_GetPerformanceFrequency();
+	return count / freq * PURPL_NS_PER_SEC +
+	       count % freq * PURPL_NS_PER_SEC / freq;
+}
+
 uint purpl_inst_run(struct purpl_inst *inst, void *user,
-		    void(frame)(struct purpl_inst *inst, SDL_Event e,
-				uint delta, void *user))
+		    void(frame)(struct purpl_inst *inst,
+				const struct purpl_input *input, uint delta,
+				void *user))
 {
-	int w;
-	int h;
 	bool fullscreen;
 	uint delta;
 	uint beginning;
 	uint last;
 	uint now;
-	SDL_Event e;
-	int idx;
-	struct SDL_Rect disp;
+	u64 allocs;
 	int ___errno;
 
 	PURPL_SAVE_ERRNO(___errno);
@@ -295,98 +493,242 @@ uint purpl_inst_run(struct purpl_inst *inst, void *user,
 
 	/* Start the loop */
 	inst->running = true;
+	inst->frame_history.last_end = 0;
 	last = beginning;
 	while (inst->running) {
-		/* Process events (turn off clang-format cause crazy edge-case formatting) */
-		/* clang-format off */
-		while (SDL_PollEvent(&e) != 0) {
-			switch (e.type) {
-			case SDL_QUIT:
-				inst->running = false;
-				break;
-			case SDL_KEYUP:
-				switch (e.key.keysym.scancode) {
-				case SDL_SCANCODE_F11:
-					/* Handle fullscreen toggling */
-					idx = SDL_GetWindowDisplayIndex(inst->wnd);
-					if (!fullscreen) {
-						SDL_GetDisplayBounds(idx, &disp);
-
-						/* Unmaximize the window */
-						if (SDL_GetWindowFlags(inst->wnd) & SDL_WINDOW_MAXIMIZED)
-							SDL_RestoreWindow(inst->wnd);
-
-						/* Set the window size and position */
-						SDL_SetWindowSize(inst->wnd, disp.w, disp.h);
-						SDL_SetWindowPosition(inst->wnd, disp.x, disp.y);
-						fullscreen = true;
-					} else {
-						/* Set the size and position to the saved values */
-						SDL_SetWindowSize(inst->wnd, inst->default_w, inst->default_h);
-						SDL_SetWindowPosition(inst->wnd, inst->default_x, inst->default_y);
-						fullscreen = false;
-					}
-					SDL_SetWindowBordered(inst->wnd, !fullscreen);
-					break;
-				}
-				break;
-			case SDL_WINDOWEVENT:
-				if (inst->wnd == SDL_GetWindowFromID(e.window.windowID)) {
-					/* Handle resizing and moving */
-					if (!fullscreen && !(SDL_GetWindowFlags(inst->wnd)
-					    & SDL_WINDOW_MAXIMIZED)) {
-						SDL_GetWindowPosition(inst->wnd, &inst->default_x,
-								      &inst->default_y);
-						SDL_GetWindowSize(inst->wnd, &inst->default_w,
-								  &inst->default_h);
-					}
-				}
-				break;
-			}
-		}
-		/* clang-format on */
+		allocs = purpl_get_alloc_count();
 
-#if PURPL_USE_OPENGL_GFX
-		/* Reset viewport size */
-		SDL_GetWindowSize(inst->wnd, &w, &h);
-		glViewport(0, 0, w, h);
+		process_events(inst, &fullscreen);
+		begin_frame(inst);
 
-		/* Clear the window */
-		glClear(GL_COLOR_BUFFER_BIT);
-#endif
 		/* Get the time */
 		now = SDL_GetTicks();
 
 		/* Call the frame function if the window is shown */
-		if (SDL_GetWindowFlags(inst->wnd) & SDL_WINDOW_INPUT_FOCUS) {
+		if (inst->input.window.flags & SDL_WINDOW_INPUT_FOCUS) {
 			delta = now - last;
-			frame(inst, e, delta, user);
+			PURPL_PROFILE_BEGIN("Frame");
+			frame(inst, &inst->input, delta, user);
+			PURPL_PROFILE_END();
+			if (inst->ecs)
+				purpl_ecs_flush(inst->ecs);
 		}
 
 		/* Get the time again */
 		last = now;
 		now = SDL_GetTicks();
 
-		/* Display rendered frame */
+		end_frame(inst, allocs);
+	}
+
+	PURPL_RESTORE_ERRNO(___errno);
+
+	/* We're done now */
+	return now - beginning;
+}
+
+uint purpl_inst_run_fixed(struct purpl_inst *inst, void *user,
+			  const struct purpl_loop_config *config,
+			  purpl_update_callback update,
+			  purpl_render_callback render)
+{
+	bool fullscreen;
+	bool vsync;
+	bool unthrottled;
+	u64 max_ticks;
+	u64 step;
+	u64 period;
+	u64 beginning;
+	u64 last;
+	u64 now;
+	u64 accumulator;
+	u64 next_frame;
+	u64 allocs;
+	uint max_steps;
+	uint steps;
+	int ___errno;
+
+	PURPL_SAVE_ERRNO(___errno);
+
+	/* Check arguments (headless instances don't need to render) */
+	if (!inst || (inst->wnd && (!inst->ctx || !render)) || !update) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* Work out the timing */
+	step = PURPL_NS_PER_SEC / ((config && config->tick_rate) ?
+					   config->tick_rate :
+					   PURPL_DEFAULT_TICK_RATE);
+	period = (config && config->frame_rate) ?
+			 PURPL_NS_PER_SEC / config->frame_rate :
+			 0;
+	max_steps = (config && config->max_steps) ? config->max_steps :
+						    PURPL_DEFAULT_MAX_STEPS;
+	max_ticks = config ? config->max_ticks : 0;
+	unthrottled = config && config->unthrottled && !inst->wnd;
 #if PURPL_USE_OPENGL_GFX
-		SDL_GL_SwapWindow(inst->wnd);
+	vsync = inst->wnd && SDL_GL_GetSwapInterval() != 0;
+#else
+	vsync = false;
 #endif
+
+	/* Without a window, wait for each update instead of spinning */
+	if (!inst->wnd && !unthrottled && !period)
+		period = step;
+
+	/* Determine if the window is fullscreened */
+	fullscreen = inst->wnd && (SDL_GetWindowFlags(inst->wnd) &
+				   SDL_WINDOW_BORDERLESS);
+
+	/* Start the loop */
+	inst->running = true;
+	inst->frame_history.last_end = 0;
+	inst->dropped_steps = 0;
+	inst->ticks = 0;
+	beginning = purpl_get_time_ns();
+	last = beginning;
+	next_frame = beginning + period;
+	accumulator = 0;
+	while (inst->running) {
+		allocs = purpl_get_alloc_count();
+
+		process_events(inst, &fullscreen);
+		begin_frame(inst);
+
+		/* Catch the simulation up to now, or just go if unthrottled */
+		now = purpl_get_time_ns();
+		accumulator += unthrottled ? step : now - last;
+		last = now;
+		for (steps = 0; accumulator >= step && steps < max_steps;
+		     steps++) {
+			PURPL_PROFILE_BEGIN("Update");
+			update(inst, step, user);
+			PURPL_PROFILE_END();
+			if (inst->ecs)
+				purpl_ecs_flush(inst->ecs);
+			accumulator -= step;
+			inst->ticks++;
+
+			/* Only one update gets each press */
+			purpl_clear_input_edges(&inst->input);
+		}
+
+		/* Without an update, nothing saw this frame's input yet */
+		if (!steps)
+			purpl_input_keep(&inst->input);
+
+		/*
+		 * If it still hasn't caught up, the updates are taking longer
+		 *  than the time they simulate, so drop the rest rather than
+		 *  falling further behind every frame
+		 */
+		if (accumulator >= step) {
+			inst->dropped_steps += accumulator / step;
+			accumulator %= step;
+		}
+
+		/* Draw, blending between the last two updates */
+		if (render && !(inst->input.window.flags &
+				SDL_WINDOW_MINIMIZED)) {
+			PURPL_PROFILE_BEGIN("Render");
+			render(inst, (double)accumulator / step, user);
+			PURPL_PROFILE_END();
+		}
+
+		end_frame(inst, allocs);
+
+		/*
+		 * Sleep until the next frame is due. This goes by a schedule
+		 *  rather than the length of each frame, so SDL_Delay being a
+		 *  bit short or long evens out.
+		 */
+		if (period && !vsync) {
+			now = purpl_get_time_ns();
+			if (now < next_frame)
+				SDL_Delay((next_frame - now) / PURPL_NS_PER_MS);
+			next_frame += period;
+			if (next_frame < now)
+				next_frame = now + period;
+		}
+
+		if (max_ticks && inst->ticks >= max_ticks)
+			inst->running = false;
 	}
 
+	/* Say how fast it went */
+	now = PURPL_MAX(purpl_get_time_ns() - beginning, 1);
+	PURPL_LOG_INFO(inst->logger,
+		       "Ran %llu updates in %.3f seconds (%.1f per second)",
+		       inst->ticks, (double)now / PURPL_NS_PER_SEC,
+		       inst->ticks * (double)PURPL_NS_PER_SEC / now);
+
 	PURPL_RESTORE_ERRNO(___errno);
 
 	/* We're done now */
-	return now - beginning;
+	return now / PURPL_NS_PER_MS;
+}
+
+/* Take an asset off the unreferenced list */
+static void lru_unlink(struct purpl_asset_cache *cache,
+		       struct purpl_asset *ast)
+{
+	if (ast->lru_prev)
+		ast->lru_prev->lru_next = ast->lru_next;
+	else
+		cache->lru_head = ast->lru_next;
+	if (ast->lru_next)
+		ast->lru_next->lru_prev = ast->lru_prev;
+	else
+		cache->lru_tail = ast->lru_prev;
+	ast->lru_prev = NULL;
+	ast->lru_next = NULL;
+}
+
+/* Put an asset on the most recently used end of the unreferenced list */
+static void lru_append(struct purpl_asset_cache *cache,
+		       struct purpl_asset *ast)
+{
+	ast->lru_prev = cache->lru_tail;
+	ast->lru_next = NULL;
+	if (cache->lru_tail)
+		cache->lru_tail->lru_next = ast;
+	else
+		cache->lru_head = ast;
+	cache->lru_tail = ast;
+}
+
+/* The bytes an asset counts against the budget */
+static size_t asset_cost(struct purpl_asset *ast)
+{
+	/* Embedded data is part of the executable either way */
+	return ast->embedded ? 0 : ast->size;
+}
+
+/* Add a reference to an asset that's already in the list */
+static const char *ref_asset(struct purpl_inst *inst, ptrdiff_t idx)
+{
+	struct purpl_asset *ast;
+
+	ast = inst->assets[idx].value;
+	if (!ast->refs++)
+		lru_unlink(&inst->cache, ast);
+	inst->cache.hits++;
+
+	return inst->assets[idx].key;
 }
 
 const char *purpl_inst_load_asset_from_file(struct purpl_inst *inst, bool map,
 					    const char *name, ...)
 {
 	va_list args;
+	struct purpl_arena *scratch;
+	struct purpl_arena_mark mark;
+	char *name_fmt;
 	char *path;
-	s64 path_len;
+	ptrdiff_t idx;
 	struct purpl_asset *ast;
-	char *tmp;
+	const char *key;
 	int ___errno;
 
 	PURPL_SAVE_ERRNO(___errno);
@@ -397,33 +739,96 @@ const char *purpl_inst_load_asset_from_file(struct purpl_inst *inst, bool map,
 		return NULL;
 	}
 
-	/* Format the path to the asset */
+	/* Format the name of the asset */
+	scratch = purpl_get_scratch_arena();
+	mark = purpl_mark_arena(scratch);
 	va_start(args, name);
-	path = purpl_fmt_text_va(&path_len, name, args);
+	name_fmt = purpl_fmt_text_va_arena(scratch, NULL, name, args);
 	va_end(args);
 
-	/* Get the asset */
-	ast = purpl_load_asset_from_file(inst->info->search_paths, map, "%s",
-					 path);
-	if (!ast) {
-		(path_len > 0) ? (void)0 : free(path);
+	/* Find its canonical path */
+	path = purpl_resolve_asset(inst->info->paths, "%s", name_fmt);
+	purpl_release_arena(scratch, mark);
+	if (!path)
 		return NULL;
+
+	/* If it's already loaded, just add a reference */
+	idx = stbds_shgeti(inst->assets, path);
+	if (idx >= 0) {
+		free(path);
+		key = ref_asset(inst, idx);
+
+		PURPL_RESTORE_ERRNO(___errno);
+
+		return key;
+	}
+
+	/* Otherwise, load it */
+	ast = purpl_load_asset(map, "%s", path);
+	if (!ast && errno == ENOENT) {
+		/* The directory listing was stale, so forget it */
+		*strrchr(path, '/') = 0;
+		purpl_refresh_search_paths(inst->info->paths, path);
+	}
+	free(path);
+	if (!ast)
+		return NULL;
+	key = purpl_inst_add_asset(inst, ast);
+	if (!key)
+		return NULL;
+
+	PURPL_RESTORE_ERRNO(___errno);
+
+	return key;
+}
+
+const char *purpl_inst_add_asset(struct purpl_inst *inst,
+				 struct purpl_asset *asset)
+{
+	ptrdiff_t idx;
+	char *key;
+	int ___errno;
+
+	PURPL_SAVE_ERRNO(___errno);
+
+	/* Check arguments */
+	if (!inst || !asset) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	/* Don't keep two copies of the same thing */
+	idx = stbds_shgeti(inst->assets, asset->name);
+	if (idx >= 0) {
+		purpl_free_asset(asset);
+
+		PURPL_RESTORE_ERRNO(___errno);
+
+		return ref_asset(inst, idx);
 	}
 
 	/* Make a new buffer and copy in the name */
-	tmp = PURPL_CALLOC(strlen(ast->name), char);
-	if (!tmp) {
-		purpl_free_asset(ast);
+	key = PURPL_CALLOC(strlen(asset->name) + 1, char);
+	if (!key) {
+		purpl_free_asset(asset);
 		return NULL;
 	}
-	strcpy(tmp, ast->name);
+	strcpy(key, asset->name);
 
 	/* Append the asset to the list */
-	stbds_shput(inst->assets, tmp, ast);
+	asset->refs = 1;
+	stbds_shput(inst->assets, key, asset);
+	inst->cache.resident += asset_cost(asset);
+	inst->cache.loaded += asset->size;
+	inst->cache.misses++;
+
+	/* Make room for it if there's a budget */
+	if (inst->cache.budget)
+		purpl_inst_trim_assets(inst, inst->cache.budget);
 
 	PURPL_RESTORE_ERRNO(___errno);
 
-	return tmp;
+	return key;
 }
 
 void purpl_inst_free_asset(struct purpl_inst *inst, const char *name)
@@ -434,24 +839,144 @@ void purpl_inst_free_asset(struct purpl_inst *inst, const char *name)
 	PURPL_SAVE_ERRNO(___errno);
 
 	/* Check the instance */
-	if (!inst) {
+	if (!inst || !name) {
 		errno = EINVAL;
 		return;
 	}
 
 	/* Get a pointer to the asset */
 	ast = stbds_shget(inst->assets, name);
+	if (!ast || !ast->refs) {
+		errno = ENOENT;
+		return;
+	}
 
-	/* Remove the asset from the list */
-	stbds_shdel(inst->assets, name);
-
-	/* Free the asset and its name */
-	free(name);
-	purpl_free_asset(ast);
+	/* Drop the reference, and once it's unused, let it be evicted */
+	if (!--ast->refs) {
+		lru_append(&inst->cache, ast);
+		if (inst->cache.budget)
+			purpl_inst_trim_assets(inst, inst->cache.budget);
+	}
 
 	PURPL_RESTORE_ERRNO(___errno);
 }
 
+size_t purpl_inst_trim_assets(struct purpl_inst *inst, size_t budget)
+{
+	struct purpl_asset *ast;
+	ptrdiff_t idx;
+	char *key;
+	size_t freed;
+
+	/* Check the instance */
+	if (!inst) {
+		errno = EINVAL;
+		return 0;
+	}
+
+	/* Evict from the least recently used end */
+	freed = 0;
+	while (inst->cache.lru_head && inst->cache.resident > budget) {
+		ast = inst->cache.lru_head;
+		lru_unlink(&inst->cache, ast);
+
+		/* Remove it from the list */
+		idx = stbds_shgeti(inst->assets, ast->name);
+		key = inst->assets[idx].key;
+		stbds_shdel(inst->assets, key);
+		free(key);
+
+		/* Free it */
+		inst->cache.resident -= asset_cost(ast);
+		freed += asset_cost(ast);
+		inst->cache.evictions++;
+		purpl_free_asset(ast);
+	}
+
+	return freed;
+}
+
+void purpl_inst_get_asset_stats(struct purpl_inst *inst,
+				struct purpl_asset_stats *stats)
+{
+	/* Check arguments */
+	if (!inst || !stats) {
+		errno = EINVAL;
+		return;
+	}
+
+	stats->hits = inst->cache.hits;
+	stats->misses = inst->cache.misses;
+	stats->evictions = inst->cache.evictions;
+	stats->resident = inst->cache.resident;
+	stats->budget = inst->cache.budget;
+	stats->count = stbds_shlenu(inst->assets);
+	stats->loaded = inst->cache.loaded;
+}
+
+/* Compare frame times for qsort */
+static int compare_times(const void *a, const void *b)
+{
+	u64 x = *(const u64 *)a;
+	u64 y = *(const u64 *)b;
+
+	return (x > y) - (x < y);
+}
+
+void purpl_inst_get_perf_stats(struct purpl_inst *inst,
+			       struct purpl_perf_stats *stats)
+{
+	struct purpl_frame_history *history;
+	u64 times[PURPL_FRAME_HISTORY];
+	u32 count;
+
+	/* Check arguments */
+	if (!inst || !stats) {
+		errno = EINVAL;
+		return;
+	}
+	history = &inst->frame_history;
+	memset(stats, 0, sizeof(struct purpl_perf_stats));
+
+	/* Sort a copy of the recent frames for the percentiles */
+	count = history->count;
+	if (count) {
+		memcpy(times, history->times, count * sizeof(u64));
+		qsort(times, count, sizeof(u64), compare_times);
+		stats->min = times[0];
+		stats->avg = history->total / count;
+		stats->p95 = times[(count * 95 + 99) / 100 - 1];
+		stats->p99 = times[(count * 99 + 99) / 100 - 1];
+		stats->max = times[count - 1];
+	}
+	stats->window = count;
+	stats->frames = history->frames;
+	stats->hitches = history->hitches;
+
+	/* Then the counters */
+	stats->frame_allocs = inst->frame_allocs;
+	stats->dropped_steps = inst->dropped_steps;
+	stats->bytes_loaded = inst->cache.loaded;
+	stats->resident = inst->cache.resident;
+	stats->assets = stbds_shlenu(inst->assets);
+	stats->mapped_bytes = purpl_get_mapped_bytes();
+	stats->log_bytes = purpl_log_written(inst->logger);
+}
+
+void purpl_inst_log_perf_stats(struct purpl_inst *inst, s8 index,
+			       uint interval)
+{
+	/* Check arguments */
+	if (!inst) {
+		errno = EINVAL;
+		return;
+	}
+
+	inst->frame_history.log_index = index;
+	inst->frame_history.log_interval = interval * PURPL_NS_PER_MS;
+	inst->frame_history.last_log = purpl_get_time_ns();
+}
+
 void purpl_inst_destroy_window(struct purpl_inst *inst)
 {
 	int ___errno;
@@ -465,6 +990,12 @@ void purpl_inst_destroy_window(struct purpl_inst *inst)
 	}
 
 #if PURPL_USE_OPENGL_GFX
+	/* The renderer has to go before its context */
+	if (inst->renderer && inst->ctx) {
+		purpl_free_renderer(inst->renderer);
+		inst->renderer = NULL;
+	}
+
 	/* Destroy the context */
 	SDL_GL_DeleteContext(inst->ctx);
 #endif
@@ -472,12 +1003,16 @@ void purpl_inst_destroy_window(struct purpl_inst *inst)
 	/* Destroy the window */
 	SDL_DestroyWindow(inst->wnd);
 	inst->wnd = NULL;
+	purpl_input_set_window(&inst->input, NULL);
 
 	PURPL_RESTORE_ERRNO(___errno);
 }
 
 void purpl_end_inst(struct purpl_inst *inst)
 {
+#ifndef NDEBUG
+	struct purpl_pool_stats pool_stats[PURPL_POOL_CLASSES];
+#endif
 	size_t i;
 	int ___errno;
 
@@ -489,25 +1024,70 @@ void purpl_end_inst(struct purpl_inst *inst)
 		return;
 	}
 
+	/* Finish any jobs, since they could be using anything */
+	if (inst->jobs)
+		purpl_inst_stop_jobs(inst);
+
+	/* Nothing can be using the entities now */
+	if (inst->ecs) {
+		purpl_free_ecs(inst->ecs);
+		inst->ecs = NULL;
+	}
+
+	/* Stop loading assets before freeing them */
+	if (inst->watch)
+		purpl_inst_stop_watching(inst);
+	if (inst->stream)
+		purpl_inst_stop_streaming(inst);
+
+	/* Free all the assets and their names (the app info frees its own) */
+	for (i = 0; i < stbds_shlenu(inst->assets); i++) {
+		if (inst->assets[i].value != inst->info->json)
+			purpl_free_asset(inst->assets[i].value);
+		free(inst->assets[i].key);
+	}
+
 	/* Free the structures for the instance */
 	purpl_free_app_info(inst->info);
 	purpl_free_embed(inst->embed);
-	purpl_end_logger(inst->logger, true);
 
-	/* Free all the assets */
-	for (i = 0; i < stbds_shlenu(inst->assets); i++)
-		purpl_free_asset(inst->assets[i].value);
+#ifndef NDEBUG
+	/* Everything from the pool allocator should be freed by now */
+	purpl_flush_pool_cache();
+	if (purpl_get_pool_stats(pool_stats)) {
+		for (i = 0; i < PURPL_POOL_CLASSES; i++) {
+			if (pool_stats[i].live)
+				PURPL_LOG_WARNING(
+					inst->logger,
+					"Leaked %lld %zu byte pool blocks",
+					pool_stats[i].live, pool_stats[i].size);
+		}
+	}
+#endif
+
+	purpl_end_logger(inst->logger, true);
 
 	/* Get rid of the string hash map */
 	stbds_shfree(inst->assets);
 
-	/* Make sure the window is closed */
+	/* Make sure the renderer is freed and the window is closed */
+	if (inst->renderer) {
+		purpl_free_renderer(inst->renderer);
+		inst->renderer = NULL;
+	}
 	purpl_inst_destroy_window(inst);
+	purpl_free_input(&inst->input);
 
 	/* Shut down SDL */
 	SDL_Quit();
 
-	/* Free the structure */
+	/* Stop the profiler and free this thread's state */
+	purpl_profile_shutdown();
+
+	/* Free the structure and the memory for each frame */
+	purpl_free_arena(inst->frame_arena);
+	purpl_free_scratch_arena();
+	purpl_forget_search_paths();
 	free(inst);
 
 	PURPL_RESTORE_ERRNO(___errno);
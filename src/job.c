@@ -0,0 +1,452 @@
+#include "purpl/job.h"
+#include "purpl/profile.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The worker the current thread is, if it's one of them */
+static PURPL_THREAD_LOCAL struct purpl_job_worker *current_worker;
+
+/* Add a job to the bottom of a deque, if there's space */
+static bool deque_push(struct purpl_job_deque *deque, struct purpl_job *job)
+{
+	int bottom;
+	int top;
+
+	bottom = SDL_AtomicGet(&deque->bottom);
+	top = SDL_AtomicGet(&deque->top);
+	if ((u32)(bottom - top) > deque->mask)
+		return false;
+
+	/* Fill the slot before thieves can see it */
+	SDL_AtomicSetPtr((void **)&deque->jobs[(u32)bottom & deque->mask], job);
+	SDL_AtomicSet(&deque->bottom, bottom + 1);
+
+	return true;
+}
+
+/* Take the newest job from the bottom of a deque (only its owner can) */
+static struct purpl_job *deque_pop(struct purpl_job_deque *deque)
+{
+	struct purpl_job *job;
+	int bottom;
+	int top;
+
+	/* Claim the bottom slot, then see if a thief got there first */
+	bottom = SDL_AtomicAdd(&deque->bottom, -1) - 1;
+	top = SDL_AtomicGet(&deque->top);
+	if (top - bottom > 0) {
+		SDL_AtomicSet(&deque->bottom, bottom + 1);
+		return NULL;
+	}
+
+	job = SDL_AtomicGetPtr(
+		(void **)&deque->jobs[(u32)bottom & deque->mask]);
+	if (top == bottom) {
+		/* This is the last job, so race thieves for it */
+		if (!SDL_AtomicCAS(&deque->top, top, top + 1))
+			job = NULL;
+		SDL_AtomicSet(&deque->bottom, bottom + 1);
+	}
+
+	return job;
+}
+
+/* Take the oldest job from the top of another worker's deque */
+static struct purpl_job *deque_steal(struct purpl_job_deque *deque)
+{
+	struct purpl_job *job;
+	int bottom;
+	int top;
+
+	top = SDL_AtomicGet(&deque->top);
+	bottom = SDL_AtomicGet(&deque->bottom);
+	if (bottom - top <= 0)
+		return NULL;
+
+	job = SDL_AtomicGetPtr((void **)&deque->jobs[(u32)top & deque->mask]);
+	if (!SDL_AtomicCAS(&deque->top, top, top + 1))
+		return NULL;
+
+	return job;
+}
+
+/* Get the next random number for picking who to steal from */
+static u32 next_victim(struct purpl_job_worker *worker)
+{
+	worker->rng ^= worker->rng << 13;
+	worker->rng ^= worker->rng >> 17;
+	worker->rng ^= worker->rng << 5;
+
+	return worker->rng;
+}
+
+/* Find a job to run, from the worker's own deque if it has one */
+static struct purpl_job *find_job(struct purpl_jobs *jobs,
+				  struct purpl_job_worker *self)
+{
+	struct purpl_job_worker *victim;
+	struct purpl_job *job = NULL;
+	u32 start;
+	uint i;
+
+	/* Newest first from our own deque, since it's likely still in cache */
+	if (self) {
+		job = deque_pop(&self->deque);
+		if (job)
+			return job;
+	}
+
+	/* Then jobs from other threads */
+	if (SDL_AtomicGet(&jobs->ninjected)) {
+		SDL_LockMutex(jobs->lock);
+		if (stbds_arrlenu(jobs->injected)) {
+			job = stbds_arrpop(jobs->injected);
+			SDL_AtomicAdd(&jobs->ninjected, -1);
+		}
+		SDL_UnlockMutex(jobs->lock);
+		if (job)
+			return job;
+	}
+
+	/* Then steal, starting from a random worker so thieves spread out */
+	start = self ? next_victim(self) : (u32)SDL_GetPerformanceCounter();
+	for (i = 0; i < jobs->count; i++) {
+		victim = &jobs->workers[(start + i) % jobs->count];
+		if (victim == self)
+			continue;
+		job = deque_steal(&victim->deque);
+		if (job) {
+			if (self)
+				self->stolen++;
+			return job;
+		}
+	}
+
+	return NULL;
+}
+
+/* Run a job and free it */
+static void run_job(struct purpl_job_worker *self, struct purpl_job *job)
+{
+	struct purpl_job_counter *counter = job->counter;
+
+	if (job->range)
+		job->range(job->data, job->start, job->end);
+	else
+		job->func(job->data);
+	PURPL_POOL_DELETE(job);
+
+	if (self)
+		self->executed++;
+	if (counter)
+		SDL_AtomicAdd(&counter->count, -1);
+}
+
+/* Queue a job, on this thread's deque if it has one */
+static int submit(struct purpl_jobs *jobs, struct purpl_job *job)
+{
+	struct purpl_job_worker *self = current_worker;
+
+	if (job->counter)
+		SDL_AtomicAdd(&job->counter->count, 1);
+
+	/* Anything that doesn't fit goes with jobs from other threads */
+	if (!self || self->jobs != jobs || !deque_push(&self->deque, job)) {
+		SDL_LockMutex(jobs->lock);
+		stbds_arrput(jobs->injected, job);
+		SDL_AtomicAdd(&jobs->ninjected, 1);
+		SDL_UnlockMutex(jobs->lock);
+	}
+
+	/* Wake someone up to take it */
+	if (SDL_AtomicGet(&jobs->sleeping) > 0)
+		SDL_SemPost(jobs->wake);
+
+	return 0;
+}
+
+/* Run jobs until the job system stops */
+static int job_worker(void *data)
+{
+	struct purpl_job_worker *self = data;
+	struct purpl_jobs *jobs = self->jobs;
+	struct purpl_job *job;
+
+	current_worker = self;
+	purpl_profile_name_thread("purpl_job");
+	while (!SDL_AtomicGet(&jobs->quit)) {
+		job = find_job(jobs, self);
+		if (job) {
+			run_job(self, job);
+			continue;
+		}
+
+		/*
+		 * Sleep until there's work. The timeout covers a job
+		 *  submitted between looking and going to sleep.
+		 */
+		SDL_AtomicAdd(&jobs->sleeping, 1);
+		SDL_SemWaitTimeout(jobs->wake, 10);
+		SDL_AtomicAdd(&jobs->sleeping, -1);
+	}
+	current_worker = NULL;
+
+	/* Give back what this thread was holding on to */
+	purpl_flush_pool_cache();
+	purpl_free_scratch_arena();
+	purpl_forget_search_paths();
+	purpl_profile_release_thread();
+
+	return 0;
+}
+
+/* Free a job system that has no threads running */
+static void free_jobs(struct purpl_jobs *jobs)
+{
+	uint i;
+
+	for (i = 0; i < jobs->count; i++)
+		free(jobs->workers[i].deque.jobs);
+	free(jobs->workers);
+	stbds_arrfree(jobs->injected);
+	SDL_DestroySemaphore(jobs->wake);
+	SDL_DestroyMutex(jobs->lock);
+	free(jobs);
+}
+
+int purpl_inst_start_jobs(struct purpl_inst *inst, uint workers)
+{
+	struct purpl_jobs *jobs;
+	struct purpl_job_worker *worker;
+	uint i;
+	int ___errno;
+
+	PURPL_SAVE_ERRNO(___errno);
+
+	/* Check arguments */
+	if (!inst) {
+		errno = EINVAL;
+		return errno;
+	}
+	if (inst->jobs) {
+		errno = EEXIST;
+		return errno;
+	}
+
+	/* Fill in defaults */
+	if (!workers)
+		workers = PURPL_MAX(SDL_GetCPUCount() - 1, 1);
+
+	/* Allocate the structure, with a worker for this thread too */
+	jobs = PURPL_CALLOC(1, struct purpl_jobs);
+	if (!jobs)
+		return errno;
+	jobs->count = workers + 1;
+	jobs->workers = PURPL_CALLOC(jobs->count, struct purpl_job_worker);
+	jobs->lock = SDL_CreateMutex();
+	jobs->wake = SDL_CreateSemaphore(0);
+	if (!jobs->workers || !jobs->lock || !jobs->wake) {
+		jobs->count = 0;
+		free_jobs(jobs);
+		errno = ENOMEM;
+		return errno;
+	}
+
+	/* Give each worker a deque */
+	for (i = 0; i < jobs->count; i++) {
+		worker = &jobs->workers[i];
+		worker->jobs = jobs;
+		worker->rng = 0x9E3779B9 * (i + 1);
+		worker->deque.mask = PURPL_JOB_QUEUE_SIZE - 1;
+		worker->deque.jobs =
+			PURPL_CALLOC(PURPL_JOB_QUEUE_SIZE, struct purpl_job *);
+		if (!worker->deque.jobs) {
+			free_jobs(jobs);
+			errno = ENOMEM;
+			return errno;
+		}
+	}
+
+	/* Start the workers */
+	inst->jobs = jobs;
+	current_worker = &jobs->workers[0];
+	for (i = 1; i < jobs->count; i++) {
+		worker = &jobs->workers[i];
+		worker->thread =
+			SDL_CreateThread(job_worker, "purpl_job", worker);
+		if (!worker->thread) {
+			purpl_inst_stop_jobs(inst);
+			errno = EAGAIN;
+			return errno;
+		}
+	}
+
+	PURPL_RESTORE_ERRNO(___errno);
+
+	return 0;
+}
+
+int purpl_inst_submit_job(struct purpl_inst *inst, purpl_job_func func,
+			  void *data, struct purpl_job_counter *counter)
+{
+	struct purpl_job *job;
+	int ___errno;
+
+	PURPL_SAVE_ERRNO(___errno);
+
+	/* Check arguments */
+	if (!inst || !func) {
+		errno = EINVAL;
+		return errno;
+	}
+
+	/* Without workers, just run it */
+	if (!inst->jobs) {
+		func(data);
+		PURPL_RESTORE_ERRNO(___errno);
+		return 0;
+	}
+
+	/* Fill out the job */
+	job = PURPL_POOL_NEW(struct purpl_job);
+	if (!job)
+		return errno;
+	job->func = func;
+	job->range = NULL;
+	job->data = data;
+	job->counter = counter;
+
+	submit(inst->jobs, job);
+
+	PURPL_RESTORE_ERRNO(___errno);
+
+	return 0;
+}
+
+void purpl_inst_wait_for_jobs(struct purpl_inst *inst,
+			      struct purpl_job_counter *counter)
+{
+	struct purpl_job_worker *self;
+	struct purpl_job *job;
+
+	if (!inst || !counter)
+		return;
+
+	/* Help out until the jobs are done */
+	self = current_worker;
+	if (inst->jobs && self && self->jobs != inst->jobs)
+		self = NULL;
+	while (SDL_AtomicGet(&counter->count) > 0) {
+		job = inst->jobs ? find_job(inst->jobs, self) : NULL;
+		if (job)
+			run_job(self, job);
+		else
+			SDL_Delay(0);
+	}
+}
+
+int purpl_inst_parallel_for(struct purpl_inst *inst, size_t count,
+			    size_t batch, purpl_range_func func, void *data)
+{
+	struct purpl_job_counter counter;
+	struct purpl_job *job;
+	size_t start;
+	int ___errno;
+
+	PURPL_SAVE_ERRNO(___errno);
+
+	/* Check arguments */
+	if (!inst || !func) {
+		errno = EINVAL;
+		return errno;
+	}
+	if (!count) {
+		PURPL_RESTORE_ERRNO(___errno);
+		return 0;
+	}
+
+	/* Without workers, do it all at once */
+	if (!inst->jobs) {
+		func(data, 0, count);
+		PURPL_RESTORE_ERRNO(___errno);
+		return 0;
+	}
+
+	/* Enough batches to even out, but not so many they cost more */
+	if (!batch)
+		batch = PURPL_MAX(count / (inst->jobs->count * 4), 1);
+
+	/* Submit a job for each batch */
+	SDL_AtomicSet(&counter.count, 0);
+	for (start = 0; start < count; start += batch) {
+		job = PURPL_POOL_NEW(struct purpl_job);
+		if (!job) {
+			/* Do the rest here */
+			func(data, start, count);
+			break;
+		}
+		job->func = NULL;
+		job->range = func;
+		job->data = data;
+		job->start = start;
+		job->end = PURPL_MIN(start + batch, count);
+		job->counter = &counter;
+		submit(inst->jobs, job);
+	}
+
+	purpl_inst_wait_for_jobs(inst, &counter);
+
+	PURPL_RESTORE_ERRNO(___errno);
+
+	return 0;
+}
+
+void purpl_inst_get_job_stats(struct purpl_inst *inst,
+			      struct purpl_job_stats *stats)
+{
+	uint i;
+
+	if (!inst || !inst->jobs || !stats)
+		return;
+
+	for (i = 0; i < inst->jobs->count; i++) {
+		stats[i].executed = inst->jobs->workers[i].executed;
+		stats[i].stolen = inst->jobs->workers[i].stolen;
+	}
+}
+
+void purpl_inst_stop_jobs(struct purpl_inst *inst)
+{
+	struct purpl_jobs *jobs;
+	struct purpl_job *job;
+	uint i;
+
+	if (!inst || !inst->jobs)
+		return;
+	jobs = inst->jobs;
+
+	/* Tell the workers to stop and wait for them */
+	SDL_AtomicSet(&jobs->quit, 1);
+	for (i = 1; i < jobs->count; i++)
+		SDL_SemPost(jobs->wake);
+	for (i = 1; i < jobs->count; i++) {
+		if (jobs->workers[i].thread)
+			SDL_WaitThread(jobs->workers[i].thread, NULL);
+	}
+
+	/* Run whatever they left behind */
+	while ((job = find_job(jobs, &jobs->workers[0])))
+		run_job(NULL, job);
+
+	/* Free everything */
+	if (current_worker && current_worker->jobs == jobs)
+		current_worker = NULL;
+	free_jobs(jobs);
+	inst->jobs = NULL;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,4 +1,5 @@
 #include "purpl/log.h"
+#include "purpl/profile.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -12,7 +13,7 @@ struct purpl_logger *purpl_init_logger(u8 *first_index_ret, s8 default_level,
 	char *first;
 	va_list args;
 	s64 len;
-	u8 first_index;
+	int first_index;
 	int ___errno;
 
 	PURPL_SAVE_ERRNO(___errno);
@@ -35,22 +36,26 @@ struct purpl_logger *purpl_init_logger(u8 *first_index_ret, s8 default_level,
 
 	/* Allocate the file stream pointers */
 	logger->logs = PURPL_CALLOC(PURPL_MAX_LOGS, FILE *);
-	if (!logger->logs)
+	if (!logger->logs) {
+		(len > 0) ? free(first) : (void)0;
+		free(logger);
 		return NULL;
+	}
 
 	/* Open the first log and fill out the structure */
-	logger->default_index = purpl_open_log(logger, first_max_level, first) &
-				0xFFFFFF;
-	if (logger->default_index < 0) {
+	first_index = purpl_open_log(logger, first_max_level, "%s", first);
+	(len > 0) ? free(first) : (void)0;
+	if (first_index < 0) {
+		free(logger->logs);
 		free(logger);
 		return NULL;
 	}
+	logger->default_index = first_index;
+	logger->default_level = (default_level < 0) ?
+					PURPL_INFO :
+					PURPL_MIN(default_level, PURPL_DEBUG);
 
-	logger->default_level =
-		((default_level < 0) ? PURPL_INFO : default_level) & 0xFFF;
-
-	/* Return the index of the first log\ */
-	first_index = logger->default_index;
+	/* Return the index of the first log */
 	*first_index_ret = first_index;
 
 	PURPL_RESTORE_ERRNO(___errno);
@@ -65,7 +70,6 @@ int purpl_open_log(struct purpl_logger *logger, s8 max_level, const char *path,
 	char *fmt_path;
 	s64 len;
 	va_list args;
-	s8 max;
 	int ___errno;
 
 	PURPL_SAVE_ERRNO(___errno);
@@ -81,8 +85,14 @@ int purpl_open_log(struct purpl_logger *logger, s8 max_level, const char *path,
 	fmt_path = purpl_fmt_text_va(&len, path, args);
 	va_end(args);
 
-	/* Determine the index */
-	index = logger->nlogs & 0xFFFFFF;
+	/* Determine the index (the first free one) */
+	for (index = 0; index < PURPL_MAX_LOGS && logger->logs[index]; index++)
+		;
+	if (index >= PURPL_MAX_LOGS) {
+		(len > 0) ? free(fmt_path) : (void)0;
+		errno = EMFILE;
+		return -1;
+	}
 
 	/* Open the log */
 	if (strcmp(fmt_path, "stdout") == 0) {
@@ -91,42 +101,379 @@ int purpl_open_log(struct purpl_logger *logger, s8 max_level, const char *path,
 		logger->logs[index] = stderr;
 	} else {
 		logger->logs[index] = fopen(fmt_path, PURPL_OVERWRITE);
-		if (logger->logs[index] == NULL)
+		if (logger->logs[index] == NULL) {
+			(len > 0) ? free(fmt_path) : (void)0;
 			return -1;
+		}
 	}
+	(len > 0) ? free(fmt_path) : (void)0;
 
 	/* Set the max level for the log */
-	max = max_level & 0x3F;
-	logger->max_level[index] = (max < 0) ? PURPL_DEBUG : max;
+	logger->max_level[index] = (max_level < 0) ?
+					   PURPL_DEBUG :
+					   PURPL_MIN(max_level, PURPL_DEBUG);
 
 	PURPL_RESTORE_ERRNO(___errno);
 
 	/* Increment the number of logs and return */
 	logger->nlogs++;
-	return index &
-	       0xFFFFFF; /* Gotta mask off any extra for the bit field */
+	return index;
+}
+
+/* The text for each message level */
+static const char *level_prefixes[] = {
+	[PURPL_WTF] = "[???] ",
+	[PURPL_FATAL] = "[fatal] ",
+	[PURPL_ERROR] = "[error] ",
+	[PURPL_WARNING] = "[warning] ",
+	[PURPL_INFO] = "[info] ",
+	[PURPL_DEBUG] = "[debug] ",
+};
+
+/* Write a message with its level, location, and time in front of it */
+static size_t write_line(FILE *fp, u8 level, const char *file, int line,
+			 time_t rawtime, const char *msg, size_t len)
+{
+	struct tm now;
+	char hdr[128];
+	int hdr_len;
+	size_t written;
+
+	/* Get the time (localtime isn't thread-safe) */
+#ifdef _WIN32
+	localtime_s(&now, &rawtime);
+#else
+	localtime_r(&rawtime, &now);
+#endif
+
+	/* Handle April Fools' */
+	if (now.tm_mon == 3 && now.tm_mday == 1) {
+		/* It's really March 32nd */
+		now.tm_mon = 2;
+		now.tm_mday = 32;
+	}
+
+	/* Format the header */
+	hdr_len = stbsp_snprintf(
+		hdr, sizeof(hdr), "%s%s:%d %d:%d:%d %02d/%02d/%04d: ",
+		level_prefixes[(level < PURPL_ARRAY_SIZE(level_prefixes)) ?
+				       level :
+				       PURPL_WTF],
+		file, line, now.tm_hour, now.tm_min, now.tm_sec, now.tm_mday,
+		now.tm_mon + 1, now.tm_year + 1900);
+	hdr_len = PURPL_MIN(hdr_len, (int)sizeof(hdr) - 1);
+
+	/* Write the header, the message, and a newline if it needs one */
+	written = fwrite(hdr, sizeof(char), hdr_len, fp);
+	written += fwrite(msg, sizeof(char), len, fp);
+	if (!len || msg[len - 1] != '\n')
+		written += fwrite("\n", sizeof(char), 1, fp);
+
+	return written;
+}
+
+/* Copy a message's arguments into a buffer, as its format string says */
+static u16 encode_args(char *buf, size_t size, const char *fmt, va_list args)
+{
+	struct purpl_fmt_spec spec;
+	size_t pos;
+	size_t len;
+	const char *str;
+	u64 val;
+	double dbl;
+	u16 str_len;
+	u8 i;
+
+	pos = 0;
+	while ((fmt = purpl_next_fmt_spec(fmt, &spec))) {
+		if (spec.arg == PURPL_FMT_NONE)
+			continue;
+
+		/* Widths and precisions from the arguments */
+		for (i = 0; i < spec.stars; i++) {
+			val = (u64)(s64)va_arg(args, int);
+			if (pos + sizeof(u64) > size)
+				return pos;
+			memcpy(buf + pos, &val, sizeof(u64));
+			pos += sizeof(u64);
+		}
+
+		/* The argument itself */
+		switch (spec.arg) {
+		case PURPL_FMT_INT:
+		case PURPL_FMT_UINT:
+			switch (spec.size) {
+			case 'l':
+				val = (spec.arg == PURPL_FMT_INT) ?
+					      (u64)va_arg(args, long) :
+					      va_arg(args, unsigned long);
+				break;
+			case 'q':
+				val = va_arg(args, unsigned long long);
+				break;
+			case 'z':
+				val = va_arg(args, size_t);
+				break;
+			case 'j':
+				val = va_arg(args, uintmax_t);
+				break;
+			case 't':
+				val = va_arg(args, ptrdiff_t);
+				break;
+			default:
+				val = (spec.arg == PURPL_FMT_INT) ?
+					      (u64)va_arg(args, int) :
+					      va_arg(args, unsigned int);
+				break;
+			}
+			break;
+		case PURPL_FMT_DOUBLE:
+			dbl = (spec.size == 'L') ? va_arg(args, long double) :
+						   va_arg(args, double);
+			memcpy(&val, &dbl, sizeof(u64));
+			break;
+		case PURPL_FMT_POINTER:
+			val = (uintptr_t)va_arg(args, void *);
+			break;
+		case PURPL_FMT_STRING:
+			/* Strings are copied, as much as fits */
+			str = va_arg(args, const char *);
+			if (!str)
+				str = "(null)";
+			if (pos + sizeof(u16) > size)
+				return pos;
+			len = PURPL_MIN(strlen(str), size - pos - sizeof(u16));
+			str_len = PURPL_MIN(len, UINT16_MAX);
+			memcpy(buf + pos, &str_len, sizeof(u16));
+			memcpy(buf + pos + sizeof(u16), str, str_len);
+			pos += sizeof(u16) + str_len;
+			continue;
+		default:
+			break;
+		}
+
+		if (pos + sizeof(u64) > size)
+			return pos;
+		memcpy(buf + pos, &val, sizeof(u64));
+		pos += sizeof(u64);
+	}
+
+	return pos;
+}
+
+/* Get the ID of a string in a binary log, writing it out the first time */
+static u32 intern_string(struct purpl_log_binary *bin, FILE *fp,
+			 const char *str)
+{
+	char hdr[1 + sizeof(u32) + sizeof(u16)];
+	ptrdiff_t idx;
+	u32 id;
+	u16 len;
+
+	idx = stbds_hmgeti(bin->strings, str);
+	if (idx >= 0)
+		return bin->strings[idx].value;
+
+	/* Define it */
+	id = bin->next_id++;
+	len = PURPL_MIN(strlen(str), UINT16_MAX);
+	hdr[0] = PURPL_LOG_BINARY_STRING;
+	memcpy(hdr + 1, &id, sizeof(u32));
+	memcpy(hdr + 1 + sizeof(u32), &len, sizeof(u16));
+	fwrite(hdr, sizeof(hdr), 1, fp);
+	fwrite(str, sizeof(char), len, fp);
+	stbds_hmput(bin->strings, str, id);
+
+	return id;
+}
+
+/* Write a message to a binary log */
+static size_t write_binary(struct purpl_log_binary *bin, FILE *fp, u8 level,
+			   const char *file, int line, time_t rawtime,
+			   const char *fmt, const char *args, u16 len)
+{
+	char hdr[2 + sizeof(u32) * 3 + sizeof(u64) + sizeof(u16)];
+	char *p;
+	u32 fmt_id;
+	u32 file_id;
+	u32 line32;
+	u64 time64;
+
+	/* Make sure the strings have been written */
+	fmt_id = intern_string(bin, fp, fmt);
+	file_id = intern_string(bin, fp, file);
+
+	/* Fill in the header */
+	line32 = line;
+	time64 = rawtime;
+	p = hdr;
+	*p++ = PURPL_LOG_BINARY_MESSAGE;
+	*p++ = level;
+	memcpy(p, &fmt_id, sizeof(u32));
+	p += sizeof(u32);
+	memcpy(p, &file_id, sizeof(u32));
+	p += sizeof(u32);
+	memcpy(p, &line32, sizeof(u32));
+	p += sizeof(u32);
+	memcpy(p, &time64, sizeof(u64));
+	p += sizeof(u64);
+	memcpy(p, &len, sizeof(u16));
+
+	/* Write it and the arguments */
+	return fwrite(hdr, sizeof(char), sizeof(hdr), fp) +
+	       fwrite(args, sizeof(char), len, fp);
+}
+
+/* Wake the writer thread if it's sleeping */
+static void wake_writer(struct purpl_log_ring *ring)
+{
+	if (SDL_AtomicGet(&ring->sleeping) &&
+	    SDL_AtomicCAS(&ring->sleeping, 1, 0))
+		SDL_SemPost(ring->wake);
+}
+
+/* Add to the bytes a logger has written */
+static void count_written(struct purpl_logger *logger, size_t written)
+{
+	SDL_AtomicLock(&logger->written_lock);
+	logger->written += written;
+	SDL_AtomicUnlock(&logger->written_lock);
 }
 
-/* Some macros for the text of different message levels */
-#define PRE_WTF "[???] "
-#define PRE_FATAL "[fatal] "
-#define PRE_ERROR "[error] "
-#define PRE_WARNING "[warning] "
-#define PRE_INFO "[info] "
-#define PRE_DEBUG "[debug] "
+/* Claim a record, format the message into it, and publish it */
+static size_t push_record(struct purpl_log_ring *ring, bool binary,
+			  u8 index, u8 level, const char *file, int line,
+			  const char *fmt, va_list args)
+{
+	struct purpl_log_record *rec;
+	u32 pos;
+	s32 diff;
+	int len;
+
+	/* Claim the record at the head once it's free */
+	pos = SDL_AtomicGet(&ring->head);
+	while (1) {
+		rec = &ring->records[pos & ring->mask];
+		diff = (s32)((u32)SDL_AtomicGet(&rec->seq) - pos);
+		if (diff == 0) {
+			if (SDL_AtomicCAS(&ring->head, pos, pos + 1))
+				break;
+		} else if (diff < 0) {
+			/* The ring is full */
+			if (ring->policy == PURPL_LOG_DROP &&
+			    level > PURPL_FATAL) {
+				SDL_AtomicIncRef(&ring->dropped);
+				return 0;
+			}
+			wake_writer(ring);
+			SDL_Delay(0);
+		}
+		pos = SDL_AtomicGet(&ring->head);
+	}
+
+	/* Fill it in (binary logs get the raw arguments instead of text) */
+	if (binary) {
+		rec->len = encode_args(rec->msg, sizeof(rec->msg), fmt, args);
+	} else {
+		len = stbsp_vsnprintf(rec->msg, sizeof(rec->msg), fmt, args);
+		rec->len = PURPL_MIN(PURPL_MAX(len, 0),
+				     (int)sizeof(rec->msg) - 1);
+	}
+	rec->fmt = fmt;
+	rec->index = index;
+	rec->level = level;
+	rec->file = file;
+	rec->line = line;
+	rec->time = time(NULL);
+
+	/* Hand it to the writer */
+	SDL_AtomicSet(&rec->seq, pos + 1);
+	wake_writer(ring);
+
+	return rec->len;
+}
+
+/* Write records as they come in */
+static int log_writer(void *data)
+{
+	struct purpl_logger *logger = data;
+	struct purpl_log_ring *ring = logger->ring;
+	struct purpl_log_record *rec;
+	bool touched[PURPL_MAX_LOGS];
+	size_t count;
+	size_t written;
+	size_t i;
+
+	purpl_profile_name_thread("purpl_log");
+	while (1) {
+		/* Write everything that's ready */
+		memset(touched, 0, sizeof(touched));
+		count = 0;
+		written = 0;
+		while (1) {
+			rec = &ring->records[ring->tail & ring->mask];
+			if ((u32)SDL_AtomicGet(&rec->seq) != ring->tail + 1)
+				break;
+
+			PURPL_PROFILE_BEGIN("Log write");
+			if (logger->binary[rec->index]) {
+				written += write_binary(
+					logger->binary[rec->index],
+					logger->logs[rec->index], rec->level,
+					rec->file, rec->line, rec->time,
+					rec->fmt, rec->msg, rec->len);
+				touched[rec->index] = true;
+			} else if (logger->logs[rec->index]) {
+				written += write_line(
+					logger->logs[rec->index], rec->level,
+					rec->file, rec->line, rec->time,
+					rec->msg, rec->len);
+				touched[rec->index] = true;
+			}
+			PURPL_PROFILE_END();
+
+			/* Give the record back to the producers */
+			SDL_AtomicSet(&rec->seq, ring->tail + ring->mask + 1);
+			ring->tail++;
+			count++;
+		}
+
+		/* Flush once per batch instead of once per message */
+		if (written)
+			count_written(logger, written);
+		for (i = 0; i < PURPL_MAX_LOGS; i++) {
+			if (touched[i])
+				fflush(logger->logs[i]);
+		}
+		if (count)
+			continue;
+		if (SDL_AtomicGet(&ring->quit))
+			break;
+
+		/* Sleep, unless something came in while saying so */
+		SDL_AtomicSet(&ring->sleeping, 1);
+		rec = &ring->records[ring->tail & ring->mask];
+		if ((u32)SDL_AtomicGet(&rec->seq) != ring->tail + 1 &&
+		    !SDL_AtomicGet(&ring->quit))
+			SDL_SemWaitTimeout(ring->wake, 100);
+		SDL_AtomicSet(&ring->sleeping, 0);
+	}
+
+	purpl_profile_release_thread();
+
+	return 0;
+}
 
 size_t purpl_write_log(struct purpl_logger *logger, const char *file,
 		       const int line, s8 index, s8 level, const char *fmt, ...)
 {
-	time_t rawtime;
-	struct tm *now;
-	char *fmt_ptr;
-	char *lvl_pre;
+	char buf[PURPL_LARGE_BUF];
+	struct purpl_arena *scratch;
+	struct purpl_arena_mark mark;
 	char *msg;
+	int len;
 	u8 idx;
 	u8 lvl;
-	s64 fmt_len;
-	s64 msg_len;
 	size_t written;
 	FILE *fp;
 	va_list args;
@@ -140,134 +487,239 @@ size_t purpl_write_log(struct purpl_logger *logger, const char *file,
 		return -1;
 	}
 
-	/* Format fmt */
-	va_start(args, fmt);
-	fmt_ptr = purpl_fmt_text_va(&fmt_len, fmt, args);
-	va_end(args);
-
-	/* Evaluate what level to use */
+	/* Evaluate what level and log to use */
 	lvl = (level < 0) ? logger->default_level : level;
-	switch (lvl) {
-	case PURPL_WTF:
-		lvl_pre = PURPL_CALLOC(strlen(PRE_WTF) + 1, char);
-		if (!lvl_pre) {
-			(!fmt_len) ? (void)0 : free(fmt_ptr);
-			return -1;
-		}
+	idx = ((index < 0) ? logger->default_index : index) & 0x3F;
 
-		strcpy(lvl_pre, PRE_WTF);
-		break;
-	case PURPL_FATAL:
-		lvl_pre = PURPL_CALLOC(strlen(PRE_FATAL) + 1, char);
-		if (!lvl_pre) {
-			(!fmt_len) ? (void)0 : free(fmt_ptr);
-			return -1;
-		}
+	/* Don't bother formatting anything that won't be written */
+	if (lvl > logger->max_level[idx]) {
+		PURPL_RESTORE_ERRNO(___errno);
+		return 0;
+	}
 
-		strcpy(lvl_pre, PRE_FATAL);
-		break;
-	case PURPL_ERROR:
-		lvl_pre = PURPL_CALLOC(strlen(PRE_ERROR) + 1, char);
-		if (!lvl_pre) {
-			(!fmt_len) ? (void)0 : free(fmt_ptr);
-			return -1;
-		}
+	/* Asynchronous loggers leave everything else to the writer thread */
+	PURPL_PROFILE_BEGIN("Log write");
+	if (logger->ring) {
+		va_start(args, fmt);
+		written = push_record(logger->ring, logger->binary[idx], idx,
+				      lvl, file, line, fmt, args);
+		va_end(args);
 
-		strcpy(lvl_pre, PRE_ERROR);
-		break;
-	case PURPL_WARNING:
-		lvl_pre = PURPL_CALLOC(strlen(PRE_WARNING) + 1, char);
-		if (!lvl_pre) {
-			(!fmt_len) ? (void)0 : free(fmt_ptr);
-			return -1;
-		}
+		PURPL_PROFILE_END();
+		PURPL_RESTORE_ERRNO(___errno);
 
-		strcpy(lvl_pre, PRE_WARNING);
-		break;
-	case PURPL_INFO:
-		lvl_pre = PURPL_CALLOC(strlen(PRE_INFO) + 1, char);
-		if (!lvl_pre) {
-			(!fmt_len) ? (void)0 : free(fmt_ptr);
-			return -1;
-		}
+		return written;
+	}
 
-		strcpy(lvl_pre, PRE_INFO);
-		break;
-	case PURPL_DEBUG:
-		lvl_pre = PURPL_CALLOC(strlen(PRE_DEBUG) + 1, char);
-		if (!lvl_pre) {
-			(!fmt_len) ? (void)0 : free(fmt_ptr);
-			return -1;
-		}
+	fp = logger->logs[idx];
+	if (!fp) {
+		PURPL_PROFILE_END();
+		errno = EINVAL;
+		return -1;
+	}
 
-		strcpy(lvl_pre, PRE_DEBUG);
-		break;
-	default:
-		lvl_pre = PURPL_CALLOC(strlen(PRE_WTF) + 1, char);
-		if (!lvl_pre) {
-			(!fmt_len) ? (void)0 : free(fmt_ptr);
-			return -1;
-		}
+	/* Binary logs just get the arguments */
+	if (logger->binary[idx]) {
+		va_start(args, fmt);
+		len = encode_args(buf, sizeof(buf), fmt, args);
+		va_end(args);
+		SDL_LockMutex(logger->binary[idx]->lock);
+		written = write_binary(logger->binary[idx], fp, lvl, file, line,
+				       time(NULL), fmt, buf, len);
+		fflush(fp);
+		SDL_UnlockMutex(logger->binary[idx]->lock);
+		count_written(logger, written);
+
+		PURPL_PROFILE_END();
+		PURPL_RESTORE_ERRNO(___errno);
+
+		return written;
+	}
 
-		strcpy(lvl_pre, PRE_WTF);
-		break;
+	/* Format the message, on the stack if it fits */
+	va_start(args, fmt);
+	len = stbsp_vsnprintf(buf, sizeof(buf), fmt, args);
+	va_end(args);
+	msg = buf;
+	scratch = NULL;
+	if (len >= (int)sizeof(buf)) {
+		scratch = purpl_get_scratch_arena();
+		mark = purpl_mark_arena(scratch);
+		va_start(args, fmt);
+		msg = purpl_fmt_text_va_arena(scratch, NULL, fmt, args);
+		va_end(args);
+		len = strlen(msg);
 	}
 
-	/* Get the time */
-	time(&rawtime);
-	now = localtime(&rawtime);
+	/* Write it */
+	written = write_line(fp, lvl, file, line, time(NULL), msg,
+			     PURPL_MAX(len, 0));
+	fflush(fp);
+	count_written(logger, written);
+	if (scratch)
+		purpl_release_arena(scratch, mark);
 
-	/* Figure out our index */
-	idx = (index < 0) ? logger->default_index : index;
-	fp = logger->logs[idx];
+	PURPL_PROFILE_END();
+	PURPL_RESTORE_ERRNO(___errno);
 
-	/* Handle April Fools' */
-	if (now->tm_mon == 3 && now->tm_mday == 1) {
-		/* It's really March 32nd (don't pass to asctime cause UB) */
-		now->tm_mon = 2;
-		now->tm_mday = 32;
-	}
+	return written;
+}
+
+int purpl_open_binary_log(struct purpl_logger *logger, s8 max_level,
+			  const char *path, ...)
+{
+	char *fmt_path;
+	s64 len;
+	va_list args;
+	u32 version;
+	int index;
+	int ___errno;
 
-	/* Format the message */
-	msg = purpl_fmt_text(&msg_len, "%s%s:%d %d:%d:%d %0.2d/%0.2d/%0.4d: %s",
-			     lvl_pre, file, line, now->tm_hour, now->tm_min,
-			     now->tm_sec, now->tm_mday, now->tm_mon + 1,
-			     now->tm_year - 70, fmt_ptr);
-	if (!msg) {
-		(fmt_len) ? (void)0 : free(fmt_ptr);
-		free(lvl_pre);
+	PURPL_SAVE_ERRNO(___errno);
+
+	/* Check the parameters */
+	if (!logger || !path) {
+		errno = EINVAL;
 		return -1;
 	}
 
-	/* Write the message */
-	written = fwrite(msg, sizeof(char), msg_len - 1, fp);
-	if (!written) {
-		(fmt_len) ? (void)0 : free(fmt_ptr);
-		free(lvl_pre);
+	/* Format the path and open the log */
+	va_start(args, path);
+	fmt_path = purpl_fmt_text_va(&len, path, args);
+	va_end(args);
+	index = purpl_open_log(logger, max_level, "%s", fmt_path);
+	(len > 0) ? free(fmt_path) : (void)0;
+	if (index < 0)
 		return -1;
-	}
 
-	/* If necessary, write a newline */
-	if (fmt_ptr[fmt_len - 2] != '\n') {
-		written = fwrite("\n", sizeof(char), 1, fp);
-		if (!written) {
-			(fmt_len) ? (void)0 : free(fmt_ptr);
-			(msg_len) ? (void)0 : free(msg);
-			free(lvl_pre);
-			return -1;
-		}
+	/* Set up its string table */
+	logger->binary[index] = PURPL_CALLOC(1, struct purpl_log_binary);
+	if (!logger->binary[index]) {
+		purpl_close_log(logger, index);
+		return -1;
+	}
+	logger->binary[index]->lock = SDL_CreateMutex();
+	if (!logger->binary[index]->lock) {
+		purpl_close_log(logger, index);
+		errno = ENOMEM;
+		return -1;
 	}
 
-	/* Just in case */
-	fflush(fp);
+	/* Write the header */
+	version = PURPL_LOG_BINARY_VERSION;
+	fwrite(PURPL_LOG_BINARY_MAGIC, sizeof(char), 4, logger->logs[index]);
+	fwrite(&version, sizeof(u32), 1, logger->logs[index]);
+
+	PURPL_RESTORE_ERRNO(___errno);
+
+	return index;
+}
 
-	/* Free everything else */
-	(msg_len) ? (void)0 : free(msg);
-	(fmt_len) ? (void)0 : free(fmt_ptr);
-	free(lvl_pre);
+int purpl_start_async_log(struct purpl_logger *logger, u32 capacity,
+			  enum purpl_log_policy policy)
+{
+	struct purpl_log_ring *ring;
+	u32 size;
+	u32 i;
+	int ___errno;
+
+	PURPL_SAVE_ERRNO(___errno);
+
+	/* Check args */
+	if (!logger) {
+		errno = EINVAL;
+		return errno;
+	}
+	if (logger->ring) {
+		errno = EEXIST;
+		return errno;
+	}
+
+	/* The ring's size has to be a power of two */
+	capacity = capacity ? capacity : PURPL_LOG_DEFAULT_RING;
+	for (size = 2; size < capacity && size < (1u << 30); size <<= 1)
+		;
+
+	/* Allocate the ring */
+	ring = PURPL_CALLOC(1, struct purpl_log_ring);
+	if (!ring)
+		return errno;
+	ring->records = PURPL_CALLOC(size, struct purpl_log_record);
+	if (!ring->records) {
+		free(ring);
+		return errno;
+	}
+	ring->mask = size - 1;
+	ring->policy = policy;
+	for (i = 0; i < size; i++)
+		SDL_AtomicSet(&ring->records[i].seq, i);
+
+	/* Start the writer */
+	ring->wake = SDL_CreateSemaphore(0);
+	if (!ring->wake) {
+		free(ring->records);
+		free(ring);
+		errno = ENOMEM;
+		return errno;
+	}
+	logger->ring = ring;
+	ring->thread = SDL_CreateThread(log_writer, "purpl_log", logger);
+	if (!ring->thread) {
+		logger->ring = NULL;
+		SDL_DestroySemaphore(ring->wake);
+		free(ring->records);
+		free(ring);
+		errno = EAGAIN;
+		return errno;
+	}
 
 	PURPL_RESTORE_ERRNO(___errno);
 
+	return 0;
+}
+
+void purpl_stop_async_log(struct purpl_logger *logger)
+{
+	struct purpl_log_ring *ring;
+
+	/* Check args */
+	if (!logger || !logger->ring) {
+		errno = EINVAL;
+		return;
+	}
+	ring = logger->ring;
+
+	/* Let the writer finish up */
+	SDL_AtomicSet(&ring->quit, 1);
+	SDL_SemPost(ring->wake);
+	SDL_WaitThread(ring->thread, NULL);
+
+	/* Go back to writing directly */
+	logger->ring = NULL;
+	SDL_DestroySemaphore(ring->wake);
+	free(ring->records);
+	free(ring);
+}
+
+u32 purpl_log_dropped(struct purpl_logger *logger)
+{
+	if (!logger || !logger->ring)
+		return 0;
+
+	return SDL_AtomicGet(&logger->ring->dropped);
+}
+
+u64 purpl_log_written(struct purpl_logger *logger)
+{
+	u64 written;
+
+	if (!logger)
+		return 0;
+
+	SDL_AtomicLock(&logger->written_lock);
+	written = logger->written;
+	SDL_AtomicUnlock(&logger->written_lock);
+
 	return written;
 }
 
@@ -280,13 +732,13 @@ s8 purpl_set_max_level(struct purpl_logger *logger, u8 index, u8 level)
 
 	/* Check arguments */
 	idx = index & 0x3F;
-	if (!logger || idx > logger->nlogs) {
+	if (!logger || !logger->logs[idx]) {
 		errno = EINVAL;
 		return -1;
 	}
 
 	/* Change the level */
-	logger->max_level[idx] = level & 0x7;
+	logger->max_level[idx] = PURPL_MIN(level, PURPL_DEBUG);
 
 	PURPL_RESTORE_ERRNO(___errno);
 
@@ -306,10 +758,20 @@ void purpl_close_log(struct purpl_logger *logger, u8 index)
 	}
 
 	/* Close the file and clear its information */
-	fclose(logger->logs[index]);
+	if (logger->logs[index] != stdout && logger->logs[index] != stderr)
+		fclose(logger->logs[index]);
+	else
+		fflush(logger->logs[index]);
+	logger->logs[index] = NULL;
 	logger->nlogs--;
 	logger->max_level[index] = 0;
-	free(logger->logs);
+	if (logger->binary[index]) {
+		stbds_hmfree(logger->binary[index]->strings);
+		if (logger->binary[index]->lock)
+			SDL_DestroyMutex(logger->binary[index]->lock);
+		free(logger->binary[index]);
+		logger->binary[index] = NULL;
+	}
 
 	PURPL_RESTORE_ERRNO(___errno);
 }
@@ -327,8 +789,15 @@ void purpl_end_logger(struct purpl_logger *logger, _Bool write_goodbye)
 		return;
 	}
 
+	/* Write whatever's waiting, and say goodbye synchronously */
+	if (logger->ring)
+		purpl_stop_async_log(logger);
+
 	/* Close every log */
-	for (i = 0; i < logger->nlogs; i++) {
+	for (i = 0; i < PURPL_MAX_LOGS; i++) {
+		if (!logger->logs[i])
+			continue;
+
 		/* Write a goodbye message if requested */
 		if (write_goodbye) {
 			char goodbye[512];
@@ -368,6 +837,7 @@ void purpl_end_logger(struct purpl_logger *logger, _Bool write_goodbye)
 	}
 
 	/* Free the logger */
+	free(logger->logs);
 	free(logger);
 
 	PURPL_RESTORE_ERRNO(___errno);
@@ -0,0 +1,448 @@
+#include "purpl/profile.h"
+#include "purpl/inst.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Every thread that has used the profiler */
+static struct purpl_profile_thread *threads;
+static SDL_SpinLock threads_lock;
+static u32 next_thread_id;
+
+/* The state of the capture */
+static SDL_atomic_t capturing;
+static SDL_atomic_t generation;
+static u64 capture_start;
+
+/* The calling thread's state */
+static PURPL_THREAD_LOCAL struct purpl_profile_thread *current_thread;
+
+/* Get the calling thread's state, creating it the first time */
+static struct purpl_profile_thread *get_thread(void)
+{
+	struct purpl_profile_thread *thread;
+
+	if (current_thread)
+		return current_thread;
+
+	thread = PURPL_CALLOC(1, struct purpl_profile_thread);
+	if (!thread)
+		return NULL;
+
+	SDL_AtomicLock(&threads_lock);
+	thread->id = next_thread_id++;
+	thread->next = threads;
+	threads = thread;
+	SDL_AtomicUnlock(&threads_lock);
+
+	current_thread = thread;
+	return thread;
+}
+
+/* Record an event if a capture is running, returning whether it was */
+static bool record(struct purpl_profile_thread *thread, const char *name,
+		   u8 type, u64 time)
+{
+	struct purpl_profile_event *event;
+	int gen;
+	int count;
+
+	if (!SDL_AtomicGet(&capturing))
+		return false;
+
+	/* Start over if this is a new capture */
+	gen = SDL_AtomicGet(&generation);
+	if (SDL_AtomicGet(&thread->generation) != gen) {
+		SDL_AtomicSet(&thread->count, 0);
+		SDL_AtomicSet(&thread->dropped, 0);
+		SDL_AtomicSet(&thread->generation, gen);
+	}
+
+	/* The buffer is only allocated once it's needed */
+	if (!thread->events) {
+		thread->events = PURPL_CALLOC(PURPL_PROFILE_BUFFER_SIZE,
+					      struct purpl_profile_event);
+		if (!thread->events)
+			return false;
+	}
+
+	count = SDL_AtomicGet(&thread->count);
+	if (count >= PURPL_PROFILE_BUFFER_SIZE) {
+		SDL_AtomicAdd(&thread->dropped, 1);
+		return false;
+	}
+
+	/* Fill in the event before exporters can see it */
+	event = &thread->events[count];
+	event->name = name;
+	event->time = time;
+	event->type = type;
+	SDL_AtomicSet(&thread->count, count + 1);
+
+	return true;
+}
+
+/* Add a finished zone to the frame summary */
+static void add_zone(struct purpl_profile_frame *frame, const char *name,
+		     u32 depth, u64 time)
+{
+	struct purpl_profile_zone *zone;
+	u32 i;
+
+	for (i = 0; i < frame->zone_count; i++) {
+		if (frame->zones[i].name == name)
+			break;
+	}
+	if (i == frame->zone_count) {
+		if (frame->zone_count >= PURPL_PROFILE_MAX_ZONES)
+			return;
+		zone = &frame->zones[frame->zone_count++];
+		zone->name = name;
+		zone->depth = depth;
+		zone->count = 0;
+		zone->total = 0;
+	}
+
+	zone = &frame->zones[i];
+	zone->depth = PURPL_MIN(zone->depth, depth);
+	zone->count++;
+	zone->total += time;
+}
+
+void purpl_profile_begin(const char *name)
+{
+	struct purpl_profile_thread *thread;
+	u64 now;
+
+	thread = get_thread();
+	if (!thread)
+		return;
+
+	/* Zones too deep are ignored, but still have to be ended */
+	if (thread->depth >= PURPL_PROFILE_MAX_DEPTH) {
+		thread->overflow++;
+		return;
+	}
+
+	now = purpl_get_time_ns();
+	thread->stack[thread->depth] = name;
+	thread->starts[thread->depth] = now;
+	thread->recorded[thread->depth] =
+		record(thread, name, PURPL_PROFILE_ZONE_BEGIN, now);
+	thread->depth++;
+}
+
+void purpl_profile_end(void)
+{
+	struct purpl_profile_thread *thread;
+	u64 now;
+
+	thread = current_thread;
+	if (!thread)
+		return;
+	if (thread->overflow) {
+		thread->overflow--;
+		return;
+	}
+	if (!thread->depth)
+		return;
+
+	now = purpl_get_time_ns();
+	thread->depth--;
+
+	/* Only end zones the capture saw begin */
+	if (thread->recorded[thread->depth])
+		record(thread, thread->stack[thread->depth],
+		       PURPL_PROFILE_ZONE_END, now);
+
+	if (thread->framed)
+		add_zone(&thread->current, thread->stack[thread->depth],
+			 thread->depth, now - thread->starts[thread->depth]);
+}
+
+void purpl_profile_frame(void)
+{
+	struct purpl_profile_thread *thread;
+	u64 now;
+
+	thread = get_thread();
+	if (!thread)
+		return;
+
+	now = purpl_get_time_ns();
+	if (thread->framed) {
+		thread->current.duration = now - thread->current.start;
+		thread->last = thread->current;
+	}
+
+	thread->framed = true;
+	thread->current.start = now;
+	thread->current.duration = 0;
+	thread->current.zone_count = 0;
+}
+
+bool purpl_profile_get_frame(struct purpl_profile_frame *frame)
+{
+	struct purpl_profile_thread *thread = current_thread;
+
+	if (!frame || !thread || !thread->last.start)
+		return false;
+
+	memcpy(frame, &thread->last, sizeof(struct purpl_profile_frame));
+	return true;
+}
+
+void purpl_profile_name_thread(const char *name)
+{
+	struct purpl_profile_thread *thread;
+
+	thread = get_thread();
+	if (thread)
+		thread->name = name;
+}
+
+void purpl_profile_start_capture(void)
+{
+	capture_start = purpl_get_time_ns();
+	SDL_AtomicAdd(&generation, 1);
+	SDL_AtomicSet(&capturing, 1);
+}
+
+u64 purpl_profile_stop_capture(void)
+{
+	struct purpl_profile_thread *thread;
+	int gen;
+	u64 dropped = 0;
+
+	SDL_AtomicSet(&capturing, 0);
+
+	gen = SDL_AtomicGet(&generation);
+	SDL_AtomicLock(&threads_lock);
+	for (thread = threads; thread; thread = thread->next) {
+		if (SDL_AtomicGet(&thread->generation) == gen)
+			dropped += SDL_AtomicGet(&thread->dropped);
+	}
+	SDL_AtomicUnlock(&threads_lock);
+
+	return dropped;
+}
+
+/* Write a string for JSON, escaping what needs it */
+static void write_json_string(FILE *fp, const char *str)
+{
+	fputc('"', fp);
+	for (; str && *str; str++) {
+		if (*str == '"' || *str == '\\')
+			fputc('\\', fp);
+		if ((u8)*str < ' ')
+			fprintf(fp, "\\u%04x", (u8)*str);
+		else
+			fputc(*str, fp);
+	}
+	fputc('"', fp);
+}
+
+/* Write the capture as Chrome trace events */
+static void export_chrome(FILE *fp, int gen)
+{
+	struct purpl_profile_thread *thread;
+	struct purpl_profile_event *event;
+	bool first = true;
+	int count;
+	int i;
+
+	fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", fp);
+	for (thread = threads; thread; thread = thread->next) {
+		if (SDL_AtomicGet(&thread->generation) != gen)
+			continue;
+
+		/* Name the thread */
+		fprintf(fp,
+			"%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+			"\"tid\":%u,\"args\":{\"name\":",
+			first ? "" : ",", thread->id);
+		if (thread->name)
+			write_json_string(fp, thread->name);
+		else
+			fprintf(fp, "\"Thread %u\"", thread->id);
+		fputs("}}", fp);
+		first = false;
+
+		/* Then its events, in microseconds */
+		count = SDL_AtomicGet(&thread->count);
+		for (i = 0; i < count; i++) {
+			event = &thread->events[i];
+			fputs(",\n{\"name\":", fp);
+			write_json_string(fp, event->name);
+			fprintf(fp,
+				",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,"
+				"\"tid\":%u}",
+				(event->type == PURPL_PROFILE_ZONE_BEGIN) ?
+					'B' :
+					'E',
+				(event->time - capture_start) / 1000.0,
+				thread->id);
+		}
+	}
+	fputs("\n]}\n", fp);
+}
+
+/* Write a string with its length in front */
+static void write_binary_string(FILE *fp, const char *str)
+{
+	u16 len;
+
+	len = str ? PURPL_MIN(strlen(str), UINT16_MAX) : 0;
+	fwrite(&len, sizeof(u16), 1, fp);
+	fwrite(str, sizeof(char), len, fp);
+}
+
+/* Write the capture in the binary format */
+static void export_binary(FILE *fp, int gen)
+{
+	struct {
+		const char *key;
+		u32 value;
+	} *ids = NULL;
+	const char **strings = NULL;
+	struct purpl_profile_thread *thread;
+	struct purpl_profile_event *event;
+	u32 version = PURPL_PROFILE_VERSION;
+	u32 nthreads = 0;
+	u32 id;
+	u64 time;
+	u32 count;
+	u32 i;
+
+	/* Give each name an ID */
+	for (thread = threads; thread; thread = thread->next) {
+		if (SDL_AtomicGet(&thread->generation) != gen)
+			continue;
+		nthreads++;
+		count = SDL_AtomicGet(&thread->count);
+		for (i = 0; i < count; i++) {
+			event = &thread->events[i];
+			if (stbds_hmgeti(ids, event->name) >= 0)
+				continue;
+			stbds_hmput(ids, event->name, stbds_arrlenu(strings));
+			stbds_arrput(strings, event->name);
+		}
+	}
+
+	/* Write the header and the string table */
+	fwrite("PPRF", sizeof(char), 4, fp);
+	fwrite(&version, sizeof(u32), 1, fp);
+	count = stbds_arrlenu(strings);
+	fwrite(&count, sizeof(u32), 1, fp);
+	for (i = 0; i < count; i++)
+		write_binary_string(fp, strings[i]);
+
+	/*
+	 * Then each thread: its ID, its name, its event count and its events,
+	 *  each a u32 name ID, a u8 type and a u64 time in nanoseconds since
+	 *  the capture started
+	 */
+	fwrite(&nthreads, sizeof(u32), 1, fp);
+	for (thread = threads; thread; thread = thread->next) {
+		if (SDL_AtomicGet(&thread->generation) != gen)
+			continue;
+		fwrite(&thread->id, sizeof(u32), 1, fp);
+		write_binary_string(fp, thread->name);
+		count = SDL_AtomicGet(&thread->count);
+		fwrite(&count, sizeof(u32), 1, fp);
+		for (i = 0; i < count; i++) {
+			event = &thread->events[i];
+			id = stbds_hmget(ids, event->name);
+			time = event->time - capture_start;
+			fwrite(&id, sizeof(u32), 1, fp);
+			fwrite(&event->type, sizeof(u8), 1, fp);
+			fwrite(&time, sizeof(u64), 1, fp);
+		}
+	}
+
+	stbds_hmfree(ids);
+	stbds_arrfree(strings);
+}
+
+int purpl_profile_export(enum purpl_profile_format format, const char *path,
+			 ...)
+{
+	struct purpl_arena *scratch;
+	struct purpl_arena_mark mark;
+	va_list args;
+	char *path_fmt;
+	FILE *fp;
+	int ___errno;
+
+	PURPL_SAVE_ERRNO(___errno);
+
+	/* Check arguments */
+	if (!path || format > PURPL_PROFILE_BINARY) {
+		errno = EINVAL;
+		return errno;
+	}
+
+	/* Open the file */
+	scratch = purpl_get_scratch_arena();
+	mark = purpl_mark_arena(scratch);
+	va_start(args, path);
+	path_fmt = purpl_fmt_text_va_arena(scratch, NULL, path, args);
+	va_end(args);
+	fp = path_fmt ? fopen(path_fmt, "wb") : NULL;
+	purpl_release_arena(scratch, mark);
+	if (!fp)
+		return errno;
+
+	/* Write the capture */
+	SDL_AtomicLock(&threads_lock);
+	if (format == PURPL_PROFILE_CHROME)
+		export_chrome(fp, SDL_AtomicGet(&generation));
+	else
+		export_binary(fp, SDL_AtomicGet(&generation));
+	SDL_AtomicUnlock(&threads_lock);
+
+	if (fclose(fp) != 0)
+		return errno;
+
+	PURPL_RESTORE_ERRNO(___errno);
+
+	return 0;
+}
+
+void purpl_profile_release_thread(void)
+{
+	struct purpl_profile_thread **link;
+	struct purpl_profile_thread *thread = current_thread;
+
+	if (!thread)
+		return;
+
+	/* Unlink it so exports stop reading its events before they're freed */
+	SDL_AtomicLock(&threads_lock);
+	for (link = &threads; *link; link = &(*link)->next) {
+		if (*link == thread) {
+			*link = thread->next;
+			break;
+		}
+	}
+	SDL_AtomicUnlock(&threads_lock);
+
+	free(thread->events);
+	free(thread);
+	current_thread = NULL;
+}
+
+void purpl_profile_shutdown(void)
+{
+	/*
+	 * Other threads might still be using their state, so only the calling
+	 *  thread's is freed, the rest is freed by each thread when it exits
+	 */
+	SDL_AtomicSet(&capturing, 0);
+	purpl_profile_release_thread();
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,822 @@
+#include "purpl/render.h"
+#include "purpl/profile.h"
+#include "purpl/sprite.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Below this many items, an insertion sort beats going over them 8 times */
+#define SMALL_SORT 32
+
+/* Gives each renderer an ID that's never reused */
+static SDL_atomic_t next_renderer_id;
+
+/* The buffer the calling thread last recorded into, and whose it is */
+static PURPL_THREAD_LOCAL u32 current_renderer;
+static PURPL_THREAD_LOCAL struct purpl_cmd_buffer *current_buffer;
+
+/* Get the calling thread's buffer, creating it the first time */
+static struct purpl_cmd_buffer *get_buffer(struct purpl_renderer *renderer)
+{
+	struct purpl_cmd_buffer *buffer;
+	SDL_threadID self;
+	size_t i;
+
+	if (current_renderer == renderer->id && current_buffer)
+		return current_buffer;
+
+	/* This thread might have recorded for another renderer in between */
+	self = SDL_ThreadID();
+	buffer = NULL;
+	SDL_AtomicLock(&renderer->lock);
+	for (i = 0; i < stbds_arrlenu(renderer->buffers); i++) {
+		if (renderer->buffers[i]->owner == self) {
+			buffer = renderer->buffers[i];
+			break;
+		}
+	}
+	if (!buffer) {
+		buffer = PURPL_CALLOC(1, struct purpl_cmd_buffer);
+		if (buffer) {
+			buffer->owner = self;
+			stbds_arrput(renderer->buffers, buffer);
+		}
+	}
+	SDL_AtomicUnlock(&renderer->lock);
+	if (!buffer)
+		return NULL;
+
+	current_renderer = renderer->id;
+	current_buffer = buffer;
+	return buffer;
+}
+
+/* Sort a few items in place */
+static void insertion_sort(struct purpl_render_item *items, size_t count)
+{
+	struct purpl_render_item item;
+	size_t i;
+	size_t j;
+
+	for (i = 1; i < count; i++) {
+		item = items[i];
+		for (j = i; j > 0 && items[j - 1].key > item.key; j--)
+			items[j] = items[j - 1];
+		items[j] = item;
+	}
+}
+
+static int null_init(struct purpl_renderer *renderer)
+{
+	renderer->data = PURPL_CALLOC(1, struct purpl_null_render_state);
+	if (!renderer->data)
+		return errno;
+
+	return 0;
+}
+
+/* Check that the items came in order and count them */
+static void null_submit(struct purpl_renderer *renderer,
+			const struct purpl_render_item *items, size_t count)
+{
+	struct purpl_null_render_state *state = renderer->data;
+	u64 last;
+	size_t i;
+
+	last = 0;
+	for (i = 0; i < count; i++) {
+		/* FNV-1a, but a key at a time */
+		state->checksum =
+			(state->checksum ^ items[i].key) * 0x100000001B3ull;
+		if (items[i].key < last)
+			state->unsorted++;
+		last = items[i].key;
+		if (items[i].cmd->type < PURPL_ARRAY_SIZE(state->counts))
+			state->counts[items[i].cmd->type]++;
+	}
+
+	state->frames++;
+	state->items += count;
+}
+
+static void null_shutdown(struct purpl_renderer *renderer)
+{
+	free(renderer->data);
+	renderer->data = NULL;
+}
+
+/* Textures are just numbered */
+static u32 null_create_texture(struct purpl_renderer *renderer,
+			       const u8 *pixels, u32 width, u32 height)
+{
+	struct purpl_null_render_state *state = renderer->data;
+
+	NOPE(pixels);
+	NOPE(width);
+	NOPE(height);
+
+	return ++state->textures;
+}
+
+const struct purpl_render_backend purpl_null_render_backend = {
+	.name = "null",
+	.init = null_init,
+	.begin = NULL,
+	.submit = null_submit,
+	.shutdown = null_shutdown,
+	.create_texture = null_create_texture,
+	.destroy_texture = NULL,
+};
+
+#if PURPL_USE_OPENGL_GFX
+/* The number of frames the streaming buffer is split between */
+#define GL_STREAM_FRAMES 3
+
+/* The fewest instances each frame's part of the streaming buffer holds */
+#define GL_MIN_INSTANCES 16384
+
+/* The GL objects and the draws of the current frame */
+struct gl_render_state {
+	GLuint program;
+	GLuint vao;
+	GLint screen;
+	GLuint white;
+	GLuint vbo;
+	bool persistent;
+	size_t capacity;
+	u32 frame;
+	struct purpl_sprite_instance *mapped;
+	GLsync fences[GL_STREAM_FRAMES];
+	struct purpl_sprite_draw *draws;
+};
+
+/*
+ * Each instance is a quad, with its corners made from the vertex ID, and
+ *  pixels are turned into clip space so commands don't need a projection
+ *  matrix
+ */
+static const char *gl_vertex_shader =
+	"#version 330 core\n"
+	"layout(location = 0) in vec4 rect;\n"
+	"layout(location = 1) in vec4 uv;\n"
+	"layout(location = 2) in vec4 color;\n"
+	"uniform vec2 screen;\n"
+	"out vec2 frag_uv;\n"
+	"out vec4 frag_color;\n"
+	"void main()\n"
+	"{\n"
+	"	vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);\n"
+	"	vec2 position = rect.xy + corner * rect.zw;\n"
+	"	gl_Position = vec4(position / screen * vec2(2.0, -2.0) +\n"
+	"			   vec2(-1.0, 1.0), 0.0, 1.0);\n"
+	"	frag_uv = mix(uv.xy, uv.zw, corner);\n"
+	"	frag_color = color;\n"
+	"}\n";
+
+static const char *gl_fragment_shader =
+	"#version 330 core\n"
+	"in vec2 frag_uv;\n"
+	"in vec4 frag_color;\n"
+	"uniform sampler2D page;\n"
+	"out vec4 out_color;\n"
+	"void main()\n"
+	"{\n"
+	"	out_color = texture(page, frag_uv) * frag_color;\n"
+	"}\n";
+
+/* Compile a shader, returning 0 if it doesn't */
+static GLuint gl_compile(GLenum type, const char *source)
+{
+	GLuint shader;
+	GLint status;
+
+	shader = glCreateShader(type);
+	if (!shader)
+		return 0;
+	glShaderSource(shader, 1, &source, NULL);
+	glCompileShader(shader);
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+	if (!status) {
+		glDeleteShader(shader);
+		return 0;
+	}
+
+	return shader;
+}
+
+static u32 gl_create_texture(struct purpl_renderer *renderer,
+			     const u8 *pixels, u32 width, u32 height)
+{
+	GLuint texture;
+
+	NOPE(renderer);
+
+	glGenTextures(1, &texture);
+	if (!texture) {
+		errno = ENOMEM;
+		return 0;
+	}
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, (GLsizei)width,
+		     (GLsizei)height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	return texture;
+}
+
+static void gl_destroy_texture(struct purpl_renderer *renderer, u32 texture)
+{
+	GLuint name = texture;
+
+	NOPE(renderer);
+
+	glDeleteTextures(1, &name);
+}
+
+/* Point the instance attributes at an instance in the streaming buffer */
+static void gl_set_instances(size_t offset)
+{
+	glVertexAttribPointer(
+		0, 4, GL_FLOAT, GL_FALSE, sizeof(struct purpl_sprite_instance),
+		(void *)(offset + offsetof(struct purpl_sprite_instance, x)));
+	glVertexAttribPointer(
+		1, 4, GL_FLOAT, GL_FALSE, sizeof(struct purpl_sprite_instance),
+		(void *)(offset + offsetof(struct purpl_sprite_instance, u0)));
+	glVertexAttribPointer(
+		2, 4, GL_UNSIGNED_BYTE, GL_TRUE,
+		sizeof(struct purpl_sprite_instance),
+		(void *)(offset +
+			 offsetof(struct purpl_sprite_instance, color)));
+}
+
+/* Wait for the GPU to be done with a frame's part of the streaming buffer */
+static void gl_wait(struct gl_render_state *state, size_t frame)
+{
+	if (!state->fences[frame])
+		return;
+
+	glClientWaitSync(state->fences[frame], GL_SYNC_FLUSH_COMMANDS_BIT,
+			 UINT64_MAX);
+	glDeleteSync(state->fences[frame]);
+	state->fences[frame] = NULL;
+}
+
+/* Make a streaming buffer with room for at least count instances a frame */
+static void gl_create_stream(struct gl_render_state *state, size_t count)
+{
+	GLbitfield flags;
+	size_t i;
+
+	/* Get rid of the old one, once the GPU is done with it */
+	for (i = 0; i < GL_STREAM_FRAMES; i++) {
+		gl_wait(state, i);
+	}
+	if (state->vbo) {
+		glBindBuffer(GL_ARRAY_BUFFER, state->vbo);
+		if (state->mapped)
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+		glDeleteBuffers(1, &state->vbo);
+	}
+	state->mapped = NULL;
+
+	state->capacity = PURPL_MAX(count, GL_MIN_INSTANCES);
+	glGenBuffers(1, &state->vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, state->vbo);
+
+	/* Keep it mapped if possible, so filling it is just writing memory */
+	if (state->persistent) {
+		flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT |
+			GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_ARRAY_BUFFER,
+				state->capacity * GL_STREAM_FRAMES *
+					sizeof(struct purpl_sprite_instance),
+				NULL, flags);
+		state->mapped = glMapBufferRange(
+			GL_ARRAY_BUFFER, 0,
+			state->capacity * GL_STREAM_FRAMES *
+				sizeof(struct purpl_sprite_instance),
+			flags);
+	}
+}
+
+/* Get room for count instances in this frame's part of the buffer */
+static struct purpl_sprite_instance *gl_map(struct gl_render_state *state,
+					    size_t count, size_t *offset)
+{
+	if (count > state->capacity)
+		gl_create_stream(state, count + count / 2);
+	glBindBuffer(GL_ARRAY_BUFFER, state->vbo);
+
+	if (state->mapped) {
+		/* Move on to the next part */
+		state->frame = (state->frame + 1) % GL_STREAM_FRAMES;
+		gl_wait(state, state->frame);
+		*offset = state->frame * state->capacity *
+			  sizeof(struct purpl_sprite_instance);
+		return state->mapped + state->frame * state->capacity;
+	}
+
+	/* Otherwise, give the driver new storage so it doesn't have to wait */
+	*offset = 0;
+	glBufferData(GL_ARRAY_BUFFER,
+		     state->capacity * sizeof(struct purpl_sprite_instance),
+		     NULL, GL_STREAM_DRAW);
+	return glMapBufferRange(GL_ARRAY_BUFFER, 0,
+				count * sizeof(struct purpl_sprite_instance),
+				GL_MAP_WRITE_BIT |
+					GL_MAP_INVALIDATE_BUFFER_BIT);
+}
+
+static void gl_shutdown(struct purpl_renderer *renderer);
+
+static int gl_init(struct purpl_renderer *renderer)
+{
+	static const u8 white[4] = { 0xFF, 0xFF, 0xFF, 0xFF };
+	struct gl_render_state *state;
+	GLuint vertex;
+	GLuint fragment;
+	GLint status;
+	size_t i;
+
+	state = PURPL_CALLOC(1, struct gl_render_state);
+	if (!state)
+		return errno;
+	renderer->data = state;
+
+	/* Build the program */
+	vertex = gl_compile(GL_VERTEX_SHADER, gl_vertex_shader);
+	fragment = gl_compile(GL_FRAGMENT_SHADER, gl_fragment_shader);
+	if (vertex && fragment) {
+		state->program = glCreateProgram();
+		glAttachShader(state->program, vertex);
+		glAttachShader(state->program, fragment);
+		glLinkProgram(state->program);
+	}
+	glDeleteShader(vertex);
+	glDeleteShader(fragment);
+	if (!state->program) {
+		gl_shutdown(renderer);
+		errno = EOPNOTSUPP;
+		return errno;
+	}
+	glGetProgramiv(state->program, GL_LINK_STATUS, &status);
+	if (!status) {
+		gl_shutdown(renderer);
+		errno = EOPNOTSUPP;
+		return errno;
+	}
+	state->screen = glGetUniformLocation(state->program, "screen");
+	glUseProgram(state->program);
+	glUniform1i(glGetUniformLocation(state->program, "page"), 0);
+
+	/* Rectangles use a white texture, so they're just sprites too */
+	state->white = gl_create_texture(renderer, white, 1, 1);
+
+	/* Every attribute is per instance */
+	glGenVertexArrays(1, &state->vao);
+	glBindVertexArray(state->vao);
+	state->persistent = GLEW_ARB_buffer_storage;
+	gl_create_stream(state, GL_MIN_INSTANCES);
+	for (i = 0; i < 3; i++) {
+		glEnableVertexAttribArray((GLuint)i);
+		glVertexAttribDivisor((GLuint)i, 1);
+	}
+
+	/* Colors have alpha */
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	return 0;
+}
+
+static void gl_begin(struct purpl_renderer *renderer, int width, int height)
+{
+	NOPE(renderer);
+
+	/* Reset viewport size and clear the window to black */
+	glViewport(0, 0, width, height);
+	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+}
+
+static void gl_submit(struct purpl_renderer *renderer,
+		      const struct purpl_render_item *items, size_t count)
+{
+	struct gl_render_state *state = renderer->data;
+	struct purpl_sprite_instance *instances;
+	struct purpl_sprite_draw *draw;
+	size_t offset;
+	size_t i;
+
+	if (!count)
+		return;
+
+	/* Batch straight into the buffer */
+	glBindVertexArray(state->vao);
+	instances = gl_map(state, count, &offset);
+	if (!instances)
+		return;
+	purpl_batch_sprites(items, count, instances, &state->draws);
+	if (!state->mapped)
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+
+	glUseProgram(state->program);
+	glUniform2f(state->screen, (float)PURPL_MAX(renderer->width, 1),
+		    (float)PURPL_MAX(renderer->height, 1));
+	glActiveTexture(GL_TEXTURE0);
+
+	/* One draw for each run of instances on the same texture */
+	for (i = 0; i < stbds_arrlenu(state->draws); i++) {
+		draw = &state->draws[i];
+		if (draw->type == PURPL_RENDER_CLEAR) {
+			glClearColor((u8)(draw->color >> 24) / 255.0f,
+				     (u8)(draw->color >> 16) / 255.0f,
+				     (u8)(draw->color >> 8) / 255.0f,
+				     (u8)draw->color / 255.0f);
+			glClear(GL_COLOR_BUFFER_BIT);
+			continue;
+		}
+
+		glBindTexture(GL_TEXTURE_2D,
+			      draw->texture ? draw->texture : state->white);
+		gl_set_instances(offset + draw->first *
+					 sizeof(struct purpl_sprite_instance));
+		glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4,
+				      (GLsizei)draw->count);
+	}
+
+	/* Know when the GPU is done with this part of the buffer */
+	if (state->mapped)
+		state->fences[state->frame] =
+			glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+static void gl_shutdown(struct purpl_renderer *renderer)
+{
+	struct gl_render_state *state = renderer->data;
+	size_t i;
+
+	if (!state)
+		return;
+
+	for (i = 0; i < GL_STREAM_FRAMES; i++) {
+		if (state->fences[i])
+			glDeleteSync(state->fences[i]);
+	}
+	if (state->vbo) {
+		glBindBuffer(GL_ARRAY_BUFFER, state->vbo);
+		if (state->mapped)
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+		glDeleteBuffers(1, &state->vbo);
+	}
+	if (state->vao)
+		glDeleteVertexArrays(1, &state->vao);
+	if (state->white)
+		glDeleteTextures(1, &state->white);
+	if (state->program)
+		glDeleteProgram(state->program);
+	stbds_arrfree(state->draws);
+	free(state);
+	renderer->data = NULL;
+}
+
+const struct purpl_render_backend purpl_gl_render_backend = {
+	.name = "OpenGL",
+	.init = gl_init,
+	.begin = gl_begin,
+	.submit = gl_submit,
+	.shutdown = gl_shutdown,
+	.create_texture = gl_create_texture,
+	.destroy_texture = gl_destroy_texture,
+};
+#endif
+
+struct purpl_renderer *
+purpl_create_renderer(const struct purpl_render_backend *backend)
+{
+	struct purpl_renderer *renderer;
+	int ___errno;
+
+	PURPL_SAVE_ERRNO(___errno);
+
+	/* Check arguments */
+	if (!backend || !backend->submit) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	/* Allocate the renderer */
+	renderer = PURPL_CALLOC(1, struct purpl_renderer);
+	if (!renderer)
+		return NULL;
+	renderer->backend = backend;
+	renderer->id = (u32)SDL_AtomicAdd(&next_renderer_id, 1) + 1;
+
+	/* Start the backend */
+	if (backend->init && backend->init(renderer) != 0) {
+		free(renderer);
+		return NULL;
+	}
+
+	PURPL_RESTORE_ERRNO(___errno);
+
+	return renderer;
+}
+
+int purpl_inst_create_renderer(struct purpl_inst *inst,
+			       const struct purpl_render_backend *backend)
+{
+	int ___errno;
+
+	PURPL_SAVE_ERRNO(___errno);
+
+	/* Check arguments */
+	if (!inst) {
+		errno = EINVAL;
+		return errno;
+	}
+	if (inst->renderer) {
+		errno = EEXIST;
+		return errno;
+	}
+
+	inst->renderer = purpl_create_renderer(backend);
+	if (!inst->renderer)
+		return errno;
+
+	PURPL_RESTORE_ERRNO(___errno);
+
+	return 0;
+}
+
+u32 purpl_render_depth(float depth, bool back_to_front)
+{
+	u32 bits;
+
+	/*
+	 * Flip every bit of negatives and the sign bit of positives, so the
+	 *  bits compare the same way as the floats
+	 */
+	memcpy(&bits, &depth, sizeof(u32));
+	bits ^= (bits & 0x80000000) ? 0xFFFFFFFF : 0x80000000;
+
+	return back_to_front ? ~bits : bits;
+}
+
+u32 purpl_render_create_texture(struct purpl_renderer *renderer,
+				const u8 *pixels, u32 width, u32 height)
+{
+	/* Check arguments */
+	if (!renderer || !pixels || !width || !height) {
+		errno = EINVAL;
+		return 0;
+	}
+	if (!renderer->backend->create_texture) {
+		errno = EOPNOTSUPP;
+		return 0;
+	}
+
+	return renderer->backend->create_texture(renderer, pixels, width,
+						 height);
+}
+
+void purpl_render_destroy_texture(struct purpl_renderer *renderer,
+				  u32 texture)
+{
+	if (!renderer || !texture) {
+		errno = EINVAL;
+		return;
+	}
+
+	if (renderer->backend->destroy_texture)
+		renderer->backend->destroy_texture(renderer, texture);
+}
+
+void purpl_render_begin(struct purpl_renderer *renderer, int width,
+			int height)
+{
+	if (!renderer) {
+		errno = EINVAL;
+		return;
+	}
+
+	renderer->width = width;
+	renderer->height = height;
+	if (renderer->backend->begin)
+		renderer->backend->begin(renderer, width, height);
+}
+
+struct purpl_render_cmd *purpl_render_push(struct purpl_renderer *renderer,
+					   u64 key)
+{
+	struct purpl_cmd_buffer *buffer;
+	struct purpl_render_cmd *cmd;
+
+	if (!renderer) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	buffer = get_buffer(renderer);
+	if (!buffer)
+		return NULL;
+
+	cmd = stbds_arraddnptr(buffer->cmds, 1);
+	memset(cmd, 0, sizeof(struct purpl_render_cmd));
+	cmd->key = key;
+
+	return cmd;
+}
+
+int purpl_render_clear(struct purpl_renderer *renderer, u8 pass, u32 color)
+{
+	struct purpl_render_cmd *cmd;
+
+	cmd = purpl_render_push(renderer, PURPL_RENDER_KEY(pass, 0, 0));
+	if (!cmd)
+		return errno;
+
+	cmd->type = PURPL_RENDER_CLEAR;
+	cmd->color = color;
+
+	return 0;
+}
+
+int purpl_render_rect(struct purpl_renderer *renderer, u64 key, float x,
+		      float y, float w, float h, u32 color)
+{
+	struct purpl_render_cmd *cmd;
+
+	cmd = purpl_render_push(renderer, key);
+	if (!cmd)
+		return errno;
+
+	cmd->type = PURPL_RENDER_RECT;
+	cmd->color = color;
+	cmd->x = x;
+	cmd->y = y;
+	cmd->w = w;
+	cmd->h = h;
+
+	return 0;
+}
+
+void purpl_render_sort(struct purpl_render_item *items,
+		       struct purpl_render_item *tmp, size_t count)
+{
+	u32 counts[sizeof(u64)][256];
+	struct purpl_render_item *src;
+	struct purpl_render_item *dst;
+	struct purpl_render_item *swap;
+	u32 offset;
+	u32 next;
+	uint shift;
+	size_t pass;
+	size_t i;
+
+	if (!items || count < 2)
+		return;
+	if (count < SMALL_SORT || !tmp) {
+		insertion_sort(items, count);
+		return;
+	}
+
+	/* Count every byte of every key in one go */
+	memset(counts, 0, sizeof(counts));
+	for (i = 0; i < count; i++) {
+		for (pass = 0; pass < sizeof(u64); pass++)
+			counts[pass][(items[i].key >> (pass * 8)) & 0xFF]++;
+	}
+
+	src = items;
+	dst = tmp;
+	for (pass = 0; pass < sizeof(u64); pass++) {
+		shift = (uint)pass * 8;
+
+		/* Skip bytes that are the same in every key */
+		if (counts[pass][(items[0].key >> shift) & 0xFF] == count)
+			continue;
+
+		/* Turn the counts into where each byte's items start */
+		offset = 0;
+		for (i = 0; i < 256; i++) {
+			next = offset + counts[pass][i];
+			counts[pass][i] = offset;
+			offset = next;
+		}
+
+		/* Scatter, keeping items with the same byte in order */
+		for (i = 0; i < count; i++)
+			dst[counts[pass][(src[i].key >> shift) & 0xFF]++] =
+				src[i];
+		swap = src;
+		src = dst;
+		dst = swap;
+	}
+
+	/* The result has to end up in items */
+	if (src != items)
+		memcpy(items, src, count * sizeof(struct purpl_render_item));
+}
+
+size_t purpl_render_flush(struct purpl_renderer *renderer)
+{
+	struct purpl_cmd_buffer *buffer;
+	struct purpl_render_item *item;
+	size_t total;
+	size_t i;
+	size_t j;
+	u64 start;
+	u64 end;
+
+	if (!renderer) {
+		errno = EINVAL;
+		return 0;
+	}
+
+	/* Gather every thread's commands */
+	SDL_AtomicLock(&renderer->lock);
+	total = 0;
+	for (i = 0; i < stbds_arrlenu(renderer->buffers); i++)
+		total += stbds_arrlenu(renderer->buffers[i]->cmds);
+	stbds_arrsetlen(renderer->items, total);
+	stbds_arrsetlen(renderer->sorted, total);
+	item = renderer->items;
+	for (i = 0; i < stbds_arrlenu(renderer->buffers); i++) {
+		buffer = renderer->buffers[i];
+		for (j = 0; j < stbds_arrlenu(buffer->cmds); j++) {
+			item->key = buffer->cmds[j].key;
+			item->cmd = &buffer->cmds[j];
+			item++;
+		}
+	}
+	SDL_AtomicUnlock(&renderer->lock);
+
+	/* Put them in order */
+	start = purpl_get_time_ns();
+	purpl_render_sort(renderer->items, renderer->sorted, total);
+	end = purpl_get_time_ns();
+	renderer->stats.sort_time = end - start;
+
+	/* Draw them */
+	PURPL_PROFILE_BEGIN("Render submit");
+	renderer->backend->submit(renderer, renderer->items, total);
+	PURPL_PROFILE_END();
+	renderer->stats.submit_time = purpl_get_time_ns() - end;
+
+	/* Empty the buffers, keeping their memory for the next frame */
+	for (i = 0; i < stbds_arrlenu(renderer->buffers); i++)
+		stbds_arrsetlen(renderer->buffers[i]->cmds, 0);
+
+	renderer->stats.frames++;
+	renderer->stats.commands += total;
+	renderer->stats.last_commands = total;
+
+	return total;
+}
+
+void purpl_render_get_stats(struct purpl_renderer *renderer,
+			    struct purpl_render_stats *stats)
+{
+	if (!renderer || !stats) {
+		errno = EINVAL;
+		return;
+	}
+
+	SDL_AtomicLock(&renderer->lock);
+	renderer->stats.buffers = stbds_arrlenu(renderer->buffers);
+	SDL_AtomicUnlock(&renderer->lock);
+	memcpy(stats, &renderer->stats, sizeof(struct purpl_render_stats));
+}
+
+void purpl_free_renderer(struct purpl_renderer *renderer)
+{
+	size_t i;
+
+	if (!renderer) {
+		errno = EINVAL;
+		return;
+	}
+
+	if (renderer->backend->shutdown)
+		renderer->backend->shutdown(renderer);
+
+	/* Other threads' caches can't match, since IDs aren't reused */
+	for (i = 0; i < stbds_arrlenu(renderer->buffers); i++) {
+		stbds_arrfree(renderer->buffers[i]->cmds);
+		free(renderer->buffers[i]);
+	}
+	stbds_arrfree(renderer->buffers);
+	stbds_arrfree(renderer->items);
+	stbds_arrfree(renderer->sorted);
+	free(renderer);
+}
+
+#ifdef __cplusplus
+}
+#endif
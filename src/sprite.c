@@ -0,0 +1,272 @@
+#include "purpl/sprite.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Check that an atlas's header and sprites are in bounds */
+static bool check_atlas(const char *data, size_t size)
+{
+	const struct purpl_atlas_header *hdr;
+	const struct purpl_atlas_sprite *sprites;
+	u64 stride;
+	u32 i;
+
+	hdr = (const struct purpl_atlas_header *)data;
+	if (size < sizeof(struct purpl_atlas_header) ||
+	    memcmp(hdr->magic, PURPL_ATLAS_MAGIC, 4) != 0 ||
+	    hdr->version != PURPL_ATLAS_VERSION || hdr->size > size ||
+	    !hdr->page_width || !hdr->page_height ||
+	    hdr->page_width > PURPL_ATLAS_MAX_PAGE_SIZE ||
+	    hdr->page_height > PURPL_ATLAS_MAX_PAGE_SIZE)
+		return false;
+
+	/* Check the offsets in a way that can't overflow */
+	if (hdr->sprites_offset > size ||
+	    hdr->sprites_offset % _Alignof(struct purpl_atlas_sprite) ||
+	    (u64)hdr->sprite_count * sizeof(struct purpl_atlas_sprite) >
+		    size - hdr->sprites_offset ||
+	    hdr->names_offset > size ||
+	    hdr->names_size > size - hdr->names_offset)
+		return false;
+
+	/* The page size is capped, so this can't overflow either */
+	stride = PURPL_ATLAS_PAGE_STRIDE(hdr->page_width, hdr->page_height);
+	if (hdr->pages_offset > size || hdr->pages_offset % PURPL_ATLAS_ALIGN ||
+	    hdr->page_count * stride > size - hdr->pages_offset)
+		return false;
+
+	sprites = (const struct purpl_atlas_sprite *)(data +
+						      hdr->sprites_offset);
+	for (i = 0; i < hdr->sprite_count; i++) {
+		if (sprites[i].page >= hdr->page_count ||
+		    (u64)sprites[i].name_offset + sprites[i].name_len >=
+			    hdr->names_size ||
+		    data[hdr->names_offset + sprites[i].name_offset +
+			 sprites[i].name_len] != 0)
+			return false;
+	}
+
+	return true;
+}
+
+struct purpl_atlas *purpl_load_atlas(struct purpl_renderer *renderer,
+				     const char *data, size_t size)
+{
+	struct purpl_atlas *atlas;
+	const char *page;
+	u64 stride;
+	u32 i;
+	int ___errno;
+
+	PURPL_SAVE_ERRNO(___errno);
+
+	/* Check arguments */
+	if (!renderer || !data) {
+		errno = EINVAL;
+		return NULL;
+	}
+	if (!check_atlas(data, size)) {
+		errno = EILSEQ;
+		return NULL;
+	}
+
+	/* Allocate the structure */
+	atlas = PURPL_CALLOC(1, struct purpl_atlas);
+	if (!atlas)
+		return NULL;
+
+	/* Fill it in */
+	atlas->hdr = (const struct purpl_atlas_header *)data;
+	atlas->sprites = (const struct purpl_atlas_sprite *)(
+		data + atlas->hdr->sprites_offset);
+	atlas->names = data + atlas->hdr->names_offset;
+	atlas->renderer = renderer;
+
+	/* Upload the pages */
+	atlas->textures =
+		PURPL_CALLOC(PURPL_MAX(atlas->hdr->page_count, 1), u32);
+	if (!atlas->textures) {
+		free(atlas);
+		return NULL;
+	}
+	stride = PURPL_ATLAS_PAGE_STRIDE(atlas->hdr->page_width,
+					 atlas->hdr->page_height);
+	for (i = 0; i < atlas->hdr->page_count; i++) {
+		page = data + atlas->hdr->pages_offset + i * stride;
+		atlas->textures[i] = purpl_render_create_texture(
+			renderer, (const u8 *)page, atlas->hdr->page_width,
+			atlas->hdr->page_height);
+		if (!atlas->textures[i]) {
+			purpl_free_atlas(atlas);
+			return NULL;
+		}
+	}
+
+	PURPL_RESTORE_ERRNO(___errno);
+
+	return atlas;
+}
+
+const struct purpl_atlas_sprite *
+purpl_find_sprite(const struct purpl_atlas *atlas, const char *name)
+{
+	size_t lo;
+	size_t hi;
+	size_t mid;
+	int cmp;
+
+	/* Check arguments */
+	if (!atlas || !name) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	/* The sprites are sorted by name */
+	lo = 0;
+	hi = atlas->hdr->sprite_count;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		cmp = strcmp(atlas->names + atlas->sprites[mid].name_offset,
+			     name);
+		if (cmp == 0)
+			return &atlas->sprites[mid];
+		else if (cmp < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return NULL;
+}
+
+int purpl_render_sprite(struct purpl_renderer *renderer, u8 pass, u32 depth,
+			const struct purpl_atlas *atlas,
+			const struct purpl_atlas_sprite *sprite, float x,
+			float y, float scale, u32 color)
+{
+	struct purpl_render_cmd *cmd;
+	u32 texture;
+
+	/* Check arguments */
+	if (!atlas || !sprite || sprite->page >= atlas->hdr->page_count) {
+		errno = EINVAL;
+		return errno;
+	}
+
+	/* The page is the material, so sprites on it get drawn together */
+	texture = atlas->textures[sprite->page];
+	cmd = purpl_render_push(renderer,
+				PURPL_RENDER_KEY(pass, texture, depth));
+	if (!cmd)
+		return errno;
+
+	cmd->type = PURPL_RENDER_SPRITE;
+	cmd->color = color;
+	cmd->x = x;
+	cmd->y = y;
+	cmd->w = sprite->w * scale;
+	cmd->h = sprite->h * scale;
+	cmd->texture = texture;
+	cmd->u0 = sprite->u0;
+	cmd->v0 = sprite->v0;
+	cmd->u1 = sprite->u1;
+	cmd->v1 = sprite->v1;
+
+	return 0;
+}
+
+size_t purpl_batch_sprites(const struct purpl_render_item *items,
+			   size_t count,
+			   struct purpl_sprite_instance *instances,
+			   struct purpl_sprite_draw **draws)
+{
+	const struct purpl_render_cmd *cmd;
+	struct purpl_sprite_draw *draw;
+	size_t total;
+	size_t i;
+	u32 texture;
+
+	/* Check arguments */
+	if (!draws || (count && (!items || !instances))) {
+		errno = EINVAL;
+		return 0;
+	}
+
+	stbds_arrsetlen(*draws, 0);
+	draw = NULL;
+	total = 0;
+	for (i = 0; i < count; i++) {
+		cmd = items[i].cmd;
+		switch (cmd->type) {
+		case PURPL_RENDER_CLEAR:
+			/* Nothing can be merged across a clear */
+			draw = stbds_arraddnptr(*draws, 1);
+			draw->type = PURPL_RENDER_CLEAR;
+			draw->texture = 0;
+			draw->color = cmd->color;
+			draw->first = (u32)total;
+			draw->count = 0;
+			draw = NULL;
+			break;
+		case PURPL_RENDER_RECT:
+		case PURPL_RENDER_SPRITE:
+			/* Start a new draw when the texture changes */
+			texture = 0;
+			if (cmd->type == PURPL_RENDER_SPRITE)
+				texture = cmd->texture;
+			if (!draw || draw->texture != texture) {
+				draw = stbds_arraddnptr(*draws, 1);
+				draw->type = PURPL_RENDER_SPRITE;
+				draw->texture = texture;
+				draw->color = 0;
+				draw->first = (u32)total;
+				draw->count = 0;
+			}
+
+			/*
+			 * Write the whole instance at once, since this could
+			 *  be write-combined memory
+			 */
+			instances[total++] = (struct purpl_sprite_instance){
+				.x = cmd->x,
+				.y = cmd->y,
+				.w = cmd->w,
+				.h = cmd->h,
+				.u0 = texture ? cmd->u0 : 0.0f,
+				.v0 = texture ? cmd->v0 : 0.0f,
+				.u1 = texture ? cmd->u1 : 1.0f,
+				.v1 = texture ? cmd->v1 : 1.0f,
+				.color = cmd->color,
+			};
+			draw->count++;
+			break;
+		}
+	}
+
+	return total;
+}
+
+void purpl_free_atlas(struct purpl_atlas *atlas)
+{
+	u32 i;
+
+	if (!atlas) {
+		errno = EINVAL;
+		return;
+	}
+
+	if (atlas->textures) {
+		for (i = 0; i < atlas->hdr->page_count; i++) {
+			if (atlas->textures[i])
+				purpl_render_destroy_texture(
+					atlas->renderer, atlas->textures[i]);
+		}
+		free(atlas->textures);
+	}
+	free(atlas);
+}
+
+#ifdef __cplusplus
+}
+#endif
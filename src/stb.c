@@ -1,5 +1,9 @@
 #define STB_DS_IMPLEMENTATION 
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_IMPLEMENTATION
 #define STB_SPRINTF_IMPLEMENTATION
 
 #include <stb_ds.h>
+#include <stb_image.h>
+#include <stb_image_write.h>
 #include <stb_sprintf.h>
@@ -0,0 +1,451 @@
+#include "purpl/stream.h"
+#include "purpl/profile.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Whether request a should come out of the queue before request b */
+static bool comes_before(struct purpl_stream_request *a,
+			 struct purpl_stream_request *b)
+{
+	if (a->priority != b->priority)
+		return a->priority > b->priority;
+
+	return a->seq < b->seq;
+}
+
+/* Add a request to the queue */
+static void queue_push(struct purpl_stream *stream,
+		       struct purpl_stream_request *req)
+{
+	struct purpl_stream_request *tmp;
+	size_t i;
+	size_t parent;
+
+	/* Put it at the end and sift it up */
+	stbds_arrput(stream->queue, req);
+	i = stbds_arrlenu(stream->queue) - 1;
+	while (i > 0) {
+		parent = (i - 1) / 2;
+		if (!comes_before(stream->queue[i], stream->queue[parent]))
+			break;
+
+		tmp = stream->queue[i];
+		stream->queue[i] = stream->queue[parent];
+		stream->queue[parent] = tmp;
+		i = parent;
+	}
+}
+
+/* Remove the request at index i of the queue */
+static struct purpl_stream_request *queue_remove(struct purpl_stream *stream,
+						 size_t i)
+{
+	struct purpl_stream_request *req;
+	struct purpl_stream_request *tmp;
+	size_t len;
+	size_t best;
+	size_t child;
+
+	/* Move the last request into the hole */
+	req = stream->queue[i];
+	stream->queue[i] = stbds_arrlast(stream->queue);
+	stbds_arrpop(stream->queue);
+	len = stbds_arrlenu(stream->queue);
+	if (i >= len)
+		return req;
+
+	/* Sift it up in case it beats its new parent */
+	while (i > 0 && comes_before(stream->queue[i],
+				     stream->queue[(i - 1) / 2])) {
+		tmp = stream->queue[i];
+		stream->queue[i] = stream->queue[(i - 1) / 2];
+		stream->queue[(i - 1) / 2] = tmp;
+		i = (i - 1) / 2;
+	}
+
+	/* Then sift it down */
+	while (1) {
+		best = i;
+		child = i * 2 + 1;
+		if (child < len &&
+		    comes_before(stream->queue[child], stream->queue[best]))
+			best = child;
+		if (child + 1 < len &&
+		    comes_before(stream->queue[child + 1], stream->queue[best]))
+			best = child + 1;
+		if (best == i)
+			break;
+
+		tmp = stream->queue[i];
+		stream->queue[i] = stream->queue[best];
+		stream->queue[best] = tmp;
+		i = best;
+	}
+
+	return req;
+}
+
+/* Free a request and everything it owns */
+static void free_request(struct purpl_stream_request *req)
+{
+	free(req->path);
+	if (req->asset)
+		purpl_free_asset(req->asset);
+	free(req);
+}
+
+/* Pull requests off the queue and load them */
+static int stream_worker(void *data)
+{
+	struct purpl_stream *stream = data;
+	struct purpl_stream_request *req;
+	struct stat st;
+	size_t size;
+	bool skip;
+
+	purpl_profile_name_thread("purpl_stream");
+	SDL_LockMutex(stream->lock);
+	while (1) {
+		/* Wait for something to do */
+		while (!stream->quit && !stbds_arrlenu(stream->queue))
+			SDL_CondWait(stream->wake, stream->lock);
+		if (stream->quit)
+			break;
+
+		/* Take the most important request */
+		req = queue_remove(stream, 0);
+		req->status = PURPL_STREAM_LOADING;
+		SDL_UnlockMutex(stream->lock);
+
+		/* Find out how big the file is */
+		size = 0;
+		if (stat(req->path, &st) == 0)
+			size = st.st_size;
+
+		/* Wait until loading it won't go over the limit */
+		SDL_LockMutex(stream->lock);
+		while (!stream->quit && !req->cancelled && stream->inflight &&
+		       stream->inflight + size > stream->max_inflight)
+			SDL_CondWait(stream->space, stream->lock);
+		stream->inflight += size;
+		req->size = size;
+		skip = req->cancelled || stream->quit;
+		SDL_UnlockMutex(stream->lock);
+
+		/* Load it */
+		if (!skip) {
+			req->asset = purpl_load_asset(req->map, "%s",
+						      req->path);
+			req->err = req->asset ? 0 : errno;
+		}
+
+		/* Hand it back to the main thread */
+		SDL_LockMutex(stream->lock);
+		stbds_arrput(stream->done, req);
+	}
+	SDL_UnlockMutex(stream->lock);
+
+	/* Give back what this thread was holding on to */
+	purpl_flush_pool_cache();
+	purpl_free_scratch_arena();
+	purpl_profile_release_thread();
+
+	return 0;
+}
+
+int purpl_inst_start_streaming(struct purpl_inst *inst, uint workers,
+			       size_t max_inflight)
+{
+	struct purpl_stream *stream;
+	SDL_Thread *thread;
+	uint i;
+	int ___errno;
+
+	PURPL_SAVE_ERRNO(___errno);
+
+	/* Check arguments */
+	if (!inst || !inst->info) {
+		errno = EINVAL;
+		return errno;
+	}
+	if (inst->stream) {
+		errno = EEXIST;
+		return errno;
+	}
+
+	/* Fill in defaults */
+	if (!workers)
+		workers = PURPL_MAX(SDL_GetCPUCount() - 1, 1);
+	if (!max_inflight)
+		max_inflight = PURPL_STREAM_DEFAULT_INFLIGHT;
+
+	/* Allocate the structure */
+	stream = PURPL_CALLOC(1, struct purpl_stream);
+	if (!stream)
+		return errno;
+	stream->max_inflight = max_inflight;
+	stream->next_handle = 1;
+
+	/* Create the synchronization objects */
+	stream->lock = SDL_CreateMutex();
+	stream->wake = SDL_CreateCond();
+	stream->space = SDL_CreateCond();
+	if (!stream->lock || !stream->wake || !stream->space) {
+		SDL_DestroyMutex(stream->lock);
+		SDL_DestroyCond(stream->wake);
+		SDL_DestroyCond(stream->space);
+		free(stream);
+		errno = ENOMEM;
+		return errno;
+	}
+
+	/* Start the workers */
+	inst->stream = stream;
+	for (i = 0; i < workers; i++) {
+		thread = SDL_CreateThread(stream_worker, "purpl_stream", stream);
+		if (!thread) {
+			purpl_inst_stop_streaming(inst);
+			errno = EAGAIN;
+			return errno;
+		}
+		stbds_arrput(stream->workers, thread);
+	}
+
+	PURPL_RESTORE_ERRNO(___errno);
+
+	return 0;
+}
+
+u32 purpl_inst_load_asset_async(struct purpl_inst *inst, bool map,
+				s32 priority, purpl_stream_callback callback,
+				void *user, const char *name, ...)
+{
+	struct purpl_stream *stream;
+	struct purpl_stream_request *req;
+	va_list args;
+	char *name_fmt;
+	s64 name_len;
+	u32 handle;
+	int ___errno;
+
+	PURPL_SAVE_ERRNO(___errno);
+
+	/* Check arguments */
+	if (!inst || !inst->stream || !name) {
+		errno = EINVAL;
+		return 0;
+	}
+	stream = inst->stream;
+
+	/* Allocate the request */
+	req = PURPL_CALLOC(1, struct purpl_stream_request);
+	if (!req)
+		return 0;
+
+	/* Find the file now, since the search path cache isn't thread-safe */
+	va_start(args, name);
+	name_fmt = purpl_fmt_text_va(&name_len, name, args);
+	va_end(args);
+	req->path = purpl_resolve_asset(inst->info->paths, "%s", name_fmt);
+	(name_len > 0) ? free(name_fmt) : (void)0;
+	if (!req->path) {
+		free(req);
+		return 0;
+	}
+
+	/* Fill in the rest */
+	req->map = map;
+	req->priority = priority;
+	req->callback = callback;
+	req->user = user;
+	req->status = PURPL_STREAM_QUEUED;
+
+	/* Queue it up and wake a worker */
+	SDL_LockMutex(stream->lock);
+	handle = stream->next_handle++;
+	if (!stream->next_handle)
+		stream->next_handle = 1; /* 0 means failure */
+	req->handle = handle;
+	req->seq = stream->seq++;
+	stbds_hmput(stream->requests, handle, req);
+	queue_push(stream, req);
+	SDL_CondSignal(stream->wake);
+	SDL_UnlockMutex(stream->lock);
+
+	PURPL_RESTORE_ERRNO(___errno);
+
+	return handle;
+}
+
+enum purpl_stream_status purpl_inst_poll_asset(struct purpl_inst *inst,
+					       u32 handle,
+					       const char **name_ret)
+{
+	struct purpl_stream_request *req;
+	enum purpl_stream_status status;
+
+	/* Check arguments */
+	if (!inst || !inst->stream) {
+		errno = EINVAL;
+		return PURPL_STREAM_INVALID;
+	}
+
+	/* Look up the request */
+	SDL_LockMutex(inst->stream->lock);
+	req = stbds_hmget(inst->stream->requests, handle);
+	if (!req) {
+		SDL_UnlockMutex(inst->stream->lock);
+		return PURPL_STREAM_INVALID;
+	}
+	status = req->status;
+
+	/* If it's finished, this is the last anyone hears of it */
+	if (status == PURPL_STREAM_DONE || status == PURPL_STREAM_FAILED) {
+		if (name_ret)
+			*name_ret = req->key;
+		stbds_hmdel(inst->stream->requests, handle);
+		free_request(req);
+	}
+	SDL_UnlockMutex(inst->stream->lock);
+
+	return status;
+}
+
+bool purpl_inst_cancel_asset(struct purpl_inst *inst, u32 handle)
+{
+	struct purpl_stream_request *req;
+	size_t i;
+	bool cancelled;
+
+	/* Check arguments */
+	if (!inst || !inst->stream) {
+		errno = EINVAL;
+		return false;
+	}
+
+	SDL_LockMutex(inst->stream->lock);
+	req = stbds_hmget(inst->stream->requests, handle);
+	cancelled = req && (req->status == PURPL_STREAM_QUEUED ||
+			    req->status == PURPL_STREAM_LOADING);
+	if (cancelled) {
+		stbds_hmdel(inst->stream->requests, handle);
+		if (req->status == PURPL_STREAM_QUEUED) {
+			/* Nobody has it yet, so it can go right now */
+			for (i = 0; i < stbds_arrlenu(inst->stream->queue); i++) {
+				if (inst->stream->queue[i] == req) {
+					queue_remove(inst->stream, i);
+					break;
+				}
+			}
+			free_request(req);
+		} else {
+			/* A worker has it, so dispatch will free it */
+			req->cancelled = true;
+			SDL_CondBroadcast(inst->stream->space);
+		}
+	}
+	SDL_UnlockMutex(inst->stream->lock);
+
+	return cancelled;
+}
+
+void purpl_inst_dispatch_assets(struct purpl_inst *inst)
+{
+	struct purpl_stream_request **done;
+	struct purpl_stream_request *req;
+	size_t i;
+
+	/* Check arguments */
+	if (!inst || !inst->stream)
+		return;
+
+	/* Take everything that's finished, and free up its in-flight bytes */
+	SDL_LockMutex(inst->stream->lock);
+	done = inst->stream->done;
+	inst->stream->done = NULL;
+	for (i = 0; i < stbds_arrlenu(done); i++)
+		inst->stream->inflight -= done[i]->size;
+	if (stbds_arrlenu(done))
+		SDL_CondBroadcast(inst->stream->space);
+	SDL_UnlockMutex(inst->stream->lock);
+
+	for (i = 0; i < stbds_arrlenu(done); i++) {
+		req = done[i];
+
+		/* Cancelled requests were already forgotten */
+		if (req->cancelled) {
+			free_request(req);
+			continue;
+		}
+
+		/* Add the asset to the list */
+		if (req->asset) {
+			req->key = purpl_inst_add_asset(inst, req->asset);
+			req->asset = NULL;
+			if (!req->key)
+				req->err = errno;
+		}
+
+		/* Either tell the callback or wait to be polled */
+		SDL_LockMutex(inst->stream->lock);
+		req->status = req->key ? PURPL_STREAM_DONE :
+					 PURPL_STREAM_FAILED;
+		if (req->callback)
+			stbds_hmdel(inst->stream->requests, req->handle);
+		SDL_UnlockMutex(inst->stream->lock);
+		if (req->callback) {
+			req->callback(inst, req->handle, req->key, req->err,
+				      req->user);
+			free_request(req);
+		}
+	}
+
+	stbds_arrfree(done);
+}
+
+void purpl_inst_stop_streaming(struct purpl_inst *inst)
+{
+	struct purpl_stream *stream;
+	size_t i;
+
+	/* Check arguments */
+	if (!inst || !inst->stream) {
+		errno = EINVAL;
+		return;
+	}
+	stream = inst->stream;
+
+	/* Tell the workers to stop and wait for them */
+	SDL_LockMutex(stream->lock);
+	stream->quit = true;
+	SDL_CondBroadcast(stream->wake);
+	SDL_CondBroadcast(stream->space);
+	SDL_UnlockMutex(stream->lock);
+	for (i = 0; i < stbds_arrlenu(stream->workers); i++)
+		SDL_WaitThread(stream->workers[i], NULL);
+
+	/* Free every request that's left */
+	for (i = 0; i < stbds_arrlenu(stream->done); i++) {
+		if (stream->done[i]->cancelled)
+			free_request(stream->done[i]);
+	}
+	for (i = 0; i < stbds_hmlenu(stream->requests); i++)
+		free_request(stream->requests[i].value);
+
+	/* Free everything else */
+	stbds_arrfree(stream->workers);
+	stbds_arrfree(stream->queue);
+	stbds_arrfree(stream->done);
+	stbds_hmfree(stream->requests);
+	SDL_DestroyMutex(stream->lock);
+	SDL_DestroyCond(stream->wake);
+	SDL_DestroyCond(stream->space);
+	free(stream);
+	inst->stream = NULL;
+}
+
+#ifdef __cplusplus
+}
+#endif
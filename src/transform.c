@@ -0,0 +1,435 @@
+#include "purpl/transform.h"
+
+#include <SDL.h>
+
+#if defined __x86_64__ || defined _M_X64
+#define HAVE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The alignment of the arrays, so whole blocks can be loaded at once */
+#define ARRAY_ALIGN (PURPL_TRANSFORM_LANES * sizeof(float))
+
+/*
+ * The space between arrays. Without it, every array starts at the same offset
+ *  in a page when the capacity is a power of two, so they all land in the
+ *  same cache sets and evict each other.
+ */
+#define ARRAY_PAD 64
+
+/* The top three rows of an identity matrix, for transforms with no parent */
+static const float identity[12] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0 };
+
+/* Make the local matrix of a transform */
+static void local_matrix(const struct purpl_transforms *transforms, size_t i,
+			 float *local)
+{
+	float x;
+	float y;
+	float z;
+	float w;
+
+	x = transforms->qx[i];
+	y = transforms->qy[i];
+	z = transforms->qz[i];
+	w = transforms->qw[i];
+
+	/* Rotate, then scale each column, then translate */
+	local[0] = (1 - 2 * (y * y + z * z)) * transforms->sx[i];
+	local[1] = 2 * (x * y - w * z) * transforms->sy[i];
+	local[2] = 2 * (x * z + w * y) * transforms->sz[i];
+	local[3] = transforms->px[i];
+	local[4] = 2 * (x * y + w * z) * transforms->sx[i];
+	local[5] = (1 - 2 * (x * x + z * z)) * transforms->sy[i];
+	local[6] = 2 * (y * z - w * x) * transforms->sz[i];
+	local[7] = transforms->py[i];
+	local[8] = 2 * (x * z - w * y) * transforms->sx[i];
+	local[9] = 2 * (y * z + w * x) * transforms->sy[i];
+	local[10] = (1 - 2 * (x * x + y * y)) * transforms->sz[i];
+	local[11] = transforms->pz[i];
+}
+
+/* Compose the world matrix of one transform */
+static void update_one(struct purpl_transforms *transforms, size_t i)
+{
+	float local[12];
+	float parent[12];
+	float value;
+	u32 r;
+	u32 c;
+
+	local_matrix(transforms, i, local);
+	if (transforms->parent[i] == PURPL_NO_PARENT) {
+		for (c = 0; c < 12; c++)
+			transforms->world[c][i] = local[c];
+		return;
+	}
+
+	for (c = 0; c < 12; c++)
+		parent[c] = transforms->world[c][transforms->parent[i]];
+	for (r = 0; r < 3; r++) {
+		for (c = 0; c < 4; c++) {
+			value = parent[r * 4] * local[c] +
+				parent[r * 4 + 1] * local[4 + c] +
+				parent[r * 4 + 2] * local[8 + c];
+			if (c == 3)
+				value += parent[r * 4 + 3];
+			transforms->world[r * 4 + c][i] = value;
+		}
+	}
+}
+
+/* Check whether one transform is inside a frustum */
+static bool cull_one(const struct purpl_transforms *transforms,
+		     vec4 planes[6], size_t i)
+{
+	float world[12];
+	float center[3];
+	float extent[3];
+	float dist;
+	u32 r;
+
+	/* Move the box into world space */
+	for (r = 0; r < 12; r++)
+		world[r] = transforms->world[r][i];
+	for (r = 0; r < 3; r++) {
+		center[r] = world[r * 4] * transforms->cx[i] +
+			    world[r * 4 + 1] * transforms->cy[i] +
+			    world[r * 4 + 2] * transforms->cz[i] +
+			    world[r * 4 + 3];
+		extent[r] = fabsf(world[r * 4]) * transforms->ex[i] +
+			    fabsf(world[r * 4 + 1]) * transforms->ey[i] +
+			    fabsf(world[r * 4 + 2]) * transforms->ez[i];
+	}
+
+	/* It's outside if it's entirely behind any plane */
+	for (r = 0; r < 6; r++) {
+		dist = planes[r][0] * center[0] + planes[r][1] * center[1] +
+		       planes[r][2] * center[2] + planes[r][3] +
+		       fabsf(planes[r][0]) * extent[0] +
+		       fabsf(planes[r][1]) * extent[1] +
+		       fabsf(planes[r][2]) * extent[2];
+		if (dist < 0)
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * The vector kernels are written once in transform_kernels.h, which gets
+ *  included here for each instruction set
+ */
+#ifdef HAVE_X86_SIMD
+/* SSE2 has no gather, so do it by hand */
+static __m128 gather_sse(const float *base, __m128i indices)
+{
+	u32 i[4];
+
+	_mm_storeu_si128((__m128i *)i, indices);
+	return _mm_set_ps(base[i[3]], base[i[2]], base[i[1]], base[i[0]]);
+}
+
+#define LANES 4
+#define KERNEL(name) name##_sse
+#define TARGET
+#define VEC __m128
+#define VECI __m128i
+#define LOAD(p) _mm_load_ps(p)
+#define LOADI(p) _mm_load_si128((const __m128i *)(p))
+#define STORE(p, v) _mm_store_ps(p, v)
+#define SET1(x) _mm_set1_ps(x)
+#define SET1I(x) _mm_set1_epi32(x)
+#define ADD(a, b) _mm_add_ps(a, b)
+#define SUB(a, b) _mm_sub_ps(a, b)
+#define MUL(a, b) _mm_mul_ps(a, b)
+#define ABS(v) _mm_andnot_ps(_mm_set1_ps(-0.0f), v)
+#define CMPGE(a, b) _mm_cmpge_ps(a, b)
+#define MOVEMASK(v) (u32) _mm_movemask_ps(v)
+#define CMPEQI(a, b) _mm_cmpeq_epi32(a, b)
+#define CMPGTI(a, b) _mm_cmpgt_epi32(a, b)
+#define ANDNOTI(a, b) _mm_andnot_si128(a, b)
+#define MOVEMASKI(v) (u32) _mm_movemask_ps(_mm_castsi128_ps(v))
+#define GATHER(base, indices) gather_sse(base, indices)
+#define BLEND(a, b, mask)                                        \
+	_mm_or_ps(_mm_and_ps(_mm_castsi128_ps(mask), b),         \
+		  _mm_andnot_ps(_mm_castsi128_ps(mask), a))
+#include "transform_kernels.h"
+
+#define LANES 8
+#define KERNEL(name) name##_avx2
+#ifdef _MSC_VER
+#define TARGET
+#else
+#define TARGET __attribute__((target("avx2")))
+#endif
+#define VEC __m256
+#define VECI __m256i
+#define LOAD(p) _mm256_load_ps(p)
+#define LOADI(p) _mm256_load_si256((const __m256i *)(p))
+#define STORE(p, v) _mm256_store_ps(p, v)
+#define SET1(x) _mm256_set1_ps(x)
+#define SET1I(x) _mm256_set1_epi32(x)
+#define ADD(a, b) _mm256_add_ps(a, b)
+#define SUB(a, b) _mm256_sub_ps(a, b)
+#define MUL(a, b) _mm256_mul_ps(a, b)
+#define ABS(v) _mm256_andnot_ps(_mm256_set1_ps(-0.0f), v)
+#define CMPGE(a, b) _mm256_cmp_ps(a, b, _CMP_GE_OQ)
+#define MOVEMASK(v) (u32) _mm256_movemask_ps(v)
+#define CMPEQI(a, b) _mm256_cmpeq_epi32(a, b)
+#define CMPGTI(a, b) _mm256_cmpgt_epi32(a, b)
+#define ANDNOTI(a, b) _mm256_andnot_si256(a, b)
+#define MOVEMASKI(v) (u32) _mm256_movemask_ps(_mm256_castsi256_ps(v))
+#define GATHER(base, indices) _mm256_i32gather_ps(base, indices, 4)
+#define BLEND(a, b, mask) _mm256_blendv_ps(a, b, _mm256_castsi256_ps(mask))
+#include "transform_kernels.h"
+#endif
+
+/* Move the arrays into a bigger allocation */
+static bool grow(struct purpl_transforms *transforms, size_t capacity)
+{
+	char *data;
+	char *base;
+	size_t stride;
+	size_t i;
+
+	/* Whole blocks always fit */
+	capacity = (PURPL_MAX(capacity, 1) + PURPL_TRANSFORM_LANES - 1) &
+		   ~(size_t)(PURPL_TRANSFORM_LANES - 1);
+	stride = capacity * sizeof(float) + ARRAY_PAD;
+	data = purpl_calloc(PURPL_TRANSFORM_ARRAYS * stride + ARRAY_ALIGN - 1,
+			    1);
+	if (!data)
+		return false;
+	base = (char *)(((uintptr_t)data + ARRAY_ALIGN - 1) &
+			~(uintptr_t)(ARRAY_ALIGN - 1));
+
+	for (i = 0; i < PURPL_TRANSFORM_ARRAYS; i++) {
+		if (transforms->count)
+			memcpy(base + i * stride, transforms->arrays[i],
+			       transforms->count * sizeof(float));
+		transforms->arrays[i] = base + i * stride;
+	}
+
+	free(transforms->data);
+	transforms->data = data;
+	transforms->capacity = capacity;
+
+	return true;
+}
+
+struct purpl_transforms *purpl_create_transforms(size_t capacity)
+{
+	struct purpl_transforms *transforms;
+	int ___errno;
+
+	PURPL_SAVE_ERRNO(___errno);
+
+	/* Allocate the structure */
+	transforms = PURPL_CALLOC(1, struct purpl_transforms);
+	if (!transforms)
+		return NULL;
+
+	/* Use the widest kernels the CPU has */
+#ifdef HAVE_X86_SIMD
+	transforms->simd = SDL_HasAVX2() ? PURPL_SIMD_AVX2 : PURPL_SIMD_SSE;
+#else
+	transforms->simd = PURPL_SIMD_NONE;
+#endif
+
+	if (!grow(transforms, capacity)) {
+		free(transforms);
+		return NULL;
+	}
+
+	PURPL_RESTORE_ERRNO(___errno);
+
+	return transforms;
+}
+
+u32 purpl_add_transform(struct purpl_transforms *transforms, u32 parent)
+{
+	size_t i;
+	u32 c;
+	int ___errno;
+
+	PURPL_SAVE_ERRNO(___errno);
+
+	/* Check arguments */
+	if (!transforms ||
+	    (parent != PURPL_NO_PARENT && parent >= transforms->count)) {
+		errno = EINVAL;
+		return PURPL_NO_PARENT;
+	}
+
+	/* The kernels compare indices as signed integers */
+	if (transforms->count >= INT32_MAX) {
+		errno = ERANGE;
+		return PURPL_NO_PARENT;
+	}
+
+	/* Make room */
+	if (transforms->count == transforms->capacity &&
+	    !grow(transforms, transforms->capacity * 2))
+		return PURPL_NO_PARENT;
+
+	/* Start with nothing */
+	i = transforms->count++;
+	transforms->px[i] = 0;
+	transforms->py[i] = 0;
+	transforms->pz[i] = 0;
+	transforms->qx[i] = 0;
+	transforms->qy[i] = 0;
+	transforms->qz[i] = 0;
+	transforms->qw[i] = 1;
+	transforms->sx[i] = 1;
+	transforms->sy[i] = 1;
+	transforms->sz[i] = 1;
+	transforms->parent[i] = parent;
+	for (c = 0; c < 12; c++)
+		transforms->world[c][i] = identity[c];
+	transforms->cx[i] = 0;
+	transforms->cy[i] = 0;
+	transforms->cz[i] = 0;
+	transforms->ex[i] = 0;
+	transforms->ey[i] = 0;
+	transforms->ez[i] = 0;
+
+	PURPL_RESTORE_ERRNO(___errno);
+
+	return (u32)i;
+}
+
+void purpl_set_transform(struct purpl_transforms *transforms, u32 index,
+			 vec3 position, versor rotation, vec3 scale)
+{
+	if (!transforms || index >= transforms->count || !position ||
+	    !rotation || !scale) {
+		errno = EINVAL;
+		return;
+	}
+
+	transforms->px[index] = position[0];
+	transforms->py[index] = position[1];
+	transforms->pz[index] = position[2];
+	transforms->qx[index] = rotation[0];
+	transforms->qy[index] = rotation[1];
+	transforms->qz[index] = rotation[2];
+	transforms->qw[index] = rotation[3];
+	transforms->sx[index] = scale[0];
+	transforms->sy[index] = scale[1];
+	transforms->sz[index] = scale[2];
+}
+
+void purpl_set_bounds(struct purpl_transforms *transforms, u32 index,
+		      vec3 box[2])
+{
+	if (!transforms || index >= transforms->count || !box) {
+		errno = EINVAL;
+		return;
+	}
+
+	/* The kernels want the center and half extents */
+	transforms->cx[index] = (box[0][0] + box[1][0]) * 0.5f;
+	transforms->cy[index] = (box[0][1] + box[1][1]) * 0.5f;
+	transforms->cz[index] = (box[0][2] + box[1][2]) * 0.5f;
+	transforms->ex[index] = fabsf(box[1][0] - box[0][0]) * 0.5f;
+	transforms->ey[index] = fabsf(box[1][1] - box[0][1]) * 0.5f;
+	transforms->ez[index] = fabsf(box[1][2] - box[0][2]) * 0.5f;
+}
+
+void purpl_update_transforms(struct purpl_transforms *transforms)
+{
+	size_t i;
+
+	if (!transforms) {
+		errno = EINVAL;
+		return;
+	}
+
+	switch (transforms->simd) {
+#ifdef HAVE_X86_SIMD
+	case PURPL_SIMD_AVX2:
+		update_avx2(transforms, 0, transforms->count);
+		break;
+	case PURPL_SIMD_SSE:
+		update_sse(transforms, 0, transforms->count);
+		break;
+#endif
+	default:
+		for (i = 0; i < transforms->count; i++)
+			update_one(transforms, i);
+		break;
+	}
+}
+
+void purpl_get_world_matrix(const struct purpl_transforms *transforms,
+			    u32 index, mat4 dest)
+{
+	u32 r;
+	u32 c;
+
+	if (!transforms || index >= transforms->count || !dest) {
+		errno = EINVAL;
+		return;
+	}
+
+	/* cglm matrices are column major */
+	for (c = 0; c < 4; c++) {
+		for (r = 0; r < 3; r++)
+			dest[c][r] = transforms->world[r * 4 + c][index];
+		dest[c][3] = c == 3 ? 1.0f : 0.0f;
+	}
+}
+
+size_t purpl_cull_transforms(const struct purpl_transforms *transforms,
+			     vec4 planes[6], size_t start, size_t count,
+			     u32 *visible)
+{
+	size_t total;
+	size_t i;
+
+	/* Check arguments */
+	if (!transforms || !planes || !visible ||
+	    start + count > transforms->count) {
+		errno = EINVAL;
+		return 0;
+	}
+
+	switch (transforms->simd) {
+#ifdef HAVE_X86_SIMD
+	case PURPL_SIMD_AVX2:
+		return cull_avx2(transforms, planes, start, start + count,
+				 visible);
+	case PURPL_SIMD_SSE:
+		return cull_sse(transforms, planes, start, start + count,
+				visible);
+#endif
+	default:
+		total = 0;
+		for (i = start; i < start + count; i++) {
+			if (cull_one(transforms, planes, i))
+				visible[total++] = (u32)i;
+		}
+		return total;
+	}
+}
+
+void purpl_free_transforms(struct purpl_transforms *transforms)
+{
+	if (!transforms) {
+		errno = EINVAL;
+		return;
+	}
+
+	free(transforms->data);
+	free(transforms);
+}
+
+#ifdef __cplusplus
+}
+#endif
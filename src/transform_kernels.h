@@ -0,0 +1,207 @@
+/*
+ * The transform kernels, written once for every instruction set. transform.c
+ *  defines the vector type and operations, then includes this, which
+ *  undefines them again for the next one.
+ */
+
+/* Compose the world matrices of a range of transforms */
+static TARGET void KERNEL(update)(struct purpl_transforms *transforms,
+				  size_t start, size_t end)
+{
+	VEC x;
+	VEC y;
+	VEC z;
+	VEC w;
+	VEC sx;
+	VEC sy;
+	VEC sz;
+	VEC one;
+	VEC two;
+	VEC local[12];
+	VEC parent[12];
+	VEC value;
+	VECI indices;
+	VECI root;
+	VECI early;
+	size_t i;
+	size_t j;
+	u32 r;
+	u32 c;
+
+	one = SET1(1.0f);
+	two = SET1(2.0f);
+	for (i = start; i + LANES <= end; i += LANES) {
+		/*
+		 * A parent in the same block hasn't been done yet, but that
+		 *  only happens near the top of deep hierarchies
+		 */
+		indices = LOADI(transforms->parent + i);
+		root = CMPEQI(indices, SET1I(-1));
+		early = ANDNOTI(root, CMPGTI(indices, SET1I((int)i - 1)));
+		if (MOVEMASKI(early)) {
+			for (j = i; j < i + LANES; j++)
+				update_one(transforms, j);
+			continue;
+		}
+
+		/* Make the local matrices, the same way local_matrix does */
+		x = LOAD(transforms->qx + i);
+		y = LOAD(transforms->qy + i);
+		z = LOAD(transforms->qz + i);
+		w = LOAD(transforms->qw + i);
+		sx = LOAD(transforms->sx + i);
+		sy = LOAD(transforms->sy + i);
+		sz = LOAD(transforms->sz + i);
+		local[0] = MUL(SUB(one, MUL(two, ADD(MUL(y, y), MUL(z, z)))),
+			       sx);
+		local[1] = MUL(MUL(two, SUB(MUL(x, y), MUL(w, z))), sy);
+		local[2] = MUL(MUL(two, ADD(MUL(x, z), MUL(w, y))), sz);
+		local[3] = LOAD(transforms->px + i);
+		local[4] = MUL(MUL(two, ADD(MUL(x, y), MUL(w, z))), sx);
+		local[5] = MUL(SUB(one, MUL(two, ADD(MUL(x, x), MUL(z, z)))),
+			       sy);
+		local[6] = MUL(MUL(two, SUB(MUL(y, z), MUL(w, x))), sz);
+		local[7] = LOAD(transforms->py + i);
+		local[8] = MUL(MUL(two, SUB(MUL(x, z), MUL(w, y))), sx);
+		local[9] = MUL(MUL(two, ADD(MUL(y, z), MUL(w, x))), sy);
+		local[10] = MUL(SUB(one, MUL(two, ADD(MUL(x, x), MUL(y, y)))),
+				sz);
+		local[11] = LOAD(transforms->pz + i);
+
+		/* Roots are just their local matrix */
+		if (MOVEMASKI(root) == (1u << LANES) - 1) {
+			for (c = 0; c < 12; c++)
+				STORE(transforms->world[c] + i, local[c]);
+			continue;
+		}
+
+		/* Roots get an identity parent, everything else gathers */
+		indices = ANDNOTI(root, indices);
+		for (c = 0; c < 12; c++)
+			parent[c] =
+				BLEND(GATHER(transforms->world[c], indices),
+				      SET1(identity[c]), root);
+		for (r = 0; r < 3; r++) {
+			for (c = 0; c < 4; c++) {
+				value = MUL(parent[r * 4], local[c]);
+				value = ADD(value, MUL(parent[r * 4 + 1],
+						       local[4 + c]));
+				value = ADD(value, MUL(parent[r * 4 + 2],
+						       local[8 + c]));
+				if (c == 3)
+					value = ADD(value, parent[r * 4 + 3]);
+				STORE(transforms->world[r * 4 + c] + i, value);
+			}
+		}
+	}
+
+	for (; i < end; i++)
+		update_one(transforms, i);
+}
+
+/* Cull a range of transforms */
+static TARGET size_t KERNEL(cull)(const struct purpl_transforms *transforms,
+				  vec4 planes[6], size_t start, size_t end,
+				  u32 *visible)
+{
+	VEC world[12];
+	VEC center[3];
+	VEC extent[3];
+	VEC cx;
+	VEC cy;
+	VEC cz;
+	VEC ex;
+	VEC ey;
+	VEC ez;
+	VEC dist;
+	VEC zero;
+	size_t total;
+	size_t i;
+	u32 mask;
+	u32 r;
+
+	/* Get to the start of a block */
+	total = 0;
+	for (i = start; i < end && i % LANES; i++) {
+		if (cull_one(transforms, planes, i))
+			visible[total++] = (u32)i;
+	}
+
+	zero = SET1(0.0f);
+	for (; i + LANES <= end; i += LANES) {
+		/* Move the boxes into world space */
+		cx = LOAD(transforms->cx + i);
+		cy = LOAD(transforms->cy + i);
+		cz = LOAD(transforms->cz + i);
+		ex = LOAD(transforms->ex + i);
+		ey = LOAD(transforms->ey + i);
+		ez = LOAD(transforms->ez + i);
+		for (r = 0; r < 12; r++)
+			world[r] = LOAD(transforms->world[r] + i);
+		for (r = 0; r < 3; r++) {
+			center[r] = ADD(ADD(MUL(world[r * 4], cx),
+					    MUL(world[r * 4 + 1], cy)),
+					ADD(MUL(world[r * 4 + 2], cz),
+					    world[r * 4 + 3]));
+			extent[r] = ADD(ADD(MUL(ABS(world[r * 4]), ex),
+					    MUL(ABS(world[r * 4 + 1]), ey)),
+					MUL(ABS(world[r * 4 + 2]), ez));
+		}
+
+		/* Test against each plane until they're all out */
+		mask = (1u << LANES) - 1;
+		for (r = 0; r < 6 && mask; r++) {
+			dist = ADD(ADD(MUL(SET1(planes[r][0]), center[0]),
+				       MUL(SET1(planes[r][1]), center[1])),
+				   ADD(MUL(SET1(planes[r][2]), center[2]),
+				       SET1(planes[r][3])));
+			dist = ADD(dist,
+				   ADD(ADD(MUL(SET1(fabsf(planes[r][0])),
+					       extent[0]),
+					   MUL(SET1(fabsf(planes[r][1])),
+					       extent[1])),
+				       MUL(SET1(fabsf(planes[r][2])),
+					   extent[2])));
+			mask &= MOVEMASK(CMPGE(dist, zero));
+		}
+
+		/*
+		 * Write every index and only keep the visible ones, total can't
+		 *  pass the current index so this stays in bounds
+		 */
+		for (r = 0; r < LANES; r++) {
+			visible[total] = (u32)(i + r);
+			total += (mask >> r) & 1;
+		}
+	}
+
+	for (; i < end; i++) {
+		if (cull_one(transforms, planes, i))
+			visible[total++] = (u32)i;
+	}
+
+	return total;
+}
+
+#undef LANES
+#undef KERNEL
+#undef TARGET
+#undef VEC
+#undef VECI
+#undef LOAD
+#undef LOADI
+#undef STORE
+#undef SET1
+#undef SET1I
+#undef ADD
+#undef SUB
+#undef MUL
+#undef ABS
+#undef CMPGE
+#undef MOVEMASK
+#undef CMPEQI
+#undef CMPGTI
+#undef ANDNOTI
+#undef MOVEMASKI
+#undef GATHER
+#undef BLEND
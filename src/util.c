@@ -1,9 +1,506 @@
 #include "purpl/util.h"
 
+/* These are for the prefault thread and telling the kernel about files */
+#ifndef _WIN32
+#include <fcntl.h>
+#include <pthread.h>
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* The number of allocations this thread has made */
+static PURPL_THREAD_LOCAL u64 alloc_count;
+
+/* This thread's scratch arena */
+static PURPL_THREAD_LOCAL struct purpl_arena *scratch_arena;
+
+void *purpl_calloc(size_t count, size_t size)
+{
+	alloc_count++;
+	return calloc(count, size);
+}
+
+u64 purpl_get_alloc_count(void)
+{
+	return alloc_count;
+}
+
+struct purpl_arena *purpl_create_arena(size_t block_size)
+{
+	struct purpl_arena *arena;
+
+	arena = PURPL_CALLOC(1, struct purpl_arena);
+	if (!arena)
+		return NULL;
+	arena->block_size = block_size ? block_size : PURPL_ARENA_DEFAULT_BLOCK;
+
+	return arena;
+}
+
+/* Get the offset of the next aligned byte in a block */
+static size_t arena_offset(struct purpl_arena_block *block)
+{
+	uintptr_t next;
+
+	next = (uintptr_t)(block->data + block->used);
+	next = (next + PURPL_ARENA_ALIGN - 1) &
+	       ~(uintptr_t)(PURPL_ARENA_ALIGN - 1);
+
+	return next - (uintptr_t)block->data;
+}
+
+void *purpl_arena_alloc(struct purpl_arena *arena, size_t size)
+{
+	struct purpl_arena_block *block;
+	struct purpl_arena_block *last;
+	size_t block_size;
+	size_t start;
+
+	/* Check arguments */
+	if (!arena) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	/* Find a block with room, reusing the ones left from before a reset */
+	last = NULL;
+	start = 0;
+	for (block = arena->current; block; block = block->next) {
+		if (block != arena->current)
+			block->used = 0;
+		start = arena_offset(block);
+		if (start + size <= block->size)
+			break;
+		last = block;
+	}
+
+	/* Add a block if none of them have room */
+	if (!block) {
+		block_size =
+			PURPL_MAX(arena->block_size, size + PURPL_ARENA_ALIGN);
+		block = purpl_calloc(1, sizeof(struct purpl_arena_block) +
+						block_size);
+		if (!block)
+			return NULL;
+		block->size = block_size;
+		if (last)
+			last->next = block;
+		else
+			arena->first = block;
+		start = arena_offset(block);
+	}
+
+	/* Take the memory */
+	arena->current = block;
+	arena->used += start - block->used + size;
+	arena->peak = PURPL_MAX(arena->peak, arena->used);
+	block->used = start + size;
+
+	return block->data + start;
+}
+
+struct purpl_arena_mark purpl_mark_arena(struct purpl_arena *arena)
+{
+	struct purpl_arena_mark mark = { 0 };
+
+	if (arena && arena->current) {
+		mark.block = arena->current;
+		mark.block_used = arena->current->used;
+		mark.used = arena->used;
+	}
+
+	return mark;
+}
+
+void purpl_release_arena(struct purpl_arena *arena,
+			 struct purpl_arena_mark mark)
+{
+	/* Check arguments */
+	if (!arena)
+		return;
+
+	/* Nothing had been allocated yet */
+	if (!mark.block) {
+		purpl_reset_arena(arena);
+		return;
+	}
+
+	arena->current = mark.block;
+	arena->current->used = mark.block_used;
+	arena->used = mark.used;
+}
+
+void purpl_reset_arena(struct purpl_arena *arena)
+{
+	/* Check arguments */
+	if (!arena)
+		return;
+
+	arena->current = arena->first;
+	if (arena->current)
+		arena->current->used = 0;
+	arena->used = 0;
+}
+
+void purpl_free_arena(struct purpl_arena *arena)
+{
+	struct purpl_arena_block *block;
+	struct purpl_arena_block *next;
+
+	/* Check arguments */
+	if (!arena)
+		return;
+
+	for (block = arena->first; block; block = next) {
+		next = block->next;
+		free(block);
+	}
+	free(arena);
+}
+
+struct purpl_arena *purpl_get_scratch_arena(void)
+{
+	if (!scratch_arena)
+		scratch_arena = purpl_create_arena(0);
+
+	return scratch_arena;
+}
+
+void purpl_free_scratch_arena(void)
+{
+	purpl_free_arena(scratch_arena);
+	scratch_arena = NULL;
+}
+
+/*
+ * A spinlock and counters for the pool allocator, which can't use SDL since
+ *  the tools link this too
+ */
+#ifdef _MSC_VER
+#define POOL_LOCK(lock)                        \
+	while (InterlockedExchange(&(lock), 1)) \
+		YieldProcessor()
+#define POOL_UNLOCK(lock) InterlockedExchange(&(lock), 0)
+#define POOL_COUNT(var, val) InterlockedExchangeAdd64(&(var), (val))
+#else
+#define POOL_LOCK(lock)                                            \
+	while (__atomic_exchange_n(&(lock), 1, __ATOMIC_ACQUIRE)) \
+		while (__atomic_load_n(&(lock), __ATOMIC_RELAXED))
+#define POOL_UNLOCK(lock) __atomic_store_n(&(lock), 0, __ATOMIC_RELEASE)
+#define POOL_COUNT(var, val) __atomic_fetch_add(&(var), (val), __ATOMIC_RELAXED)
+#endif
+
+/* The bytes mapped by purpl_map_file, counted the same way as the pool */
+static s64 mapped_bytes;
+
+u64 purpl_get_mapped_bytes(void)
+{
+	return mapped_bytes;
+}
+
+/* What freed blocks are filled with in debug builds */
+#define POOL_POISON 0xDD
+
+/* The number of blocks a thread cache takes from or gives back at once */
+#define POOL_CACHE_BATCH 32
+
+/* A free block */
+struct pool_block {
+	struct pool_block *next;
+};
+
+/* One of the size classes */
+struct pool_class {
+	volatile long lock;
+	struct pool_block *free;
+	void *slabs; /* The start of each slab points to the next one */
+	size_t nslabs;
+	s64 live;
+};
+
+static struct pool_class pool_classes[PURPL_POOL_CLASSES];
+
+#if PURPL_POOL_THREAD_CACHE
+/* This thread's free blocks for one size class */
+struct pool_cache {
+	struct pool_block *free;
+	u32 count;
+};
+
+static PURPL_THREAD_LOCAL struct pool_cache pool_caches[PURPL_POOL_CLASSES];
+#endif
+
+/* Get the size class for an allocation, or -1 if it's too big */
+static int pool_class_index(size_t size)
+{
+	int i;
+
+	for (i = 0; i < PURPL_POOL_CLASSES; i++) {
+		if (size <= (size_t)16 << i)
+			return i;
+	}
+
+	return -1;
+}
+
+#ifndef NDEBUG
+/* Fill a freed block with the poison value, except for the link */
+static void pool_poison(struct pool_block *block, size_t size)
+{
+	memset(block + 1, POOL_POISON, size - sizeof(struct pool_block));
+}
+
+/* Check that nobody wrote to a block after freeing it */
+static void pool_check(struct pool_block *block, size_t size)
+{
+	const u8 *p;
+
+	for (p = (const u8 *)(block + 1); p < (const u8 *)block + size; p++) {
+		if (*p != POOL_POISON) {
+			fprintf(stderr,
+				"Warning: %zu byte pool block %p was written "
+				"to at offset %zu after being freed\n",
+				size, (void *)block, (size_t)(p - (u8 *)block));
+			return;
+		}
+	}
+}
+#endif
+
+/* Get a new slab and split it into free blocks, with the lock held */
+static bool pool_add_slab(struct pool_class *cls, size_t size)
+{
+	struct pool_block *block;
+	char *slab;
+	size_t i;
+
+	/* Get some cache line aligned memory */
+#ifdef _WIN32
+	slab = _aligned_malloc(PURPL_POOL_SLAB_SIZE, PURPL_CACHE_LINE);
+#else
+	if (posix_memalign((void **)&slab, PURPL_CACHE_LINE,
+			   PURPL_POOL_SLAB_SIZE) != 0)
+		slab = NULL;
+#endif
+	if (!slab) {
+		errno = ENOMEM;
+		return false;
+	}
+	alloc_count++;
+
+	/* The first cache line links the slabs together */
+	*(void **)slab = cls->slabs;
+	cls->slabs = slab;
+	cls->nslabs++;
+
+	/* Split up the rest, backwards so the blocks get used in order */
+	for (i = (PURPL_POOL_SLAB_SIZE - PURPL_CACHE_LINE) / size; i > 0; i--) {
+		block = (struct pool_block *)(slab + PURPL_CACHE_LINE +
+					       (i - 1) * size);
+#ifndef NDEBUG
+		pool_poison(block, size);
+#endif
+		block->next = cls->free;
+		cls->free = block;
+	}
+
+	return true;
+}
+
+#if PURPL_POOL_THREAD_CACHE
+/* Move a batch of blocks from a size class to this thread's cache */
+static bool pool_refill(struct pool_class *cls, struct pool_cache *cache,
+			size_t size)
+{
+	struct pool_block *block;
+	u32 i;
+
+	POOL_LOCK(cls->lock);
+	for (i = 0; i < POOL_CACHE_BATCH; i++) {
+		if (!cls->free && !pool_add_slab(cls, size))
+			break;
+		block = cls->free;
+		cls->free = block->next;
+		block->next = cache->free;
+		cache->free = block;
+		cache->count++;
+	}
+	POOL_UNLOCK(cls->lock);
+
+	return cache->free != NULL;
+}
+
+/* Give blocks from this thread's cache back to a size class */
+static void pool_spill(struct pool_class *cls, struct pool_cache *cache,
+		       u32 count)
+{
+	struct pool_block *block;
+
+	POOL_LOCK(cls->lock);
+	while (count-- && cache->free) {
+		block = cache->free;
+		cache->free = block->next;
+		cache->count--;
+		block->next = cls->free;
+		cls->free = block;
+	}
+	POOL_UNLOCK(cls->lock);
+}
+#endif
+
+void *purpl_pool_alloc(size_t size)
+{
+	struct pool_class *cls;
+	struct pool_block *block;
+	size_t block_size;
+	int idx;
+
+	/* Big allocations don't belong here */
+	idx = pool_class_index(size);
+	if (idx < 0)
+		return purpl_calloc(1, size);
+	cls = &pool_classes[idx];
+	block_size = (size_t)16 << idx;
+
+	/* Take a block, from this thread's cache if possible */
+#if PURPL_POOL_THREAD_CACHE
+	if (!pool_caches[idx].free &&
+	    !pool_refill(cls, &pool_caches[idx], block_size))
+		return NULL;
+	block = pool_caches[idx].free;
+	pool_caches[idx].free = block->next;
+	pool_caches[idx].count--;
+#else
+	POOL_LOCK(cls->lock);
+	if (!cls->free && !pool_add_slab(cls, block_size)) {
+		POOL_UNLOCK(cls->lock);
+		return NULL;
+	}
+	block = cls->free;
+	cls->free = block->next;
+	POOL_UNLOCK(cls->lock);
+#endif
+
+#ifndef NDEBUG
+	pool_check(block, block_size);
+	POOL_COUNT(cls->live, 1);
+#endif
+
+	memset(block, 0, size);
+
+	return block;
+}
+
+void purpl_pool_free(void *ptr, size_t size)
+{
+	struct pool_class *cls;
+	struct pool_block *block;
+	int idx;
+
+	if (!ptr)
+		return;
+
+	/* Big allocations came from calloc */
+	idx = pool_class_index(size);
+	if (idx < 0) {
+		free(ptr);
+		return;
+	}
+	cls = &pool_classes[idx];
+	block = ptr;
+
+#ifndef NDEBUG
+	pool_poison(block, (size_t)16 << idx);
+	POOL_COUNT(cls->live, -1);
+#endif
+
+	/* Put it in this thread's cache, and give some back if it's full */
+#if PURPL_POOL_THREAD_CACHE
+	block->next = pool_caches[idx].free;
+	pool_caches[idx].free = block;
+	if (++pool_caches[idx].count > POOL_CACHE_BATCH * 2)
+		pool_spill(cls, &pool_caches[idx], POOL_CACHE_BATCH);
+#else
+	POOL_LOCK(cls->lock);
+	block->next = cls->free;
+	cls->free = block;
+	POOL_UNLOCK(cls->lock);
+#endif
+}
+
+char *purpl_pool_strndup(const char *str, size_t len)
+{
+	size_t *block;
+	char *copy;
+
+	/* Check arguments */
+	if (!str) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	/*
+	 * Keep the size in front of the string, since it could be shorter by
+	 *  the time it's freed
+	 */
+	block = purpl_pool_alloc(sizeof(size_t) + len + 1);
+	if (!block)
+		return NULL;
+	*block = sizeof(size_t) + len + 1;
+	copy = (char *)(block + 1);
+	memcpy(copy, str, len);
+	copy[len] = 0;
+
+	return copy;
+}
+
+char *purpl_pool_strdup(const char *str)
+{
+	return purpl_pool_strndup(str, str ? strlen(str) : 0);
+}
+
+void purpl_pool_free_str(char *str)
+{
+	size_t *block;
+
+	if (!str)
+		return;
+	block = (size_t *)str - 1;
+	purpl_pool_free(block, *block);
+}
+
+void purpl_flush_pool_cache(void)
+{
+#if PURPL_POOL_THREAD_CACHE
+	uint i;
+
+	for (i = 0; i < PURPL_POOL_CLASSES; i++)
+		pool_spill(&pool_classes[i], &pool_caches[i], UINT32_MAX);
+#endif
+}
+
+s64 purpl_get_pool_stats(struct purpl_pool_stats *stats)
+{
+	s64 live;
+	uint i;
+
+	live = 0;
+	for (i = 0; i < PURPL_POOL_CLASSES; i++) {
+		POOL_LOCK(pool_classes[i].lock);
+		if (stats) {
+			stats[i].size = (size_t)16 << i;
+			stats[i].slabs = pool_classes[i].nslabs;
+			stats[i].live = pool_classes[i].live;
+		}
+		live += pool_classes[i].live;
+		POOL_UNLOCK(pool_classes[i].lock);
+	}
+
+	return live;
+}
+
 char *purpl_fmt_text_va(s64 *len_ret, const char *fmt, va_list args)
 {
 	s64 len;
@@ -33,7 +530,7 @@ char *purpl_fmt_text_va(s64 *len_ret, const char *fmt, va_list args)
 	buf = PURPL_CALLOC(len, char);
 	if (!buf) {
 		errno = ENOMEM;
-		len = -1;
+		*len_ret = -1;
 		return fmt; /*
 			     * This function is used a lot and if it can't
 			     *  "fail" that's good
@@ -44,7 +541,7 @@ char *purpl_fmt_text_va(s64 *len_ret, const char *fmt, va_list args)
 	stbsp_vsnprintf(buf, len, fmt, ap);
 	if (!buf) {
 		errno = E2BIG;
-		len = -1;
+		*len_ret = -1;
 		return fmt;
 	}
 	*len_ret = len;
@@ -77,35 +574,430 @@ char *purpl_fmt_text(s64 *len_ret, const char *fmt, ...)
 	return fmt_ptr;
 }
 
+char *purpl_fmt_text_va_arena(struct purpl_arena *arena, s64 *len_ret,
+			      const char *fmt, va_list args)
+{
+	struct purpl_arena_block *block;
+	char *buf;
+	size_t start;
+	size_t avail;
+	int len;
+	va_list ap;
+
+	/* Check our parameters */
+	if (!arena || !fmt) {
+		errno = EINVAL;
+		len_ret ? *len_ret = -1 : 0;
+		return fmt;
+	}
+
+	/* Try to format straight into the current block */
+	va_copy(ap, args);
+	block = arena->current;
+	if (block) {
+		start = arena_offset(block);
+		avail = (block->size > start) ? block->size - start : 0;
+		len = stbsp_vsnprintf(block->data + start,
+				      PURPL_MIN(avail, INT32_MAX), fmt, args);
+	} else {
+		avail = 0;
+		len = stbsp_vsnprintf(NULL, 0, fmt, args);
+	}
+	if (len < 0) {
+		va_end(ap);
+		errno = E2BIG;
+		len_ret ? *len_ret = -1 : 0;
+		return fmt;
+	}
+
+	/*
+	 * If it fit, this gives back the same spot, otherwise there's a new
+	 *  block to format it into
+	 */
+	buf = purpl_arena_alloc(arena, len + 1);
+	if (!buf) {
+		va_end(ap);
+		len_ret ? *len_ret = -1 : 0;
+		return fmt;
+	}
+	if ((size_t)len >= avail)
+		stbsp_vsnprintf(buf, len + 1, fmt, ap);
+	va_end(ap);
+
+	len_ret ? *len_ret = len : 0;
+
+	return buf;
+}
+
+char *purpl_fmt_text_arena(struct purpl_arena *arena, s64 *len_ret,
+			   const char *fmt, ...)
+{
+	va_list args;
+	char *buf;
+
+	va_start(args, fmt);
+	buf = purpl_fmt_text_va_arena(arena, len_ret, fmt, args);
+	va_end(args);
+
+	return buf;
+}
+
+char *purpl_arena_strdup(struct purpl_arena *arena, const char *str)
+{
+	char *copy;
+	size_t len;
+
+	/* Check arguments */
+	if (!str) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	len = strlen(str);
+	copy = purpl_arena_alloc(arena, len + 1);
+	if (!copy)
+		return NULL;
+	memcpy(copy, str, len + 1);
+
+	return copy;
+}
+
+const char *purpl_next_fmt_spec(const char *fmt, struct purpl_fmt_spec *spec)
+{
+	const char *p;
+
+	/* Check arguments */
+	if (!fmt || !spec) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	/* Find the next % */
+	p = strchr(fmt, '%');
+	if (!p)
+		return NULL;
+	memset(spec, 0, sizeof(struct purpl_fmt_spec));
+	spec->start = p++;
+
+	/* Skip the flags, width, and precision, counting any *s */
+	while (*p && strchr("-+ #0123456789.*'", *p)) {
+		if (*p == '*')
+			spec->stars++;
+		p++;
+	}
+	spec->body_len = p - spec->start - 1;
+
+	/* Read the length modifier */
+	switch (*p) {
+	case 'h':
+		spec->size = (p[1] == 'h') ? 'H' : 'h';
+		p += (p[1] == 'h') ? 2 : 1;
+		break;
+	case 'l':
+		spec->size = (p[1] == 'l') ? 'q' : 'l';
+		p += (p[1] == 'l') ? 2 : 1;
+		break;
+	case 'L':
+	case 'z':
+	case 'j':
+	case 't':
+		spec->size = *p++;
+		break;
+	}
+
+	/* Figure out what kind of argument the conversion takes */
+	spec->conv = *p;
+	switch (spec->conv) {
+	case 'd':
+	case 'i':
+		spec->arg = PURPL_FMT_INT;
+		break;
+	case 'u':
+	case 'o':
+	case 'x':
+	case 'X':
+	case 'c':
+		spec->arg = PURPL_FMT_UINT;
+		break;
+	case 'f':
+	case 'F':
+	case 'e':
+	case 'E':
+	case 'g':
+	case 'G':
+	case 'a':
+	case 'A':
+		spec->arg = PURPL_FMT_DOUBLE;
+		break;
+	case 's':
+		spec->arg = PURPL_FMT_STRING;
+		break;
+	case 'p':
+		spec->arg = PURPL_FMT_POINTER;
+		break;
+	case '%':
+	default:
+		spec->arg = PURPL_FMT_NONE;
+		spec->stars = 0;
+		break;
+	}
+	if (*p)
+		p++;
+	spec->len = p - spec->start;
+
+	return p;
+}
+
+/* How much the prefault thread touches between checks for being stopped */
+#define PREFAULT_CHUNK (2 * 1024 * 1024)
+
+/*
+ * A thread that faults a mapping's pages in. This uses the OS's threads
+ *  instead of SDL's for the same reason the pool does.
+ */
+struct purpl_prefault {
+#ifdef _WIN32
+	HANDLE thread;
+#else
+	pthread_t thread;
+#endif
+	long stop;
+	u8 *base;
+	size_t len;
+	size_t page;
+};
+
+#ifdef _MSC_VER
+#define PREFAULT_STOPPED(pf) InterlockedCompareExchange(&(pf)->stop, 0, 0)
+#define PREFAULT_STOP(pf) InterlockedExchange(&(pf)->stop, 1)
+#else
+#define PREFAULT_STOPPED(pf) __atomic_load_n(&(pf)->stop, __ATOMIC_RELAXED)
+#define PREFAULT_STOP(pf) __atomic_store_n(&(pf)->stop, 1, __ATOMIC_RELAXED)
+#endif
+
+/* Get the size of a file without moving its position */
+static s64 get_file_size(FILE *fp)
+{
+#ifdef _WIN32
+	struct _stat64 st;
+
+	if (_fstat64(fileno(fp), &st) < 0)
+		return -1;
+#else
+	struct stat st;
+
+	if (fstat(fileno(fp), &st) < 0)
+		return -1;
+#endif
+
+	return st.st_size;
+}
+
+/* Get what mapping offsets have to be aligned to */
+static u64 get_map_granularity(void)
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+
+	GetSystemInfo(&info);
+	return info.dwAllocationGranularity;
+#else
+	return sysconf(_SC_PAGESIZE);
+#endif
+}
+
+/* Touch every page of a mapping, a chunk at a time */
+#ifdef _WIN32
+static DWORD WINAPI prefault_thread(void *data)
+#else
+static void *prefault_thread(void *data)
+#endif
+{
+	struct purpl_prefault *pf = data;
+	size_t chunk;
+	size_t i;
+	size_t j;
+
+	for (i = 0; i < pf->len && !PREFAULT_STOPPED(pf); i += chunk) {
+		chunk = PURPL_MIN(pf->len - i, PREFAULT_CHUNK);
+
+		/* Let the kernel do it in one go if it can */
+#ifdef MADV_POPULATE_READ
+		if (madvise(pf->base + i, chunk, MADV_POPULATE_READ) == 0)
+			continue;
+#endif
+		for (j = 0; j < chunk; j += pf->page)
+			(void)*(volatile u8 *)(pf->base + i + j);
+	}
+
+#ifdef _WIN32
+	return 0;
+#else
+	return NULL;
+#endif
+}
+
+/* Start faulting in a mapping's pages, unless that's already happening */
+static int start_prefault(struct purpl_mapping *mapping)
+{
+	struct purpl_prefault *pf;
+
+	if (mapping->prefault)
+		return 0;
+
+	pf = PURPL_CALLOC(1, struct purpl_prefault);
+	if (!pf)
+		return errno;
+	pf->base = mapping->base;
+	pf->len = mapping->base_len;
+	pf->page = get_map_granularity();
+#ifdef _WIN32
+	/* The allocation granularity is bigger than a page */
+	pf->page = 4096;
+	pf->thread = CreateThread(NULL, 0, prefault_thread, pf, 0, NULL);
+	if (!pf->thread) {
+		free(pf);
+		errno = EAGAIN;
+		return errno;
+	}
+#else
+	errno = pthread_create(&pf->thread, NULL, prefault_thread, pf);
+	if (errno) {
+		free(pf);
+		return errno;
+	}
+#endif
+	mapping->prefault = pf;
+
+	return 0;
+}
+
+/* Stop faulting in a mapping's pages and wait for the thread */
+static void stop_prefault(struct purpl_mapping *mapping)
+{
+	struct purpl_prefault *pf = mapping->prefault;
+
+	if (!pf)
+		return;
+
+	PREFAULT_STOP(pf);
+#ifdef _WIN32
+	WaitForSingleObject(pf->thread, INFINITE);
+	CloseHandle(pf->thread);
+#else
+	pthread_join(pf->thread, NULL);
+#endif
+	free(pf);
+	mapping->prefault = NULL;
+}
+
+int purpl_advise_mapping(struct purpl_mapping *mapping, u32 hints)
+{
+	int ___errno;
+
+	PURPL_SAVE_ERRNO(___errno);
+
+	/* Check arguments */
+	if (!mapping || ((hints & PURPL_MAP_SEQUENTIAL) &&
+			 (hints & PURPL_MAP_RANDOM))) {
+		errno = EINVAL;
+		return errno;
+	}
+
+	/* These are all just hints, so failures don't matter */
+#ifdef _WIN32
+#if _WIN32_WINNT >= 0x0602
+	if (hints & PURPL_MAP_WILLNEED) {
+		WIN32_MEMORY_RANGE_ENTRY range;
+
+		range.VirtualAddress = mapping->base;
+		range.NumberOfBytes = mapping->base_len;
+		PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+	}
+#endif
+#else
+	if (hints & PURPL_MAP_SEQUENTIAL)
+		madvise(mapping->base, mapping->base_len, MADV_SEQUENTIAL);
+	else if (hints & PURPL_MAP_RANDOM)
+		madvise(mapping->base, mapping->base_len, MADV_RANDOM);
+	else
+		madvise(mapping->base, mapping->base_len, MADV_NORMAL);
+	if (hints & PURPL_MAP_WILLNEED)
+		madvise(mapping->base, mapping->base_len, MADV_WILLNEED);
+#ifdef MADV_HUGEPAGE
+	if (hints & PURPL_MAP_HUGEPAGE)
+		madvise(mapping->base, mapping->base_len, MADV_HUGEPAGE);
+#endif
+#endif
+	mapping->hints = hints;
+
+	/* Do this last so it benefits from the rest */
+	if (hints & PURPL_MAP_PREFAULT) {
+		if (start_prefault(mapping))
+			return errno;
+	}
+
+	PURPL_RESTORE_ERRNO(___errno);
+
+	return 0;
+}
+
 struct purpl_mapping *purpl_map_file(u8 protection, FILE *fp)
+{
+	return purpl_map_file_range(protection, fp, 0, 0, PURPL_MAP_NORMAL);
+}
+
+struct purpl_mapping *purpl_map_file_range(u8 protection, FILE *fp,
+					   u64 offset, u64 len, u32 hints)
 {
 	struct purpl_mapping *mapping;
 	u8 prot;
 	int fd;
 	int fd2;
-	size_t fpos;
+	s64 size;
+	u64 base_offset;
+	u64 base_len;
 	int ___errno;
 
 	PURPL_SAVE_ERRNO(___errno);
 
 	/* Check arguments */
-	if (!fp) {
+	if (!fp || ((hints & PURPL_MAP_SEQUENTIAL) &&
+		    (hints & PURPL_MAP_RANDOM))) {
 		errno = EINVAL;
 		return NULL;
 	}
 
+	/* Figure out how thicc the file is */
+	size = get_file_size(fp);
+	if (size < 0)
+		return NULL;
+
+	/* Make sure the range is in the file, and fits in the address space */
+	if (!len && (u64)size > offset)
+		len = size - offset;
+	if (!len || offset >= (u64)size || len > (u64)size - offset) {
+		errno = EINVAL;
+		return NULL;
+	}
+	base_offset = offset - offset % get_map_granularity();
+	base_len = len + (offset - base_offset);
+	if (base_len > SIZE_MAX) {
+		errno = EFBIG;
+		return NULL;
+	}
+
 	/* Allocate the mapping information */
-	mapping = PURPL_CALLOC(1, struct purpl_mapping);
+	mapping = PURPL_POOL_NEW(struct purpl_mapping);
+	if (!mapping)
+		return NULL;
+	mapping->offset = offset;
+	mapping->len = len;
+	mapping->base_len = base_len;
 
 	/* Fix up protection (limit it to 2) */
 	prot = protection & 0xF;
 
-	/* Figure out how thicc the file is */
-	fpos = ftell(fp);
-	fseek(fp, 0, SEEK_END);
-	mapping->len = ftell(fp);
-	fseek(fp, 0, fpos);
-
 	/*
 	 * Why in K&R's great creation does Windows
 	 *  even _have_ file descriptors _and_ handles?!
@@ -113,7 +1005,7 @@ struct purpl_mapping *purpl_map_file(u8 protection, FILE *fp)
 	 */
 	fd = fileno(fp);
 	if (fd < 0) {
-		free(mapping);
+		PURPL_POOL_DELETE(mapping);
 		errno = EBADF;
 		return NULL;
 	}
@@ -145,13 +1037,14 @@ struct purpl_mapping *purpl_map_file(u8 protection, FILE *fp)
 		break;
 	}
 
-	/* Create a mapping object, whatever the fuck that's meant to be */
+	/*
+	 * Create a mapping object, whatever the fuck that's meant to be. It
+	 *  covers the whole file, and the view picks out the range.
+	 */
 	mapping->handle = CreateFileMappingA(file, NULL, PAGE_EXECUTE_READWRITE,
-					     PURPL_HIGH(mapping->len, u32),
-					     PURPL_LOW(mapping->len, u32),
-					     NULL);
+					     0, 0, NULL);
 	if (!mapping->handle) {
-		free(mapping);
+		PURPL_POOL_DELETE(mapping);
 		if (GetLastError() == ERROR_ACCESS_DENIED)
 			errno = EPERM;
 		else
@@ -162,10 +1055,13 @@ struct purpl_mapping *purpl_map_file(u8 protection, FILE *fp)
 	}
 
 	/* Create a "view" of the mapping */
-	mapping->data =
-		MapViewOfFile(mapping->handle, prot, 0, 0, mapping->len);
-	if (!mapping->data) {
-		free(mapping);
+	mapping->base = MapViewOfFile(mapping->handle, prot,
+				      (u32)(base_offset >> 32),
+				      (u32)(base_offset & 0xFFFFFFFF),
+				      mapping->base_len);
+	if (!mapping->base) {
+		CloseHandle(mapping->handle);
+		PURPL_POOL_DELETE(mapping);
 		/* 
 		 * Microsoft brought this upon us by having
 		 *  their own weird-ass system for error codes
@@ -197,30 +1093,50 @@ struct purpl_mapping *purpl_map_file(u8 protection, FILE *fp)
 
 	/* Map the file */
 	errno = 0;
-	PURPL_RETRY_INTR(mapping->data =
-				 mmap(NULL, mapping->len, prot,
-				      (prot - 1) ? MAP_SHARED : MAP_PRIVATE,
-				      fd2, 0));
-
-	/* If a permission error arises, downgrade requested access */
-	if (!mapping->data && errno == EPERM) {
-		prot--;
+	PURPL_RETRY_INTR(mapping->base = mmap(NULL, mapping->base_len, prot,
+					      (prot & PROT_WRITE) ? MAP_SHARED :
+								    MAP_PRIVATE,
+					      fd2, base_offset));
+
+	/*
+	 * If the file can't be written, make the pages copy-on-write so
+	 *  writing to them is still safe
+	 */
+	if (mapping->base == MAP_FAILED &&
+	    (errno == EACCES || errno == EPERM) && prot & PROT_WRITE) {
 		errno = 0;
-		PURPL_RETRY_INTR(mapping->data = mmap(NULL, mapping->len,
-						      prot - 1, MAP_SHARED, fd2,
-						      0));
+		PURPL_RETRY_INTR(mapping->base =
+					 mmap(NULL, mapping->base_len, prot,
+					      MAP_PRIVATE, fd2, base_offset));
 	}
 
 	/* Do some final error checking */
-	if (errno || !mapping->data) {
-		free(mapping);
+	if (mapping->base == MAP_FAILED) {
+		PURPL_POOL_DELETE(mapping);
 		close(fd2);
 		return NULL;
 	}
+
+	/* Tell the kernel how the file will be read while there's an fd */
+#ifdef POSIX_FADV_WILLNEED
+	if (hints & PURPL_MAP_SEQUENTIAL)
+		posix_fadvise(fd2, offset, len, POSIX_FADV_SEQUENTIAL);
+	else if (hints & PURPL_MAP_RANDOM)
+		posix_fadvise(fd2, offset, len, POSIX_FADV_RANDOM);
+	if (hints & PURPL_MAP_WILLNEED)
+		posix_fadvise(fd2, offset, len, POSIX_FADV_WILLNEED);
+#endif
 #endif /* _WIN32 */
 
 	/* Close fd2 */
 	close(fd2);
+	mapping->data = (u8 *)mapping->base + (offset - base_offset);
+	mapping->prot = protection & 0xF;
+	POOL_COUNT(mapped_bytes, mapping->base_len);
+
+	/* Apply the rest of the hints */
+	if (hints)
+		purpl_advise_mapping(mapping, hints);
 
 	PURPL_RESTORE_ERRNO(___errno);
 
@@ -240,18 +1156,22 @@ void purpl_unmap_file(struct purpl_mapping *mapping)
 		return;
 	}
 
+	/* The pages can't go away while they're being touched */
+	stop_prefault(mapping);
+
 	/* Begin all that nasty platform-specific shit */
 #ifdef _WIN32
 	/* Unmap the file view and close the handle to the mapping object */
-	UnmapViewOfFile(mapping->data);
+	UnmapViewOfFile(mapping->base);
 	CloseHandle(mapping->handle);
 #else
 	/* Unmap the file */
-	PURPL_RETRY_INTR(munmap(mapping->data, mapping->len));
+	PURPL_RETRY_INTR(munmap(mapping->base, mapping->base_len));
 #endif
+	POOL_COUNT(mapped_bytes, -(s64)mapping->base_len);
 
 	/* Free info */
-	free(mapping);
+	PURPL_POOL_DELETE(mapping);
 
 	PURPL_RESTORE_ERRNO(___errno);
 }
@@ -287,21 +1207,26 @@ char *purpl_read_file_fp(size_t *len_ret, struct purpl_mapping **mapping,
 			will_map = false;
 		}
 
-		/* Map the file */
-		map_info = purpl_map_file(1, fp);
+		/* Map the file, it's all getting read anyway */
+		map_info = purpl_map_file_range(1, fp, 0, 0,
+						PURPL_MAP_WILLNEED);
 		if (!map_info)
 			will_map = false;
 	}
 
 	/* Either mapping wasn't requested, or it failed */
 	if (!will_map) {
-		size_t fpos;
+		s64 size;
 
 		/* Determine file length */
-		fpos = ftell(fp);
-		fseek(fp, 0, SEEK_END);
-		len = ftell(fp);
-		fseek(fp, 0, fpos);
+		size = get_file_size(fp);
+		if (size < 0)
+			return NULL;
+		if ((u64)size >= SIZE_MAX) {
+			errno = EFBIG;
+			return NULL;
+		}
+		len = size;
 
 		/* Allocate a buffer */
 		file = PURPL_CALLOC(len + 1, char);
@@ -342,8 +1267,9 @@ char *purpl_read_file(size_t *len_ret, struct purpl_mapping **info, bool *map,
 		      const char *path, ...)
 {
 	va_list args;
+	struct purpl_arena *scratch;
+	struct purpl_arena_mark mark;
 	char *path_fmt;
-	s64 path_len;
 	FILE *fp;
 	int ___errno;
 
@@ -356,12 +1282,15 @@ char *purpl_read_file(size_t *len_ret, struct purpl_mapping **info, bool *map,
 	}
 
 	/* Format the path to the file */
+	scratch = purpl_get_scratch_arena();
+	mark = purpl_mark_arena(scratch);
 	va_start(args, path);
-	path_fmt = purpl_fmt_text_va(&path_len, path, args);
+	path_fmt = purpl_fmt_text_va_arena(scratch, NULL, path, args);
 	va_end(args);
 
 	/* Open the file */
 	fp = fopen(path_fmt, PURPL_WRITE);
+	purpl_release_arena(scratch, mark);
 	if (!fp)
 		return NULL;
 
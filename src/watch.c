@@ -0,0 +1,390 @@
+#include "purpl/watch.h"
+#include "purpl/profile.h"
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef __linux__
+/* The events that mean a file's contents might be different */
+#define WATCH_CHANGED (IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO)
+
+/* The events that mean a directory's listing is different */
+#define WATCH_LISTING (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)
+
+/* Note that a directory's listing is stale, unless that's already known */
+static void mark_dir_changed(struct purpl_watch *watch, const char *dir)
+{
+	char *copy;
+	size_t i;
+
+	for (i = 0; i < stbds_arrlenu(watch->changed_dirs); i++) {
+		if (strcmp(watch->changed_dirs[i], dir) == 0)
+			return;
+	}
+
+	copy = PURPL_CALLOC(strlen(dir) + 1, char);
+	if (!copy)
+		return;
+	strcpy(copy, dir);
+	stbds_arrput(watch->changed_dirs, copy);
+}
+
+/* Read whatever events are waiting */
+static void read_events(struct purpl_watch *watch)
+{
+	char buf[4096]
+		__attribute__((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event *ev;
+	const char *dir;
+	char *path;
+	s64 path_len;
+	ssize_t len;
+	ssize_t i;
+
+	while ((len = read(watch->fd, buf, sizeof(buf))) > 0) {
+		SDL_LockMutex(watch->lock);
+		for (i = 0; i < len;
+		     i += sizeof(struct inotify_event) + ev->len) {
+			ev = (const struct inotify_event *)(buf + i);
+			dir = stbds_hmget(watch->dirs, ev->wd);
+			if (!dir || !ev->len)
+				continue;
+
+			if (ev->mask & WATCH_LISTING)
+				mark_dir_changed(watch, dir);
+
+			/* Restart the file's delay every time it changes */
+			if (ev->mask & WATCH_CHANGED) {
+				path = purpl_fmt_text(&path_len, "%s/%s", dir,
+						      ev->name);
+				stbds_shput(watch->pending, path,
+					    SDL_GetTicks());
+				(path_len > 0) ? free(path) : (void)0;
+			}
+		}
+		SDL_UnlockMutex(watch->lock);
+	}
+}
+
+/* Reload files that have settled */
+static void reload_pending(struct purpl_watch *watch)
+{
+	struct purpl_asset *ast;
+	char **due = NULL;
+	u32 *stamps = NULL;
+	ptrdiff_t idx;
+	bool map;
+	u32 now;
+	size_t i;
+
+	/* Find everything that hasn't changed for long enough */
+	SDL_LockMutex(watch->lock);
+	now = SDL_GetTicks();
+	for (i = 0; i < stbds_shlenu(watch->pending); i++) {
+		if (now - watch->pending[i].value >= watch->delay) {
+			stbds_arrput(due, watch->pending[i].key);
+			stbds_arrput(stamps, watch->pending[i].value);
+		}
+	}
+	SDL_UnlockMutex(watch->lock);
+
+	for (i = 0; i < stbds_arrlenu(due); i++) {
+		/* Only reload files that belong to assets */
+		SDL_LockMutex(watch->lock);
+		idx = stbds_shgeti(watch->files, due[i]);
+		map = idx >= 0 && watch->files[idx].value;
+		SDL_UnlockMutex(watch->lock);
+		ast = (idx >= 0) ? purpl_load_asset(map, "%s", due[i]) : NULL;
+
+		/*
+		 * Hand it to the main thread and forget the change, unless the
+		 *  file changed again while it was loading
+		 */
+		SDL_LockMutex(watch->lock);
+		if (ast)
+			stbds_arrput(watch->ready, ast);
+		idx = stbds_shgeti(watch->pending, due[i]);
+		if (idx >= 0 && watch->pending[idx].value == stamps[i])
+			stbds_shdel(watch->pending, due[i]);
+		SDL_UnlockMutex(watch->lock);
+	}
+
+	stbds_arrfree(due);
+	stbds_arrfree(stamps);
+}
+
+/* Wait for events and reload files */
+static int watch_thread(void *data)
+{
+	struct purpl_watch *watch = data;
+	struct pollfd pfd;
+
+	purpl_profile_name_thread("purpl_watch");
+	pfd.fd = watch->fd;
+	pfd.events = POLLIN;
+	while (!SDL_AtomicGet(&watch->quit)) {
+		/* Wake up at least once per delay to check for settled files */
+		if (poll(&pfd, 1, watch->delay) > 0)
+			read_events(watch);
+		reload_pending(watch);
+	}
+
+	/* Give back what this thread was holding on to */
+	purpl_flush_pool_cache();
+	purpl_free_scratch_arena();
+	purpl_profile_release_thread();
+
+	return 0;
+}
+
+/* Watch the directories of any assets loaded since last time */
+static void sync_watches(struct purpl_inst *inst, bool force)
+{
+	struct purpl_watch *watch = inst->watch;
+	struct purpl_asset *ast;
+	char *dir;
+	char *sep;
+	int wd;
+	size_t i;
+
+	/* Every new asset is a miss, so there's nothing to do without one */
+	if (!force && watch->synced == inst->cache.misses)
+		return;
+	watch->synced = inst->cache.misses;
+
+	SDL_LockMutex(watch->lock);
+	for (i = 0; i < stbds_shlenu(inst->assets); i++) {
+		ast = inst->assets[i].value;
+		if (ast->embedded)
+			continue;
+		stbds_shput(watch->files, ast->name, ast->mapped);
+
+		/* Get the directory */
+		sep = strrchr(ast->name, '/');
+		if (!sep)
+			continue;
+		dir = PURPL_CALLOC(sep - ast->name + 1, char);
+		if (!dir)
+			continue;
+		memcpy(dir, ast->name, sep - ast->name);
+
+		/* Watch it if it isn't already */
+		if (stbds_shgeti(watch->watched, dir) < 0) {
+			wd = inotify_add_watch(watch->fd, dir,
+					       WATCH_CHANGED | WATCH_LISTING);
+			if (wd >= 0) {
+				stbds_shput(watch->watched, dir, wd);
+				stbds_hmput(watch->dirs, wd, dir);
+				continue;
+			}
+		}
+		free(dir);
+	}
+	SDL_UnlockMutex(watch->lock);
+}
+#endif
+
+int purpl_inst_start_watching(struct purpl_inst *inst, uint delay)
+{
+#ifdef __linux__
+	struct purpl_watch *watch;
+	int ___errno;
+
+	PURPL_SAVE_ERRNO(___errno);
+
+	/* Check arguments */
+	if (!inst || !inst->info) {
+		errno = EINVAL;
+		return errno;
+	}
+	if (inst->watch) {
+		errno = EEXIST;
+		return errno;
+	}
+
+	/* Allocate the structure */
+	watch = PURPL_CALLOC(1, struct purpl_watch);
+	if (!watch)
+		return errno;
+	watch->delay = delay ? delay : PURPL_WATCH_DEFAULT_DELAY;
+	stbds_sh_new_strdup(watch->watched);
+	stbds_sh_new_strdup(watch->files);
+	stbds_sh_new_strdup(watch->pending);
+
+	/* Create the inotify instance and lock */
+	watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (watch->fd < 0) {
+		free(watch);
+		return errno;
+	}
+	watch->lock = SDL_CreateMutex();
+	if (!watch->lock) {
+		close(watch->fd);
+		free(watch);
+		errno = ENOMEM;
+		return errno;
+	}
+
+	/* Watch what's already loaded, then start the thread */
+	inst->watch = watch;
+	sync_watches(inst, true);
+	watch->thread = SDL_CreateThread(watch_thread, "purpl_watch", watch);
+	if (!watch->thread) {
+		purpl_inst_stop_watching(inst);
+		errno = EAGAIN;
+		return errno;
+	}
+
+	PURPL_RESTORE_ERRNO(___errno);
+
+	return 0;
+#else
+	NOPE(inst);
+	NOPE(delay);
+	errno = EOPNOTSUPP;
+	return errno;
+#endif
+}
+
+int purpl_inst_add_reload_callback(struct purpl_inst *inst,
+				   purpl_reload_callback callback, void *user)
+{
+	struct purpl_reload_callback_info info;
+
+	/* Check arguments */
+	if (!inst || !inst->watch || !callback) {
+		errno = EINVAL;
+		return errno;
+	}
+
+	info.callback = callback;
+	info.user = user;
+	stbds_arrput(inst->watch->callbacks, info);
+
+	return 0;
+}
+
+void purpl_inst_reload_assets(struct purpl_inst *inst)
+{
+#ifdef __linux__
+	struct purpl_asset **ready;
+	char **changed_dirs;
+	struct purpl_asset *ast;
+	struct purpl_asset *new_ast;
+	struct purpl_asset tmp;
+	ptrdiff_t idx;
+	size_t i;
+	size_t j;
+
+	/* Check arguments */
+	if (!inst || !inst->watch)
+		return;
+
+	/* Pick up new assets */
+	sync_watches(inst, false);
+
+	/* Take what the thread has for us */
+	SDL_LockMutex(inst->watch->lock);
+	ready = inst->watch->ready;
+	inst->watch->ready = NULL;
+	changed_dirs = inst->watch->changed_dirs;
+	inst->watch->changed_dirs = NULL;
+	SDL_UnlockMutex(inst->watch->lock);
+
+	/* Forget stale directory listings */
+	for (i = 0; i < stbds_arrlenu(changed_dirs); i++) {
+		purpl_refresh_search_paths(inst->info->paths, changed_dirs[i]);
+		free(changed_dirs[i]);
+	}
+	stbds_arrfree(changed_dirs);
+
+	for (i = 0; i < stbds_arrlenu(ready); i++) {
+		new_ast = ready[i];
+
+		/* It might've been evicted since */
+		idx = stbds_shgeti(inst->assets, new_ast->name);
+		if (idx < 0) {
+			purpl_free_asset(new_ast);
+			continue;
+		}
+		ast = inst->assets[idx].value;
+
+		/* Swap the contents, so the old ones get freed */
+		inst->cache.resident -= ast->size;
+		inst->cache.resident += new_ast->size;
+		tmp = *ast;
+		ast->data = new_ast->data;
+		ast->size = new_ast->size;
+		ast->mapping = new_ast->mapping;
+		ast->mapped = new_ast->mapped;
+		new_ast->data = tmp.data;
+		new_ast->size = tmp.size;
+		new_ast->mapping = tmp.mapping;
+		new_ast->mapped = tmp.mapped;
+		purpl_free_asset(new_ast);
+
+		/* Let everyone know */
+		for (j = 0; j < stbds_arrlenu(inst->watch->callbacks); j++)
+			inst->watch->callbacks[j].callback(
+				inst, inst->assets[idx].key,
+				inst->watch->callbacks[j].user);
+	}
+
+	stbds_arrfree(ready);
+#else
+	NOPE(inst);
+#endif
+}
+
+void purpl_inst_stop_watching(struct purpl_inst *inst)
+{
+#ifdef __linux__
+	struct purpl_watch *watch;
+	size_t i;
+
+	/* Check arguments */
+	if (!inst || !inst->watch) {
+		errno = EINVAL;
+		return;
+	}
+	watch = inst->watch;
+
+	/* Stop the thread */
+	SDL_AtomicSet(&watch->quit, 1);
+	if (watch->thread)
+		SDL_WaitThread(watch->thread, NULL);
+
+	/* Free what it left behind */
+	for (i = 0; i < stbds_arrlenu(watch->ready); i++)
+		purpl_free_asset(watch->ready[i]);
+	for (i = 0; i < stbds_arrlenu(watch->changed_dirs); i++)
+		free(watch->changed_dirs[i]);
+	for (i = 0; i < stbds_hmlenu(watch->dirs); i++)
+		free(watch->dirs[i].value);
+
+	/* Free everything else */
+	stbds_arrfree(watch->ready);
+	stbds_arrfree(watch->changed_dirs);
+	stbds_arrfree(watch->callbacks);
+	stbds_hmfree(watch->dirs);
+	stbds_shfree(watch->watched);
+	stbds_shfree(watch->files);
+	stbds_shfree(watch->pending);
+	SDL_DestroyMutex(watch->lock);
+	close(watch->fd);
+	free(watch);
+	inst->watch = NULL;
+#else
+	NOPE(inst);
+#endif
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,327 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <stb_ds.h>
+
+#include <purpl/types.h>
+#include <purpl/util.h>
+
+/*
+ * These have to match purpl/log.h, which can't be included here since it
+ *  needs SDL
+ */
+#define LOG_MAGIC "PLOG"
+#define LOG_VERSION 1
+#define LOG_STRING 0
+#define LOG_MESSAGE 1
+
+void usage(const char *prog);
+bool decode_message(FILE *fp, char **strings, const char *data, size_t size,
+		    size_t *pos);
+
+/* The text for each message level, the same as the logger's */
+static const char *level_prefixes[] = {
+	"[???] ", "[fatal] ", "[error] ", "[warning] ", "[info] ", "[debug] ",
+};
+
+int main(int argc, char *argv[])
+{
+	char *data;
+	size_t size;
+	bool mapped = false;
+	FILE *fp;
+	char **strings = NULL;
+	char *str;
+	size_t pos;
+	u32 version;
+	u32 id;
+	u16 len;
+	size_t count = 0;
+	size_t i;
+	int ret = 0;
+
+	/* Check arguments */
+	if (argc < 2)
+		usage(argv[0]);
+
+	/* Read the log */
+	data = purpl_read_file(&size, NULL, &mapped, "%s", argv[1]);
+	if (!data) {
+		fprintf(stderr, "Error: failed to read file %s: %s\n", argv[1],
+			strerror(errno));
+		return errno;
+	}
+
+	/* Check the header */
+	if (size < 8 || memcmp(data, LOG_MAGIC, 4) != 0) {
+		fprintf(stderr, "Error: %s isn't a binary log\n", argv[1]);
+		mapped ? (void)0 : free(data);
+		return EILSEQ;
+	}
+	memcpy(&version, data + 4, sizeof(u32));
+	if (version != LOG_VERSION) {
+		fprintf(stderr, "Error: %s is version %u, expected %u\n",
+			argv[1], version, LOG_VERSION);
+		mapped ? (void)0 : free(data);
+		return EILSEQ;
+	}
+
+	/* Open the output */
+	fp = (argc > 2) ? fopen(argv[2], "wb") : stdout;
+	if (!fp) {
+		ret = errno;
+		fprintf(stderr, "Error: failed to truncate file: %s\n",
+			strerror(errno));
+		mapped ? (void)0 : free(data);
+		return ret;
+	}
+
+	/* Go through each entry */
+	pos = 8;
+	while (pos < size) {
+		switch (data[pos++]) {
+		case LOG_STRING:
+			/* Remember the string under its ID */
+			if (pos + sizeof(u32) + sizeof(u16) > size)
+				goto truncated;
+			memcpy(&id, data + pos, sizeof(u32));
+			memcpy(&len, data + pos + sizeof(u32), sizeof(u16));
+			pos += sizeof(u32) + sizeof(u16);
+			if (pos + len > size || id != stbds_arrlenu(strings))
+				goto truncated;
+			str = calloc(len + 1, sizeof(char));
+			if (!str) {
+				fprintf(stderr, "Error: out of memory\n");
+				ret = ENOMEM;
+				goto done;
+			}
+			memcpy(str, data + pos, len);
+			stbds_arrput(strings, str);
+			pos += len;
+			break;
+		case LOG_MESSAGE:
+			if (!decode_message(fp, strings, data, size, &pos))
+				goto truncated;
+			count++;
+			break;
+		default:
+			goto truncated;
+		}
+	}
+
+	fprintf(stderr, "Decoded %zu messages\n", count);
+	goto done;
+
+truncated:
+	fprintf(stderr,
+		"Error: %s is truncated or corrupt after %zu messages (at "
+		"offset %zu)\n",
+		argv[1], count, pos);
+	ret = EILSEQ;
+
+done:
+	for (i = 0; i < stbds_arrlenu(strings); i++)
+		free(strings[i]);
+	stbds_arrfree(strings);
+	if (fp != stdout)
+		fclose(fp);
+	mapped ? (void)0 : free(data);
+
+	return ret;
+}
+
+void usage(const char *prog)
+{
+	printf("Usage: %s <binary log> [<output>]\n", prog);
+	exit(1);
+}
+
+/* Take 8 bytes from the arguments, if there are that many */
+static bool take_u64(const char *args, size_t size, size_t *pos, u64 *val)
+{
+	if (*pos + sizeof(u64) > size)
+		return false;
+	memcpy(val, args + *pos, sizeof(u64));
+	*pos += sizeof(u64);
+
+	return true;
+}
+
+/* Format a message from its format string and encoded arguments */
+static void format_message(FILE *fp, const char *fmt, const char *args,
+			   size_t size)
+{
+	struct purpl_fmt_spec spec;
+	char spec_fmt[64];
+	char *str;
+	const char *next;
+	const char *p;
+	size_t pos;
+	size_t room;
+	size_t i;
+	int n;
+	u64 val;
+	u64 star;
+	double dbl;
+	u16 len;
+
+	pos = 0;
+	while ((next = purpl_next_fmt_spec(fmt, &spec))) {
+		/* Copy the text before the specification */
+		fwrite(fmt, sizeof(char), spec.start - fmt, fp);
+		fmt = next;
+		if (spec.arg == PURPL_FMT_NONE) {
+			if (spec.conv == '%')
+				fputc('%', fp);
+			continue;
+		}
+
+		/* Rebuild the specification, with the *s filled in */
+		i = 0;
+		spec_fmt[i++] = '%';
+		for (p = spec.start + 1; p < spec.start + 1 + spec.body_len;
+		     p++) {
+			if (*p == '*') {
+				if (!take_u64(args, size, &pos, &star))
+					goto missing;
+				room = sizeof(spec_fmt) - i - 4;
+				if (room < 2)
+					continue;
+
+				/* Only count what actually fit */
+				n = snprintf(spec_fmt + i, room, "%d",
+					     (int)(s64)star);
+				if (n > 0)
+					i += PURPL_MIN((size_t)n, room - 1);
+			} else if (i < sizeof(spec_fmt) - 4) {
+				spec_fmt[i++] = *p;
+			}
+		}
+
+		/* Add the conversion, with the size it was stored as */
+		switch (spec.arg) {
+		case PURPL_FMT_INT:
+		case PURPL_FMT_UINT:
+			if (!take_u64(args, size, &pos, &val))
+				goto missing;
+			if (spec.conv == 'c') {
+				spec_fmt[i++] = 'c';
+				spec_fmt[i] = 0;
+				fprintf(fp, spec_fmt, (int)val);
+			} else {
+				spec_fmt[i++] = 'l';
+				spec_fmt[i++] = 'l';
+				spec_fmt[i++] = spec.conv;
+				spec_fmt[i] = 0;
+				fprintf(fp, spec_fmt, val);
+			}
+			break;
+		case PURPL_FMT_DOUBLE:
+			if (!take_u64(args, size, &pos, &val))
+				goto missing;
+			memcpy(&dbl, &val, sizeof(double));
+			spec_fmt[i++] = spec.conv;
+			spec_fmt[i] = 0;
+			fprintf(fp, spec_fmt, dbl);
+			break;
+		case PURPL_FMT_POINTER:
+			if (!take_u64(args, size, &pos, &val))
+				goto missing;
+			spec_fmt[i++] = 'p';
+			spec_fmt[i] = 0;
+			fprintf(fp, spec_fmt, (void *)(uintptr_t)val);
+			break;
+		case PURPL_FMT_STRING:
+			if (pos + sizeof(u16) > size)
+				goto missing;
+			memcpy(&len, args + pos, sizeof(u16));
+			pos += sizeof(u16);
+			len = PURPL_MIN(len, size - pos);
+			str = calloc(len + 1, sizeof(char));
+			if (!str)
+				goto missing;
+			memcpy(str, args + pos, len);
+			pos += len;
+			spec_fmt[i++] = 's';
+			spec_fmt[i] = 0;
+			fprintf(fp, spec_fmt, str);
+			free(str);
+			break;
+		default:
+			break;
+		}
+
+		continue;
+	missing:
+		/* The arguments didn't all fit when the message was logged */
+		fputs("<?>", fp);
+	}
+
+	/* Copy the rest of the text */
+	fputs(fmt, fp);
+}
+
+bool decode_message(FILE *fp, char **strings, const char *data, size_t size,
+		    size_t *pos)
+{
+	const char *p;
+	u8 level;
+	u32 fmt_id;
+	u32 file_id;
+	u32 line;
+	u64 time64;
+	u16 len;
+	time_t rawtime;
+	struct tm unknown;
+	struct tm *now;
+	const char *fmt;
+
+	/* Read the header */
+	if (*pos + 1 + sizeof(u32) * 3 + sizeof(u64) + sizeof(u16) > size)
+		return false;
+	p = data + *pos;
+	level = *p++;
+	memcpy(&fmt_id, p, sizeof(u32));
+	p += sizeof(u32);
+	memcpy(&file_id, p, sizeof(u32));
+	p += sizeof(u32);
+	memcpy(&line, p, sizeof(u32));
+	p += sizeof(u32);
+	memcpy(&time64, p, sizeof(u64));
+	p += sizeof(u64);
+	memcpy(&len, p, sizeof(u16));
+	p += sizeof(u16);
+	if (p + len > data + size || fmt_id >= stbds_arrlenu(strings) ||
+	    file_id >= stbds_arrlenu(strings))
+		return false;
+	*pos = p - data + len;
+
+	/* Get the time, the same way the logger does */
+	rawtime = time64;
+	now = localtime(&rawtime);
+	if (!now) {
+		memset(&unknown, 0, sizeof(struct tm));
+		now = &unknown;
+	}
+	if (now->tm_mon == 3 && now->tm_mday == 1) {
+		now->tm_mon = 2;
+		now->tm_mday = 32;
+	}
+
+	/* Write the header and the message */
+	fprintf(fp, "%s%s:%u %d:%d:%d %02d/%02d/%04d: ",
+		level_prefixes[(level < PURPL_ARRAY_SIZE(level_prefixes)) ?
+				       level :
+				       0],
+		strings[file_id], line, now->tm_hour, now->tm_min, now->tm_sec,
+		now->tm_mday, now->tm_mon + 1, now->tm_year + 1900);
+	fmt = strings[fmt_id];
+	format_message(fp, fmt, p, len);
+	if (!*fmt || fmt[strlen(fmt) - 1] != '\n')
+		fputc('\n', fp);
+
+	return true;
+}
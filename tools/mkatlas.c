@@ -0,0 +1,509 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include <stb_ds.h>
+#include <stb_image.h>
+
+#include <purpl/atlas.h>
+#include <purpl/types.h>
+#include <purpl/util.h>
+
+/* The default size of each page */
+#define DEFAULT_PAGE_SIZE 2048
+
+/* The default space between sprites */
+#define DEFAULT_PADDING 1
+
+/* An image that's been loaded */
+struct image {
+	char *name;
+	u8 *pixels;
+	u32 w;
+	u32 h;
+	u32 page;
+	u32 x;
+	u32 y;
+};
+
+/* A segment of the top of what's been packed into a page so far */
+struct skyline_node {
+	u32 x;
+	u32 y;
+	u32 w;
+};
+
+/* A page being packed */
+struct page {
+	struct skyline_node *skyline;
+	u8 *pixels;
+};
+
+void usage(const char *prog);
+int make_atlas(const char *dir, const char *output_name, u32 page_size,
+	       u32 padding);
+
+int main(int argc, char *argv[])
+{
+	u32 page_size = DEFAULT_PAGE_SIZE;
+	u32 padding = DEFAULT_PADDING;
+	int i;
+
+	/* Check for options */
+	for (i = 1; i < argc - 2; i += 2) {
+		if (strcmp(argv[i], "-s") == 0)
+			page_size = (u32)strtoul(argv[i + 1], NULL, 10);
+		else if (strcmp(argv[i], "-p") == 0)
+			padding = (u32)strtoul(argv[i + 1], NULL, 10);
+		else
+			break;
+	}
+	if (argc - i != 2 || !page_size ||
+	    page_size > PURPL_ATLAS_MAX_PAGE_SIZE)
+		usage(argv[0]);
+
+	return make_atlas(argv[i], argv[i + 1], page_size, padding);
+}
+
+void usage(const char *prog)
+{
+	printf("Usage: %s [-s <page size>] [-p <padding>] <image directory> "
+	       "<output atlas>\n",
+	       PURPL_GET_BASENAME(prog));
+	exit(EINVAL);
+}
+
+/* Load an image, keeping it if it is one */
+static int add_image(struct image **images, const char *path,
+		     const char *name)
+{
+	struct image image = { 0 };
+	char *ext;
+	int w;
+	int h;
+	int channels;
+
+	image.pixels = stbi_load(path, &w, &h, &channels, 4);
+	if (!image.pixels) {
+		printf("Skipping %s (%s)\n", name, stbi_failure_reason());
+		return 0;
+	}
+	image.w = (u32)w;
+	image.h = (u32)h;
+
+	/* Sprites are named by their path without the extension */
+	image.name = PURPL_CALLOC(strlen(name) + 1, char);
+	if (!image.name) {
+		stbi_image_free(image.pixels);
+		return errno;
+	}
+	strcpy(image.name, name);
+	ext = strrchr(image.name, '.');
+	if (ext && !strchr(ext, '/'))
+		*ext = 0;
+
+	printf("Adding %s (%ux%u)\n", image.name, image.w, image.h);
+	stbds_arrput(*images, image);
+	return 0;
+}
+
+/* Load every image under a directory */
+static int add_dir(struct image **images, const char *root, const char *rel)
+{
+	char *path;
+	char *name;
+	s64 path_len;
+	s64 name_len;
+	bool is_dir;
+	int err = 0;
+#ifdef _WIN32
+	WIN32_FIND_DATAA ent;
+	HANDLE find;
+	char *pattern;
+	s64 pattern_len;
+
+	/* Start listing the directory */
+	pattern = purpl_fmt_text(&pattern_len, "%s%s%s/*", root,
+				 (*rel) ? "/" : "", rel);
+	find = FindFirstFileA(pattern, &ent);
+	(pattern_len > 0) ? free(pattern) : (void)0;
+	if (find == INVALID_HANDLE_VALUE) {
+		fprintf(stderr, "Error: failed to open directory %s/%s\n", root,
+			rel);
+		return ENOENT;
+	}
+
+	do {
+		const char *ent_name = ent.cFileName;
+
+		is_dir = ent.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY;
+#else
+	DIR *dir;
+	struct dirent *ent;
+	struct stat st;
+
+	/* Start listing the directory */
+	path = purpl_fmt_text(&path_len, "%s%s%s", root, (*rel) ? "/" : "",
+			      rel);
+	dir = opendir(path);
+	(path_len > 0) ? free(path) : (void)0;
+	if (!dir) {
+		fprintf(stderr, "Error: failed to open directory %s/%s: %s\n",
+			root, rel, strerror(errno));
+		return errno;
+	}
+
+	while ((ent = readdir(dir))) {
+		const char *ent_name = ent->d_name;
+#endif
+		/* Skip . and .. */
+		if (strcmp(ent_name, ".") == 0 || strcmp(ent_name, "..") == 0)
+			continue;
+
+		/* Build the path on disk and the name in the atlas */
+		name = purpl_fmt_text(&name_len, "%s%s%s", rel,
+				      (*rel) ? "/" : "", ent_name);
+		path = purpl_fmt_text(&path_len, "%s/%s", root, name);
+#ifndef _WIN32
+		is_dir = stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+#endif
+
+		/* Recurse into directories, try to load everything else */
+		if (is_dir)
+			err = add_dir(images, root, name);
+		else
+			err = add_image(images, path, name);
+		(name_len > 0) ? free(name) : (void)0;
+		(path_len > 0) ? free(path) : (void)0;
+		if (err)
+			break;
+#ifdef _WIN32
+	} while (FindNextFileA(find, &ent));
+	FindClose(find);
+#else
+	}
+	closedir(dir);
+#endif
+
+	return err;
+}
+
+/*
+ * Find where a rectangle would sit if its left edge was at a node, returning
+ *  false if it doesn't fit
+ */
+static bool skyline_fit(struct skyline_node *skyline, size_t index, u32 w,
+			u32 h, u32 size, u32 *y)
+{
+	u32 x = skyline[index].x;
+	u32 left = w;
+
+	if (x + w > size)
+		return false;
+
+	/* It has to sit on the highest node under it */
+	*y = 0;
+	while (left) {
+		*y = PURPL_MAX(*y, skyline[index].y);
+		if (*y + h > size)
+			return false;
+		left -= PURPL_MIN(left, skyline[index].w);
+		index++;
+	}
+
+	return true;
+}
+
+/* Add a rectangle to the skyline, then flatten it */
+static void skyline_add(struct skyline_node **skyline, size_t index, u32 x,
+			u32 y, u32 w, u32 h)
+{
+	struct skyline_node node = { x, y + h, w };
+	struct skyline_node *next;
+	u32 shrink;
+	size_t i;
+
+	stbds_arrins(*skyline, index, node);
+
+	/* Cut away whatever the new node covers */
+	i = index + 1;
+	while (i < stbds_arrlenu(*skyline)) {
+		next = &(*skyline)[i];
+		if (next->x >= x + w)
+			break;
+		shrink = x + w - next->x;
+		if (shrink >= next->w) {
+			stbds_arrdel(*skyline, i);
+			continue;
+		}
+		next->x += shrink;
+		next->w -= shrink;
+		break;
+	}
+
+	/* Merge neighbours at the same height */
+	i = 0;
+	while (i + 1 < stbds_arrlenu(*skyline)) {
+		if ((*skyline)[i].y == (*skyline)[i + 1].y) {
+			(*skyline)[i].w += (*skyline)[i + 1].w;
+			stbds_arrdel(*skyline, i + 1);
+		} else {
+			i++;
+		}
+	}
+}
+
+/* Put a rectangle on a page, bottom-left, returning false if it won't fit */
+static bool skyline_pack(struct page *page, u32 size, u32 w, u32 h, u32 *x,
+			 u32 *y)
+{
+	size_t best = SIZE_MAX;
+	u32 best_top = UINT32_MAX;
+	u32 best_w = UINT32_MAX;
+	u32 top;
+	size_t i;
+
+	for (i = 0; i < stbds_arrlenu(page->skyline); i++) {
+		if (!skyline_fit(page->skyline, i, w, h, size, &top))
+			continue;
+
+		/* Keep it low, then in the narrowest gap */
+		if (top + h < best_top ||
+		    (top + h == best_top && page->skyline[i].w < best_w)) {
+			best = i;
+			best_top = top + h;
+			best_w = page->skyline[i].w;
+			*y = top;
+		}
+	}
+	if (best == SIZE_MAX)
+		return false;
+
+	*x = page->skyline[best].x;
+	skyline_add(&page->skyline, best, *x, *y, w, h);
+	return true;
+}
+
+/* Sort images by height, then width, biggest first */
+static int compare_size(const void *a, const void *b)
+{
+	const struct image *x = *(const struct image *const *)a;
+	const struct image *y = *(const struct image *const *)b;
+
+	if (x->h != y->h)
+		return (x->h < y->h) - (x->h > y->h);
+	return (x->w < y->w) - (x->w > y->w);
+}
+
+/* Sort images by name, which is how they're looked up */
+static int compare_name(const void *a, const void *b)
+{
+	return strcmp(((const struct image *)a)->name,
+		      ((const struct image *)b)->name);
+}
+
+/* Pack the images into pages */
+static int pack_images(struct image *images, struct page **pages, u32 size,
+		       u32 padding)
+{
+	struct image **order;
+	struct page page;
+	struct skyline_node node = { 0, 0, 0 };
+	size_t count = stbds_arrlenu(images);
+	size_t i;
+	size_t j;
+	u32 row;
+
+	/* The biggest images go first, so the small ones fill the gaps */
+	order = PURPL_CALLOC(PURPL_MAX(count, 1), struct image *);
+	if (!order)
+		return errno;
+	for (i = 0; i < count; i++)
+		order[i] = &images[i];
+	qsort(order, count, sizeof(struct image *), compare_size);
+
+	for (i = 0; i < count; i++) {
+		if (order[i]->w + padding > size ||
+		    order[i]->h + padding > size) {
+			fprintf(stderr,
+				"Error: %s (%ux%u) doesn't fit on a %ux%u "
+				"page\n",
+				order[i]->name, order[i]->w, order[i]->h, size,
+				size);
+			free(order);
+			return E2BIG;
+		}
+
+		/* Try every page, then start a new one */
+		for (j = 0; j < stbds_arrlenu(*pages); j++) {
+			if (skyline_pack(&(*pages)[j], size,
+					 order[i]->w + padding,
+					 order[i]->h + padding, &order[i]->x,
+					 &order[i]->y))
+				break;
+		}
+		if (j == stbds_arrlenu(*pages)) {
+			page.skyline = NULL;
+			page.pixels = PURPL_CALLOC((size_t)size * size * 4, u8);
+			if (!page.pixels) {
+				free(order);
+				return errno;
+			}
+			node.w = size;
+			stbds_arrput(page.skyline, node);
+			stbds_arrput(*pages, page);
+			skyline_pack(&(*pages)[j], size, order[i]->w + padding,
+				     order[i]->h + padding, &order[i]->x,
+				     &order[i]->y);
+		}
+		order[i]->page = (u32)j;
+
+		/* Copy the image in */
+		for (row = 0; row < order[i]->h; row++)
+			memcpy((*pages)[j].pixels +
+				       ((size_t)(order[i]->y + row) * size +
+					order[i]->x) *
+					       4,
+			       order[i]->pixels + (size_t)row * order[i]->w * 4,
+			       (size_t)order[i]->w * 4);
+	}
+
+	free(order);
+	return 0;
+}
+
+/* Write the atlas */
+static size_t write_atlas(FILE *fp, struct image *images, struct page *pages,
+			  u32 size)
+{
+	static const char zeroes[PURPL_ATLAS_ALIGN];
+	struct purpl_atlas_header hdr = { 0 };
+	struct purpl_atlas_sprite sprite;
+	u64 stride;
+	u64 pos;
+	u32 name_offset;
+	size_t i;
+
+	/* Work out where everything goes */
+	memcpy(hdr.magic, PURPL_ATLAS_MAGIC, 4);
+	hdr.version = PURPL_ATLAS_VERSION;
+	hdr.page_count = (u32)stbds_arrlenu(pages);
+	hdr.page_width = size;
+	hdr.page_height = size;
+	hdr.sprite_count = (u32)stbds_arrlenu(images);
+	hdr.sprites_offset = sizeof(struct purpl_atlas_header);
+	hdr.names_offset = hdr.sprites_offset +
+			   hdr.sprite_count * sizeof(struct purpl_atlas_sprite);
+	for (i = 0; i < stbds_arrlenu(images); i++)
+		hdr.names_size += strlen(images[i].name) + 1;
+	stride = PURPL_ATLAS_PAGE_STRIDE(size, size);
+	hdr.pages_offset = (hdr.names_offset + hdr.names_size +
+			    PURPL_ATLAS_ALIGN - 1) &
+			   ~((u64)PURPL_ATLAS_ALIGN - 1);
+	hdr.size = hdr.pages_offset + hdr.page_count * stride;
+
+	/* Write the header and the sprites */
+	fwrite(&hdr, sizeof(struct purpl_atlas_header), 1, fp);
+	name_offset = 0;
+	for (i = 0; i < stbds_arrlenu(images); i++) {
+		sprite.name_offset = name_offset;
+		sprite.name_len = (u32)strlen(images[i].name);
+		sprite.page = images[i].page;
+		sprite.x = images[i].x;
+		sprite.y = images[i].y;
+		sprite.w = images[i].w;
+		sprite.h = images[i].h;
+		sprite.u0 = (float)images[i].x / size;
+		sprite.v0 = (float)images[i].y / size;
+		sprite.u1 = (float)(images[i].x + images[i].w) / size;
+		sprite.v1 = (float)(images[i].y + images[i].h) / size;
+		fwrite(&sprite, sizeof(struct purpl_atlas_sprite), 1, fp);
+		name_offset += sprite.name_len + 1;
+	}
+
+	/* Then the names */
+	for (i = 0; i < stbds_arrlenu(images); i++)
+		fwrite(images[i].name, 1, strlen(images[i].name) + 1, fp);
+
+	/* Then the pages, each aligned */
+	pos = hdr.names_offset + hdr.names_size;
+	for (i = 0; i < stbds_arrlenu(pages); i++) {
+		fwrite(zeroes, 1, hdr.pages_offset + i * stride - pos, fp);
+		fwrite(pages[i].pixels, 1, (size_t)size * size * 4, fp);
+		pos = hdr.pages_offset + i * stride + (u64)size * size * 4;
+	}
+	fwrite(zeroes, 1, hdr.size - pos, fp);
+	if (ferror(fp))
+		return 0;
+
+	return hdr.size;
+}
+
+int make_atlas(const char *dir, const char *output_name, u32 page_size,
+	       u32 padding)
+{
+	struct image *images = NULL;
+	struct page *pages = NULL;
+	FILE *fp;
+	size_t size;
+	size_t i;
+	int err;
+
+	/* Load the images */
+	printf("Loading images from %s\n", dir);
+	err = add_dir(&images, dir, "");
+	if (err)
+		return err;
+
+	/* Pack them, then put them in the order they're looked up in */
+	printf("Packing %zu images into %ux%u pages...\n",
+	       stbds_arrlenu(images), page_size, page_size);
+	err = pack_images(images, &pages, page_size, padding);
+	if (err)
+		return err;
+	qsort(images, stbds_arrlenu(images), sizeof(struct image),
+	      compare_name);
+
+	/* Open the output file */
+	fp = fopen(output_name, "wb");
+	if (!fp) {
+		fprintf(stderr, "Error: failed to truncate file: %s\n",
+			strerror(errno));
+		return errno;
+	}
+
+	/* Write the atlas */
+	printf("Writing atlas to %s...\n", output_name);
+	size = write_atlas(fp, images, pages, page_size);
+	fclose(fp);
+	if (!size) {
+		fprintf(stderr, "Error: couldn't write to file: %s\n",
+			strerror(errno));
+		return errno;
+	}
+
+	printf("Done! Output file is %s, containing %zu sprites on %zu pages "
+	       "in %zu bytes.\n",
+	       output_name, stbds_arrlenu(images), stbds_arrlenu(pages), size);
+
+	/* Free everything */
+	for (i = 0; i < stbds_arrlenu(images); i++) {
+		free(images[i].name);
+		stbi_image_free(images[i].pixels);
+	}
+	stbds_arrfree(images);
+	for (i = 0; i < stbds_arrlenu(pages); i++) {
+		stbds_arrfree(pages[i].skyline);
+		free(pages[i].pixels);
+	}
+	stbds_arrfree(pages);
+
+	return 0;
+}
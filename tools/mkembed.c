@@ -2,15 +2,27 @@
 #include <stdlib.h>
 #include <stdarg.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include <stb_ds.h>
+
+#include <purpl/pack.h>
 #include <purpl/types.h>
 #include <purpl/util.h>
 
 void usage(const char *prog);
+size_t write_c(FILE *fp, const char *input, size_t input_len,
+	       const char *sym_base);
+size_t write_asm(FILE *fp, const char *input_name, const char *sym_base);
+int make_pack(const char *dir, const char *output_name, bool compress);
 
 int main(int argc, char *argv[])
 {
-	size_t i;
-	size_t j;
 	size_t k;
 	char *sym_base;
 	char *input;
@@ -19,44 +31,39 @@ int main(int argc, char *argv[])
 	char *input_name;
 	bool have_custom_output;
 	bool mapped = false;
+	bool assembly = false;
 	char *output_name;
 
 	/* Check arguments */
 	if (argc < 3)
 		usage(argv[0]);
 
+	/* Check if we're making a pack instead */
+	if (strcmp(argv[1], "-p") == 0) {
+		if (argc > 4 && strcmp(argv[2], "-z") == 0)
+			return make_pack(argv[3], argv[4], true);
+		else if (argc > 3)
+			return make_pack(argv[2], argv[3], false);
+		usage(argv[0]);
+	}
+
+	/* Check if we're making an assembly file */
+	if (strcmp(argv[1], "-s") == 0) {
+		if (argc < 4)
+			usage(argv[0]);
+		assembly = true;
+		argv++;
+		argc--;
+	}
+
 	/* Make an alias to our input file and the base name for the symbols */
 	input_name = argv[1];
 	sym_base = argv[2];
 
 	/* Check if there's an alternate output file */
 	have_custom_output = (argc > 3);
-
-	/* Make a separate buffer */
-	if (have_custom_output) {
-		output_name = argv[3];
-	} else {
-		/* Allocate a buffer */
-		output_name = PURPL_CALLOC(strlen("embed.c") + 1, char);
-		if (!output_name) {
-			fprintf(stderr,
-				"Error: failed to allocate buffer: %s\n",
-				strerror(errno));
-			return errno;
-		}
-
-		/* Copy in the text */
-		strcpy(output_name, "embed.c");
-	}
-
-	/* Use my handy function to read the input file */
-	input = purpl_read_file(&input_len, NULL, &mapped, "%s", input_name);
-	if (!input) {
-		fprintf(stderr, "Error: failed to read file: %s\n",
-			strerror(errno));
-		return errno;
-	}
-	printf("Using input file \"%s\" (%zu bytes)\n", input_name, input_len);
+	output_name = have_custom_output ? argv[3] :
+					   (assembly ? "embed.S" : "embed.c");
 
 	/* Open the output file */
 	fp = fopen(output_name, "wb");
@@ -66,95 +73,345 @@ int main(int argc, char *argv[])
 		return errno;
 	}
 
-	/* Write the start of the array */
-	printf("Writing data to %s...\n", output_name);
-	i = fprintf(fp, "const unsigned char %s_start[] = {\n\t", sym_base);
-	if (!i) {
+	if (assembly) {
+		/* The assembler does the reading, so nothing has to be loaded */
+		printf("Writing assembly to %s...\n", output_name);
+		k = write_asm(fp, input_name, sym_base);
+	} else {
+		/* Use my handy function to read the input file */
+		input = purpl_read_file(&input_len, NULL, &mapped, "%s",
+					input_name);
+		if (!input) {
+			fprintf(stderr, "Error: failed to read file: %s\n",
+				strerror(errno));
+			return errno;
+		}
+		printf("Using input file \"%s\" (%zu bytes)\n", input_name,
+		       input_len);
+
+		printf("Writing data to %s...\n", output_name);
+		k = write_c(fp, input, input_len, sym_base);
+		free(input);
+	}
+	if (!k) {
 		fprintf(stderr, "Error: couldn't write to file: %s\n",
 			strerror(errno));
 		return errno;
 	}
 
-	/* Now write the individual bytes */
-	j = 0;
-	k = i;
-	for (i = 0; i < input_len; i++) {
-		errno = 0;
-		j += fprintf(fp, "0x%.2X", input[i] & 0xFF);
-		if (i < input_len - 1)
-			j += fprintf(fp, ",");
-		else
-			fprintf(fp, "\n");
+	/* Close the file */
+	fclose(fp);
 
-		/* Check for an error */
-		if (errno) {
-			fprintf(stderr, "Error: couldn't write to file: %s\n",
-				strerror(errno));
-			return errno;
-		}
+	/* And we're done */
+	printf("Done! Output file is %s, containing %zu bytes.\n", output_name,
+	       k);
+	return 0;
+}
+
+size_t write_c(FILE *fp, const char *input, size_t input_len,
+	       const char *sym_base)
+{
+	static const char hex[] = "0123456789ABCDEF";
+	char line[PURPL_LARGE_BUF];
+	size_t i;
+	size_t j;
+	size_t k;
+	size_t n;
+
+	/* Write the start of the array */
+	k = fprintf(fp,
+		    "#include <stddef.h>\n\n"
+		    "/* Aligned so that packs can be read in place */\n"
+		    "#ifdef _MSC_VER\n__declspec(align(64))\n#else\n"
+		    "__attribute__((aligned(64)))\n#endif\n"
+		    "const unsigned char %s_start[] = {\n",
+		    sym_base);
+	if (!k)
+		return 0;
 
-		/* Add to the total output written */
-		k += j;
-
-		/* Ensure we don't exceed 80 columns/line :) */
-		if (i < input_len - 1) {
-			if (j >= 70) {
-				j = 0;
-				errno = 0;
-				fprintf(fp, "\n\t");
-
-				/* Check for an error again */
-				if (errno) {
-					fprintf(stderr,
-						"Error: couldn't write to file: %s\n",
-						strerror(errno));
-					return errno;
-				}
-			} else {
-				errno = 0;
-				j += fprintf(fp, " ");
-
-				/* Check for an error again */
-				if (errno) {
-					fprintf(stderr,
-						"Error: couldn't write to file: %s\n",
-						strerror(errno));
-					return errno;
-				}
-			}
+	/*
+	 * Now write the bytes, a whole line at a time (12 per line keeps us
+	 *  under 80 columns :) )
+	 */
+	for (i = 0; i < input_len; i += 12) {
+		n = PURPL_MIN(input_len - i, 12);
+		line[0] = '\t';
+		for (j = 0; j < n; j++) {
+			memcpy(line + 1 + j * 6, "0x00, ", 6);
+			line[1 + j * 6 + 2] = hex[(input[i + j] >> 4) & 0xF];
+			line[1 + j * 6 + 3] = hex[input[i + j] & 0xF];
 		}
+
+		/* Replace the trailing space with a newline */
+		line[j * 6] = '\n';
+		if (!fwrite(line, j * 6 + 1, 1, fp))
+			return 0;
+		k += j * 6 + 1;
 	}
 
 	/* Terminate the array and write the other symbols */
-	i = fprintf(
+	n = fprintf(
 		fp,
 		"};\nconst unsigned char *%s_end =\n\t(unsigned char *)(%s_start +"
-		" sizeof(%s_start));\nconst unsigned long %s_size = sizeof(%s_start);\n",
+		" sizeof(%s_start));\nconst size_t %s_size = sizeof(%s_start);\n",
 		sym_base, sym_base, sym_base, sym_base, sym_base);
-	if (!i) {
-		fprintf(stderr, "Error: couldn't write to file: %s\n",
-			strerror(errno));
-		return errno;
-	}
+	if (!n)
+		return 0;
 
 	/* And now we have our total bytes outputted */
-	k += i;
+	return k + n;
+}
 
-	/* Close the file and free input */
-	fclose(fp);
-	free(input);
+size_t write_asm(FILE *fp, const char *input_name, const char *sym_base)
+{
+	char *full;
+	char *path;
+	size_t i;
+	size_t j;
+	size_t k;
 
-	/* And we're done */
-	printf("Done! Output file is %s, containing %zu bytes.\n", output_name,
-	       k);
-	if (!have_custom_output)
-		free(output_name);
-	return 0;
+	/* The assembler needs an absolute path */
+#ifdef _WIN32
+	full = _fullpath(NULL, input_name, 0);
+#else
+	full = realpath(input_name, NULL);
+#endif
+	if (!full)
+		return 0;
+
+	/* Use forward slashes on Windows, and escape it for the string */
+	path = PURPL_CALLOC(strlen(full) * 2 + 1, char);
+	if (!path) {
+		free(full);
+		return 0;
+	}
+	for (i = 0, j = 0; full[i]; i++) {
+#ifdef _WIN32
+		if (full[i] == '\\')
+			full[i] = '/';
+#endif
+		if (full[i] == '"' || full[i] == '\\')
+			path[j++] = '\\';
+		path[j++] = full[i];
+	}
+	free(full);
+
+	/*
+	 * This gets run through the C preprocessor, so the differences between
+	 *  object formats can be handled there
+	 */
+	k = fprintf(
+		fp,
+		"#if defined __APPLE__ || (defined _WIN32 && !defined _WIN64)\n"
+		"#define SYM(x) _##x\n"
+		"#else\n"
+		"#define SYM(x) x\n"
+		"#endif\n"
+		"\n"
+		"#if defined __APPLE__\n"
+		"\t.const\n"
+		"#elif defined _WIN32\n"
+		"\t.section .rdata,\"dr\"\n"
+		"#else\n"
+		"\t.section .rodata\n"
+		"#endif\n"
+		"\n"
+		"\t.global SYM(%s_start)\n"
+		"\t.global SYM(%s_end)\n"
+		"\t.global SYM(%s_size)\n"
+		"\n"
+		"\t.balign 64\n"
+		"SYM(%s_start):\n"
+		"\t.incbin \"%s\"\n"
+		"SYM(%s_end):\n"
+		"\n"
+		"\t.balign 8\n"
+		"SYM(%s_size):\n"
+		"#if defined __LP64__ || defined _WIN64\n"
+		"\t.quad SYM(%s_end) - SYM(%s_start)\n"
+		"#else\n"
+		"\t.long SYM(%s_end) - SYM(%s_start)\n"
+		"#endif\n"
+		"\n"
+		"#if defined __linux__ && defined __ELF__\n"
+		"\t.section .note.GNU-stack,\"\",%%progbits\n"
+		"#endif\n",
+		sym_base, sym_base, sym_base, sym_base, path, sym_base,
+		sym_base, sym_base, sym_base, sym_base, sym_base);
+
+	free(path);
+	return k;
 }
 
 void usage(const char *prog)
 {
-	printf("Usage: %s <binary file> <symbol basename> [<output>]\n",
-	       PURPL_GET_BASENAME(prog));
+	printf("Usage: %s [-s] <binary file> <symbol basename> [<output>]\n"
+	       "       %s -p [-z] <directory> <output pack>\n",
+	       PURPL_GET_BASENAME(prog), PURPL_GET_BASENAME(prog));
 	exit(EINVAL);
 }
+
+/* Read a file and add it to a pack, keeping track of its buffer */
+static int add_file(struct purpl_pack_writer *writer, char ***bufs,
+		    const char *path, const char *name, bool compress)
+{
+	FILE *fp;
+	char *data;
+	size_t len;
+	bool map = false;
+
+	/* Read the file */
+	fp = fopen(path, PURPL_READ);
+	if (!fp) {
+		fprintf(stderr, "Error: failed to open file %s: %s\n", path,
+			strerror(errno));
+		return errno;
+	}
+	data = purpl_read_file_fp(&len, NULL, &map, fp);
+	fclose(fp);
+	if (!data) {
+		fprintf(stderr, "Error: failed to read file %s: %s\n", path,
+			strerror(errno));
+		return errno;
+	}
+	stbds_arrput(*bufs, data);
+
+	/* Add it to the pack */
+	printf("Adding %s (%zu bytes)\n", name, len);
+	return purpl_pack_writer_add(writer, name, data, len, compress);
+}
+
+/* Add every file under a directory to a pack */
+static int add_dir(struct purpl_pack_writer *writer, char ***bufs,
+		   const char *root, const char *rel, bool compress)
+{
+	char *path;
+	char *name;
+	s64 path_len;
+	s64 name_len;
+	bool is_dir;
+	int err = 0;
+#ifdef _WIN32
+	WIN32_FIND_DATAA ent;
+	HANDLE find;
+	char *pattern;
+	s64 pattern_len;
+
+	/* Start listing the directory */
+	pattern = purpl_fmt_text(&pattern_len, "%s%s%s/*", root,
+				 (*rel) ? "/" : "", rel);
+	find = FindFirstFileA(pattern, &ent);
+	(pattern_len > 0) ? free(pattern) : (void)0;
+	if (find == INVALID_HANDLE_VALUE) {
+		fprintf(stderr, "Error: failed to open directory %s/%s\n", root,
+			rel);
+		return ENOENT;
+	}
+
+	do {
+		const char *ent_name = ent.cFileName;
+
+		is_dir = ent.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY;
+#else
+	DIR *dir;
+	struct dirent *ent;
+	struct stat st;
+
+	/* Start listing the directory */
+	path = purpl_fmt_text(&path_len, "%s%s%s", root, (*rel) ? "/" : "",
+			      rel);
+	dir = opendir(path);
+	(path_len > 0) ? free(path) : (void)0;
+	if (!dir) {
+		fprintf(stderr, "Error: failed to open directory %s/%s: %s\n",
+			root, rel, strerror(errno));
+		return errno;
+	}
+
+	while ((ent = readdir(dir))) {
+		const char *ent_name = ent->d_name;
+#endif
+		/* Skip . and .. */
+		if (strcmp(ent_name, ".") == 0 || strcmp(ent_name, "..") == 0)
+			continue;
+
+		/* Build the path on disk and the name in the pack */
+		name = purpl_fmt_text(&name_len, "%s%s%s", rel,
+				      (*rel) ? "/" : "", ent_name);
+		path = purpl_fmt_text(&path_len, "%s/%s", root, name);
+#ifndef _WIN32
+		is_dir = stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+#endif
+
+		/* Recurse into directories, add everything else */
+		if (is_dir)
+			err = add_dir(writer, bufs, root, name, compress);
+		else
+			err = add_file(writer, bufs, path, name, compress);
+		(name_len > 0) ? free(name) : (void)0;
+		(path_len > 0) ? free(path) : (void)0;
+		if (err)
+			break;
+#ifdef _WIN32
+	} while (FindNextFileA(find, &ent));
+	FindClose(find);
+#else
+	}
+	closedir(dir);
+#endif
+
+	return err;
+}
+
+int make_pack(const char *dir, const char *output_name, bool compress)
+{
+	struct purpl_pack_writer *writer;
+	char **bufs = NULL;
+	FILE *fp;
+	size_t size;
+	size_t i;
+	int err;
+
+	/* Create a writer */
+	writer = purpl_create_pack_writer();
+	if (!writer) {
+		fprintf(stderr, "Error: failed to create pack writer: %s\n",
+			strerror(errno));
+		return errno;
+	}
+
+	/* Add everything in the directory */
+	printf("Packing directory %s%s\n", dir,
+	       compress ? " (compressed)" : "");
+	err = add_dir(writer, &bufs, dir, "", compress);
+	if (err)
+		return err;
+
+	/* Open the output file */
+	fp = fopen(output_name, "wb");
+	if (!fp) {
+		fprintf(stderr, "Error: failed to truncate file: %s\n",
+			strerror(errno));
+		return errno;
+	}
+
+	/* Write the pack */
+	printf("Writing pack to %s...\n", output_name);
+	size = purpl_write_pack(writer, fp);
+	fclose(fp);
+	if (!size) {
+		fprintf(stderr, "Error: couldn't write to file: %s\n",
+			strerror(errno));
+		return errno;
+	}
+
+	/* Free everything */
+	purpl_free_pack_writer(writer);
+	for (i = 0; i < stbds_arrlenu(bufs); i++)
+		free(bufs[i]);
+	stbds_arrfree(bufs);
+
+	printf("Done! Output file is %s, containing %zu bytes.\n", output_name,
+	       size);
+	return 0;
+}